@@ -431,7 +431,23 @@ static inline block_t *block_ChainGather( block_t *p_list )
 VLC_API block_fifo_t *block_FifoNew(void) VLC_USED VLC_MALLOC;
 
 /**
- * Destroys a FIFO created by block_FifoNew().
+ * Creates a single-producer single-consumer FIFO queue of blocks.
+ *
+ * This is a variant of block_FifoNew() for queues with exactly one thread
+ * queueing blocks and one thread dequeueing them (at any given time).
+ * block_FifoPut() and block_FifoGet() do not take the FIFO lock, except to
+ * wake up a consumer waiting for an empty queue; vlc_fifo_GetCount() and
+ * vlc_fifo_GetBytes() can be used without the lock.
+ *
+ * The vlc_fifo_*() functions keep working as documented, and can be used
+ * to serialize several threads on either side of the queue.
+ *
+ * @return the FIFO or NULL on memory error
+ */
+VLC_API block_fifo_t *block_FifoNewSPSC(void) VLC_USED VLC_MALLOC;
+
+/**
+ * Destroys a FIFO created by block_FifoNew() or block_FifoNewSPSC().
  *
  * @note Any queued blocks are also destroyed.
  * @warning No other threads may be using the FIFO when this function is
@@ -177,6 +177,13 @@ enum demux_query_e
      * arg1=double *quality, arg2=double *strength */
     DEMUX_GET_SIGNAL = 0x107,
 
+    /** Retrieves the progress of an index being built while playing,
+     * between 0.0 and 1.0.
+     * Can fail, if no index is being built.
+     *
+     * arg1=double * */
+    DEMUX_GET_INDEX_PROGRESS = 0x108,
+
     /** Sets the paused or playing/resumed state.
      *
      * Streams are initially in playing state. The control always specifies a
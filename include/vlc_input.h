@@ -255,6 +255,7 @@ struct input_thread_t
  *                   variable value being the one currently selected, -1 if no teletext)
  *  - "signal-quality"
  *  - "signal-strength"
+ *  - "index-progress" (of an index built while playing [0 .. 1], -1 if none)
  *  - "program-scrambled" (if the current program is scrambled)
  *  - "cache" (level of data cached [0 .. 1])
  *
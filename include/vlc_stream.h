@@ -89,7 +89,8 @@ struct stream_t
      * (*eof is always false when invoking pf_block(); pf_block() should set
      *  *eof to true if it detects the end of the stream)
      *
-     * \return a data block,
+     * \return a data block or a chain of data blocks (linked with
+     * \ref block_t.p_next),
      * NULL if no data available yet, on error and at end-of-stream
      */
     block_t    *(*pf_block)(stream_t *, bool *eof);
@@ -35,6 +35,7 @@ struct vlc_http_conn_cbs
     struct vlc_http_stream *(*stream_open)(struct vlc_http_conn *,
                                            const struct vlc_http_msg *);
     void (*release)(struct vlc_http_conn *);
+    bool (*busy)(struct vlc_http_conn *);
 };
 
 struct vlc_http_conn
@@ -54,6 +55,12 @@ static inline void vlc_http_conn_release(struct vlc_http_conn *conn)
     conn->cbs->release(conn);
 }
 
+/** Tells whether streams are open on a connection */
+static inline bool vlc_http_conn_busy(struct vlc_http_conn *conn)
+{
+    return conn->cbs->busy(conn);
+}
+
 void vlc_http_err(void *, const char *msg, ...) VLC_FORMAT(2, 3);
 void vlc_http_dbg(void *, const char *msg, ...) VLC_FORMAT(2, 3);
 
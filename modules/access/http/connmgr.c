@@ -92,90 +92,348 @@ static char *vlc_http_proxy_find(const char *hostname, unsigned port,
 }
 
 
+/** Maximum number of connections kept to a given server */
+#define VLC_HTTP_MGR_MAX_PER_HOST 4
+/** Delay after which an unused connection is closed */
+#define VLC_HTTP_MGR_IDLE_TIMEOUT (30 * CLOCK_FREQ)
+
+struct vlc_http_mgr_conn
+{
+    struct vlc_http_conn *conn;
+    char *host;
+    char *proxy;
+    unsigned port;
+    bool secure;
+    bool multiplex; /* HTTP/2 */
+    bool failed; /* released once the pending requests are done */
+    unsigned pending; /* requests waiting for their response header */
+    mtime_t last_use;
+};
+
+/**
+ * Connections shared by all the managers of a LibVLC instance.
+ *
+ * The pool lock is not held while waiting for a response, or while
+ * establishing a new connection, so that a slow server does not hold
+ * requests to other servers back.
+ */
+struct vlc_http_pool
+{
+    struct vlc_http_pool *next;
+    libvlc_int_t *libvlc;
+    unsigned refs;
+    vlc_mutex_t lock;
+    vlc_tls_creds_t *creds;
+    struct vlc_http_mgr_conn *conns;
+    size_t conns_count;
+};
+
 struct vlc_http_mgr
 {
     vlc_object_t *obj;
-    vlc_tls_creds_t *creds;
     struct vlc_http_cookie_jar_t *jar;
-    struct vlc_http_conn *conn;
+    struct vlc_http_pool *pool;
+    unsigned hits;
+    unsigned misses;
 };
 
-static struct vlc_http_conn *vlc_http_mgr_find(struct vlc_http_mgr *mgr,
-                                               const char *host, unsigned port)
+static vlc_mutex_t vlc_http_pools_lock = VLC_STATIC_MUTEX;
+static struct vlc_http_pool *vlc_http_pools = NULL;
+
+/** Gets the LibVLC instance object, which outlives the pooled connections */
+static vlc_object_t *vlc_http_pool_obj(const struct vlc_http_pool *pool)
 {
-    (void) host; (void) port;
-    return mgr->conn;
+    return VLC_OBJECT(pool->libvlc);
 }
 
-static void vlc_http_mgr_release(struct vlc_http_mgr *mgr,
-                                 struct vlc_http_conn *conn)
+static struct vlc_http_pool *vlc_http_pool_hold(libvlc_int_t *libvlc)
 {
-    assert(mgr->conn == conn);
-    mgr->conn = NULL;
+    struct vlc_http_pool *pool;
+
+    vlc_mutex_lock(&vlc_http_pools_lock);
+    for (pool = vlc_http_pools; pool != NULL; pool = pool->next)
+        if (pool->libvlc == libvlc)
+            break;
 
-    vlc_http_conn_release(conn);
+    if (pool == NULL)
+    {
+        pool = malloc(sizeof (*pool));
+        if (likely(pool != NULL))
+        {
+            pool->libvlc = libvlc;
+            pool->refs = 0;
+            vlc_mutex_init(&pool->lock);
+            pool->creds = NULL;
+            pool->conns = NULL;
+            pool->conns_count = 0;
+            pool->next = vlc_http_pools;
+            vlc_http_pools = pool;
+        }
+    }
+
+    if (likely(pool != NULL))
+        pool->refs++;
+    vlc_mutex_unlock(&vlc_http_pools_lock);
+    return pool;
 }
 
-static
-struct vlc_http_msg *vlc_http_mgr_reuse(struct vlc_http_mgr *mgr,
-                                        const char *host, unsigned port,
-                                        const struct vlc_http_msg *req)
+static void vlc_http_mgr_release(struct vlc_http_pool *pool, size_t i);
+
+static void vlc_http_pool_release(struct vlc_http_pool *pool)
 {
-    struct vlc_http_conn *conn = vlc_http_mgr_find(mgr, host, port);
-    if (conn == NULL)
-        return NULL;
+    vlc_mutex_lock(&vlc_http_pools_lock);
+    if (--pool->refs > 0)
+    {
+        vlc_mutex_unlock(&vlc_http_pools_lock);
+        return;
+    }
+
+    for (struct vlc_http_pool **pp = &vlc_http_pools; *pp != NULL;
+         pp = &(*pp)->next)
+        if (*pp == pool)
+        {
+            *pp = pool->next;
+            break;
+        }
+    vlc_mutex_unlock(&vlc_http_pools_lock);
+
+    while (pool->conns_count > 0)
+        vlc_http_mgr_release(pool, pool->conns_count - 1);
+    free(pool->conns);
+    if (pool->creds != NULL)
+        vlc_tls_Delete(pool->creds);
+    vlc_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+static bool vlc_http_mgr_match(const struct vlc_http_mgr_conn *entry,
+                               bool secure, const char *host, unsigned port,
+                               const char *proxy)
+{
+    if (entry->failed || entry->secure != secure || entry->port != port
+     || strcasecmp(entry->host, host))
+        return false;
+    if (entry->proxy == NULL || proxy == NULL)
+        return entry->proxy == proxy;
+    return !strcmp(entry->proxy, proxy);
+}
+
+static void vlc_http_mgr_release(struct vlc_http_pool *pool, size_t i)
+{
+    struct vlc_http_mgr_conn *entry = &pool->conns[i];
 
+    assert(entry->pending == 0);
+    /* Any stream still open on the connection remains usable */
+    vlc_http_conn_release(entry->conn);
+    free(entry->proxy);
+    free(entry->host);
+
+    pool->conns_count--;
+    memmove(entry, entry + 1, (pool->conns_count - i) * sizeof (*entry));
+}
+
+static size_t vlc_http_mgr_find(const struct vlc_http_pool *pool,
+                                const struct vlc_http_conn *conn)
+{
+    size_t i;
+
+    for (i = 0; i < pool->conns_count; i++)
+        if (pool->conns[i].conn == conn)
+            break;
+    assert(i < pool->conns_count); /* kept while requests are pending */
+    return i;
+}
+
+static void vlc_http_mgr_expire(struct vlc_http_pool *pool)
+{
+    mtime_t now = mdate();
+
+    for (size_t i = 0; i < pool->conns_count;)
+    {
+        struct vlc_http_mgr_conn *entry = &pool->conns[i];
+
+        if (entry->pending > 0 || vlc_http_conn_busy(entry->conn))
+            entry->last_use = now; /* idle time starts after the streams */
+        else if (now - entry->last_use > VLC_HTTP_MGR_IDLE_TIMEOUT)
+        {
+            vlc_http_mgr_release(pool, i);
+            continue;
+        }
+        i++;
+    }
+}
+
+static int vlc_http_mgr_add(struct vlc_http_pool *pool,
+                            struct vlc_http_conn *conn, bool multiplex,
+                            bool secure, const char *host, unsigned port,
+                            const char *proxy)
+{
+    size_t count = 0, lru = SIZE_MAX;
+
+    /* Make room by closing the least recently used connection */
+    for (size_t i = 0; i < pool->conns_count; i++)
+    {
+        const struct vlc_http_mgr_conn *entry = &pool->conns[i];
+
+        if (!vlc_http_mgr_match(entry, secure, host, port, proxy))
+            continue;
+        count++;
+        if (entry->pending == 0
+         && (lru == SIZE_MAX || entry->last_use < pool->conns[lru].last_use))
+            lru = i;
+    }
+
+    if (count >= VLC_HTTP_MGR_MAX_PER_HOST && lru != SIZE_MAX)
+        vlc_http_mgr_release(pool, lru);
+
+    struct vlc_http_mgr_conn *tab = realloc(pool->conns,
+                                    (pool->conns_count + 1) * sizeof (*tab));
+    if (unlikely(tab == NULL))
+        return -1;
+    pool->conns = tab;
+
+    struct vlc_http_mgr_conn *entry = &tab[pool->conns_count];
+
+    entry->host = strdup(host);
+    entry->proxy = (proxy != NULL) ? strdup(proxy) : NULL;
+    if (unlikely(entry->host == NULL || (proxy != NULL && entry->proxy == NULL)))
+    {
+        free(entry->proxy);
+        free(entry->host);
+        return -1;
+    }
+
+    entry->conn = conn;
+    entry->port = port;
+    entry->secure = secure;
+    entry->multiplex = multiplex;
+    entry->failed = false;
+    entry->pending = 0;
+    entry->last_use = mdate();
+    pool->conns_count++;
+    return 0;
+}
+
+/**
+ * Sends a request on a pooled connection and waits for the response header.
+ * The pool lock is held on entry and on return, but not while waiting.
+ */
+static struct vlc_http_msg *vlc_http_mgr_open(struct vlc_http_pool *pool,
+                                              size_t i,
+                                              const struct vlc_http_msg *req)
+{
+    struct vlc_http_mgr_conn *entry = &pool->conns[i];
+    struct vlc_http_conn *conn = entry->conn;
     struct vlc_http_stream *stream = vlc_http_stream_open(conn, req);
+    struct vlc_http_msg *m = NULL;
+
     if (stream != NULL)
     {
-        struct vlc_http_msg *m = vlc_http_msg_get_initial(stream);
+        entry->pending++;
+        vlc_mutex_unlock(&pool->lock);
+        m = vlc_http_msg_get_initial(stream);
+        vlc_mutex_lock(&pool->lock);
+
+        i = vlc_http_mgr_find(pool, conn);
+        entry = &pool->conns[i];
+        entry->pending--;
+
         if (m != NULL)
-            return m;
+            entry->last_use = mdate();
+        else
+            entry->failed = true;
 
         /* NOTE: If the request were not idempotent, we would not know if it
          * was processed by the other end. Thus POST is not used/supported so
          * far, and CONNECT is treated as if it were idempotent (which works
          * fine here). */
     }
-    /* Get rid of closing or reset connection */
-    vlc_http_mgr_release(mgr, conn);
-    return NULL;
+    else
+        entry->failed = true;
+
+    /* Get rid of closing or reset connection, once no longer waited on */
+    if (entry->failed && entry->pending == 0)
+        vlc_http_mgr_release(pool, i);
+    return m;
+}
+
+static
+struct vlc_http_msg *vlc_http_mgr_reuse(struct vlc_http_mgr *mgr, bool secure,
+                                        const char *host, unsigned port,
+                                        const char *proxy,
+                                        const struct vlc_http_msg *req)
+{
+    struct vlc_http_pool *pool = mgr->pool;
+    struct vlc_http_msg *resp = NULL;
+
+    vlc_mutex_lock(&pool->lock);
+    vlc_http_mgr_expire(pool);
+
+    /* Try the most recently added connections first */
+    for (size_t i = pool->conns_count; i > 0 && resp == NULL; i--)
+    {
+        const struct vlc_http_mgr_conn *entry = &pool->conns[i - 1];
+
+        if (!vlc_http_mgr_match(entry, secure, host, port, proxy))
+            continue;
+        /* HTTP/1 carries only one request at a time */
+        if (!entry->multiplex && vlc_http_conn_busy(entry->conn))
+            continue;
+
+        resp = vlc_http_mgr_open(pool, i - 1, req);
+        if (resp == NULL) /* the table may have changed in the meantime */
+            i = pool->conns_count + 1;
+    }
+    vlc_mutex_unlock(&pool->lock);
+
+    if (resp != NULL)
+        mgr->hits++;
+    else
+        mgr->misses++;
+    return resp;
 }
 
 static struct vlc_http_msg *vlc_https_request(struct vlc_http_mgr *mgr,
                                               const char *host, unsigned port,
                                               const struct vlc_http_msg *req)
 {
+    struct vlc_http_pool *pool = mgr->pool;
+    vlc_object_t *obj = vlc_http_pool_obj(pool);
+    vlc_tls_creds_t *creds;
     vlc_tls_t *tls;
     bool http2 = true;
 
-    if (mgr->creds == NULL && mgr->conn != NULL)
-        return NULL; /* switch from HTTP to HTTPS not implemented */
+    vlc_mutex_lock(&pool->lock);
+    if (pool->creds == NULL)
+        /* First TLS connection: load x509 credentials */
+        pool->creds = vlc_tls_ClientCreate(obj);
+    creds = pool->creds;
+    vlc_mutex_unlock(&pool->lock);
 
-    if (mgr->creds == NULL)
-    {   /* First TLS connection: load x509 credentials */
-        mgr->creds = vlc_tls_ClientCreate(mgr->obj);
-        if (mgr->creds == NULL)
-            return NULL;
-    }
+    if (creds == NULL)
+        return NULL;
+
+    char *proxy = vlc_http_proxy_find(host, port, true);
 
     /* TODO? non-idempotent request support */
-    struct vlc_http_msg *resp = vlc_http_mgr_reuse(mgr, host, port, req);
+    struct vlc_http_msg *resp = vlc_http_mgr_reuse(mgr, true, host, port,
+                                                   proxy, req);
     if (resp != NULL)
-        return resp; /* existing connection reused */
-
-    char *proxy = vlc_http_proxy_find(host, port, true);
-    if (proxy != NULL)
     {
-        tls = vlc_https_connect_proxy(mgr->creds, mgr->creds,
-                                      host, port, &http2, proxy);
         free(proxy);
+        return resp; /* existing connection reused */
     }
+
+    if (proxy != NULL)
+        tls = vlc_https_connect_proxy(creds, creds, host, port, &http2, proxy);
     else
-        tls = vlc_https_connect(mgr->creds, host, port, &http2);
+        tls = vlc_https_connect(creds, host, port, &http2);
 
     if (tls == NULL)
+    {
+        free(proxy);
         return NULL;
+    }
 
     struct vlc_http_conn *conn;
 
@@ -187,45 +445,59 @@ static struct vlc_http_msg *vlc_https_request(struct vlc_http_mgr *mgr,
      * NOTE: We do not enforce TLS version 1.2 for HTTP 2.0 explicitly.
      */
     if (http2)
-        conn = vlc_h2_conn_create(mgr->obj, tls);
+        conn = vlc_h2_conn_create(obj, tls);
     else
-        conn = vlc_h1_conn_create(mgr->obj, tls, false);
+        conn = vlc_h1_conn_create(obj, tls, false);
 
     if (unlikely(conn == NULL))
     {
+        free(proxy);
         vlc_tls_Close(tls);
         return NULL;
     }
 
-    mgr->conn = conn;
+    vlc_mutex_lock(&pool->lock);
+    int val = vlc_http_mgr_add(pool, conn, http2, true, host, port, proxy);
+    free(proxy);
+    if (unlikely(val))
+    {
+        vlc_mutex_unlock(&pool->lock);
+        vlc_http_conn_release(conn);
+        return NULL;
+    }
 
-    return vlc_http_mgr_reuse(mgr, host, port, req);
+    resp = vlc_http_mgr_open(pool, pool->conns_count - 1, req);
+    vlc_mutex_unlock(&pool->lock);
+    return resp;
 }
 
 static struct vlc_http_msg *vlc_http_request(struct vlc_http_mgr *mgr,
                                              const char *host, unsigned port,
                                              const struct vlc_http_msg *req)
 {
-    if (mgr->creds != NULL && mgr->conn != NULL)
-        return NULL; /* switch from HTTPS to HTTP not implemented */
+    struct vlc_http_pool *pool = mgr->pool;
+    vlc_object_t *obj = vlc_http_pool_obj(pool);
+    char *proxy = vlc_http_proxy_find(host, port, false);
 
-    struct vlc_http_msg *resp = vlc_http_mgr_reuse(mgr, host, port, req);
+    struct vlc_http_msg *resp = vlc_http_mgr_reuse(mgr, false, host, port,
+                                                   proxy, req);
     if (resp != NULL)
+    {
+        free(proxy);
         return resp;
+    }
 
     struct vlc_http_conn *conn;
     struct vlc_http_stream *stream;
 
-    char *proxy = vlc_http_proxy_find(host, port, false);
     if (proxy != NULL)
     {
         vlc_url_t url;
 
         vlc_UrlParse(&url, proxy);
-        free(proxy);
 
         if (url.psz_host != NULL)
-            stream = vlc_h1_request(mgr->obj, url.psz_host,
+            stream = vlc_h1_request(obj, url.psz_host,
                                     url.i_port ? url.i_port : 80, true, req,
                                     true, &conn);
         else
@@ -234,20 +506,30 @@ static struct vlc_http_msg *vlc_http_request(struct vlc_http_mgr *mgr,
         vlc_UrlClean(&url);
     }
     else
-        stream = vlc_h1_request(mgr->obj, host, port ? port : 80, false, req,
+        stream = vlc_h1_request(obj, host, port ? port : 80, false, req,
                                 true, &conn);
 
     if (stream == NULL)
+    {
+        free(proxy);
         return NULL;
+    }
 
     resp = vlc_http_msg_get_initial(stream);
     if (resp == NULL)
     {
+        free(proxy);
         vlc_http_conn_release(conn);
         return NULL;
     }
 
-    mgr->conn = conn;
+    /* The response remains valid even if the connection cannot be kept */
+    vlc_mutex_lock(&pool->lock);
+    int val = vlc_http_mgr_add(pool, conn, false, false, host, port, proxy);
+    vlc_mutex_unlock(&pool->lock);
+    if (val)
+        vlc_http_conn_release(conn);
+    free(proxy);
     return resp;
 }
 
@@ -263,6 +545,13 @@ struct vlc_http_cookie_jar_t *vlc_http_mgr_get_jar(struct vlc_http_mgr *mgr)
     return mgr->jar;
 }
 
+void vlc_http_mgr_get_stats(struct vlc_http_mgr *mgr, unsigned *restrict hits,
+                            unsigned *restrict misses)
+{
+    *hits = mgr->hits;
+    *misses = mgr->misses;
+}
+
 struct vlc_http_mgr *vlc_http_mgr_create(vlc_object_t *obj,
                                          struct vlc_http_cookie_jar_t *jar)
 {
@@ -270,18 +559,25 @@ struct vlc_http_mgr *vlc_http_mgr_create(vlc_object_t *obj,
     if (unlikely(mgr == NULL))
         return NULL;
 
+    mgr->pool = vlc_http_pool_hold(obj->obj.libvlc);
+    if (unlikely(mgr->pool == NULL))
+    {
+        free(mgr);
+        return NULL;
+    }
+
     mgr->obj = obj;
-    mgr->creds = NULL;
     mgr->jar = jar;
-    mgr->conn = NULL;
+    mgr->hits = 0;
+    mgr->misses = 0;
     return mgr;
 }
 
 void vlc_http_mgr_destroy(struct vlc_http_mgr *mgr)
 {
-    if (mgr->conn != NULL)
-        vlc_http_mgr_release(mgr, mgr->conn);
-    if (mgr->creds != NULL)
-        vlc_tls_Delete(mgr->creds);
+    vlc_http_dbg(mgr->obj, "connections reused %u time(s), created %u time(s)",
+                 mgr->hits, mgr->misses);
+
+    vlc_http_pool_release(mgr->pool);
     free(mgr);
 }
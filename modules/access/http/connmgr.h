@@ -39,6 +39,10 @@ struct vlc_http_cookie_jar_t;
  * establishing a new one. If succesful, the initial HTTP response header is
  * returned.
  *
+ * Connections are kept per scheme, server, port and proxy, up to a few per
+ * server, until they are unused for some time. HTTP/2 connections carry
+ * concurrent requests.
+ *
  * @param mgr HTTP connection manager
  * @param https whether to use HTTPS (true) or unencrypted HTTP (false)
  * @param host name of authoritative HTTP server to send the request to
@@ -53,6 +57,18 @@ struct vlc_http_msg *vlc_http_mgr_request(struct vlc_http_mgr *mgr, bool https,
 
 struct vlc_http_cookie_jar_t *vlc_http_mgr_get_jar(struct vlc_http_mgr *);
 
+/**
+ * Gets connection pool statistics
+ *
+ * @param mgr HTTP connection manager
+ * @param hits storage for the number of requests sent on an existing
+ *             connection [OUT]
+ * @param misses storage for the number of requests that needed a new
+ *               connection [OUT]
+ */
+void vlc_http_mgr_get_stats(struct vlc_http_mgr *mgr, unsigned *hits,
+                            unsigned *misses);
+
 /**
  * Creates an HTTP connection manager
  *
@@ -0,0 +1,427 @@
+/*****************************************************************************
+ * connmgr_test.c: HTTP connection manager tests
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#undef NDEBUG
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_tls.h>
+#include "conn.h"
+#include "connmgr.h"
+#include "message.h"
+#include "transport.h"
+#include "h2frame.h"
+
+/* Connections are emulated: each request gets an immediate response */
+struct test_conn
+{
+    struct vlc_http_conn conn;
+    char host[32];
+    bool multiplex;
+    bool released;
+    unsigned streams;
+};
+
+struct test_stream
+{
+    struct vlc_http_stream stream;
+    struct test_conn *conn;
+};
+
+#define MAX_CONNS 32
+
+static struct test_conn conns[MAX_CONNS];
+static unsigned conns_count;
+static bool secure_h2;
+static mtime_t now = VLC_TS_0;
+
+static struct vlc_http_msg *stream_read_headers(struct vlc_http_stream *s)
+{
+    struct vlc_http_msg *m = vlc_http_resp_create(200);
+    assert(m != NULL);
+    vlc_http_msg_attach(m, s);
+    return m;
+}
+
+static block_t *stream_read(struct vlc_http_stream *s)
+{
+    (void) s;
+    return NULL;
+}
+
+static void stream_close(struct vlc_http_stream *s, bool abort)
+{
+    struct test_stream *ts = container_of(s, struct test_stream, stream);
+
+    assert(!abort);
+    assert(ts->conn->streams > 0);
+    ts->conn->streams--;
+    free(ts);
+}
+
+static const struct vlc_http_stream_cbs stream_callbacks =
+{
+    stream_read_headers,
+    stream_read,
+    stream_close,
+};
+
+static struct vlc_http_stream *conn_stream_open(struct vlc_http_conn *c,
+                                                const struct vlc_http_msg *req)
+{
+    struct test_conn *conn = container_of(c, struct test_conn, conn);
+
+    (void) req;
+    assert(!conn->released);
+    if (!conn->multiplex && conn->streams > 0)
+        return NULL;
+
+    struct test_stream *ts = malloc(sizeof (*ts));
+    assert(ts != NULL);
+    ts->stream.cbs = &stream_callbacks;
+    ts->conn = conn;
+    conn->streams++;
+    return &ts->stream;
+}
+
+static void conn_release(struct vlc_http_conn *c)
+{
+    struct test_conn *conn = container_of(c, struct test_conn, conn);
+
+    assert(!conn->released);
+    conn->released = true;
+}
+
+static bool conn_busy(struct vlc_http_conn *c)
+{
+    struct test_conn *conn = container_of(c, struct test_conn, conn);
+
+    return conn->streams > 0;
+}
+
+static const struct vlc_http_conn_cbs conn_callbacks =
+{
+    conn_stream_open,
+    conn_release,
+    conn_busy,
+};
+
+static struct vlc_http_conn *conn_create(const char *host, bool multiplex)
+{
+    assert(conns_count < MAX_CONNS);
+
+    struct test_conn *conn = &conns[conns_count++];
+
+    conn->conn.cbs = &conn_callbacks;
+    conn->conn.tls = NULL;
+    snprintf(conn->host, sizeof (conn->host), "%s", host);
+    conn->multiplex = multiplex;
+    conn->released = false;
+    conn->streams = 0;
+    return &conn->conn;
+}
+
+/* Overrides of the transport and the clock */
+mtime_t mdate(void)
+{
+    return now;
+}
+
+static vlc_tls_creds_t *const creds = (void *)&creds;
+static char tls_host[32];
+
+vlc_tls_creds_t *vlc_tls_ClientCreate(vlc_object_t *obj)
+{
+    (void) obj;
+    return creds;
+}
+
+void vlc_tls_Delete(vlc_tls_creds_t *crd)
+{
+    assert(crd == creds);
+}
+
+vlc_tls_t *vlc_tls_SocketOpenTLS(vlc_tls_creds_t *crd, const char *name,
+                                 unsigned port, const char *service,
+                                 const char *const *alpn, char **alp)
+{
+    assert(crd == creds);
+    (void) port; (void) service; (void) alpn;
+    snprintf(tls_host, sizeof (tls_host), "%s", name);
+    *alp = secure_h2 ? strdup("h2") : NULL;
+    return (vlc_tls_t *)tls_host;
+}
+
+vlc_tls_t *vlc_https_connect_proxy(void *ctx, vlc_tls_creds_t *crd,
+                                   const char *name, unsigned port,
+                                   bool *restrict two, const char *proxy)
+{
+    (void) ctx; (void) crd; (void) name; (void) port; (void) two;
+    (void) proxy;
+    assert(!"proxy");
+    return NULL;
+}
+
+struct vlc_http_conn *vlc_h1_conn_create(void *ctx, vlc_tls_t *tls,
+                                         bool proxy)
+{
+    (void) ctx; (void) proxy;
+    assert(tls == (vlc_tls_t *)tls_host);
+    return conn_create(tls_host, false);
+}
+
+struct vlc_http_conn *vlc_h2_conn_create(void *ctx, vlc_tls_t *tls)
+{
+    (void) ctx;
+    assert(tls == (vlc_tls_t *)tls_host);
+    return conn_create(tls_host, true);
+}
+
+struct vlc_http_stream *vlc_h1_request(void *ctx, const char *hostname,
+                                       unsigned port, bool proxy,
+                                       const struct vlc_http_msg *req,
+                                       bool idempotent,
+                                       struct vlc_http_conn **restrict connp)
+{
+    (void) ctx; (void) port; (void) proxy; (void) idempotent;
+
+    struct vlc_http_conn *conn = conn_create(hostname, false);
+    struct vlc_http_stream *s = vlc_http_stream_open(conn, req);
+    assert(s != NULL);
+    *connp = conn;
+    return s;
+}
+
+struct vlc_h2_frame *
+vlc_h2_frame_headers(uint_fast32_t id, uint_fast32_t mtu, bool eos,
+                     unsigned count, const char *const tab[][2])
+{
+    (void) id; (void) mtu; (void) eos; (void) count; (void) tab;
+    assert(!"h2 frame");
+    return NULL;
+}
+
+/* Fake objects, quiet so that nothing is actually logged */
+static libvlc_int_t instances[2];
+static struct vlc_common_members objects[3];
+
+static vlc_object_t *object(unsigned i, unsigned instance)
+{
+    objects[i].flags = OBJECT_FLAGS_QUIET;
+    objects[i].libvlc = &instances[instance];
+    instances[instance].obj.flags = OBJECT_FLAGS_QUIET;
+    instances[instance].obj.libvlc = &instances[instance];
+    return (vlc_object_t *)&objects[i];
+}
+
+static struct vlc_http_msg *request(struct vlc_http_mgr *mgr, bool https,
+                                    const char *host, unsigned port)
+{
+    struct vlc_http_msg *req = vlc_http_req_create("GET",
+                                                   https ? "https" : "http",
+                                                   host, "/");
+    assert(req != NULL);
+
+    struct vlc_http_msg *resp = vlc_http_mgr_request(mgr, https, host, port,
+                                                     req);
+    vlc_http_msg_destroy(req);
+    assert(resp != NULL);
+    return resp;
+}
+
+static void request_done(struct vlc_http_mgr *mgr, bool https,
+                         const char *host, unsigned port)
+{
+    vlc_http_msg_destroy(request(mgr, https, host, port));
+}
+
+static void check_stats(struct vlc_http_mgr *mgr, unsigned hits,
+                        unsigned misses)
+{
+    unsigned h, m;
+
+    vlc_http_mgr_get_stats(mgr, &h, &m);
+    assert(h == hits);
+    assert(m == misses);
+}
+
+static void test_keying(struct vlc_http_mgr *mgr)
+{
+    request_done(mgr, false, "www.example.com", 0);
+    assert(conns_count == 1);
+    request_done(mgr, false, "www.example.com", 0);
+    request_done(mgr, false, "WWW.Example.COM", 0);
+    assert(conns_count == 1);
+    check_stats(mgr, 2, 1);
+
+    /* Other server, port or scheme */
+    request_done(mgr, false, "www.example.org", 0);
+    assert(conns_count == 2);
+    request_done(mgr, false, "www.example.com", 8080);
+    assert(conns_count == 3);
+    request_done(mgr, true, "www.example.com", 0);
+    assert(conns_count == 4);
+    assert(conns[3].conn.cbs == &conn_callbacks && !conns[3].multiplex);
+
+    request_done(mgr, false, "www.example.org", 0);
+    request_done(mgr, false, "www.example.com", 8080);
+    request_done(mgr, true, "www.example.com", 0);
+    assert(conns_count == 4);
+
+    for (unsigned i = 0; i < conns_count; i++)
+        assert(!conns[i].released);
+}
+
+static void test_busy(struct vlc_http_mgr *mgr)
+{
+    unsigned base = conns_count;
+
+    /* HTTP/1 connections carry one request at a time */
+    struct vlc_http_msg *a = request(mgr, false, "busy.example.com", 0);
+    struct vlc_http_msg *b = request(mgr, false, "busy.example.com", 0);
+    assert(conns_count == base + 2);
+    vlc_http_msg_destroy(a);
+    struct vlc_http_msg *c = request(mgr, false, "busy.example.com", 0);
+    assert(conns_count == base + 2);
+    assert(conns[base].streams == 1 && conns[base + 1].streams == 1);
+    vlc_http_msg_destroy(c);
+    vlc_http_msg_destroy(b);
+
+    /* HTTP/2 connections carry concurrent requests */
+    secure_h2 = true;
+    a = request(mgr, true, "h2.example.com", 0);
+    b = request(mgr, true, "h2.example.com", 0);
+    assert(conns_count == base + 3);
+    assert(conns[base + 2].multiplex && conns[base + 2].streams == 2);
+    vlc_http_msg_destroy(a);
+    vlc_http_msg_destroy(b);
+    assert(conns[base + 2].streams == 0);
+    secure_h2 = false;
+}
+
+static void test_limit(struct vlc_http_mgr *mgr)
+{
+    struct vlc_http_msg *resps[5];
+    unsigned base = conns_count;
+
+    for (unsigned i = 0; i < 5; i++)
+    {
+        now += CLOCK_FREQ;
+        resps[i] = request(mgr, false, "limit.example.com", 0);
+    }
+    assert(conns_count == base + 5);
+
+    /* The least recently used connection was dropped, but its response
+     * remains usable */
+    assert(conns[base].released);
+    for (unsigned i = 1; i < 5; i++)
+        assert(!conns[base + i].released);
+
+    for (unsigned i = 0; i < 5; i++)
+        vlc_http_msg_destroy(resps[i]);
+
+    request_done(mgr, false, "limit.example.com", 0);
+    assert(conns_count == base + 5);
+}
+
+static void test_expiry(struct vlc_http_mgr *mgr)
+{
+    unsigned base = conns_count;
+
+    struct vlc_http_msg *busy = request(mgr, false, "expiry.example.com", 0);
+    assert(conns_count == base + 1);
+
+    /* Idle connections are closed after a while, busy ones are not */
+    now += 31 * CLOCK_FREQ;
+    request_done(mgr, false, "other.example.com", 0);
+    for (unsigned i = 0; i < base; i++)
+        assert(conns[i].released);
+    assert(!conns[base].released);
+    assert(!conns[base + 1].released);
+
+    vlc_http_msg_destroy(busy);
+
+    /* The idle time starts once the streams are closed */
+    now += 20 * CLOCK_FREQ;
+    request_done(mgr, false, "expiry.example.com", 0);
+    assert(conns_count == base + 2);
+    assert(!conns[base].released);
+}
+
+static void test_sharing(void)
+{
+    unsigned base = conns_count;
+    struct vlc_http_mgr *a = vlc_http_mgr_create(object(0, 0), NULL);
+    struct vlc_http_mgr *b = vlc_http_mgr_create(object(1, 0), NULL);
+    struct vlc_http_mgr *c = vlc_http_mgr_create(object(2, 1), NULL);
+    assert(a != NULL && b != NULL && c != NULL);
+
+    /* Managers of one instance share the connections */
+    request_done(a, false, "shared.example.com", 0);
+    request_done(b, false, "shared.example.com", 0);
+    assert(conns_count == base + 1);
+    check_stats(b, 1, 0);
+
+    /* but not with the other instances */
+    request_done(c, false, "shared.example.com", 0);
+    assert(conns_count == base + 2);
+    vlc_http_mgr_destroy(c);
+    assert(conns[base + 1].released);
+
+    /* The connections outlive the manager which created them */
+    vlc_http_mgr_destroy(a);
+    assert(!conns[base].released);
+    request_done(b, false, "shared.example.com", 0);
+    assert(conns_count == base + 2);
+    vlc_http_mgr_destroy(b);
+    assert(conns[base].released);
+}
+
+int main(void)
+{
+    unsetenv("http_proxy");
+    unsetenv("https_proxy");
+
+    struct vlc_http_mgr *mgr = vlc_http_mgr_create(object(0, 0), NULL);
+    assert(mgr != NULL);
+
+    test_keying(mgr);
+    test_busy(mgr);
+    test_limit(mgr);
+    test_expiry(mgr);
+
+    vlc_http_mgr_destroy(mgr);
+    for (unsigned i = 0; i < conns_count; i++)
+    {
+        assert(conns[i].released);
+        assert(conns[i].streams == 0);
+    }
+
+    test_sharing();
+    return 0;
+}
@@ -30,6 +30,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <vlc_common.h>
+#include <vlc_atomic.h>
 #include <vlc_tls.h>
 #include <vlc_block.h>
 
@@ -113,8 +114,8 @@ struct vlc_h1_conn
     struct vlc_http_stream stream;
     uintmax_t content_length;
     bool connection_close;
-    bool active;
-    bool released;
+    atomic_bool active;
+    atomic_uint refs; /**< Owner, and open stream if any */
     bool proxy;
     void *opaque;
 };
@@ -123,6 +124,12 @@ struct vlc_h1_conn
 
 static void vlc_h1_conn_destroy(struct vlc_h1_conn *conn);
 
+static void vlc_h1_conn_unref(struct vlc_h1_conn *conn)
+{
+    if (atomic_fetch_sub(&conn->refs, 1) == 1)
+        vlc_h1_conn_destroy(conn);
+}
+
 static void *vlc_h1_stream_fatal(struct vlc_h1_conn *conn)
 {
     if (conn->conn.tls != NULL)
@@ -146,22 +153,33 @@ static struct vlc_http_stream *vlc_h1_stream_open(struct vlc_http_conn *c,
     struct vlc_h1_conn *conn = container_of(c, struct vlc_h1_conn, conn);
     size_t len;
     ssize_t val;
+    bool idle = false;
 
-    if (conn->active || conn->conn.tls == NULL)
+    /* The owner may be checking or releasing the connection concurrently */
+    if (!atomic_compare_exchange_strong(&conn->active, &idle, true))
         return NULL;
 
-    char *payload = vlc_http_msg_format(req, &len, conn->proxy);
+    char *payload = NULL;
+    if (conn->conn.tls != NULL)
+        payload = vlc_http_msg_format(req, &len, conn->proxy);
     if (unlikely(payload == NULL))
+    {
+        atomic_store(&conn->active, false);
         return NULL;
+    }
 
     vlc_http_dbg(CO(conn), "outgoing request:\n%.*s", (int)len, payload);
     val = vlc_tls_Write(conn->conn.tls, payload, len);
     free(payload);
 
     if (val < (ssize_t)len)
-        return vlc_h1_stream_fatal(conn);
+    {
+        vlc_h1_stream_fatal(conn);
+        atomic_store(&conn->active, false);
+        return NULL;
+    }
 
-    conn->active = true;
+    atomic_fetch_add(&conn->refs, 1);
     conn->content_length = 0;
     conn->connection_close = false;
     return &conn->stream;
@@ -277,10 +295,8 @@ static void vlc_h1_stream_close(struct vlc_http_stream *stream, bool abort)
     if (abort)
         vlc_h1_stream_fatal(conn);
 
-    conn->active = false;
-
-    if (conn->released)
-        vlc_h1_conn_destroy(conn);
+    atomic_store(&conn->active, false);
+    vlc_h1_conn_unref(conn);
 }
 
 static const struct vlc_http_stream_cbs vlc_h1_stream_callbacks =
@@ -293,7 +309,7 @@ static const struct vlc_http_stream_cbs vlc_h1_stream_callbacks =
 static void vlc_h1_conn_destroy(struct vlc_h1_conn *conn)
 {
     assert(!conn->active);
-    assert(conn->released);
+    assert(atomic_load(&conn->refs) == 0);
 
     if (conn->conn.tls != NULL)
     {
@@ -307,17 +323,21 @@ static void vlc_h1_conn_release(struct vlc_http_conn *c)
 {
     struct vlc_h1_conn *conn = container_of(c, struct vlc_h1_conn, conn);
 
-    assert(!conn->released);
-    conn->released = true;
+    vlc_h1_conn_unref(conn);
+}
 
-    if (!conn->active)
-        vlc_h1_conn_destroy(conn);
+static bool vlc_h1_conn_busy(struct vlc_http_conn *c)
+{
+    struct vlc_h1_conn *conn = container_of(c, struct vlc_h1_conn, conn);
+
+    return atomic_load(&conn->active);
 }
 
 static const struct vlc_http_conn_cbs vlc_h1_conn_callbacks =
 {
     vlc_h1_stream_open,
     vlc_h1_conn_release,
+    vlc_h1_conn_busy,
 };
 
 struct vlc_http_conn *vlc_h1_conn_create(void *ctx, vlc_tls_t *tls, bool proxy)
@@ -329,8 +349,8 @@ struct vlc_http_conn *vlc_h1_conn_create(void *ctx, vlc_tls_t *tls, bool proxy)
     conn->conn.cbs = &vlc_h1_conn_callbacks;
     conn->conn.tls = tls;
     conn->stream.cbs = &vlc_h1_stream_callbacks;
-    conn->active = false;
-    conn->released = false;
+    atomic_init(&conn->active, false);
+    atomic_init(&conn->refs, 1);
     conn->proxy = proxy;
     conn->opaque = ctx;
 
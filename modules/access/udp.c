@@ -43,6 +43,7 @@
 #include <vlc_network.h>
 #include <vlc_block.h>
 #include <vlc_interrupt.h>
+#include <vlc_atomic.h>
 #ifdef HAVE_POLL
 # include <poll.h>
 #endif
@@ -59,6 +60,11 @@ static void Close( vlc_object_t * );
 #define BUFFER_TEXT N_("Receive buffer")
 #define BUFFER_LONGTEXT N_("UDP receive buffer size (bytes)" )
 #define TIMEOUT_TEXT N_("UDP Source timeout (sec)")
+#define BATCH_TEXT N_("Receive batch size")
+#define BATCH_LONGTEXT N_("Maximum number of datagrams to receive " \
+    "with a single system call (1 disables batching)." )
+
+#define UDP_BATCH_MAX 64
 
 vlc_module_begin ()
     set_shortname( N_("UDP" ) )
@@ -69,6 +75,10 @@ vlc_module_begin ()
     add_obsolete_integer( "server-port" ) /* since 2.0.0 */
     add_obsolete_integer( "udp-buffer" ) /* since 3.0.0 */
     add_integer( "udp-timeout", -1, TIMEOUT_TEXT, NULL, true )
+#ifdef HAVE_RECVMMSG
+    add_integer_with_range( "udp-batch", 32, 1, UDP_BATCH_MAX,
+                            BATCH_TEXT, BATCH_LONGTEXT, true )
+#endif
 
     set_capability( "access", 0 )
     add_shortcut( "udp", "udpstream", "udp4", "udp6" )
@@ -76,17 +86,50 @@ vlc_module_begin ()
     set_callbacks( Open, Close )
 vlc_module_end ()
 
+#ifdef HAVE_RECVMMSG
+/* Receive buffers of consecutive datagrams, allocated at once and freed
+ * with the last datagram block */
+typedef struct udp_slab_t udp_slab_t;
+
+typedef struct
+{
+    block_t     self;
+    udp_slab_t *slab;
+} udp_block_t;
+
+struct udp_slab_t
+{
+    atomic_uint  refs;
+    size_t       mtu;
+    uint8_t     *data;
+    udp_block_t  blocks[];
+};
+#endif
+
 struct access_sys_t
 {
     int fd;
     int timeout;
     size_t mtu;
+#ifdef HAVE_RECVMMSG
+    unsigned batch;
+    uint64_t datagrams;
+    uint64_t syscalls;
+    udp_slab_t *slab;
+    unsigned used; /* slab slots already handed out */
+    struct iovec iov[UDP_BATCH_MAX];
+    struct mmsghdr msgs[UDP_BATCH_MAX];
+#endif
 };
 
 /*****************************************************************************
  * Local prototypes
  *****************************************************************************/
 static block_t *BlockUDP( stream_t *, bool * );
+#ifdef HAVE_RECVMMSG
+static block_t *BlockUDPBatch( stream_t *, bool * );
+static void SlabRelease( udp_slab_t * );
+#endif
 static int Control( stream_t *, int, va_list );
 
 /*****************************************************************************
@@ -174,6 +217,28 @@ static int Open( vlc_object_t *p_this )
     if( sys->timeout > 0)
         sys->timeout *= 1000;
 
+#ifdef HAVE_RECVMMSG
+    sys->batch = var_InheritInteger( p_access, "udp-batch" );
+    sys->datagrams = 0;
+    sys->syscalls = 0;
+    sys->slab = NULL;
+    sys->used = 0;
+    for( unsigned i = 0; i < UDP_BATCH_MAX; i++ )
+    {
+        memset( &sys->msgs[i], 0, sizeof( sys->msgs[i] ) );
+        sys->msgs[i].msg_hdr.msg_iov = &sys->iov[i];
+        sys->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    if( sys->batch > 1 )
+    {
+        p_access->pf_block = BlockUDPBatch;
+        /* Receive statistics, for the average batch size */
+        var_Create( p_access, "udp-datagrams", VLC_VAR_INTEGER );
+        var_Create( p_access, "udp-syscalls", VLC_VAR_INTEGER );
+    }
+#endif
+
     return VLC_SUCCESS;
 }
 
@@ -185,6 +250,15 @@ static void Close( vlc_object_t *p_this )
     stream_t     *p_access = (stream_t*)p_this;
     access_sys_t *sys = p_access->p_sys;
 
+#ifdef HAVE_RECVMMSG
+    if( sys->slab != NULL )
+        SlabRelease( sys->slab );
+
+    if( sys->syscalls > 0 )
+        msg_Dbg( p_access, "received %"PRIu64" datagrams in %"PRIu64
+                 " system calls (average batch: %.2f)", sys->datagrams,
+                 sys->syscalls, (double)sys->datagrams / sys->syscalls );
+#endif
     net_Close( sys->fd );
 }
 
@@ -285,3 +359,137 @@ skip:
 
     return pkt;
 }
+
+#ifdef HAVE_RECVMMSG
+static udp_slab_t *SlabNew(unsigned count, size_t mtu)
+{
+    size_t header = sizeof (udp_slab_t) + count * sizeof (udp_block_t);
+
+    header = (header + 63) & ~(size_t)63;
+
+    udp_slab_t *slab = malloc(header + count * mtu);
+    if (unlikely(slab == NULL))
+        return NULL;
+
+    atomic_init(&slab->refs, 1);
+    slab->mtu = mtu;
+    slab->data = (uint8_t *)slab + header;
+    return slab;
+}
+
+static void SlabRelease(udp_slab_t *slab)
+{
+    if (atomic_fetch_sub_explicit(&slab->refs, 1, memory_order_acq_rel) == 1)
+        free(slab);
+}
+
+static void BlockSlabRelease(block_t *block)
+{
+    udp_block_t *pkt = container_of(block, udp_block_t, self);
+
+    SlabRelease(pkt->slab);
+}
+
+/*****************************************************************************
+ * BlockUDPBatch: receive as many datagrams as are pending with one recvmmsg()
+ *****************************************************************************
+ * Datagrams are received into a slab of consecutive buffers, allocated once
+ * for as many datagrams as the batch size. Each datagram is returned as a
+ * block referencing the slab, and the next calls use the remaining slots.
+ * Datagrams are returned as a chain.
+ *****************************************************************************/
+static block_t *BlockUDPBatch(stream_t *access, bool *restrict eof)
+{
+    access_sys_t *sys = access->p_sys;
+
+    if (sys->slab == NULL)
+    {
+        sys->slab = SlabNew(sys->batch, sys->mtu);
+        if (unlikely(sys->slab == NULL))
+        {   /* OOM - dequeue and discard one packet */
+            char dummy;
+            recv(sys->fd, &dummy, 1, 0);
+            return NULL;
+        }
+
+        for (unsigned i = 0; i < sys->batch; i++)
+        {
+            sys->iov[i].iov_base = sys->slab->data + i * sys->mtu;
+            sys->iov[i].iov_len = sys->mtu;
+        }
+        sys->used = 0;
+    }
+
+#ifdef __linux__
+    const int trunc_flag = MSG_TRUNC;
+#else
+    const int trunc_flag = 0;
+#endif
+
+    struct pollfd ufd[1];
+
+    ufd[0].fd = sys->fd;
+    ufd[0].events = POLLIN;
+
+    switch (vlc_poll_i11e(ufd, 1, sys->timeout))
+    {
+        case 0:
+            msg_Err(access, "receive time-out");
+            *eof = true;
+            /* fall through */
+        case -1:
+            return NULL;
+    }
+
+    udp_slab_t *slab = sys->slab;
+    unsigned first = sys->used;
+    int n = recvmmsg(sys->fd, sys->msgs + first, sys->batch - first,
+                     MSG_DONTWAIT | trunc_flag, NULL);
+    if (n <= 0)
+        return NULL;
+
+    sys->datagrams += n;
+    sys->syscalls++;
+    var_SetInteger(access, "udp-datagrams", sys->datagrams);
+    var_SetInteger(access, "udp-syscalls", sys->syscalls);
+
+    /* One reference per datagram block */
+    atomic_fetch_add_explicit(&slab->refs, n, memory_order_relaxed);
+    sys->used += n;
+
+    block_t *chain = NULL, **pp = &chain;
+
+    for (unsigned i = first; i < first + n; i++)
+    {
+        udp_block_t *pkt = &slab->blocks[i];
+        size_t len = sys->msgs[i].msg_len;
+
+        block_Init(&pkt->self, slab->data + i * slab->mtu, slab->mtu);
+        pkt->self.pf_release = BlockSlabRelease;
+        pkt->slab = slab;
+
+        if (sys->msgs[i].msg_hdr.msg_flags & trunc_flag)
+        {
+            msg_Err(access, "%zu bytes packet truncated (MTU was %zu)",
+                    len, slab->mtu);
+            pkt->self.i_flags |= BLOCK_FLAG_CORRUPTED;
+            if (len > sys->mtu)
+                sys->mtu = len;
+        }
+        else
+            pkt->self.i_buffer = len;
+
+        *pp = &pkt->self;
+        pp = &pkt->self.p_next;
+    }
+
+    /* Allocate the next slab once this one is used up, or too small */
+    if (sys->used == sys->batch || sys->mtu != slab->mtu)
+    {
+        SlabRelease(slab);
+        sys->slab = NULL;
+    }
+
+    return chain;
+}
+#endif
@@ -46,10 +46,16 @@
 #else
 #   include <sys/socket.h>
 #endif
+#ifdef __linux__
+#   include <netinet/udp.h>
+#endif
 
 #include <vlc_network.h>
 
 #define MAX_EMPTY_BLOCKS 200
+#define MAX_BATCH_PACKETS 64
+/* Largest UDP payload that can be handed to the kernel for segmentation */
+#define MAX_GSO_SIZE 65507
 
 /*****************************************************************************
  * Module descriptor
@@ -71,6 +77,19 @@ static void Close( vlc_object_t * );
                           "helps reducing the scheduling load on " \
                           "heavily-loaded systems." )
 
+#define BATCH_TEXT N_("Batch size")
+#define BATCH_LONGTEXT N_("Maximum number of packets that can be sent " \
+                          "with a single system call." )
+
+#define WINDOW_TEXT N_("Pacing window (ms)")
+#define WINDOW_LONGTEXT N_("Packets that are due within this delay are " \
+                           "sent together instead of being waited for " \
+                           "one by one." )
+
+#define GSO_TEXT N_("Segmentation offload")
+#define GSO_LONGTEXT N_("Let the kernel split batches of packets with " \
+                        "UDP generic segmentation offload, if available." )
+
 vlc_module_begin ()
     set_description( N_("UDP stream output") )
     set_shortname( "UDP" )
@@ -79,6 +98,11 @@ vlc_module_begin ()
     add_integer( SOUT_CFG_PREFIX "caching", DEFAULT_PTS_DELAY / 1000, CACHING_TEXT, CACHING_LONGTEXT, true )
     add_integer( SOUT_CFG_PREFIX "group", 1, GROUP_TEXT, GROUP_LONGTEXT,
                                  true )
+    add_integer_with_range( SOUT_CFG_PREFIX "batch", 32, 1, MAX_BATCH_PACKETS,
+                            BATCH_TEXT, BATCH_LONGTEXT, true )
+    add_integer( SOUT_CFG_PREFIX "batch-window", 0, WINDOW_TEXT,
+                 WINDOW_LONGTEXT, true )
+    add_bool( SOUT_CFG_PREFIX "gso", true, GSO_TEXT, GSO_LONGTEXT, true )
 
     set_capability( "sout access", 0 )
     add_shortcut( "udp" )
@@ -92,6 +116,9 @@ vlc_module_end ()
 static const char *const ppsz_sout_options[] = {
     "caching",
     "group",
+    "batch",
+    "batch-window",
+    "gso",
     NULL
 };
 
@@ -120,6 +147,16 @@ struct sout_access_out_sys_t
     block_fifo_t *p_empty_blocks;
     block_t      *p_buffer;
 
+    /* Owned by the sending thread */
+    block_t      *p_pending;
+    block_t      *pp_batch[MAX_BATCH_PACKETS];
+    unsigned      i_batch;
+    unsigned      i_batch_max;
+    mtime_t       i_batch_window;
+    bool          b_gso;
+    uint64_t      i_datagrams;
+    uint64_t      i_gso_datagrams;
+
     vlc_thread_t  thread;
 };
 
@@ -209,9 +246,20 @@ static int Open( vlc_object_t *p_this )
     p_sys->i_handle = i_handle;
     p_sys->i_mtu = var_CreateGetInteger( p_this, "mtu" );
     p_sys->b_mtu_warning = false;
-    p_sys->p_fifo = block_FifoNew();
-    p_sys->p_empty_blocks = block_FifoNew();
+    p_sys->p_fifo = block_FifoNewSPSC();
+    p_sys->p_empty_blocks = block_FifoNewSPSC();
     p_sys->p_buffer = NULL;
+    p_sys->p_pending = NULL;
+    p_sys->i_batch = 0;
+    p_sys->i_batch_max = var_GetInteger( p_access, SOUT_CFG_PREFIX "batch" );
+    p_sys->i_batch_window = UINT64_C(1000)
+                 * var_GetInteger( p_access, SOUT_CFG_PREFIX "batch-window" );
+    p_sys->b_gso = var_GetBool( p_access, SOUT_CFG_PREFIX "gso" );
+    p_sys->i_datagrams = 0;
+    p_sys->i_gso_datagrams = 0;
+    /* Transmission statistics */
+    var_Create( p_access, "udp-datagrams", VLC_VAR_INTEGER );
+    var_Create( p_access, "udp-gso-datagrams", VLC_VAR_INTEGER );
 
     if( vlc_clone( &p_sys->thread, ThreadWrite, p_access,
                            VLC_THREAD_PRIORITY_HIGHEST ) )
@@ -240,6 +288,11 @@ static void Close( vlc_object_t * p_this )
 
     vlc_cancel( p_sys->thread );
     vlc_join( p_sys->thread, NULL );
+
+    for( unsigned i = 0; i < p_sys->i_batch; i++ )
+        block_Release( p_sys->pp_batch[i] );
+    if( p_sys->p_pending ) block_Release( p_sys->p_pending );
+
     block_FifoRelease( p_sys->p_fifo );
     block_FifoRelease( p_sys->p_empty_blocks );
 
@@ -380,6 +433,172 @@ static block_t *NewUDPPacket( sout_access_out_t *p_access, mtime_t i_dts)
     return p_buffer;
 }
 
+/*****************************************************************************
+ * SendPackets: send packets one datagram each
+ *****************************************************************************/
+static void SendPackets( sout_access_out_t *p_access, block_t *const *pp_batch,
+                         unsigned i_count )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr msgs[MAX_BATCH_PACKETS];
+    struct iovec iov[MAX_BATCH_PACKETS];
+
+    memset( msgs, 0, i_count * sizeof (msgs[0]) );
+    for( unsigned i = 0; i < i_count; i++ )
+    {
+        iov[i].iov_base = pp_batch[i]->p_buffer;
+        iov[i].iov_len = pp_batch[i]->i_buffer;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    for( unsigned i = 0; i < i_count; )
+    {
+        int val = sendmmsg( p_sys->i_handle, msgs + i, i_count - i, 0 );
+        if( val <= 0 )
+        {   /* Skip the failing packet */
+            msg_Warn( p_access, "send error: %s", vlc_strerror_c(errno) );
+            i++;
+        }
+        else
+        {
+            i += val;
+            p_sys->i_datagrams += val;
+        }
+    }
+#else
+    for( unsigned i = 0; i < i_count; i++ )
+    {
+        if ( send( p_sys->i_handle, pp_batch[i]->p_buffer,
+                   pp_batch[i]->i_buffer, 0 ) == -1 )
+            msg_Warn( p_access, "send error: %s", vlc_strerror_c(errno) );
+        else
+            p_sys->i_datagrams++;
+    }
+#endif
+}
+
+#if defined(UDP_SEGMENT) && defined(SOL_UDP)
+/*****************************************************************************
+ * GSORun: count the leading packets that can be segmented together
+ *****************************************************************************
+ * All segments but the last one must have the same size, and the whole
+ * must fit in a single UDP datagram.
+ *****************************************************************************/
+static unsigned GSORun( block_t *const *pp_batch, unsigned i_count )
+{
+    const size_t i_segment = pp_batch[0]->i_buffer;
+
+    if( i_segment == 0 || i_segment > MAX_GSO_SIZE )
+        return 0;
+
+    const unsigned i_max = __MIN( i_count, MAX_GSO_SIZE / i_segment );
+    unsigned n = 1;
+
+    while( n < i_max && pp_batch[n]->i_buffer == i_segment )
+        n++;
+    if( n < i_max && pp_batch[n]->i_buffer > 0
+     && pp_batch[n]->i_buffer < i_segment )
+        n++;
+    return n;
+}
+
+/*****************************************************************************
+ * SendGSO: send packets as a single datagram segmented by the kernel
+ *****************************************************************************/
+static int SendGSO( sout_access_out_t *p_access, block_t *const *pp_batch,
+                    unsigned i_count )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    struct iovec iov[MAX_BATCH_PACKETS];
+
+    for( unsigned i = 0; i < i_count; i++ )
+    {
+        iov[i].iov_base = pp_batch[i]->p_buffer;
+        iov[i].iov_len = pp_batch[i]->i_buffer;
+    }
+
+    union
+    {
+        char buf[CMSG_SPACE(sizeof (uint16_t))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg = {
+        .msg_iov = iov,
+        .msg_iovlen = i_count,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof (control.buf),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR( &msg );
+    uint16_t i_gso = pp_batch[0]->i_buffer;
+
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof (i_gso));
+    memcpy( CMSG_DATA(cmsg), &i_gso, sizeof (i_gso) );
+
+    if( sendmsg( p_sys->i_handle, &msg, 0 ) >= 0 )
+    {
+        p_sys->i_datagrams += i_count;
+        p_sys->i_gso_datagrams += i_count;
+        return 0;
+    }
+
+    switch( errno )
+    {
+        case EINVAL:
+        case EIO:
+        case ENOPROTOOPT:
+        case EOPNOTSUPP:
+            msg_Dbg( p_access, "segmentation offload not available: %s",
+                     vlc_strerror_c(errno) );
+            p_sys->b_gso = false;
+            break;
+    }
+    return -1;
+}
+#endif
+
+/*****************************************************************************
+ * SendBatch: send all the packets of the current batch
+ *****************************************************************************/
+static void SendBatch( sout_access_out_t *p_access )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    block_t *const *pp_batch = p_sys->pp_batch;
+    const unsigned i_count = p_sys->i_batch;
+    unsigned i_first = 0; /* first packet not sent yet */
+
+#if defined(UDP_SEGMENT) && defined(SOL_UDP)
+    /* Segment each run of packets of the same size, in as many datagrams
+     * as the maximum UDP payload requires, and send the other packets in
+     * between as they come */
+    for( unsigned i = 0; p_sys->b_gso && i + 1 < i_count; )
+    {
+        unsigned n = GSORun( pp_batch + i, i_count - i );
+        if( n < 2 )
+        {
+            i++;
+            continue;
+        }
+
+        SendPackets( p_access, pp_batch + i_first, i - i_first );
+        i_first = i;
+        if( SendGSO( p_access, pp_batch + i, n ) )
+            break;
+        i += n;
+        i_first = i;
+    }
+#endif
+
+    SendPackets( p_access, pp_batch + i_first, i_count - i_first );
+
+    var_SetInteger( p_access, "udp-datagrams", p_sys->i_datagrams );
+    var_SetInteger( p_access, "udp-gso-datagrams", p_sys->i_gso_datagrams );
+}
+
 /*****************************************************************************
  * ThreadWrite: Write a packet on the network at the good time.
  *****************************************************************************/
@@ -395,9 +614,12 @@ static void* ThreadWrite( void *data )
 
     for (;;)
     {
-        block_t *p_pk = block_FifoGet( p_sys->p_fifo );
+        block_t *p_pk = p_sys->p_pending;
         mtime_t       i_date, i_sent;
 
+        if( p_pk == NULL )
+            p_pk = p_sys->p_pending = block_FifoGet( p_sys->p_fifo );
+
         i_date = p_sys->i_caching + p_pk->i_dts;
         if( i_date_last > 0 )
         {
@@ -407,6 +629,7 @@ static void* ThreadWrite( void *data )
                     msg_Dbg( p_access, "mmh, hole (%"PRId64" > 2s) -> drop",
                              i_date - i_date_last );
 
+                p_sys->p_pending = NULL;
                 block_FifoPut( p_sys->p_empty_blocks, p_pk );
 
                 i_date_last = i_date;
@@ -421,16 +644,49 @@ static void* ThreadWrite( void *data )
             }
         }
 
-        block_cleanup_push( p_pk );
+        /* The batch is released by Close() if the thread gets cancelled */
+        p_sys->p_pending = NULL;
+        p_sys->pp_batch[0] = p_pk;
+        p_sys->i_batch = 1;
+
         i_to_send--;
         if( !i_to_send || (p_pk->i_flags & BLOCK_FLAG_CLOCK) )
         {
             mwait( i_date );
             i_to_send = i_group;
         }
-        if ( send( p_sys->i_handle, p_pk->p_buffer, p_pk->i_buffer, 0 ) == -1 )
-            msg_Warn( p_access, "send error: %s", vlc_strerror_c(errno) );
-        vlc_cleanup_pop();
+        i_date_last = i_date;
+
+        /* Append the following packets that would not be waited for, and
+         * those that are due within the pacing window */
+        const mtime_t i_window_end = mdate() + p_sys->i_batch_window;
+
+        while( p_sys->i_batch < p_sys->i_batch_max )
+        {
+            vlc_fifo_Lock( p_sys->p_fifo );
+            p_pk = vlc_fifo_DequeueUnlocked( p_sys->p_fifo );
+            vlc_fifo_Unlock( p_sys->p_fifo );
+            if( p_pk == NULL )
+                break;
+
+            mtime_t i_next = p_sys->i_caching + p_pk->i_dts;
+            bool b_wait = i_to_send == 1
+                       || (p_pk->i_flags & BLOCK_FLAG_CLOCK);
+
+            if( i_next - i_date_last > 2000000
+             || i_next - i_date_last < -1000
+             || ( b_wait && i_next > i_window_end ) )
+            {   /* Leave it to the next iteration */
+                p_sys->p_pending = p_pk;
+                break;
+            }
+
+            i_to_send = b_wait ? i_group : i_to_send - 1;
+            i_date = i_date_last = i_next;
+            p_sys->pp_batch[p_sys->i_batch++] = p_pk;
+        }
+
+        SendBatch( p_access );
 
         if( i_dropped_packets )
         {
@@ -447,9 +703,10 @@ static void* ThreadWrite( void *data )
         }
 #endif
 
-        block_FifoPut( p_sys->p_empty_blocks, p_pk );
-
-        i_date_last = i_date;
+        for( unsigned i = 1; i < p_sys->i_batch; i++ )
+            p_sys->pp_batch[i - 1]->p_next = p_sys->pp_batch[i];
+        p_sys->i_batch = 0;
+        block_FifoPut( p_sys->p_empty_blocks, p_sys->pp_batch[0] );
     }
     return NULL;
 }
@@ -40,15 +40,19 @@
 #include "tools/Debug.hpp"
 #include <vlc_stream.h>
 #include <vlc_demux.h>
+#include <vlc_input.h>
 #include <vlc_threads.h>
 
 #include <algorithm>
+#include <cmath>
 #include <ctime>
 
 using namespace adaptive::http;
 using namespace adaptive::logic;
 using namespace adaptive;
 
+#define ADAPTIVE_PTS_DELAY (1000 * INT64_C(1000))
+
 PlaylistManager::PlaylistManager( demux_t *p_demux_,
                                   SharedResources *res,
                                   AbstractPlaylist *pl,
@@ -64,6 +68,10 @@ PlaylistManager::PlaylistManager( demux_t *p_demux_,
     resources = res;
     bufferingLogic = NULL;
     failedupdates = 0;
+    f_catchup_rate = 1.0;
+    liveedge.i_end = VLC_TS_INVALID;
+    liveedge.i_prevend = VLC_TS_INVALID;
+    liveedge.i_changed = VLC_TS_INVALID;
     b_thread = false;
     b_buffering = false;
     b_canceled = false;
@@ -611,7 +619,7 @@ int PlaylistManager::doControl(int i_query, va_list args)
         }
 
         case DEMUX_GET_PTS_DELAY:
-            *va_arg (args, int64_t *) = 1000 * INT64_C(1000);
+            *va_arg (args, int64_t *) = ADAPTIVE_PTS_DELAY;
             break;
 
         default:
@@ -633,6 +641,8 @@ void PlaylistManager::Run()
     vlc_mutex_lock(&lock);
     const mtime_t i_min_buffering = bufferingLogic->getMinBuffering(playlist);
     const mtime_t i_extra_buffering = bufferingLogic->getMaxBuffering(playlist) - i_min_buffering;
+    const mtime_t i_target_delay = bufferingLogic->isLowLatency(playlist) && playlist->isLive()
+                                 ? bufferingLogic->getLiveDelay(playlist) : 0;
     while(1)
     {
         while(!b_buffering && !b_canceled)
@@ -656,6 +666,8 @@ void PlaylistManager::Run()
 
         int canc = vlc_savecancel();
         AbstractStream::buffering_status i_return = bufferize(i_nzpcr, i_min_buffering, i_extra_buffering);
+        if(i_target_delay && i_nzpcr != VLC_TS_INVALID)
+            updatePlaybackRate(i_target_delay, i_nzpcr);
         vlc_restorecancel( canc );
 
         if(i_return != AbstractStream::buffering_lessthanmin)
@@ -691,6 +703,101 @@ void * PlaylistManager::managerThread(void *opaque)
     return NULL;
 }
 
+mtime_t PlaylistManager::getLiveEdge()
+{
+    mtime_t i_end = VLC_TS_INVALID;
+    mtime_t i_offset = 0;
+    std::vector<AbstractStream *>::const_iterator it;
+    for(it=streams.begin(); it!=streams.end(); ++it)
+    {
+        const AbstractStream *st = *it;
+        if(st->isValid() && !st->isDisabled() && st->isSelected())
+        {
+            mtime_t start, end, length, mediaStart, demuxStart;
+            if(!st->getMediaPlaybackTimes(&start, &end, &length,
+                                          &mediaStart, &demuxStart))
+                continue;
+            if(start < 0) /* Live template. Range end = now() */
+                end = CLOCK_FREQ * time(NULL);
+            if(i_end == VLC_TS_INVALID || end < i_end)
+            {
+                i_end = end;
+                /* playlist to demux time */
+                i_offset = demuxStart - mediaStart;
+            }
+        }
+    }
+    if(i_end == VLC_TS_INVALID)
+        return VLC_TS_INVALID;
+
+    /* The last listed segment can still be in progress: the edge is the
+       end of the previous listing, plus the time elapsed since the list
+       grew, but never past the listed end */
+    mtime_t now = mdate();
+    if(i_end != liveedge.i_end)
+    {
+        liveedge.i_prevend = (liveedge.i_end == VLC_TS_INVALID ||
+                              i_end < liveedge.i_end) ? i_end : liveedge.i_end;
+        liveedge.i_end = i_end;
+        liveedge.i_changed = now;
+    }
+    i_end = std::min(liveedge.i_end,
+                     liveedge.i_prevend + (now - liveedge.i_changed));
+
+    return i_end + i_offset;
+}
+
+#define CATCHUP_RATE_FASTER 1.05f
+#define CATCHUP_RATE_SLOWER 0.95f
+void PlaylistManager::updatePlaybackRate(mtime_t i_target, mtime_t i_nzpcr)
+{
+    input_thread_t *p_input = p_demux->p_input;
+    if(!p_input)
+        return;
+
+    const float f_input_rate = var_GetFloat(p_input, "rate");
+    if(std::fabs(f_input_rate - f_catchup_rate) > 0.01f)
+    {
+        /* Do not fight the user rate, until it is set back to normal */
+        if(std::fabs(f_input_rate - 1.0f) > 0.01f)
+            return;
+        f_catchup_rate = 1.0f;
+    }
+
+    mtime_t i_edge = getLiveEdge();
+    if(i_edge == VLC_TS_INVALID)
+        return;
+
+    /* What is played lags the demux by the pts delay (input jitter) */
+    mtime_t i_ahead = i_edge - (i_nzpcr - ADAPTIVE_PTS_DELAY);
+    if(i_ahead < 0)
+        i_ahead = 0;
+
+    float f_rate = f_catchup_rate;
+    if(f_rate > 1.0f)
+    {
+        if(i_ahead <= i_target)
+            f_rate = 1.0f;
+    }
+    else if(f_rate < 1.0f)
+    {
+        if(i_ahead >= i_target * 3 / 4)
+            f_rate = 1.0f;
+    }
+    else if(i_ahead > i_target + i_target / 4)
+        f_rate = CATCHUP_RATE_FASTER;
+    else if(i_ahead < i_target / 4)
+        f_rate = CATCHUP_RATE_SLOWER; /* avoid starving */
+
+    if(f_rate != f_catchup_rate)
+    {
+        msg_Dbg(p_demux, "%" PRId64 "ms behind live edge, rate %.2f",
+                i_ahead / 1000, f_rate);
+        f_catchup_rate = f_rate;
+        var_SetFloat(p_input, "rate", f_rate);
+    }
+}
+
 void PlaylistManager::updateControlsPosition()
 {
     vlc_mutex_locker locker(&cached.lock);
@@ -856,6 +963,12 @@ AbstractBufferingLogic *PlaylistManager::createBufferingLogic() const
         v = var_InheritInteger(p_demux, "adaptive-maxbuffer");
         if(v)
             bl->setUserMaxBuffering(CLOCK_FREQ / 1000 * v);
+        v = var_InheritInteger(p_demux, "adaptive-lowlatency-delay");
+        if(v)
+            bl->setUserLowLatencyDelay(CLOCK_FREQ / 1000 * v);
+        int i = var_InheritInteger(p_demux, "adaptive-lowlatency");
+        if(i != -1)
+            bl->setLowDelay(i == 1);
     }
     return bl;
 }
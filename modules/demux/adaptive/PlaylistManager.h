@@ -86,6 +86,8 @@ namespace adaptive
             void unsetPeriod();
 
             void updateControlsPosition();
+            mtime_t getLiveEdge();
+            void updatePlaybackRate(mtime_t, mtime_t);
 
             /* local factories */
             virtual AbstractAdaptationLogic *createLogic(AbstractAdaptationLogic::LogicType,
@@ -114,6 +116,13 @@ namespace adaptive
             /* buffering process */
             time_t                               nextPlaylistupdate;
             int                                  failedupdates;
+            float                                f_catchup_rate; /* low latency */
+            struct
+            {
+                mtime_t     i_end; /* last listed end */
+                mtime_t     i_prevend; /* end before the last list growth */
+                mtime_t     i_changed; /* when the list grew */
+            } liveedge;
 
             /* Controls */
             struct
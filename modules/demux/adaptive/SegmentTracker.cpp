@@ -87,7 +87,7 @@ SegmentTracker::SegmentTracker(SharedResources *res,
 {
     resources = res;
     first = true;
-    curNumber = next = std::numeric_limits<uint64_t>::max();
+    curNumber = readNumber = next = std::numeric_limits<uint64_t>::max();
     initializing = true;
     index_sent = false;
     init_sent = false;
@@ -156,12 +156,21 @@ bool SegmentTracker::segmentsListReady() const
         rep = logic->getNextRepresentation(adaptationSet, NULL);
     if(rep && rep->getPlaylist()->isLive())
     {
-        assert(curNumber != std::numeric_limits<uint64_t>::max());
-        return rep->getMinAheadTime(curNumber) > 0;
+        /* The prefetched segment still has to be demuxed */
+        assert(readNumber != std::numeric_limits<uint64_t>::max());
+        return rep->getMinAheadTime(readNumber) > 0;
     }
     return true;
 }
 
+bool SegmentTracker::isLowLatency() const
+{
+    BaseRepresentation *rep = curRepresentation;
+    if(!rep)
+        rep = logic->getNextRepresentation(adaptationSet, NULL);
+    return rep && bufferingLogic->isLowLatency(rep->getPlaylist());
+}
+
 void SegmentTracker::reset()
 {
     notify(SegmentTrackerEvent(curRepresentation, NULL));
@@ -172,8 +181,20 @@ void SegmentTracker::reset()
     format = StreamFormat::UNKNOWN;
 }
 
+void SegmentTracker::prefetchedChunkUsed()
+{
+    readNumber = curNumber;
+}
+
+/* Changes when the segments of the current representation are updated */
+unsigned SegmentTracker::getUpdateCount() const
+{
+    return curRepresentation ? curRepresentation->getUpdateCount() : 0;
+}
+
 SegmentChunk * SegmentTracker::getNextChunk(bool switch_allowed,
-                                            AbstractConnectionManager *connManager)
+                                            AbstractConnectionManager *connManager,
+                                            bool prefetch)
 {
     BaseRepresentation *rep = NULL, *prevRep = NULL;
     ISegment *segment;
@@ -220,11 +241,15 @@ SegmentChunk * SegmentTracker::getNextChunk(bool switch_allowed,
         next = bufferingLogic->getStartSegmentNumber(rep);
         if(next == std::numeric_limits<uint64_t>::max())
             return NULL;
+        /* loading did schedule from the default start, closer with low latency */
+        b_updated = true;
     }
     else if(prevRep && !rep->consistentSegmentNumber())
     {
         /* Convert our segment number */
         next = rep->translateSegmentNumber(next, prevRep);
+        if(readNumber != std::numeric_limits<uint64_t>::max())
+            readNumber = rep->translateSegmentNumber(readNumber, prevRep);
     }
 
     if(b_updated)
@@ -313,6 +338,8 @@ SegmentChunk * SegmentTracker::getNextChunk(bool switch_allowed,
     if(chunk)
     {
         curNumber = next;
+        if(!prefetch)
+            readNumber = curNumber;
         next++;
     }
 
@@ -352,7 +379,7 @@ void SegmentTracker::setPositionByNumber(uint64_t segnumber, bool restarted)
         index_sent = false;
         init_sent = false;
     }
-    curNumber = next = segnumber;
+    curNumber = readNumber = next = segnumber;
 }
 
 mtime_t SegmentTracker::getPlaybackTime() const
@@ -363,8 +390,16 @@ mtime_t SegmentTracker::getPlaybackTime() const
     if(!rep)
         rep = logic->getNextRepresentation(adaptationSet, NULL);
 
-    if(rep &&
-       rep->getPlaybackTimeDurationBySegmentNumber(next, &time, &duration))
+    if(!rep)
+        return 0;
+
+    /* Until the first chunk, next is not the start segment yet */
+    uint64_t number = next;
+    if(number == std::numeric_limits<uint64_t>::max())
+        number = bufferingLogic->getStartSegmentNumber(rep);
+
+    if(number != std::numeric_limits<uint64_t>::max() &&
+       rep->getPlaybackTimeDurationBySegmentNumber(number, &time, &duration))
     {
         return time;
     }
@@ -128,8 +128,11 @@ namespace adaptive
             const std::string & getStreamLanguage() const;
             const Role & getStreamRole() const;
             bool segmentsListReady() const;
+            bool isLowLatency() const;
             void reset();
-            SegmentChunk* getNextChunk(bool, AbstractConnectionManager *);
+            SegmentChunk* getNextChunk(bool, AbstractConnectionManager *, bool prefetch);
+            void prefetchedChunkUsed();
+            unsigned getUpdateCount() const;
             bool setPositionByTime(mtime_t, bool, bool);
             void setPositionByNumber(uint64_t, bool);
             mtime_t getPlaybackTime() const; /* Current segment start time if selected */
@@ -150,6 +153,7 @@ namespace adaptive
             bool init_sent;
             uint64_t next;
             uint64_t curNumber;
+            uint64_t readNumber; /* curNumber, but the prefetched segment */
             StreamFormat format;
             SharedResources *resources;
             AbstractAdaptationLogic *logic;
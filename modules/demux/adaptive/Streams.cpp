@@ -45,6 +45,11 @@ AbstractStream::AbstractStream(demux_t * demux_)
     p_realdemux = demux_;
     format = StreamFormat::UNKNOWN;
     currentChunk = NULL;
+    nextChunk = NULL;
+    nextChunkPending = false;
+    prefetching = false;
+    nextChunkMissing = false;
+    nextChunkMissingUpdate = 0;
     eof = false;
     valid = true;
     disabled = false;
@@ -112,6 +117,7 @@ bool AbstractStream::init(const StreamFormat &format_, SegmentTracker *tracker,
 AbstractStream::~AbstractStream()
 {
     delete currentChunk;
+    delete nextChunk;
     if(segmentTracker)
         segmentTracker->notifyBufferingState(false);
     delete segmentTracker;
@@ -326,6 +332,7 @@ AbstractStream::buffering_status AbstractStream::doBufferize(mtime_t nz_deadline
     if(esCount() && !isSelected() && !fakeEsOut()->restarting())
     {
         setDisabled(true);
+        dropNextChunk();
         segmentTracker->reset();
         fakeEsOut()->commandsQueue()->Abort(false);
         msg_Dbg(p_realdemux, "deactivating %s stream %s",
@@ -375,7 +382,8 @@ AbstractStream::buffering_status AbstractStream::doBufferize(mtime_t nz_deadline
     segmentTracker->notifyBufferingLevel(i_min_buffering, i_demuxed, i_total_buffering);
     if(i_demuxed < i_total_buffering) /* not already demuxed */
     {
-        if(!segmentTracker->segmentsListReady()) /* Live Streams */
+        if(!segmentTracker->segmentsListReady() && /* Live Streams */
+           !hasAvailableData())
         {
             vlc_mutex_unlock(&lock);
             return AbstractStream::buffering_suspended;
@@ -423,6 +431,15 @@ AbstractStream::buffering_status AbstractStream::doBufferize(mtime_t nz_deadline
     return AbstractStream::buffering_full;
 }
 
+bool AbstractStream::hasAvailableData() const
+{
+    /* Low latency segments are demuxed while they are received */
+    if(!segmentTracker->isLowLatency())
+        return false;
+    return (currentChunk && currentChunk->hasAvailableData()) ||
+           (demuxersource && demuxersource->hasAvailableData());
+}
+
 AbstractStream::status AbstractStream::dequeue(mtime_t nz_deadline, mtime_t *pi_pcr)
 {
     vlc_mutex_locker locker(&lock);
@@ -469,13 +486,63 @@ AbstractStream::status AbstractStream::dequeue(mtime_t nz_deadline, mtime_t *pi_
     return AbstractStream::status_buffering;
 }
 
-std::string AbstractStream::getContentType()
+SegmentChunk * AbstractStream::getNextChunk()
 {
-    if (currentChunk == NULL && !eof)
+    nextChunkMissing = false;
+
+    if(nextChunkPending)
     {
-        const bool b_restarting = fakeEsOut()->restarting();
-        currentChunk = segmentTracker->getNextChunk(!b_restarting, connManager);
+        SegmentChunk *chunk = nextChunk;
+        std::list<SegmentTrackerEvent> events;
+        events.swap(nextChunkEvents);
+        nextChunk = NULL;
+        nextChunkPending = false;
+
+        std::list<SegmentTrackerEvent>::const_iterator it;
+        for(it = events.begin(); it != events.end(); ++it)
+            trackerEvent(*it);
+        segmentTracker->prefetchedChunkUsed();
+        return chunk;
     }
+
+    const bool b_restarting = fakeEsOut()->restarting();
+    return segmentTracker->getNextChunk(!b_restarting, connManager, false);
+}
+
+void AbstractStream::prefetchNextChunk()
+{
+    if(nextChunkPending || discontinuity || needrestart ||
+       fakeEsOut()->restarting())
+        return;
+
+    /* Nothing yet (live): retry once the segments are updated, or with
+     * the next chunk, and not for every block */
+    if(nextChunkMissing &&
+       nextChunkMissingUpdate == segmentTracker->getUpdateCount())
+        return;
+
+    prefetching = true;
+    nextChunk = segmentTracker->getNextChunk(true, connManager, true);
+    prefetching = false;
+
+    nextChunkPending = (nextChunk || !nextChunkEvents.empty());
+    nextChunkMissing = !nextChunkPending;
+    nextChunkMissingUpdate = segmentTracker->getUpdateCount();
+}
+
+void AbstractStream::dropNextChunk()
+{
+    delete nextChunk;
+    nextChunk = NULL;
+    nextChunkPending = false;
+    nextChunkMissing = false;
+    nextChunkEvents.clear();
+}
+
+std::string AbstractStream::getContentType()
+{
+    if (currentChunk == NULL && !eof)
+        currentChunk = getNextChunk();
     if(currentChunk)
         return currentChunk->getContentType();
     else
@@ -485,10 +552,7 @@ std::string AbstractStream::getContentType()
 block_t * AbstractStream::readNextBlock()
 {
     if (currentChunk == NULL && !eof)
-    {
-        const bool b_restarting = fakeEsOut()->restarting();
-        currentChunk = segmentTracker->getNextChunk(!b_restarting, connManager);
-    }
+        currentChunk = getNextChunk();
 
     if(discontinuity && demuxfirstchunk)
     {
@@ -532,6 +596,10 @@ block_t * AbstractStream::readNextBlock()
         delete currentChunk;
         currentChunk = NULL;
     }
+    else
+    {
+        prefetchNextChunk();
+    }
 
     block = checkBlock(block, b_segment_head_chunk);
 
@@ -547,6 +615,7 @@ bool AbstractStream::setPosition(mtime_t time, bool tryonly)
     bool ret = segmentTracker->setPositionByTime(time, b_needs_restart, tryonly);
     if(!tryonly && ret)
     {
+        dropNextChunk();
         // clear eof flag before restartDemux() to prevent readNextBlock() fail
         eof = false;
         demuxfirstchunk = true;
@@ -643,6 +712,12 @@ AbstractDemuxer *AbstractStream::newDemux(vlc_object_t *p_obj, const StreamForma
 
 void AbstractStream::trackerEvent(const SegmentTrackerEvent &event)
 {
+    if(prefetching)
+    {
+        nextChunkEvents.push_back(event);
+        return;
+    }
+
     switch(event.type)
     {
         case SegmentTrackerEvent::DISCONTINUITY:
@@ -31,6 +31,7 @@
 #include "plumbing/FakeESOut.hpp"
 
 #include <string>
+#include <list>
 
 namespace adaptive
 {
@@ -125,6 +126,21 @@ namespace adaptive
 
         SegmentChunk *currentChunk;
         bool eof;
+
+        /* The next chunk is requested once the current one is, so that it
+         * is downloaded while the current one is demuxed. The tracker events
+         * of that request only apply once it becomes the current chunk. */
+        SegmentChunk *getNextChunk();
+        void prefetchNextChunk();
+        void dropNextChunk();
+        SegmentChunk *nextChunk;
+        bool nextChunkPending;
+        bool prefetching;
+        /* Nothing to prefetch after the current chunk, unless the segments
+         * were updated since that update count */
+        bool nextChunkMissing;
+        unsigned nextChunkMissingUpdate;
+        std::list<SegmentTrackerEvent> nextChunkEvents;
         std::string language;
         std::string description;
 
@@ -138,6 +154,7 @@ namespace adaptive
     private:
         void declaredCodecs();
         buffering_status doBufferize(mtime_t, mtime_t, mtime_t);
+        bool hasAvailableData() const;
         buffering_status last_buffer_status;
         bool valid;
         bool disabled;
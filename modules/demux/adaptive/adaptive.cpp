@@ -82,9 +82,21 @@ static void Close   (vlc_object_t *);
 #define ADAPT_ACCESS_TEXT N_("Use regular HTTP modules")
 #define ADAPT_ACCESS_LONGTEXT N_("Connect using HTTP access instead of custom HTTP code")
 
+#define ADAPT_SPLIT_TEXT N_("Parallel range requests")
+#define ADAPT_SPLIT_LONGTEXT N_("Downloads large segments as this many byte ranges in parallel")
+
+#define ADAPT_CACHE_TEXT N_("Segment cache size (MiB)")
+#define ADAPT_CACHE_LONGTEXT N_("Memory shared by all the sessions to keep the downloaded segments, 0 to disable")
+
+#define ADAPT_CACHE_DISK_TEXT N_("Segment cache disk size (MiB)")
+#define ADAPT_CACHE_DISK_LONGTEXT N_("Disk space where the segments leaving the memory cache are kept, 0 to disable")
+
 #define ADAPT_LOWLATENCY_TEXT N_("Low latency")
 #define ADAPT_LOWLATENCY_LONGTEXT N_("Overrides low latency parameters")
 
+#define ADAPT_LOWLATENCY_DELAY_TEXT N_("Low latency playback delay (ms)")
+#define ADAPT_LOWLATENCY_DELAY_LONGTEXT N_("Targeted delay behind the live edge, kept by adjusting the playback rate")
+
 static const AbstractAdaptationLogic::LogicType pi_logics[] = {
                                 AbstractAdaptationLogic::Default,
                                 AbstractAdaptationLogic::Predictive,
@@ -137,6 +149,10 @@ vlc_module_begin ()
                      ADAPT_HEIGHT_TEXT, ADAPT_HEIGHT_TEXT, false )
         add_integer( "adaptive-bw",     250, ADAPT_BW_TEXT,     ADAPT_BW_LONGTEXT,     false )
         add_bool   ( "adaptive-use-access", false, ADAPT_ACCESS_TEXT, ADAPT_ACCESS_LONGTEXT, true );
+        add_integer( "adaptive-range-split", 1, ADAPT_SPLIT_TEXT, ADAPT_SPLIT_LONGTEXT, true )
+            change_integer_range( 1, 4 )
+        add_integer( "adaptive-cache-size", 0, ADAPT_CACHE_TEXT, ADAPT_CACHE_LONGTEXT, true )
+        add_integer( "adaptive-cache-disk-size", 0, ADAPT_CACHE_DISK_TEXT, ADAPT_CACHE_DISK_LONGTEXT, true )
         add_integer( "adaptive-livedelay",
                      AbstractBufferingLogic::DEFAULT_LIVE_BUFFERING / 1000,
                      ADAPT_BUFFER_TEXT, ADAPT_BUFFER_LONGTEXT, true );
@@ -145,6 +161,10 @@ vlc_module_begin ()
                      ADAPT_MAXBUFFER_TEXT, NULL, true );
         add_integer( "adaptive-lowlatency", -1, ADAPT_LOWLATENCY_TEXT, ADAPT_LOWLATENCY_LONGTEXT, true );
             change_integer_list(rgi_latency, ppsz_latency)
+        add_integer( "adaptive-lowlatency-delay",
+                     AbstractBufferingLogic::BUFFERING_LOWEST_LIMIT / 1000,
+                     ADAPT_LOWLATENCY_DELAY_TEXT, ADAPT_LOWLATENCY_DELAY_LONGTEXT, true )
+            change_integer_range( 500, 10000 )
         set_callbacks( Open, Close )
 vlc_module_end ()
 
@@ -65,6 +65,11 @@ std::string AbstractChunkSource::getContentType() const
     return std::string();
 }
 
+bool AbstractChunkSource::hasAvailableData() const
+{
+    return hasMoreData();
+}
+
 enum RequestStatus AbstractChunkSource::getRequestStatus() const
 {
     return requeststatus;
@@ -127,6 +132,11 @@ bool AbstractChunk::isEmpty() const
     return !source->hasMoreData();
 }
 
+bool AbstractChunk::hasAvailableData() const
+{
+    return source->hasAvailableData();
+}
+
 block_t * AbstractChunk::readBlock()
 {
     return doRead(0, true);
@@ -295,6 +305,12 @@ block_t * HTTPChunkSource::readBlock()
 HTTPChunkBufferedSource::HTTPChunkBufferedSource(const std::string& url, AbstractConnectionManager *manager,
                                                  const adaptive::ID &sourceid, bool access) :
     HTTPChunkSource(url, manager, sourceid, access),
+    partsread  (0),
+    parent     (NULL),
+    retries    (0),
+    splitpending (0),
+    splitsize  (0),
+    splitstart (0),
     p_head     (NULL),
     pp_tail    (&p_head),
     buffered     (0)
@@ -304,6 +320,8 @@ HTTPChunkBufferedSource::HTTPChunkBufferedSource(const std::string& url, Abstrac
     eof = false;
     held = false;
     downloadstart = 0;
+    /* segments can be shared between sessions */
+    params.setCacheable(true);
 }
 
 HTTPChunkBufferedSource::~HTTPChunkBufferedSource()
@@ -325,6 +343,11 @@ HTTPChunkBufferedSource::~HTTPChunkBufferedSource()
     buffered = 0;
     vlc_mutex_unlock(&lock);
 
+    /* cancels and waits the parts still being downloaded */
+    std::vector<HTTPChunkBufferedSource *>::const_iterator it;
+    for(it = parts.begin(); it != parts.end(); ++it)
+        delete *it;
+
     vlc_cond_destroy(&avail);
 }
 
@@ -350,12 +373,14 @@ void HTTPChunkBufferedSource::release()
 void HTTPChunkBufferedSource::bufferize(size_t readsize)
 {
     vlc_mutex_lock(&lock);
+    const bool b_first = !prepared;
     if(!prepare())
     {
         done = true;
         eof = true;
         vlc_cond_signal(&avail);
         vlc_mutex_unlock(&lock);
+        downloaded(0, 0, true);
         return;
     }
 
@@ -367,6 +392,13 @@ void HTTPChunkBufferedSource::bufferize(size_t readsize)
 
     vlc_mutex_unlock(&lock);
 
+    if(b_first)
+    {
+        std::vector<HTTPChunkBufferedSource *>::const_iterator it;
+        for(it = parts.begin(); it != parts.end(); ++it)
+            connManager->start(*it);
+    }
+
     block_t *p_block = block_Alloc(readsize);
     if(!p_block)
     {
@@ -397,21 +429,51 @@ void HTTPChunkBufferedSource::bufferize(size_t readsize)
         vlc_mutex_locker locker( &lock );
         buffered += p_block->i_buffer;
         block_ChainLastAppend(&pp_tail, p_block);
-        if((size_t) ret < readsize)
-        {
-            done = true;
-            rate.size = buffered + consumed;
-            rate.time = mdate() - downloadstart;
-            downloadstart = 0;
-        }
+        /* Short reads are transfer chunks, which are handed to the
+         * demuxer as they arrive. Only no data means the end. */
     }
 
-    if(rate.size && rate.time)
+    if(ret > 0)
+        downloaded(ret, 0, false);
+    else
+        downloaded(rate.size, rate.time, true);
+
+    vlc_cond_signal(&avail);
+}
+
+void HTTPChunkBufferedSource::downloaded(size_t size, mtime_t time, bool b_end)
+{
+    /* The ranges of split segments are downloaded in parallel: their data
+     * is accounted as it arrives, and reported at least every period as
+     * the combined rate, over the time elapsed since the previous report.
+     * Other segments are reported once downloaded. */
+    HTTPChunkBufferedSource *origin = parent ? parent : this;
+    const mtime_t now = mdate();
+    vlc_mutex_lock(&origin->lock);
+    if(origin->splitpending)
     {
-        connManager->updateDownloadRate(sourceid, rate.size, rate.time);
+        if(b_end)
+        {
+            size = 0; /* already accounted */
+            origin->splitpending--;
+        }
+        origin->splitsize += size;
+        time = now - origin->splitstart;
+        if(time >= SPLIT_RATE_PERIOD || !origin->splitpending)
+        {
+            size = origin->splitsize;
+            origin->splitsize = 0;
+            origin->splitstart = now;
+        }
+        else
+            size = 0;
     }
+    else if(!b_end)
+        size = 0;
+    vlc_mutex_unlock(&origin->lock);
 
-    vlc_cond_signal(&avail);
+    if(size && time)
+        connManager->updateDownloadRate(sourceid, size, time);
 }
 
 bool HTTPChunkBufferedSource::prepare()
@@ -419,17 +481,172 @@ bool HTTPChunkBufferedSource::prepare()
     if(!prepared)
     {
         downloadstart = mdate();
-        return HTTPChunkSource::prepare();
+        const unsigned count = connManager ? connManager->getRangeSplitCount() : 1;
+        if(parent || count < 2)
+            return HTTPChunkSource::prepare();
+        return prepareSplit(count);
+    }
+    return true;
+}
+
+bool HTTPChunkBufferedSource::prepareSplit(unsigned count)
+{
+    const size_t start = bytesRange.isValid() ? bytesRange.getStartByte() : 0;
+    size_t end = bytesRange.isValid() ? bytesRange.getEndByte() : 0;
+
+    /* Request our range only. Unless known, the size will be in the
+     * reply: segments under twice the minimum range size then fit in
+     * our range, and are not split, as if their size was known */
+    size_t length = 2 * SPLIT_MIN_SIZE;
+    if(end)
+    {
+        const size_t total = end - start + 1;
+        const size_t n = std::min((size_t) count, total / SPLIT_MIN_SIZE);
+        if(n < 2)
+            return HTTPChunkSource::prepare();
+        length = (total + n - 1) / n;
+    }
+
+    const BytesRange range = bytesRange;
+    bytesRange = BytesRange(start, start + length - 1);
+    bool b_ret = HTTPChunkSource::prepare();
+    bytesRange = range;
+    if(!b_ret)
+        return false;
+
+    /* Range not honored, or nothing left */
+    if(contentLength != length)
+        return true;
+
+    if(!end)
+    {
+        const size_t total = connection->getTotalLength();
+        if(total <= start + length)
+            return true;
+        end = total - 1;
+    }
+
+    if(!createParts(start + length, end, count - 1))
+        return false;
+
+    splitpending = parts.size() + 1;
+    splitstart = downloadstart;
+    return true;
+}
+
+bool HTTPChunkBufferedSource::createParts(size_t start, size_t end, size_t count)
+{
+    const size_t total = end - start + 1;
+    count = std::max((size_t) 1, std::min(count, total / SPLIT_MIN_SIZE));
+    const size_t length = (total + count - 1) / count;
+
+    for(size_t pos = start; pos <= end; pos += length)
+    {
+        HTTPChunkBufferedSource *part =
+                new (std::nothrow) HTTPChunkBufferedSource(params.getUrl(), connManager,
+                                                           sourceid, usesAccess());
+        if(!part)
+        {
+            std::vector<HTTPChunkBufferedSource *>::const_iterator it;
+            for(it = parts.begin(); it != parts.end(); ++it)
+                delete *it;
+            parts.clear();
+            return false;
+        }
+        part->parent = this;
+        part->setBytesRange(BytesRange(pos, std::min(end, pos + length - 1)));
+        parts.push_back(part);
     }
+
     return true;
 }
 
+HTTPChunkBufferedSource * HTTPChunkBufferedSource::retryPart(HTTPChunkBufferedSource *part)
+{
+    size_t received;
+    vlc_mutex_lock(&part->lock);
+    received = part->consumed;
+    vlc_mutex_unlock(&part->lock);
+
+    const size_t start = part->bytesRange.getStartByte();
+    const size_t end = part->bytesRange.getEndByte();
+    if(start + received > end)
+        return NULL; /* complete */
+
+    if(part->retries >= SPLIT_MAX_RETRIES)
+        return part;
+
+    /* Request what is missing only, the start was already moved */
+    HTTPChunkBufferedSource *retry =
+            new (std::nothrow) HTTPChunkBufferedSource(params.getUrl(), connManager,
+                                                       sourceid, usesAccess());
+    if(!retry)
+        return part;
+    retry->parent = this;
+    retry->retries = part->retries + 1;
+    retry->setBytesRange(BytesRange(start + received, end));
+
+    vlc_mutex_lock(&lock);
+    if(splitpending)
+        splitpending++;
+    vlc_mutex_unlock(&lock);
+
+    connManager->start(retry);
+    return retry;
+}
+
+void HTTPChunkBufferedSource::pullParts(size_t readsize)
+{
+    while(done && buffered < readsize && partsread < parts.size())
+    {
+        HTTPChunkBufferedSource *part = parts[partsread];
+        vlc_mutex_unlock(&lock);
+        block_t *p_block = part->readBlock();
+        if(p_block == NULL || p_block->i_buffer == 0)
+        {
+            if(p_block)
+                block_Release(p_block);
+
+            /* A range that failed or was cut must not be skipped over:
+             * its data is requested again, or the segment ends there. */
+            HTTPChunkBufferedSource *retry = retryPart(part);
+            vlc_mutex_lock(&lock);
+            if(retry == part)
+            {
+                requeststatus = RequestStatus::GenericError;
+                partsread = parts.size();
+                break;
+            }
+            if(retry)
+            {
+                parts[partsread] = retry;
+                vlc_mutex_unlock(&lock);
+                delete part;
+                vlc_mutex_lock(&lock);
+            }
+            else
+                partsread++;
+            continue;
+        }
+        vlc_mutex_lock(&lock);
+        buffered += p_block->i_buffer;
+        block_ChainLastAppend(&pp_tail, p_block);
+    }
+}
+
 bool HTTPChunkBufferedSource::hasMoreData() const
 {
     vlc_mutex_locker locker( &lock );
     return !eof;
 }
 
+bool HTTPChunkBufferedSource::hasAvailableData() const
+{
+    /* received, but not read yet */
+    vlc_mutex_locker locker( &lock );
+    return p_head != NULL;
+}
+
 block_t * HTTPChunkBufferedSource::readBlock()
 {
     block_t *p_block = NULL;
@@ -439,6 +656,8 @@ block_t * HTTPChunkBufferedSource::readBlock()
     while(!p_head && !done)
         vlc_cond_wait(&avail, &lock);
 
+    pullParts(1);
+
     if(!p_head && done)
     {
         if(!eof)
@@ -453,7 +672,7 @@ block_t * HTTPChunkBufferedSource::readBlock()
     if(p_head == NULL)
     {
         pp_tail = &p_head;
-        if(done)
+        if(done && partsread == parts.size())
             eof = true;
     }
     p_block->p_next = NULL;
@@ -471,6 +690,8 @@ block_t * HTTPChunkBufferedSource::read(size_t readsize)
     while(readsize > buffered && !done)
         vlc_cond_wait(&avail, &lock);
 
+    pullParts(readsize);
+
     block_t *p_block = NULL;
     if(!readsize || !buffered || !(p_block = block_Alloc(readsize)) )
     {
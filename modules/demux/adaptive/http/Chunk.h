@@ -50,6 +50,7 @@ namespace adaptive
                 virtual block_t *   readBlock       () = 0;
                 virtual block_t *   read            (size_t) = 0;
                 virtual bool        hasMoreData     () const = 0;
+                virtual bool        hasAvailableData() const; /* without blocking */
                 void                setBytesRange   (const BytesRange &);
                 const BytesRange &  getBytesRange   () const;
                 virtual std::string getContentType  () const;
@@ -71,6 +72,7 @@ namespace adaptive
                 size_t              getBytesRead            () const;
                 uint64_t            getStartByteInFile      () const;
                 bool                isEmpty                 () const;
+                bool                hasAvailableData        () const;
 
                 virtual block_t *   readBlock       ();
                 virtual block_t *   read            (size_t);
@@ -109,10 +111,10 @@ namespace adaptive
                 bool                prepared;
                 bool                eof;
                 ID                  sourceid;
+                ConnectionParams    params;
 
             private:
                 bool init(const std::string &);
-                ConnectionParams    params;
         };
 
         class HTTPChunkBufferedSource : public HTTPChunkSource
@@ -126,6 +128,7 @@ namespace adaptive
                 virtual block_t *  readBlock       (); /* reimpl */
                 virtual block_t *  read            (size_t); /* reimpl */
                 virtual bool       hasMoreData     () const; /* impl */
+                virtual bool       hasAvailableData() const; /* reimpl */
                 void               hold();
                 void               release();
 
@@ -135,6 +138,27 @@ namespace adaptive
                 bool               isDone() const;
 
             private:
+                /* Large segments can be requested as several byte ranges,
+                 * downloaded in parallel by the following parts, and moved
+                 * in order to our buffer once our own range is read */
+                bool               prepareSplit(unsigned);
+                bool               createParts(size_t, size_t, size_t);
+                void               pullParts(size_t);
+                /* NULL once the part range is complete, the part itself if
+                 * it cannot be requested again */
+                HTTPChunkBufferedSource * retryPart(HTTPChunkBufferedSource *);
+                void               downloaded(size_t, mtime_t, bool);
+                std::vector<HTTPChunkBufferedSource *> parts;
+                size_t              partsread;
+                HTTPChunkBufferedSource *parent;
+                unsigned            retries; /* of a failed part range */
+                size_t              splitpending; /* ranges left to download */
+                size_t              splitsize; /* not reported yet */
+                mtime_t             splitstart; /* of the rate period */
+                static const size_t SPLIT_MIN_SIZE = 512 * 1024;
+                static const unsigned SPLIT_MAX_RETRIES = 2;
+                static const mtime_t SPLIT_RATE_PERIOD = CLOCK_FREQ / 4;
+
                 block_t            *p_head; /* read cache buffer */
                 block_t           **pp_tail;
                 size_t              buffered; /* read cache size */
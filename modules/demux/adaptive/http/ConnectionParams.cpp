@@ -32,11 +32,13 @@ using namespace adaptive::http;
 
 ConnectionParams::ConnectionParams()
 {
+    cacheable = false;
 }
 
 ConnectionParams::ConnectionParams(const std::string &uri)
 {
     this->uri = uri;
+    cacheable = false;
     parse();
 }
 
@@ -60,6 +62,11 @@ const std::string & ConnectionParams::getPath() const
     return path;
 }
 
+const std::string & ConnectionParams::getUserInfo() const
+{
+    return userinfo;
+}
+
 void ConnectionParams::setPath(const std::string &path_)
 {
     path = path_;
@@ -88,6 +95,16 @@ bool ConnectionParams::isLocal() const
     return scheme != "http" && scheme != "https";
 }
 
+bool ConnectionParams::isCacheable() const
+{
+    return cacheable;
+}
+
+void ConnectionParams::setCacheable(bool b)
+{
+    cacheable = b;
+}
+
 void ConnectionParams::parse()
 {
     vlc_url_t url_components;
@@ -109,6 +126,12 @@ void ConnectionParams::parse()
                          ((scheme == "https") ? 443 : 80);
     if(url_components.psz_host)
         hostname = url_components.psz_host;
+    if(url_components.psz_username)
+    {
+        userinfo = url_components.psz_username;
+        if(url_components.psz_password)
+            userinfo += std::string(":") + url_components.psz_password;
+    }
 
     vlc_UrlClean(&url_components);
 }
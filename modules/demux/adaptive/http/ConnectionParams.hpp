@@ -59,9 +59,12 @@ namespace adaptive
                 const std::string & getScheme() const;
                 const std::string & getHostname() const;
                 const std::string & getPath() const;
+                const std::string & getUserInfo() const;
                 bool isLocal() const;
                 void setPath(const std::string &);
                 uint16_t getPort() const;
+                bool isCacheable() const;
+                void setCacheable(bool);
 
             private:
                 void parse();
@@ -69,7 +72,9 @@ namespace adaptive
                 std::string scheme;
                 std::string hostname;
                 std::string path;
+                std::string userinfo; /* credentials of the URL */
                 uint16_t port;
+                bool cacheable;
         };
     }
 }
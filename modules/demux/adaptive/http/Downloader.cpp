@@ -26,39 +26,45 @@
 #include <vlc_threads.h>
 #include <vlc_atomic.h>
 
+#include <algorithm>
+
 using namespace adaptive::http;
 
-Downloader::Downloader()
+Downloader::Downloader(unsigned workers)
 {
     vlc_mutex_init(&lock);
     vlc_cond_init(&waitcond);
+    vlc_cond_init(&updatedcond);
     killed = false;
-    thread_handle_valid = false;
+    maxworkers = workers ? workers : 1;
 }
 
 bool Downloader::start()
 {
-    if(!thread_handle_valid &&
-       vlc_clone(&thread_handle, downloaderThread,
-                 static_cast<void *>(this), VLC_THREAD_PRIORITY_INPUT))
+    while(thread_handles.size() < maxworkers)
     {
-        return false;
+        vlc_thread_t thread_handle;
+        if(vlc_clone(&thread_handle, downloaderThread,
+                     static_cast<void *>(this), VLC_THREAD_PRIORITY_INPUT))
+            break;
+        thread_handles.push_back(thread_handle);
     }
-    thread_handle_valid = true;
-    return true;
+    return !thread_handles.empty();
 }
 
 Downloader::~Downloader()
 {
     vlc_mutex_lock( &lock );
     killed = true;
-    vlc_cond_signal(&waitcond);
+    vlc_cond_broadcast(&waitcond);
     vlc_mutex_unlock( &lock );
 
-    if(thread_handle_valid)
-        vlc_join(thread_handle, NULL);
+    std::vector<vlc_thread_t>::const_iterator it;
+    for(it = thread_handles.begin(); it != thread_handles.end(); ++it)
+        vlc_join(*it, NULL);
     vlc_mutex_destroy(&lock);
     vlc_cond_destroy(&waitcond);
+    vlc_cond_destroy(&updatedcond);
 }
 void Downloader::schedule(HTTPChunkBufferedSource *source)
 {
@@ -72,8 +78,16 @@ void Downloader::schedule(HTTPChunkBufferedSource *source)
 void Downloader::cancel(HTTPChunkBufferedSource *source)
 {
     vlc_mutex_lock(&lock);
-    source->release();
     chunks.remove(source);
+    /* wait for the piece being read, if any */
+    if(std::find(downloading.begin(), downloading.end(), source) != downloading.end())
+    {
+        cancelled.push_back(source);
+        while(std::find(downloading.begin(), downloading.end(), source) != downloading.end())
+            vlc_cond_wait(&updatedcond, &lock);
+        cancelled.remove(source);
+    }
+    source->release();
     vlc_mutex_unlock(&lock);
 }
 
@@ -92,27 +106,63 @@ void Downloader::DownloadSource(HTTPChunkBufferedSource *source)
         source->bufferize(HTTPChunkSource::CHUNK_SIZE);
 }
 
+bool Downloader::isDownloading(const ID &id) const
+{
+    std::list<HTTPChunkBufferedSource *>::const_iterator it;
+    for(it = downloading.begin(); it != downloading.end(); ++it)
+        if((*it)->sourceid == id)
+            return true;
+    return false;
+}
+
+bool Downloader::isCancelled(const HTTPChunkBufferedSource *source) const
+{
+    return std::find(cancelled.begin(), cancelled.end(), source) != cancelled.end();
+}
+
+HTTPChunkBufferedSource * Downloader::getNextSource()
+{
+    /* Oldest source of a stream not being downloaded,
+     * or range of a split source */
+    std::list<HTTPChunkBufferedSource *>::iterator it;
+    for(it = chunks.begin(); it != chunks.end(); ++it)
+    {
+        HTTPChunkBufferedSource *source = *it;
+        if(source->parent || !isDownloading(source->sourceid))
+        {
+            chunks.erase(it);
+            return source;
+        }
+    }
+    return NULL;
+}
+
 void Downloader::Run()
 {
     vlc_mutex_lock(&lock);
     while(1)
     {
-        while(chunks.empty() && !killed)
+        HTTPChunkBufferedSource *source = NULL;
+        while(!killed && (source = getNextSource()) == NULL)
             vlc_cond_wait(&waitcond, &lock);
 
         if(killed)
             break;
 
-        if(!chunks.empty())
+        downloading.push_back(source);
+        do
         {
-            HTTPChunkBufferedSource *source = chunks.front();
+            vlc_mutex_unlock(&lock);
             DownloadSource(source);
-            if(source->isDone())
-            {
-                chunks.pop_front();
-                source->release();
-            }
-        }
+            vlc_mutex_lock(&lock);
+        } while(!killed && !source->isDone() && !isCancelled(source));
+
+        downloading.remove(source);
+        if(source->isDone())
+            source->release();
+        vlc_cond_broadcast(&updatedcond);
+        /* next source of that stream */
+        vlc_cond_signal(&waitcond);
     }
     vlc_mutex_unlock(&lock);
 }
@@ -24,6 +24,7 @@
 
 #include <vlc_common.h>
 #include <list>
+#include <vector>
 
 namespace adaptive
 {
@@ -31,25 +32,37 @@ namespace adaptive
     namespace http
     {
 
+        /* Downloads the scheduled sources from a pool of threads. Sources of
+         * a same stream are downloaded one after the other, in scheduling
+         * order, while the streams and the ranges of a split source are
+         * downloaded concurrently. */
         class Downloader
         {
             public:
-                Downloader();
+                Downloader(unsigned = DEFAULT_WORKERS);
                 ~Downloader();
                 bool start();
                 void schedule(HTTPChunkBufferedSource *);
                 void cancel(HTTPChunkBufferedSource *);
 
+                static const unsigned DEFAULT_WORKERS = 4;
+
             private:
                 static void * downloaderThread(void *);
                 void Run();
                 void DownloadSource(HTTPChunkBufferedSource *);
-                vlc_thread_t thread_handle;
+                HTTPChunkBufferedSource * getNextSource();
+                bool isDownloading(const ID &) const;
+                bool isCancelled(const HTTPChunkBufferedSource *) const;
+                std::vector<vlc_thread_t> thread_handles;
+                unsigned     maxworkers;
                 vlc_mutex_t  lock;
                 vlc_cond_t   waitcond;
-                bool         thread_handle_valid;
+                vlc_cond_t   updatedcond;
                 bool         killed;
                 std::list<HTTPChunkBufferedSource *> chunks;
+                std::list<HTTPChunkBufferedSource *> downloading;
+                std::list<HTTPChunkBufferedSource *> cancelled;
         };
 
     }
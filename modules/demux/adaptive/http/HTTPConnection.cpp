@@ -39,6 +39,8 @@ AbstractConnection::AbstractConnection(vlc_object_t *p_object_)
     available = true;
     bytesRead = 0;
     contentLength = 0;
+    totalLength = 0;
+    cacheLifetime = -1;
 }
 
 AbstractConnection::~AbstractConnection()
@@ -60,6 +62,16 @@ size_t AbstractConnection::getContentLength() const
     return contentLength;
 }
 
+size_t AbstractConnection::getTotalLength() const
+{
+    return totalLength;
+}
+
+int AbstractConnection::getCacheLifetime() const
+{
+    return cacheLifetime;
+}
+
 const std::string & AbstractConnection::getContentType() const
 {
     return contentType;
@@ -130,6 +142,7 @@ void HTTPConnection::disconnect()
     queryOk = false;
     bytesRead = 0;
     contentLength = 0;
+    totalLength = 0;
     chunked = false;
     chunkLength = 0;
     bytesRange = BytesRange();
@@ -144,6 +157,8 @@ enum RequestStatus
     chunked = false;
     chunked_eof = false;
     chunkLength = 0;
+    totalLength = 0;
+    cacheLifetime = -1;
 
     /* Set new path for this query */
     params.setPath(path);
@@ -208,8 +223,10 @@ enum RequestStatus
 
 ssize_t HTTPConnection::read(void *p_buffer, size_t len)
 {
-    if( !connected() ||
-       (!queryOk && bytesRead == 0) )
+    if( !connected() )
+        return (bytesRead) ? 0 : VLC_EGENERIC; /* EOF after a short read */
+
+    if( !queryOk && bytesRead == 0 )
         return VLC_EGENERIC;
 
     if(len == 0)
@@ -229,7 +246,8 @@ ssize_t HTTPConnection::read(void *p_buffer, size_t len)
     if(ret >= 0)
         bytesRead += ret;
 
-    if(ret < 0 || (size_t)ret < len || /* set EOF */
+    if(ret < 0 || /* set EOF */
+       ((size_t)ret < len && (!chunked || chunked_eof || ret == 0)) ||
        (contentLength == bytesRead && connectionClose))
     {
         transport->disconnect();
@@ -351,6 +369,10 @@ ssize_t HTTPConnection::readChunk(void *p_buffer, size_t len)
             ssize_t in = transport->read(&crlf, 2);
             if(in < 2 || memcmp(crlf, "\r\n", 2))
                 return (copied == 0) ? -1 : copied;
+            /* Don't wait for the next chunk to be sent: low latency
+             * servers push each CMAF chunk as soon as it is encoded */
+            if(copied > 0)
+                break;
         }
     }
 
@@ -372,6 +394,7 @@ void HTTPConnection::setUsed( bool b )
             queryOk = false;
             bytesRead = 0;
             contentLength = 0;
+            totalLength = 0;
             bytesRange = BytesRange();
         }
         else  /* We can't resend request if we haven't finished reading */
@@ -390,6 +413,45 @@ void HTTPConnection::onHeader(const std::string &key,
         ss >> length;
         contentLength = length;
     }
+    else if(Helper::icaseEquals(key, "Content-Range"))
+    {
+        /* bytes first-last/total */
+        std::string::size_type pos = value.rfind('/');
+        if(pos != std::string::npos)
+        {
+            std::istringstream ss(value.substr(pos + 1));
+            ss.imbue(std::locale("C"));
+            size_t length;
+            if(ss >> length)
+                totalLength = length;
+        }
+    }
+    else if(Helper::icaseEquals(key, "Cache-Control"))
+    {
+        /* We are a shared cache, without revalidation */
+        int maxage = -1, smaxage = -1;
+        bool nocache = false;
+        std::list<std::string> directives = Helper::tokenize(value, ',');
+        std::list<std::string>::iterator it;
+        for(it = directives.begin(); it != directives.end(); ++it)
+        {
+            std::string directive = *it;
+            directive.erase(0, directive.find_first_not_of(' '));
+            std::istringstream ss(directive.substr(directive.find('=') + 1));
+            ss.imbue(std::locale("C"));
+            if(Helper::icaseEquals(directive, "no-store") ||
+               Helper::icaseEquals(directive, "no-cache"))
+                nocache = true;
+            else if(directive.compare(0, 8, "max-age=") == 0)
+                ss >> maxage;
+            else if(directive.compare(0, 9, "s-maxage=") == 0)
+                ss >> smaxage;
+        }
+        if(nocache)
+            cacheLifetime = 0;
+        else
+            cacheLifetime = (smaxage >= 0) ? smaxage : maxage;
+    }
     else if (Helper::icaseEquals(key, "Connection") &&
              Helper::icaseEquals(value, "close"))
     {
@@ -488,6 +550,7 @@ void StreamUrlConnection::reset()
     p_streamurl = NULL;
     bytesRead = 0;
     contentLength = 0;
+    totalLength = 0;
     contentType = std::string();
     bytesRange = BytesRange();
 }
@@ -537,6 +600,7 @@ enum RequestStatus
     int64_t i_size = stream_Size(p_streamurl);
     if(i_size > -1)
     {
+        totalLength = (size_t) i_size;
         if(!range.isValid() || contentLength > (size_t) i_size)
             contentLength = (size_t) i_size;
     }
@@ -562,7 +626,7 @@ ssize_t StreamUrlConnection::read(void *p_buffer, size_t len)
     if(ret >= 0)
         bytesRead += ret;
 
-    if(ret < 0 || (size_t)ret < len || /* set EOF */
+    if(ret <= 0 || /* set EOF */
        contentLength == bytesRead )
     {
         reset();
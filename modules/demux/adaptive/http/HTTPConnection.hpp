@@ -51,6 +51,8 @@ namespace adaptive
                 virtual ssize_t read        (void *p_buffer, size_t len) = 0;
 
                 virtual size_t  getContentLength() const;
+                virtual size_t  getTotalLength() const; /* 0 if unknown */
+                virtual int     getCacheLifetime() const; /* seconds, -1 if unknown */
                 virtual const std::string & getContentType() const;
                 virtual void    setUsed( bool ) = 0;
 
@@ -59,6 +61,8 @@ namespace adaptive
                 ConnectionParams   params;
                 bool               available;
                 size_t             contentLength;
+                size_t             totalLength;
+                int                cacheLifetime;
                 std::string        contentType;
                 BytesRange         bytesRange;
                 size_t             bytesRead;
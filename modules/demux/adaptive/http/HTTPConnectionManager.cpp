@@ -30,6 +30,7 @@
 #include "ConnectionParams.hpp"
 #include "Transport.hpp"
 #include "Downloader.hpp"
+#include "SegmentCache.hpp"
 #include <vlc_url.h>
 #include <vlc_http.h>
 
@@ -40,6 +41,7 @@ AbstractConnectionManager::AbstractConnectionManager(vlc_object_t *p_object_)
 {
     p_object = p_object_;
     rateObserver = NULL;
+    rangeSplitCount = 1;
 }
 
 AbstractConnectionManager::~AbstractConnectionManager()
@@ -58,6 +60,11 @@ void AbstractConnectionManager::setDownloadRateObserver(IDownloadRateObserver *o
     rateObserver = obs;
 }
 
+unsigned AbstractConnectionManager::getRangeSplitCount() const
+{
+    return rangeSplitCount;
+}
+
 
 HTTPConnectionManager::HTTPConnectionManager    (vlc_object_t *p_object_, AuthStorage *storage)
     : AbstractConnectionManager( p_object_ ),
@@ -66,7 +73,13 @@ HTTPConnectionManager::HTTPConnectionManager    (vlc_object_t *p_object_, AuthSt
     vlc_mutex_init(&lock);
     downloader = new (std::nothrow) Downloader();
     downloader->start();
+    /* more ranges than workers would not be downloaded in parallel */
+    int64_t i_split = var_InheritInteger(p_object, "adaptive-range-split");
+    if(i_split > 1)
+        rangeSplitCount = __MIN(i_split, Downloader::DEFAULT_WORKERS);
     factory = new ConnectionFactory(storage);
+    authStorage = storage;
+    cache = SegmentCache::acquire(p_object);
 }
 
 HTTPConnectionManager::~HTTPConnectionManager   ()
@@ -74,6 +87,8 @@ HTTPConnectionManager::~HTTPConnectionManager   ()
     delete downloader;
     delete factory;
     this->closeAllConnections();
+    if(cache)
+        SegmentCache::release(p_object, cache);
     vlc_mutex_destroy(&lock);
 }
 
@@ -94,10 +109,13 @@ void HTTPConnectionManager::releaseAllConnections()
 
 AbstractConnection * HTTPConnectionManager::reuseConnection(ConnectionParams &params)
 {
+    const bool b_cached = cache && params.isCacheable();
     std::vector<AbstractConnection *>::const_iterator it;
     for(it = connectionPool.begin(); it != connectionPool.end(); ++it)
     {
         AbstractConnection *conn = *it;
+        if(b_cached != (dynamic_cast<CachedConnection *>(conn) != NULL))
+            continue;
         if(conn->canReuse(params))
             return conn;
     }
@@ -121,7 +139,11 @@ AbstractConnection * HTTPConnectionManager::getConnection(ConnectionParams &para
     AbstractConnection *conn = reuseConnection(params);
     if(!conn)
     {
-        conn = factory->createConnection(p_object, params);
+        if(cache && params.isCacheable())
+            conn = new (std::nothrow) CachedConnection(p_object, this, cache,
+                                                       authStorage);
+        else
+            conn = factory->createConnection(p_object, params);
         if(!conn)
         {
             vlc_mutex_unlock(&lock);
@@ -42,6 +42,7 @@ namespace adaptive
         class AuthStorage;
         class Downloader;
         class AbstractChunkSource;
+        class SegmentCache;
 
         class AbstractConnectionManager : public IDownloadRateObserver
         {
@@ -55,9 +56,11 @@ namespace adaptive
 
                 virtual void updateDownloadRate(const ID &, size_t, mtime_t); /* impl */
                 void setDownloadRateObserver(IDownloadRateObserver *);
+                unsigned getRangeSplitCount() const;
 
             protected:
                 vlc_object_t                                       *p_object;
+                unsigned                                            rangeSplitCount;
 
             private:
                 IDownloadRateObserver                              *rateObserver;
@@ -79,6 +82,8 @@ namespace adaptive
             private:
                 void    releaseAllConnections ();
                 Downloader                                         *downloader;
+                SegmentCache                                       *cache;
+                AuthStorage                                        *authStorage;
                 vlc_mutex_t                                         lock;
                 std::vector<AbstractConnection *>                   connectionPool;
                 AbstractConnectionFactory                          *factory;
@@ -0,0 +1,878 @@
+/*
+ * SegmentCache.cpp
+ *****************************************************************************
+ * Copyright (C) 2020 - VideoLAN and VLC Authors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "SegmentCache.hpp"
+#include "HTTPConnectionManager.h"
+#include "ConnectionParams.hpp"
+#include "AuthStorage.hpp"
+#include "../../cachefile.h"
+
+#include <vlc_fs.h>
+#include <vlc_md5.h>
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <ctime>
+#include <sstream>
+#include <vector>
+
+using namespace adaptive::http;
+
+#define SEGMENTCACHE_MAGIC "VLCASC01"
+
+struct SegmentCache::Entry
+{
+    std::string  key;
+    enum
+    {
+        Requesting,
+        Downloading,
+        Complete,
+        Failed,
+        Orphaned, /* its downloader went away, another reader resumes */
+    }            state;
+    enum RequestStatus status;
+    std::string  contentType;
+    size_t       length; /* announced, 0 if unknown */
+    size_t       total;
+    std::vector<uint8_t> data;
+    time_t       expires; /* 0 if not to be kept */
+    unsigned     refs;
+    bool         linked;
+    bool         ondisk;
+};
+
+namespace
+{
+    struct header_t
+    {
+        char     magic[8];
+        int64_t  i_expires;
+        uint64_t i_size;
+        uint64_t i_total;
+        uint32_t i_key;
+        uint32_t i_type;
+    };
+}
+
+static vlc_mutex_t instance_lock = VLC_STATIC_MUTEX;
+static SegmentCache *instance = NULL;
+static unsigned instance_refs = 0;
+
+SegmentCache * SegmentCache::acquire(vlc_object_t *obj)
+{
+    int64_t i_memsize = var_InheritInteger(obj, "adaptive-cache-size");
+    if(i_memsize <= 0)
+        return NULL;
+
+    vlc_mutex_locker locker(&instance_lock);
+    if(instance == NULL)
+    {
+        int64_t i_disksize = var_InheritInteger(obj, "adaptive-cache-disk-size");
+        instance = new (std::nothrow) SegmentCache((size_t) i_memsize << 20,
+                                                   (i_disksize > 0) ? (size_t) i_disksize << 20 : 0);
+        if(instance == NULL)
+            return NULL;
+        msg_Dbg(obj, "segment cache of %" PRId64 " MiB, %" PRId64 " MiB on disk",
+                i_memsize, (i_disksize > 0) ? i_disksize : 0);
+    }
+    instance_refs++;
+    return instance;
+}
+
+void SegmentCache::release(vlc_object_t *obj, SegmentCache *cache)
+{
+    vlc_mutex_locker locker(&instance_lock);
+    assert(cache == instance);
+
+    vlc_mutex_lock(&cache->lock);
+    msg_Dbg(obj, "segment cache: %u hits, %u coalesced, %u misses",
+            cache->hits, cache->coalesced, cache->misses);
+    vlc_mutex_unlock(&cache->lock);
+
+    if(--instance_refs == 0)
+    {
+        delete instance;
+        instance = NULL;
+    }
+}
+
+SegmentCache::SegmentCache(size_t memsize_, size_t disksize_)
+{
+    vlc_mutex_init(&lock);
+    vlc_cond_init(&cond);
+    vlc_mutex_init(&disklock);
+    memused = 0;
+    memsize = memsize_;
+    disksize = disksize_;
+    diskused = 0;
+    diskscanned = false;
+    hits = coalesced = misses = 0;
+
+    char *psz_dir = disksize ? cachefile_GetDir("adaptive") : NULL;
+    if(psz_dir)
+    {
+        dir = psz_dir;
+        free(psz_dir);
+    }
+}
+
+SegmentCache::~SegmentCache()
+{
+    std::list<Entry *>::const_iterator it;
+    for(it = lru.begin(); it != lru.end(); ++it)
+        delete *it;
+    vlc_mutex_destroy(&disklock);
+    vlc_cond_destroy(&cond);
+    vlc_mutex_destroy(&lock);
+}
+
+SegmentCache::Entry * SegmentCache::find(const std::string &key)
+{
+    std::map<std::string, Entry *>::const_iterator it = entries.find(key);
+    if(it == entries.end())
+        return NULL;
+
+    Entry *entry = it->second;
+    if(entry->state == Entry::Complete && entry->expires <= time(NULL))
+    {
+        unlink(entry);
+        return NULL;
+    }
+    return entry;
+}
+
+SegmentCache::Entry * SegmentCache::get(const std::string &key, bool *download)
+{
+    vlc_mutex_locker locker(&lock);
+
+    Entry *entry = find(key);
+    if(entry == NULL && !dir.empty())
+    {
+        /* do not block the other sessions while reading the disk */
+        vlc_mutex_unlock(&lock);
+        Entry *loaded = load(key);
+        vlc_mutex_lock(&lock);
+
+        entry = find(key);
+        if(entry == NULL && loaded != NULL)
+        {
+            entry = loaded;
+            entries[key] = entry;
+            lru.push_front(entry);
+            memused += entry->data.size();
+        }
+        else delete loaded;
+    }
+
+    if(entry)
+    {
+        if(entry->state == Entry::Complete)
+            hits++;
+        else
+            coalesced++;
+        entry->refs++;
+        lru.remove(entry);
+        lru.push_front(entry);
+        *download = false;
+        return entry;
+    }
+
+    entry = new (std::nothrow) Entry;
+    if(entry == NULL)
+        return NULL;
+    entry->key = key;
+    entry->state = Entry::Requesting;
+    entry->status = RequestStatus::Success;
+    entry->length = 0;
+    entry->total = 0;
+    entry->expires = 0;
+    entry->refs = 1;
+    entry->linked = true;
+    entry->ondisk = false;
+    entries[key] = entry;
+    lru.push_front(entry);
+    misses++;
+    *download = true;
+    return entry;
+}
+
+void SegmentCache::put(Entry *entry)
+{
+    std::vector<Entry *> spilled;
+
+    vlc_mutex_lock(&lock);
+    if(--entry->refs == 0 && entry->state == Entry::Orphaned)
+    {
+        /* nobody is left to resume it */
+        entry->state = Entry::Failed;
+        if(entry->linked)
+            unlink(entry);
+        else
+            destroy(entry);
+    }
+    else if(entry->refs == 0 && !entry->linked)
+        destroy(entry);
+    else
+        evict(&spilled);
+    vlc_mutex_unlock(&lock);
+
+    flush(spilled);
+}
+
+void SegmentCache::setHeaders(Entry *entry, enum RequestStatus status, size_t length,
+                              size_t total, const std::string &type, int lifetime)
+{
+    vlc_mutex_locker locker(&lock);
+    entry->status = status;
+    if(status == RequestStatus::Success)
+    {
+        entry->state = Entry::Downloading;
+        entry->length = length;
+        entry->total = total;
+        entry->contentType = type;
+        if(lifetime < 0)
+            lifetime = DEFAULT_LIFETIME;
+        entry->expires = lifetime ? time(NULL) + lifetime : 0;
+        if(length && length <= memsize)
+        {
+            try
+            {
+                entry->data.reserve(length);
+            } catch(...) {}
+        }
+    }
+    else
+    {
+        entry->state = Entry::Failed;
+        if(entry->linked)
+            unlink(entry);
+    }
+    vlc_cond_broadcast(&cond);
+}
+
+void SegmentCache::append(Entry *entry, const void *p_buffer, size_t len)
+{
+    std::vector<Entry *> spilled;
+
+    vlc_mutex_lock(&lock);
+    if(entry->state != Entry::Downloading)
+    {
+        vlc_mutex_unlock(&lock);
+        return;
+    }
+
+    try
+    {
+        const uint8_t *p = static_cast<const uint8_t *>(p_buffer);
+        entry->data.insert(entry->data.end(), p, p + len);
+        memused += len;
+    } catch(...) {
+        entry->state = Entry::Failed;
+        if(entry->linked)
+            unlink(entry);
+    }
+
+    /* downloads count against the memory budget too */
+    evict(&spilled);
+    if(memused > memsize && entry->state == Entry::Downloading)
+    {
+        /* it does not fit: keep it only for the current readers */
+        if(entry->linked)
+        {
+            entries.erase(entry->key);
+            lru.remove(entry);
+            entry->linked = false;
+        }
+        if(entry->refs == 1)
+        {
+            /* its downloader reads the source directly */
+            memused -= entry->data.size();
+            std::vector<uint8_t>().swap(entry->data);
+            entry->state = Entry::Failed;
+        }
+    }
+    vlc_cond_broadcast(&cond);
+    vlc_mutex_unlock(&lock);
+
+    flush(spilled);
+}
+
+void SegmentCache::complete(Entry *entry, bool b_success)
+{
+    vlc_mutex_locker locker(&lock);
+    if(entry->state != Entry::Downloading)
+        return;
+
+    entry->state = b_success ? Entry::Complete : Entry::Failed;
+    if(entry->linked && (!b_success || !entry->expires))
+        unlink(entry);
+    vlc_cond_broadcast(&cond);
+}
+
+void SegmentCache::store(Entry *entry)
+{
+    vlc_mutex_lock(&lock);
+    /* the data of a complete entry does not change anymore */
+    const bool b_store = !dir.empty() && entry->state == Entry::Complete &&
+                         entry->linked && !entry->ondisk &&
+                         entry->expires > time(NULL);
+    if(b_store)
+        entry->ondisk = true;
+    vlc_mutex_unlock(&lock);
+
+    if(b_store && !spill(entry))
+    {
+        vlc_mutex_lock(&lock);
+        entry->ondisk = false; /* written on eviction instead */
+        vlc_mutex_unlock(&lock);
+    }
+}
+
+void SegmentCache::abandon(Entry *entry)
+{
+    vlc_mutex_locker locker(&lock);
+    if(entry->state != Entry::Downloading)
+        return;
+
+    /* Another session's seek or close must not cut our readers */
+    if(entry->refs > 1)
+        entry->state = Entry::Orphaned;
+    else
+    {
+        entry->state = Entry::Failed;
+        if(entry->linked)
+            unlink(entry);
+    }
+    vlc_cond_broadcast(&cond);
+}
+
+enum RequestStatus SegmentCache::waitHeaders(Entry *entry, size_t *length, size_t *total,
+                                             std::string *type)
+{
+    vlc_mutex_locker locker(&lock);
+    while(entry->state == Entry::Requesting)
+        vlc_cond_wait(&cond, &lock);
+
+    /* the download was aborted */
+    if(entry->state == Entry::Failed && entry->status == RequestStatus::Success)
+        return RequestStatus::GenericError;
+
+    *length = entry->length;
+    *total = entry->total;
+    *type = entry->contentType;
+    return entry->status;
+}
+
+ssize_t SegmentCache::read(Entry *entry, size_t offset, void *p_buffer, size_t len,
+                           bool *resume)
+{
+    vlc_mutex_locker locker(&lock);
+    /* hand out what was received so far, as the downloader does */
+    while(entry->state == Entry::Downloading && entry->data.size() <= offset)
+        vlc_cond_wait(&cond, &lock);
+
+    if(offset >= entry->data.size())
+    {
+        if(entry->state == Entry::Orphaned)
+        {
+            /* the first reader at the end takes the download over */
+            entry->state = Entry::Downloading;
+            *resume = true;
+            return -1;
+        }
+        return (entry->state == Entry::Failed) ? -1 : 0;
+    }
+
+    len = std::min(len, entry->data.size() - offset);
+    memcpy(p_buffer, &entry->data[offset], len);
+    return len;
+}
+
+void SegmentCache::unlink(Entry *entry)
+{
+    entries.erase(entry->key);
+    lru.remove(entry);
+    entry->linked = false;
+    if(entry->refs == 0)
+        destroy(entry);
+}
+
+void SegmentCache::destroy(Entry *entry)
+{
+    memused -= entry->data.size();
+    delete entry;
+}
+
+void SegmentCache::evict(std::vector<Entry *> *spilled)
+{
+    if(memused <= memsize)
+        return;
+
+    /* least recently used first */
+    std::vector<Entry *> unused;
+    std::list<Entry *>::const_reverse_iterator it;
+    for(it = lru.rbegin(); it != lru.rend(); ++it)
+        if((*it)->refs == 0 && (*it)->state == Entry::Complete)
+            unused.push_back(*it);
+
+    const time_t now = time(NULL);
+    for(size_t i = 0; i < unused.size() && memused > memsize; i++)
+    {
+        Entry *entry = unused[i];
+        if(!dir.empty() && !entry->ondisk && entry->expires > now)
+        {
+            /* detached, then written by the caller without the lock */
+            entries.erase(entry->key);
+            lru.remove(entry);
+            entry->linked = false;
+            memused -= entry->data.size();
+            spilled->push_back(entry);
+        }
+        else unlink(entry);
+    }
+}
+
+void SegmentCache::flush(const std::vector<Entry *> &spilled)
+{
+    /* the spilled entries are no longer reachable */
+    for(size_t i = 0; i < spilled.size(); i++)
+    {
+        spill(spilled[i]);
+        delete spilled[i];
+    }
+}
+
+std::string SegmentCache::getPath(const std::string &key) const
+{
+    char *psz_path = cachefile_GetPath("adaptive", key.data(), key.size());
+    if(psz_path == NULL)
+        return std::string();
+    std::string path(psz_path);
+    free(psz_path);
+    return path;
+}
+
+bool SegmentCache::spill(const Entry *entry)
+{
+    const std::string path = getPath(entry->key);
+    if(path.empty())
+        return false;
+
+    char *psz_tmp;
+    FILE *file = cachefile_Create(path.c_str(), &psz_tmp);
+    if(file == NULL)
+        return false;
+
+    header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SEGMENTCACHE_MAGIC, 8);
+    hdr.i_expires = entry->expires;
+    hdr.i_size = entry->data.size();
+    hdr.i_total = entry->total;
+    hdr.i_key = entry->key.size();
+    hdr.i_type = entry->contentType.size();
+
+    bool b_error =
+        fwrite(&hdr, sizeof(hdr), 1, file) != 1 ||
+        fwrite(entry->key.data(), 1, hdr.i_key, file) != hdr.i_key ||
+        fwrite(entry->contentType.data(), 1, hdr.i_type, file) != hdr.i_type ||
+        (!entry->data.empty() &&
+         fwrite(&entry->data[0], 1, entry->data.size(), file) != entry->data.size());
+
+    if(cachefile_Commit(file, psz_tmp, path.c_str(), b_error))
+        return false;
+
+    std::vector<std::string> pruned;
+    vlc_mutex_lock(&disklock);
+    if(!diskscanned)
+    {
+        scan();
+        diskscanned = true;
+    }
+    else
+    {
+        /* replaced file */
+        std::list<DiskFile>::iterator it;
+        for(it = diskfiles.begin(); it != diskfiles.end(); ++it)
+        {
+            if((*it).path == path)
+            {
+                diskused -= (*it).size;
+                diskfiles.erase(it);
+                break;
+            }
+        }
+        DiskFile file;
+        file.path = path;
+        file.mtime = time(NULL);
+        file.size = sizeof(hdr) + hdr.i_key + hdr.i_type + hdr.i_size;
+        diskfiles.push_back(file);
+        diskused += file.size;
+    }
+    prune(&pruned);
+    vlc_mutex_unlock(&disklock);
+
+    for(size_t i = 0; i < pruned.size(); i++)
+        vlc_unlink(pruned[i].c_str());
+    return true;
+}
+
+SegmentCache::Entry * SegmentCache::load(const std::string &key) const
+{
+    const std::string path = getPath(key);
+    if(path.empty())
+        return NULL;
+
+    FILE *file = vlc_fopen(path.c_str(), "rb");
+    if(file == NULL)
+        return NULL;
+
+    Entry *entry = NULL;
+    std::string filekey, type;
+    header_t hdr;
+    if(fread(&hdr, sizeof(hdr), 1, file) == 1 &&
+       !memcmp(hdr.magic, SEGMENTCACHE_MAGIC, 8) &&
+       hdr.i_expires > time(NULL) && hdr.i_key == key.size() &&
+       hdr.i_size <= disksize && hdr.i_type < 1024)
+    {
+        filekey.resize(hdr.i_key);
+        type.resize(hdr.i_type);
+        entry = new (std::nothrow) Entry;
+        if(entry)
+        {
+            try
+            {
+                entry->data.resize(hdr.i_size);
+            } catch(...) {
+                delete entry;
+                entry = NULL;
+            }
+        }
+
+        if(entry &&
+           (fread(&filekey[0], 1, hdr.i_key, file) != hdr.i_key || filekey != key ||
+            (hdr.i_type && fread(&type[0], 1, hdr.i_type, file) != hdr.i_type) ||
+            (hdr.i_size && fread(&entry->data[0], 1, hdr.i_size, file) != hdr.i_size)))
+        {
+            delete entry;
+            entry = NULL;
+        }
+    }
+    fclose(file);
+
+    if(entry == NULL)
+        return NULL;
+
+    entry->key = key;
+    entry->state = Entry::Complete;
+    entry->status = RequestStatus::Success;
+    entry->contentType = type;
+    entry->length = entry->data.size();
+    entry->total = hdr.i_total;
+    entry->expires = hdr.i_expires;
+    entry->refs = 0;
+    entry->linked = true;
+    entry->ondisk = true;
+    return entry;
+}
+
+void SegmentCache::scan()
+{
+    /* the files of the previous sessions, sorted once */
+    std::vector<DiskFile> files;
+    DIR *d = vlc_opendir(dir.c_str());
+    if(d != NULL)
+    {
+        const char *psz_name;
+        while((psz_name = vlc_readdir(d)) != NULL)
+        {
+            /* skip the temporary files being written */
+            if(psz_name[0] == '.' || strchr(psz_name, '.') != NULL)
+                continue;
+
+            DiskFile file;
+            file.path = dir + DIR_SEP + psz_name;
+            struct stat st;
+            if(vlc_stat(file.path.c_str(), &st) || !S_ISREG(st.st_mode))
+                continue;
+            file.mtime = st.st_mtime;
+            file.size = st.st_size;
+            files.push_back(file);
+        }
+        closedir(d);
+    }
+
+    /* oldest first */
+    std::sort(files.begin(), files.end());
+    diskfiles.assign(files.begin(), files.end());
+    diskused = 0;
+    for(size_t i = 0; i < files.size(); i++)
+        diskused += files[i].size;
+}
+
+void SegmentCache::prune(std::vector<std::string> *pruned)
+{
+    while(diskused > disksize && !diskfiles.empty())
+    {
+        pruned->push_back(diskfiles.front().path);
+        diskused -= diskfiles.front().size;
+        diskfiles.pop_front();
+    }
+}
+
+CachedConnection::CachedConnection(vlc_object_t *p_object_, AbstractConnectionManager *manager_,
+                                   SegmentCache *cache_, AuthStorage *authStorage_)
+    : AbstractConnection(p_object_)
+{
+    manager = manager_;
+    cache = cache_;
+    authStorage = authStorage_;
+    entry = NULL;
+    source = NULL;
+}
+
+CachedConnection::~CachedConnection()
+{
+    reset();
+}
+
+bool CachedConnection::canReuse(const ConnectionParams &params_) const
+{
+    return available && params_.isCacheable() &&
+           params.usesAccess() == params_.usesAccess() &&
+           params.getHostname() == params_.getHostname() &&
+           params.getUserInfo() == params_.getUserInfo() &&
+           params.getScheme() == params_.getScheme() &&
+           params.getPort() == params_.getPort();
+}
+
+enum RequestStatus
+    CachedConnection::request(const std::string &path, const BytesRange &range)
+{
+    reset();
+
+    params.setPath(path);
+    bytesRange = range;
+
+    std::ostringstream key;
+    key.imbue(std::locale("C"));
+    key << params.getUrl();
+    if(range.isValid())
+        key << "@" << range.getStartByte() << "-" << range.getEndByte();
+
+    /* Responses may depend on the credentials and cookies: they are part of
+     * the key, hashed as the key is stored in the cache files. */
+    std::string cookie;
+    if(authStorage)
+        cookie = authStorage->getCookie(params, params.getScheme() == "https" ||
+                                                params.getPort() == 443);
+    if(!params.getUserInfo().empty() || !cookie.empty())
+    {
+        const std::string auth = params.getUserInfo() + "\n" + cookie;
+        struct md5_s md5;
+        InitMD5(&md5);
+        AddMD5(&md5, auth.data(), auth.size());
+        EndMD5(&md5);
+        char *psz_hash = psz_md5_hash(&md5);
+        if(psz_hash == NULL)
+            return RequestStatus::GenericError;
+        key << "#" << psz_hash;
+        free(psz_hash);
+    }
+
+    enum RequestStatus status = RequestStatus::GenericError;
+    for(int i = 0; i < 2; i++)
+    {
+        bool b_download;
+        entry = cache->get(key.str(), &b_download);
+        if(entry == NULL)
+            return RequestStatus::GenericError;
+
+        if(b_download)
+            return download(range);
+
+        status = cache->waitHeaders(entry, &contentLength, &totalLength, &contentType);
+        if(status != RequestStatus::GenericError)
+            break;
+
+        /* the download we joined failed, retry */
+        cache->put(entry);
+        entry = NULL;
+    }
+
+    if(status != RequestStatus::Success)
+        reset();
+    return status;
+}
+
+enum RequestStatus CachedConnection::download(const BytesRange &range)
+{
+    enum RequestStatus status = openSource(range);
+    if(status == RequestStatus::Success)
+    {
+        contentLength = source->getContentLength();
+        totalLength = source->getTotalLength();
+        contentType = source->getContentType();
+        cache->setHeaders(entry, status, contentLength, totalLength, contentType,
+                          source->getCacheLifetime());
+    }
+    else
+    {
+        cache->setHeaders(entry, status, 0, 0, std::string(), 0);
+        reset();
+    }
+
+    return status;
+}
+
+bool CachedConnection::resume()
+{
+    /* request what is missing from the entry */
+    size_t start = bytesRead;
+    size_t end = 0;
+    if(bytesRange.isValid())
+    {
+        start += bytesRange.getStartByte();
+        end = bytesRange.getEndByte();
+    }
+
+    if(openSource(BytesRange(start, end)) != RequestStatus::Success)
+        return false;
+
+    if(contentLength && source->getContentLength() != contentLength - bytesRead)
+    {
+        /* range not honored */
+        source->setUsed(false);
+        source = NULL;
+        return false;
+    }
+    return true;
+}
+
+enum RequestStatus CachedConnection::openSource(const BytesRange &range)
+{
+    ConnectionParams sourceparams = params;
+    sourceparams.setCacheable(false);
+
+    enum RequestStatus status = RequestStatus::GenericError;
+    unsigned int i_redirects = 0;
+    while(i_redirects++ < HTTPConnection::MAX_REDIRECTS)
+    {
+        source = manager->getConnection(sourceparams);
+        if(source == NULL)
+        {
+            status = RequestStatus::GenericError;
+            break;
+        }
+
+        status = source->request(sourceparams.getPath(), range);
+        if(status != RequestStatus::Redirection)
+            break;
+
+        HTTPConnection *httpconn = dynamic_cast<HTTPConnection *>(source);
+        if(httpconn == NULL)
+            break;
+        sourceparams = httpconn->getRedirection();
+        source->setUsed(false);
+        source = NULL;
+    }
+
+    if(status != RequestStatus::Success && source)
+    {
+        source->setUsed(false);
+        source = NULL;
+    }
+    return status;
+}
+
+ssize_t CachedConnection::read(void *p_buffer, size_t len)
+{
+    if(entry == NULL)
+        return VLC_EGENERIC;
+
+    if(len == 0)
+        return VLC_SUCCESS;
+
+    ssize_t ret = -1;
+    if(source == NULL)
+    {
+        bool b_resume = false;
+        ret = cache->read(entry, bytesRead, p_buffer, len, &b_resume);
+        if(b_resume && !resume())
+            cache->complete(entry, false);
+    }
+
+    if(source)
+    {
+        ret = source->read(p_buffer, len);
+        if(ret > 0)
+            cache->append(entry, p_buffer, ret);
+
+        const bool b_end = (ret >= 0 && contentLength &&
+                            bytesRead + ret == contentLength);
+        if(ret <= 0 || b_end)
+        {
+            const bool b_success = b_end || (ret == 0 && !contentLength);
+            cache->complete(entry, b_success);
+            source->setUsed(false);
+            source = NULL;
+            if(b_success)
+                cache->store(entry);
+        }
+    }
+
+    if(ret > 0)
+        bytesRead += ret;
+    return ret;
+}
+
+void CachedConnection::setUsed( bool b )
+{
+    available = !b;
+    if(available)
+        reset();
+}
+
+void CachedConnection::reset()
+{
+    if(source)
+    {
+        if(entry)
+            cache->abandon(entry);
+        source->setUsed(false);
+        source = NULL;
+    }
+    if(entry)
+    {
+        cache->put(entry);
+        entry = NULL;
+    }
+    bytesRead = 0;
+    contentLength = 0;
+    totalLength = 0;
+    contentType = std::string();
+    bytesRange = BytesRange();
+}
@@ -0,0 +1,148 @@
+/*
+ * SegmentCache.hpp
+ *****************************************************************************
+ * Copyright (C) 2020 - VideoLAN and VLC Authors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifndef SEGMENTCACHE_HPP
+#define SEGMENTCACHE_HPP
+
+#include "HTTPConnection.hpp"
+
+#include <vlc_common.h>
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#include <ctime>
+
+namespace adaptive
+{
+    namespace http
+    {
+        class AbstractConnectionManager;
+        class AuthStorage;
+
+        /* Process wide cache of the downloaded segments, keyed by URL, byte
+         * range and credentials. Completed entries are written to the disk,
+         * where other processes find them too, and the least recently used
+         * ones are dropped from memory. An entry being downloaded is read by
+         * all its requesters as it is received. */
+        class SegmentCache
+        {
+            public:
+                struct Entry;
+
+                static SegmentCache * acquire(vlc_object_t *); /* NULL if disabled */
+                static void release(vlc_object_t *, SegmentCache *);
+
+                /* Gets the entry of key, which the caller has to download
+                 * when download is set */
+                Entry * get(const std::string &, bool *download);
+                void put(Entry *);
+
+                /* downloader side */
+                void setHeaders(Entry *, enum RequestStatus, size_t length, size_t total,
+                                const std::string &, int lifetime);
+                void append(Entry *, const void *, size_t);
+                void complete(Entry *, bool);
+                void store(Entry *); /* writes a complete entry to the disk */
+                void abandon(Entry *); /* before completion */
+
+                /* reader side, which sets resume when it has to continue
+                 * the download of a downloader gone away */
+                enum RequestStatus waitHeaders(Entry *, size_t *length, size_t *total,
+                                               std::string *);
+                ssize_t read(Entry *, size_t offset, void *, size_t, bool *resume);
+
+                static const int DEFAULT_LIFETIME = 3600; /* without cache headers */
+
+            private:
+                struct DiskFile
+                {
+                    std::string path;
+                    time_t      mtime;
+                    uint64_t    size;
+                    bool operator<(const DiskFile &other) const { return mtime < other.mtime; }
+                };
+
+                SegmentCache(size_t, size_t);
+                ~SegmentCache();
+                Entry * find(const std::string &);
+                void unlink(Entry *);
+                void destroy(Entry *);
+                void evict(std::vector<Entry *> *);
+                void flush(const std::vector<Entry *> &);
+                /* disk accesses, done without the lock */
+                bool spill(const Entry *);
+                Entry * load(const std::string &) const;
+                /* disk usage, under disklock */
+                void scan();
+                void prune(std::vector<std::string> *);
+                std::string getPath(const std::string &) const;
+
+                vlc_mutex_t  lock;
+                vlc_cond_t   cond;
+                std::map<std::string, Entry *> entries;
+                std::list<Entry *> lru; /* most recent first */
+                size_t       memused;
+                size_t       memsize;
+                size_t       disksize;
+                std::string  dir;
+                unsigned     hits;
+                unsigned     coalesced;
+                unsigned     misses;
+
+                /* files written by this process, or found on the first write */
+                vlc_mutex_t  disklock;
+                std::list<DiskFile> diskfiles; /* oldest first */
+                uint64_t     diskused;
+                bool         diskscanned;
+        };
+
+        /* Serves cacheable requests from the segment cache, downloading
+         * them with a regular connection on misses */
+        class CachedConnection : public AbstractConnection
+        {
+            public:
+                CachedConnection(vlc_object_t *, AbstractConnectionManager *, SegmentCache *,
+                                 AuthStorage *);
+                virtual ~CachedConnection();
+
+                virtual bool    canReuse     (const ConnectionParams &) const;
+
+                virtual enum RequestStatus
+                                request     (const std::string& path, const BytesRange & = BytesRange());
+                virtual ssize_t read        (void *p_buffer, size_t len);
+
+                virtual void    setUsed( bool );
+
+            protected:
+                enum RequestStatus download(const BytesRange &);
+                enum RequestStatus openSource(const BytesRange &);
+                bool resume();
+                void reset();
+                AbstractConnectionManager *manager;
+                SegmentCache        *cache;
+                AuthStorage         *authStorage;
+                SegmentCache::Entry *entry;
+                AbstractConnection  *source; /* while downloading */
+        };
+    }
+}
+
+#endif // SEGMENTCACHE_HPP
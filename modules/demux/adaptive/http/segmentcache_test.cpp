@@ -0,0 +1,219 @@
+/*****************************************************************************
+ * segmentcache_test.cpp: adaptive segment cache test
+ *****************************************************************************
+ * Copyright (C) 2020 - VideoLAN and VLC Authors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <vlc_common.h>
+#include <vlc_fs.h>
+#include <vlc_variables.h>
+#include "../../../../lib/libvlc_internal.h"
+
+#include "SegmentCache.hpp"
+#include "../../cachefile.h"
+
+using namespace adaptive::http;
+
+const char vlc_module_name[] = "segmentcache_test";
+
+#define SEGMENT_SIZE 100000
+
+static uint8_t pattern(size_t i)
+{
+    return (i * 7) % 253;
+}
+
+static void Download(SegmentCache *cache, SegmentCache::Entry *entry, size_t size)
+{
+    std::vector<uint8_t> buf(size);
+    for(size_t i = 0; i < size; i++)
+        buf[i] = pattern(i);
+
+    cache->setHeaders(entry, RequestStatus::Success, size, size,
+                      "video/mp2t", SegmentCache::DEFAULT_LIFETIME);
+    for(size_t i = 0; i < size; i += 1000)
+        cache->append(entry, &buf[i], std::min<size_t>(1000, size - i));
+    cache->complete(entry, true);
+}
+
+static void ReadAll(SegmentCache *cache, SegmentCache::Entry *entry, size_t size)
+{
+    size_t length, total;
+    std::string type;
+
+    assert(cache->waitHeaders(entry, &length, &total, &type) == RequestStatus::Success);
+    assert(length == size && total == size && type == "video/mp2t");
+
+    size_t offset = 0;
+    uint8_t buf[4096];
+    ssize_t val;
+    bool resume = false;
+    while((val = cache->read(entry, offset, buf, sizeof(buf), &resume)) > 0)
+    {
+        for(ssize_t i = 0; i < val; i++)
+            assert(buf[i] == pattern(offset + i));
+        offset += val;
+    }
+    assert(val == 0 && !resume);
+    assert(offset == size);
+}
+
+struct reader
+{
+    SegmentCache *cache;
+    SegmentCache::Entry *entry;
+};
+
+static void *Reader(void *data)
+{
+    struct reader *r = static_cast<struct reader *>(data);
+    ReadAll(r->cache, r->entry, SEGMENT_SIZE);
+    return NULL;
+}
+
+/* Concurrent requests share a single download */
+static void test_coalesce(vlc_object_t *obj)
+{
+    SegmentCache *cache = SegmentCache::acquire(obj);
+    assert(cache != NULL);
+
+    bool download;
+    SegmentCache::Entry *entry = cache->get("http://host/coalesce.ts", &download);
+    assert(entry != NULL && download);
+
+    struct reader r;
+    vlc_thread_t th;
+    r.cache = cache;
+    r.entry = cache->get("http://host/coalesce.ts", &download);
+    assert(r.entry == entry && !download);
+    assert(vlc_clone(&th, Reader, &r, VLC_THREAD_PRIORITY_LOW) == 0);
+
+    Download(cache, entry, SEGMENT_SIZE);
+    vlc_join(th, NULL);
+    cache->put(r.entry);
+    cache->put(entry);
+
+    /* later requests hit the memory */
+    entry = cache->get("http://host/coalesce.ts", &download);
+    assert(entry != NULL && !download);
+    ReadAll(cache, entry, SEGMENT_SIZE);
+    cache->put(entry);
+
+    SegmentCache::release(obj, cache);
+}
+
+/* Complete segments are written through to the disk, for other processes */
+static void test_disk(vlc_object_t *obj)
+{
+    static const char key[] = "http://host/disk.ts";
+    char *psz_path = cachefile_GetPath("adaptive", key, strlen(key));
+    assert(psz_path != NULL);
+
+    SegmentCache *cache = SegmentCache::acquire(obj);
+    assert(cache != NULL);
+
+    bool download;
+    SegmentCache::Entry *entry = cache->get(key, &download);
+    assert(entry != NULL && download);
+    Download(cache, entry, SEGMENT_SIZE);
+    cache->store(entry);
+
+    /* while still in memory */
+    struct stat st;
+    assert(vlc_stat(psz_path, &st) == 0);
+    assert(st.st_size > SEGMENT_SIZE);
+    cache->put(entry);
+    SegmentCache::release(obj, cache);
+
+    /* a new cache instance stands for another process */
+    cache = SegmentCache::acquire(obj);
+    assert(cache != NULL);
+    entry = cache->get(key, &download);
+    assert(entry != NULL && !download);
+    ReadAll(cache, entry, SEGMENT_SIZE);
+    cache->put(entry);
+    SegmentCache::release(obj, cache);
+
+    vlc_unlink(psz_path);
+    free(psz_path);
+}
+
+/* Downloads beyond the memory budget are not kept */
+static void test_budget(vlc_object_t *obj)
+{
+    static const char key[] = "http://host/huge.ts";
+    const size_t size = (1 << 20) + SEGMENT_SIZE;
+
+    var_SetInteger(obj, "adaptive-cache-disk-size", 0);
+    SegmentCache *cache = SegmentCache::acquire(obj);
+    assert(cache != NULL);
+
+    bool download;
+    SegmentCache::Entry *entry = cache->get(key, &download);
+    assert(entry != NULL && download);
+    Download(cache, entry, size);
+    cache->put(entry);
+
+    entry = cache->get(key, &download);
+    assert(entry != NULL && download);
+    cache->abandon(entry);
+    cache->put(entry);
+
+    SegmentCache::release(obj, cache);
+}
+
+int main(void)
+{
+    char dir[] = "/tmp/vlc-segmentcache-XXXXXX";
+    assert(mkdtemp(dir) != NULL);
+    setenv("XDG_CACHE_HOME", dir, 1);
+    alarm(10);
+
+    libvlc_int_t *vlc = libvlc_InternalCreate();
+    assert(vlc != NULL);
+
+    vlc_object_t *obj = VLC_OBJECT(vlc);
+    obj->obj.flags |= OBJECT_FLAGS_QUIET;
+    var_Create(obj, "adaptive-cache-size", VLC_VAR_INTEGER);
+    var_SetInteger(obj, "adaptive-cache-size", 1); /* MiB */
+    var_Create(obj, "adaptive-cache-disk-size", VLC_VAR_INTEGER);
+    var_SetInteger(obj, "adaptive-cache-disk-size", 16); /* MiB */
+
+    test_coalesce(obj);
+    test_disk(obj);
+    test_budget(obj);
+
+    libvlc_InternalDestroy(vlc);
+
+    std::string cachedir = std::string(dir) + "/vlc/adaptive";
+    rmdir(cachedir.c_str());
+    rmdir((std::string(dir) + "/vlc").c_str());
+    rmdir(dir);
+    return 0;
+}
@@ -47,6 +47,7 @@ AbstractBufferingLogic::AbstractBufferingLogic()
     userMinBuffering = 0;
     userMaxBuffering = 0;
     userLiveDelay = 0;
+    userLowLatencyDelay = 0;
 }
 
 void AbstractBufferingLogic::setLowDelay(bool b)
@@ -69,6 +70,11 @@ void AbstractBufferingLogic::setUserLiveDelay(mtime_t v)
     userLiveDelay = v;
 }
 
+void AbstractBufferingLogic::setUserLowLatencyDelay(mtime_t v)
+{
+    userLowLatencyDelay = v;
+}
+
 DefaultBufferingLogic::DefaultBufferingLogic()
     : AbstractBufferingLogic()
 {
@@ -103,7 +109,8 @@ uint64_t DefaultBufferingLogic::getStartSegmentNumber(BaseRepresentation *rep) c
 mtime_t DefaultBufferingLogic::getMinBuffering(const AbstractPlaylist *p) const
 {
     if(isLowLatency(p))
-        return BUFFERING_LOWEST_LIMIT;
+        return userLowLatencyDelay ? userLowLatencyDelay
+                                   : BUFFERING_LOWEST_LIMIT;
 
     mtime_t buffering = userMinBuffering ? userMinBuffering
                                          : DEFAULT_MIN_BUFFERING;
@@ -114,8 +121,8 @@ mtime_t DefaultBufferingLogic::getMinBuffering(const AbstractPlaylist *p) const
 
 mtime_t DefaultBufferingLogic::getMaxBuffering(const AbstractPlaylist *p) const
 {
-    if(isLowLatency(p))
-        return getMinBuffering(p);
+    if(isLowLatency(p)) /* headroom to detect the late playback */
+        return getMinBuffering(p) * 2;
 
     mtime_t buffering = userMaxBuffering ? userMaxBuffering
                                          : DEFAULT_MAX_BUFFERING;
@@ -46,9 +46,11 @@ namespace adaptive
                 virtual mtime_t getMinBuffering(const AbstractPlaylist *) const = 0;
                 virtual mtime_t getMaxBuffering(const AbstractPlaylist *) const = 0;
                 virtual mtime_t getLiveDelay(const AbstractPlaylist *) const = 0;
+                virtual bool isLowLatency(const AbstractPlaylist *) const = 0;
                 void setUserMinBuffering(mtime_t);
                 void setUserMaxBuffering(mtime_t);
                 void setUserLiveDelay(mtime_t);
+                void setUserLowLatencyDelay(mtime_t);
                 void setLowDelay(bool);
                 static const mtime_t BUFFERING_LOWEST_LIMIT;
                 static const mtime_t DEFAULT_MIN_BUFFERING;
@@ -59,6 +61,7 @@ namespace adaptive
                 mtime_t userMinBuffering;
                 mtime_t userMaxBuffering;
                 mtime_t userLiveDelay;
+                mtime_t userLowLatencyDelay;
                 Undef<bool> userLowLatency;
         };
 
@@ -71,11 +74,11 @@ namespace adaptive
                 virtual mtime_t getMinBuffering(const AbstractPlaylist *) const; /* impl */
                 virtual mtime_t getMaxBuffering(const AbstractPlaylist *) const; /* impl */
                 virtual mtime_t getLiveDelay(const AbstractPlaylist *) const; /* impl */
+                virtual bool isLowLatency(const AbstractPlaylist *) const; /* impl */
 
             protected:
                 mtime_t getBufferingOffset(const AbstractPlaylist *) const;
                 uint64_t getLiveStartSegmentNumber(BaseRepresentation *) const;
-                bool isLowLatency(const AbstractPlaylist *) const;
         };
     }
 }
@@ -59,6 +59,7 @@ void SegmentInformation::init()
     segmentBase = NULL;
     segmentList = NULL;
     mediaSegmentTemplate = NULL;
+    updatecount = 0;
 }
 
 SegmentInformation::~SegmentInformation()
@@ -449,6 +450,7 @@ void SegmentInformation::updateWith(SegmentInformation *updated)
             child->updateWith(updatedChild);
     }
     /* FIXME: handle difference */
+    updatecount++;
 }
 
 void SegmentInformation::mergeWithTimeline(SegmentTimeline *updated)
@@ -460,6 +462,7 @@ void SegmentInformation::mergeWithTimeline(SegmentTimeline *updated)
         if(timeline)
             timeline->updateWith(*updated);
     }
+    updatecount++;
 }
 
 void SegmentInformation::pruneByPlaybackTime(mtime_t time)
@@ -501,6 +504,11 @@ const CommonEncryption & SegmentInformation::intheritEncryption() const
     return commonEncryption;
 }
 
+unsigned SegmentInformation::getUpdateCount() const
+{
+    return updatecount;
+}
+
 void SegmentInformation::setEncryption(const CommonEncryption &enc)
 {
     commonEncryption = enc;
@@ -526,6 +534,7 @@ void SegmentInformation::updateSegmentList(SegmentList *list, bool restamp)
         delete segmentList;
         segmentList = list;
     }
+    updatecount++;
 }
 
 void SegmentInformation::setSegmentBase(SegmentBase *base)
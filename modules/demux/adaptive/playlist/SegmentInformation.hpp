@@ -83,6 +83,7 @@ namespace adaptive
                 virtual uint64_t translateSegmentNumber(uint64_t, const SegmentInformation *) const;
                 void setEncryption(const CommonEncryption &);
                 const CommonEncryption & intheritEncryption() const;
+                unsigned getUpdateCount() const; /* of the segments */
 
             protected:
                 std::size_t getAllSegments(std::vector<ISegment *> &) const;
@@ -113,6 +114,7 @@ namespace adaptive
                 CommonEncryption commonEncryption;
                 Undef<bool>      availabilityTimeComplete;
                 Undef<mtime_t>   availabilityTimeOffset;
+                unsigned         updatecount;
         };
     }
 }
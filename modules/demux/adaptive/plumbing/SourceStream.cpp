@@ -134,6 +134,11 @@ void ChunksSourceStream::Reset()
     AbstractChunksSourceStream::Reset();
 }
 
+bool ChunksSourceStream::hasAvailableData() const
+{
+    return p_block && p_block->i_buffer;
+}
+
 std::string ChunksSourceStream::getContentType()
 {
     if(!b_eof && !p_block)
@@ -219,6 +224,11 @@ void BufferedChunksSourceStream::Reset()
     AbstractChunksSourceStream::Reset();
 }
 
+bool BufferedChunksSourceStream::hasAvailableData() const
+{
+    return block_BytestreamRemaining(&bs) > i_bytestream_offset;
+}
+
 ssize_t BufferedChunksSourceStream::Read(uint8_t *buf, size_t size)
 {
     size_t i_copied = 0;
@@ -36,6 +36,7 @@ namespace adaptive
             virtual stream_t *makeStream() = 0;
             virtual void Reset() = 0;
             virtual size_t Peek(const uint8_t **, size_t) = 0;
+            virtual bool hasAvailableData() const = 0; /* not read by the demuxer yet */
     };
 
     class AbstractChunksSourceStream : public AbstractSourceStream
@@ -67,6 +68,7 @@ namespace adaptive
             ChunksSourceStream(vlc_object_t *, AbstractSource *);
             virtual ~ChunksSourceStream();
             virtual void Reset(); /* reimpl */
+            virtual bool hasAvailableData() const; /* impl */
 
         protected:
             virtual ssize_t Read(uint8_t *, size_t); /* impl */
@@ -84,6 +86,7 @@ namespace adaptive
             BufferedChunksSourceStream(vlc_object_t *, AbstractSource *);
             virtual ~BufferedChunksSourceStream();
             virtual void Reset(); /* reimpl */
+            virtual bool hasAvailableData() const; /* impl */
 
         protected:
             virtual ssize_t Read(uint8_t *, size_t); /* impl */
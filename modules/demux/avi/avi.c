@@ -37,7 +37,11 @@
 #include <vlc_demux.h>
 #include <vlc_input.h>
 
+#include <vlc_atomic.h>
 #include <vlc_dialog.h>
+#include <vlc_fs.h>
+#include <vlc_interrupt.h>
+#include <vlc_md5.h>
 
 #include <vlc_meta.h>
 #include <vlc_codecs.h>
@@ -46,6 +50,7 @@
 
 #include "libavi.h"
 #include "../rawdv.h"
+#include "../cachefile.h"
 
 /*****************************************************************************
  * Module descriptor
@@ -58,6 +63,11 @@
     "Recreate a index for the AVI file. Use this if your AVI file is damaged "\
     "or incomplete (not seekable)." )
 
+#define INDEX_CACHE_TEXT N_("Keep rebuilt indexes")
+#define INDEX_CACHE_LONGTEXT N_( \
+    "Store the indexes rebuilt for broken or incomplete files in the cache " \
+    "directory, so that they are not scanned again when played next time." )
+
 static int  Open ( vlc_object_t * );
 static void Close( vlc_object_t * );
 
@@ -80,6 +90,8 @@ vlc_module_begin ()
     add_integer( "avi-index", 0,
               INDEX_TEXT, INDEX_LONGTEXT, false )
         change_integer_list( pi_index, ppsz_indexes )
+    add_bool( "avi-index-cache", false,
+              INDEX_CACHE_TEXT, INDEX_CACHE_LONGTEXT, true )
 
     set_callbacks( Open, Close )
 vlc_module_end ()
@@ -138,6 +150,35 @@ static void avi_index_Init( avi_index_t * );
 static void avi_index_Clean( avi_index_t * );
 static void avi_index_Append( avi_index_t *, uint64_t *, avi_entry_t * );
 
+/* Rebuilds the index of a fast seekable file from a thread reading the
+ * stream through its own handle. The demuxer takes the new entries as they
+ * come, so that playback starts before the whole file is scanned.
+ * Without a URL to open the stream again, the index is built at opening. */
+typedef struct
+{
+    vlc_thread_t    thread;
+    vlc_mutex_t     lock;
+    vlc_cond_t      wait;
+    atomic_bool     b_stop;
+
+    char            *psz_url;
+    char            *psz_cache; /* NULL if the index is not kept */
+    uint64_t        i_size;
+    uint8_t         signature[16];
+    uint64_t        i_movi_pos;
+    uint64_t        i_movi_end;
+    uint64_t        i_riff1_pos; /* second OpenDML RIFF, or 0 */
+    vlc_dialog_id   *p_dialog;   /* progress of a blocking creation */
+
+    /* protected by lock */
+    avi_index_t     *p_pending;  /* entries not taken yet, per track */
+    bool            b_done;      /* the thread will not index more */
+    bool            b_complete;  /* the scan reached the end of the file */
+    bool            b_cached;    /* loaded from the cache file */
+
+    bool            b_finished;  /* the demuxer took the last entries */
+} avi_indexer_t;
+
 typedef struct
 {
     bool            b_activated;
@@ -178,6 +219,7 @@ struct demux_sys_t
     bool  b_seekable;
     bool  b_fastseekable;
     bool  b_indexloaded; /* if we read indexes from end of file before starting */
+    bool  b_indx_deferred; /* OpenDML sub-indexes are read on first seek */
     mtime_t i_read_increment;
     uint32_t i_avih_flags;
     avi_chunk_t ck_root;
@@ -187,6 +229,8 @@ struct demux_sys_t
     uint64_t i_movi_begin;
     uint64_t i_movi_lastchunk_pos;   /* XXX position of last valid chunk */
 
+    avi_indexer_t *p_indexer;        /* background index creation */
+
     /* number of streams and information */
     unsigned int i_track;
     avi_track_t  **track;
@@ -218,12 +262,18 @@ static int AVI_StreamBytesSet ( demux_t *,
 vlc_fourcc_t AVI_FourccGetCodec( unsigned int i_cat, vlc_fourcc_t );
 static int   AVI_GetKeyFlag    ( vlc_fourcc_t , uint8_t * );
 
-static int AVI_PacketGetHeader( demux_t *, avi_packet_t *p_pk );
-static int AVI_PacketNext     ( demux_t * );
-static int AVI_PacketSearch   ( demux_t * );
+static int AVI_PacketGetHeader( stream_t *, avi_packet_t *p_pk );
+static int AVI_PacketNext     ( stream_t * );
+static int AVI_PacketSearch   ( demux_t *, stream_t * );
 
 static void AVI_IndexLoad    ( demux_t * );
-static void AVI_IndexCreate  ( demux_t * );
+static int64_t AVI_IndexSuperDuration( demux_t *, unsigned int i_stream );
+
+static int  AVI_IndexerStart ( demux_t *, avi_chunk_list_t *p_movi );
+static void AVI_IndexCreate  ( demux_t *, avi_chunk_list_t *p_movi );
+static void AVI_IndexerStop  ( demux_t * );
+static void AVI_IndexerTake  ( demux_t * );
+static void AVI_IndexerWait  ( demux_t *, mtime_t i_date, uint64_t i_pos );
 
 static void AVI_ExtractSubtitle( demux_t *, unsigned int i_stream, avi_chunk_list_t *, avi_chunk_STRING_t * );
 
@@ -276,6 +326,9 @@ static void Close ( vlc_object_t * p_this )
     demux_t *    p_demux = (demux_t *)p_this;
     demux_sys_t *p_sys = p_demux->p_sys  ;
 
+    if( p_sys->p_indexer )
+        AVI_IndexerStop( p_demux );
+
     for( unsigned int i = 0; i < p_sys->i_track; i++ )
     {
         if( p_sys->track[i] )
@@ -830,7 +883,8 @@ static int Open( vlc_object_t * p_this )
 aviindex:
         if( p_sys->b_fastseekable )
         {
-            AVI_IndexCreate( p_demux );
+            if( AVI_IndexerStart( p_demux, p_movi ) )
+                AVI_IndexCreate( p_demux, p_movi );
         }
         else if( p_sys->b_seekable )
         {
@@ -848,6 +902,12 @@ aviindex:
 
     /* *** movie length in sec *** */
     p_sys->i_length = AVI_MovieGetLength( p_demux );
+    if( p_sys->p_indexer )
+    {
+        /* Estimate it until the whole file is indexed */
+        p_sys->i_length = (mtime_t)p_avih->i_totalframes *
+                          (mtime_t)p_avih->i_microsecperframe / CLOCK_FREQ;
+    }
 
     /* Check the index completeness */
     unsigned int i_idx_totalframes = 0;
@@ -857,7 +917,8 @@ aviindex:
         if( tk->fmt.i_cat == VIDEO_ES && tk->idx.p_entry )
             i_idx_totalframes = __MAX(i_idx_totalframes, tk->idx.i_size);
     }
-    if( i_idx_totalframes != p_avih->i_totalframes &&
+    if( !p_sys->p_indexer && !p_sys->b_indx_deferred &&
+        i_idx_totalframes != p_avih->i_totalframes &&
         p_sys->i_length < (mtime_t)p_avih->i_totalframes *
                           (mtime_t)p_avih->i_microsecperframe /
                           CLOCK_FREQ )
@@ -866,7 +927,8 @@ aviindex:
                            "approximative or will exhibit strange behavior" );
         if( (i_do_index == 0 || i_do_index == 3) && !b_index )
         {
-            if( !p_sys->b_fastseekable ) {
+            /* No need to ask if the index is rebuilt while playing */
+            if( !p_sys->b_fastseekable || p_demux->s->psz_url != NULL ) {
                 b_index = true;
                 goto aviindex;
             }
@@ -1110,6 +1172,8 @@ static int Demux_Seekable( demux_t *p_demux )
     /* cannot be more than 100 stream (dcXX or wbXX) */
     avi_track_toread_t toread[100];
 
+    if( p_sys->p_indexer )
+        AVI_IndexerTake( p_demux );
 
     /* detect new selected/unselected streams */
     for( i_track = 0; i_track < p_sys->i_track; i_track++ )
@@ -1255,7 +1319,7 @@ static int Demux_Seekable( demux_t *p_demux )
             if( p_sys->b_seekable && p_sys->i_movi_lastchunk_pos >= p_sys->i_movi_begin + 12 )
             {
                 vlc_stream_Seek( p_demux->s, p_sys->i_movi_lastchunk_pos );
-                if( AVI_PacketNext( p_demux ) )
+                if( AVI_PacketNext( p_demux->s ) )
                 {
                     return( AVI_TrackStopFinishedStreams( p_demux ) ? 0 : 1 );
                 }
@@ -1269,7 +1333,7 @@ static int Demux_Seekable( demux_t *p_demux )
             {
                 avi_packet_t avi_pk;
 
-                if( AVI_PacketGetHeader( p_demux, &avi_pk ) )
+                if( AVI_PacketGetHeader( p_demux->s, &avi_pk ) )
                 {
                     msg_Warn( p_demux,
                              "cannot get packet header, track disabled" );
@@ -1278,7 +1342,7 @@ static int Demux_Seekable( demux_t *p_demux )
                 if( avi_pk.i_stream >= p_sys->i_track ||
                     ( avi_pk.i_cat != AUDIO_ES && avi_pk.i_cat != VIDEO_ES ) )
                 {
-                    if( AVI_PacketNext( p_demux ) )
+                    if( AVI_PacketNext( p_demux->s ) )
                     {
                         msg_Warn( p_demux,
                                   "cannot skip packet, track disabled" );
@@ -1319,7 +1383,7 @@ static int Demux_Seekable( demux_t *p_demux )
                     }
                     else
                     {
-                        if( AVI_PacketNext( p_demux ) )
+                        if( AVI_PacketNext( p_demux->s ) )
                         {
                             msg_Warn( p_demux,
                                       "cannot skip packet, track disabled" );
@@ -1500,7 +1564,7 @@ static int Demux_UnSeekable( demux_t *p_demux )
 
         avi_packet_t    avi_pk;
 
-        if( AVI_PacketGetHeader( p_demux, &avi_pk ) )
+        if( AVI_PacketGetHeader( p_demux->s, &avi_pk ) )
         {
             return VLC_DEMUXER_EOF;
         }
@@ -1517,18 +1581,18 @@ static int Demux_UnSeekable( demux_t *p_demux )
                 case AVIFOURCC_JUNK:
                 case AVIFOURCC_LIST:
                 case AVIFOURCC_RIFF:
-                    return( !AVI_PacketNext( p_demux ) ? 1 : 0 );
+                    return( !AVI_PacketNext( p_demux->s ) ? 1 : 0 );
                 case AVIFOURCC_idx1:
                     if( p_sys->b_odml )
                     {
-                        return( !AVI_PacketNext( p_demux ) ? 1 : 0 );
+                        return( !AVI_PacketNext( p_demux->s ) ? 1 : 0 );
                     }
                     return VLC_DEMUXER_EOF;
                 default:
                     msg_Warn( p_demux,
                               "seems to have lost position @%"PRIu64", resync",
                               vlc_stream_Tell(p_demux->s) );
-                    if( AVI_PacketSearch( p_demux ) )
+                    if( AVI_PacketSearch( p_demux, p_demux->s ) )
                     {
                         msg_Err( p_demux, "resync failed" );
                         return VLC_DEMUXER_EGENERIC;
@@ -1554,7 +1618,7 @@ static int Demux_UnSeekable( demux_t *p_demux )
             }
             else
             {
-                if( AVI_PacketNext( p_demux ) )
+                if( AVI_PacketNext( p_demux->s ) )
                 {
                     return VLC_DEMUXER_EOF;
                 }
@@ -1595,27 +1659,35 @@ static int Seek( demux_t *p_demux, mtime_t i_date, int i_percent, bool b_accurat
         uint64_t i_pos_backup = vlc_stream_Tell( p_demux->s );
 
         /* Check and lazy load indexes if it was not done (not fastseekable) */
-        if ( !p_sys->b_indexloaded && ( p_sys->i_avih_flags & AVIF_HASINDEX ) )
+        if ( !p_sys->b_indexloaded &&
+             ( ( p_sys->i_avih_flags & AVIF_HASINDEX ) || p_sys->b_indx_deferred ) )
         {
             avi_chunk_t *p_riff = AVI_ChunkFind( &p_sys->ck_root, AVIFOURCC_RIFF, 0, true );
             if (unlikely( !p_riff ))
                 return VLC_EGENERIC;
 
-            int i_ret = AVI_ChunkFetchIndexes( p_demux->s, p_riff );
+            int i_ret = VLC_EGENERIC;
+            if ( p_sys->i_avih_flags & AVIF_HASINDEX )
+                i_ret = AVI_ChunkFetchIndexes( p_demux->s, p_riff );
             if ( i_ret )
             {
                 /* Go back to position before index failure */
                 if ( vlc_stream_Tell( p_demux->s ) - i_pos_backup )
                     vlc_stream_Seek( p_demux->s, i_pos_backup );
 
-                if ( p_sys->i_avih_flags & AVIF_MUSTUSEINDEX )
+                if ( ( p_sys->i_avih_flags & AVIF_MUSTUSEINDEX ) &&
+                     !p_sys->b_indx_deferred )
                     return VLC_EGENERIC;
             }
-            else AVI_IndexLoad( p_demux );
+            if ( !i_ret || p_sys->b_indx_deferred )
+                AVI_IndexLoad( p_demux );
 
             p_sys->b_indexloaded = true; /* we don't want to try each time */
         }
 
+        if( p_sys->p_indexer && p_sys->i_length )
+            AVI_IndexerWait( p_demux, i_date, 0 );
+
         if( !p_sys->i_length )
         {
             avi_track_t *p_stream = NULL;
@@ -1623,6 +1695,7 @@ static int Seek( demux_t *p_demux, mtime_t i_date, int i_percent, bool b_accurat
             uint64_t i_pos;
 
             if ( !p_sys->i_movi_lastchunk_pos && /* set when index is successfully loaded */
+                 !p_sys->p_indexer &&
                  ! ( p_sys->i_avih_flags & AVIF_ISINTERLEAVED ) )
             {
                 msg_Err( p_demux, "seeking without index at %d%%"
@@ -1640,6 +1713,8 @@ static int Seek( demux_t *p_demux, mtime_t i_date, int i_percent, bool b_accurat
             /* try to find chunk that is at i_percent or the file */
             i_pos = __MAX( i_percent * stream_Size( p_demux->s ) / 100,
                            p_sys->i_movi_begin );
+            if( p_sys->p_indexer )
+                AVI_IndexerWait( p_demux, 0, i_pos );
             /* search first selected stream (and prefer non-EOF ones) */
             for( unsigned i = 0; i < p_sys->i_track; i++ )
             {
@@ -1953,7 +2028,7 @@ static int AVI_StreamChunkFind( demux_t *p_demux, unsigned int i_stream )
     if( p_sys->i_movi_lastchunk_pos >= p_sys->i_movi_begin + 12 )
     {
         vlc_stream_Seek( p_demux->s, p_sys->i_movi_lastchunk_pos );
-        if( AVI_PacketNext( p_demux ) )
+        if( AVI_PacketNext( p_demux->s ) )
         {
             return VLC_EGENERIC;
         }
@@ -1965,7 +2040,7 @@ static int AVI_StreamChunkFind( demux_t *p_demux, unsigned int i_stream )
 
     for( ;; )
     {
-        if( AVI_PacketGetHeader( p_demux, &avi_pk ) )
+        if( AVI_PacketGetHeader( p_demux->s, &avi_pk ) )
         {
             msg_Warn( p_demux, "cannot get packet header" );
             return VLC_EGENERIC;
@@ -1973,7 +2048,7 @@ static int AVI_StreamChunkFind( demux_t *p_demux, unsigned int i_stream )
         if( avi_pk.i_stream >= p_sys->i_track ||
             ( avi_pk.i_cat != AUDIO_ES && avi_pk.i_cat != VIDEO_ES ) )
         {
-            if( AVI_PacketNext( p_demux ) )
+            if( AVI_PacketNext( p_demux->s ) )
             {
                 return VLC_EGENERIC;
             }
@@ -2007,7 +2082,7 @@ static int AVI_StreamChunkFind( demux_t *p_demux, unsigned int i_stream )
                 return VLC_SUCCESS;
             }
 
-            if( AVI_PacketNext( p_demux ) )
+            if( AVI_PacketNext( p_demux->s ) )
             {
                 return VLC_EGENERIC;
             }
@@ -2304,17 +2379,17 @@ static void AVI_ParseStreamHeader( vlc_fourcc_t i_id,
 /****************************************************************************
  *
  ****************************************************************************/
-static int AVI_PacketGetHeader( demux_t *p_demux, avi_packet_t *p_pk )
+static int AVI_PacketGetHeader( stream_t *s, avi_packet_t *p_pk )
 {
     const uint8_t *p_peek;
 
-    if( vlc_stream_Peek( p_demux->s, &p_peek, 16 ) < 16 )
+    if( vlc_stream_Peek( s, &p_peek, 16 ) < 16 )
     {
         return VLC_EGENERIC;
     }
     p_pk->i_fourcc  = VLC_FOURCC( p_peek[0], p_peek[1], p_peek[2], p_peek[3] );
     p_pk->i_size    = GetDWLE( p_peek + 4 );
-    p_pk->i_pos     = vlc_stream_Tell( p_demux->s );
+    p_pk->i_pos     = vlc_stream_Tell( s );
     if( p_pk->i_fourcc == AVIFOURCC_LIST || p_pk->i_fourcc == AVIFOURCC_RIFF )
     {
         p_pk->i_type = VLC_FOURCC( p_peek[8],  p_peek[9],
@@ -2331,12 +2406,12 @@ static int AVI_PacketGetHeader( demux_t *p_demux, avi_packet_t *p_pk )
     return VLC_SUCCESS;
 }
 
-static int AVI_PacketNext( demux_t *p_demux )
+static int AVI_PacketNext( stream_t *s )
 {
     avi_packet_t    avi_ck;
     size_t          i_skip = 0;
 
-    if( AVI_PacketGetHeader( p_demux, &avi_ck ) )
+    if( AVI_PacketGetHeader( s, &avi_ck ) )
     {
         return VLC_EGENERIC;
     }
@@ -2361,7 +2436,7 @@ static int AVI_PacketNext( demux_t *p_demux )
     if( i_skip > SSIZE_MAX )
         return VLC_EGENERIC;
 
-    ssize_t i_ret = vlc_stream_Read( p_demux->s, NULL, i_skip );
+    ssize_t i_ret = vlc_stream_Read( s, NULL, i_skip );
     if( i_ret < 0 || (size_t) i_ret != i_skip )
     {
         return VLC_EGENERIC;
@@ -2369,7 +2444,7 @@ static int AVI_PacketNext( demux_t *p_demux )
     return VLC_SUCCESS;
 }
 
-static int AVI_PacketSearch( demux_t *p_demux )
+static int AVI_PacketSearch( demux_t *p_demux, stream_t *s )
 {
     demux_sys_t     *p_sys = p_demux->p_sys;
     avi_packet_t    avi_pk;
@@ -2377,11 +2452,11 @@ static int AVI_PacketSearch( demux_t *p_demux )
 
     for( ;; )
     {
-        if( vlc_stream_Read( p_demux->s, NULL, 1 ) != 1 )
+        if( vlc_stream_Read( s, NULL, 1 ) != 1 )
         {
             return VLC_EGENERIC;
         }
-        AVI_PacketGetHeader( p_demux, &avi_pk );
+        AVI_PacketGetHeader( s, &avi_pk );
         if( avi_pk.i_stream < p_sys->i_track &&
             ( avi_pk.i_cat == AUDIO_ES || avi_pk.i_cat == VIDEO_ES ) )
         {
@@ -2623,6 +2698,10 @@ static void AVI_IndexLoad_indx( demux_t *p_demux,
     avi_chunk_list_t    *p_riff;
     avi_chunk_list_t    *p_hdrl;
 
+    /* Reading the sub-indexes seeks all over the file, do it on first
+     * seek only if the stream is slow */
+    const bool b_defer = !p_sys->b_fastseekable && !p_sys->b_indx_deferred;
+
     p_riff = AVI_ChunkFind( &p_sys->ck_root, AVIFOURCC_RIFF, 0, true);
     p_hdrl = AVI_ChunkFind( p_riff, AVIFOURCC_hdrl, 0, true );
 
@@ -2651,6 +2730,13 @@ static void AVI_IndexLoad_indx( demux_t *p_demux,
         {
             if ( !p_sys->b_seekable )
                 return;
+            if( b_defer )
+            {
+                msg_Dbg( p_demux, "deferring %u subindexes of stream[%u]",
+                         p_indx->i_entriesinuse, i_stream );
+                p_sys->b_indx_deferred = true;
+                continue;
+            }
             avi_chunk_t    ck_sub;
             for( unsigned i = 0; i < p_indx->i_entriesinuse; i++ )
             {
@@ -2699,12 +2785,14 @@ static void AVI_IndexLoad( demux_t *p_demux )
         if( p_idx_indx[i].i_size > p_idx_idx1[i].i_size )
         {
             msg_Dbg( p_demux, "selected ODML index for stream[%u]", i );
+            avi_index_Clean( &p_sys->track[i]->idx );
             p_sys->track[i]->idx = p_idx_indx[i];
             avi_index_Clean( &p_idx_idx1[i] );
         }
         else
         {
             msg_Dbg( p_demux, "selected standard index for stream[%u]", i );
+            avi_index_Clean( &p_sys->track[i]->idx );
             p_sys->track[i]->idx = p_idx_idx1[i];
             avi_index_Clean( &p_idx_indx[i] );
         }
@@ -2732,104 +2820,207 @@ static void AVI_IndexLoad( demux_t *p_demux )
     }
 }
 
-static void AVI_IndexCreate( demux_t *p_demux )
+/* Sums the durations of an OpenDML super index, while its sub-indexes are
+ * not loaded */
+static int64_t AVI_IndexSuperDuration( demux_t *p_demux, unsigned int i_stream )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
 
-    avi_chunk_list_t *p_riff;
-    avi_chunk_list_t *p_movi;
+    if( !p_sys->b_indx_deferred || p_sys->b_indexloaded )
+        return 0;
 
-    unsigned int i_stream;
-    uint32_t i_movi_end;
+    avi_chunk_list_t *p_riff = AVI_ChunkFind( &p_sys->ck_root, AVIFOURCC_RIFF, 0, true );
+    avi_chunk_list_t *p_hdrl = AVI_ChunkFind( p_riff, AVIFOURCC_hdrl, 0, true );
+    avi_chunk_list_t *p_strl = AVI_ChunkFind( p_hdrl, AVIFOURCC_strl, i_stream, true );
+    avi_chunk_indx_t *p_indx = AVI_ChunkFind( p_strl, AVIFOURCC_indx, 0, false );
 
-    mtime_t i_dialog_update;
-    vlc_dialog_id *p_dialog_id = NULL;
+    if( !p_indx || p_indx->i_indextype != AVI_INDEX_OF_INDEXES )
+        return 0;
 
-    p_riff = AVI_ChunkFind( &p_sys->ck_root, AVIFOURCC_RIFF, 0, true );
-    p_movi = AVI_ChunkFind( p_riff, AVIFOURCC_movi, 0, true );
+    int64_t i_duration = 0;
+    for( unsigned i = 0; i < p_indx->i_entriesinuse; i++ )
+        i_duration += p_indx->idx.super[i].i_duration;
+    return i_duration;
+}
 
-    if( !p_movi )
+/*****************************************************************************
+ * Background index creation
+ *****************************************************************************
+ * Cache file: header, then for each track its entry count and entries, in
+ * host byte order.
+ *****************************************************************************/
+#define AVI_INDEX_MAGIC     "VLCAVIX1"
+#define AVI_INDEX_SIGNATURE 65536
+
+typedef struct
+{
+    char     magic[8];
+    uint8_t  signature[16];
+    uint64_t i_size;
+    uint32_t i_track;
+} avi_index_header_t;
+
+static bool AVI_IndexerLoad( demux_t *p_demux, avi_indexer_t *p_idx )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    FILE *file = vlc_fopen( p_idx->psz_cache, "rb" );
+    if( file == NULL )
+        return false;
+
+    avi_index_t p_index[p_sys->i_track];
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+        avi_index_Init( &p_index[i] );
+
+    avi_index_header_t hdr;
+    bool b_ok = fread( &hdr, sizeof(hdr), 1, file ) == 1 &&
+                !memcmp( hdr.magic, AVI_INDEX_MAGIC, 8 ) &&
+                !memcmp( hdr.signature, p_idx->signature, 16 ) &&
+                hdr.i_size == p_idx->i_size &&
+                hdr.i_track == p_sys->i_track;
+
+    for( unsigned i = 0; b_ok && i < p_sys->i_track; i++ )
     {
-        msg_Err( p_demux, "cannot find p_movi" );
-        return;
+        uint32_t i_count;
+
+        /* entries are at least 8 bytes apart */
+        b_ok = fread( &i_count, sizeof(i_count), 1, file ) == 1 &&
+               i_count <= p_idx->i_size / 8;
+        if( !b_ok || i_count == 0 )
+            continue;
+
+        p_index[i].p_entry = vlc_alloc( i_count, sizeof(avi_entry_t) );
+        b_ok = p_index[i].p_entry != NULL &&
+               fread( p_index[i].p_entry, sizeof(avi_entry_t), i_count,
+                      file ) == i_count;
+        if( b_ok )
+            p_index[i].i_size = p_index[i].i_max = i_count;
     }
+    fclose( file );
 
-    for( i_stream = 0; i_stream < p_sys->i_track; i_stream++ )
-        avi_index_Init( &p_sys->track[i_stream]->idx );
+    vlc_mutex_lock( &p_idx->lock );
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+    {
+        if( b_ok )
+        {
+            avi_index_Clean( &p_idx->p_pending[i] );
+            p_idx->p_pending[i] = p_index[i];
+        }
+        else
+            avi_index_Clean( &p_index[i] );
+    }
+    p_idx->b_cached = b_ok;
+    vlc_mutex_unlock( &p_idx->lock );
+
+    if( b_ok )
+        msg_Dbg( p_demux, "loaded index from %s", p_idx->psz_cache );
+    return b_ok;
+}
 
-    i_movi_end = __MIN( (uint32_t)(p_movi->i_chunk_pos + p_movi->i_chunk_size),
-                        stream_Size( p_demux->s ) );
+static void AVI_IndexerSave( demux_t *p_demux, avi_indexer_t *p_idx )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
 
-    vlc_stream_Seek( p_demux->s, p_movi->i_chunk_pos + 12 );
-    msg_Warn( p_demux, "creating index from LIST-movi, will take time !" );
+    char *psz_tmp;
+    FILE *file = cachefile_Create( p_idx->psz_cache, &psz_tmp );
+    if( file == NULL )
+        return;
 
+    avi_index_header_t hdr;
+    memset( &hdr, 0, sizeof(hdr) );
+    memcpy( hdr.magic, AVI_INDEX_MAGIC, 8 );
+    memcpy( hdr.signature, p_idx->signature, 16 );
+    hdr.i_size = p_idx->i_size;
+    hdr.i_track = p_sys->i_track;
 
-    /* Only show dialog if AVI is > 10MB */
-    i_dialog_update = mdate();
-    if( stream_Size( p_demux->s ) > 10000000 )
+    bool b_error = fwrite( &hdr, sizeof(hdr), 1, file ) != 1;
+    for( unsigned i = 0; i < p_sys->i_track && !b_error; i++ )
     {
-        p_dialog_id =
-            vlc_dialog_display_progress( p_demux, false, 0.0, _("Cancel"),
-                                         _("Broken or missing AVI Index"),
-                                         _("Fixing AVI Index...") );
+        const avi_index_t *p_index = &p_sys->track[i]->idx;
+        uint32_t i_count = p_index->p_entry ? p_index->i_size : 0;
+
+        b_error = fwrite( &i_count, sizeof(i_count), 1, file ) != 1 ||
+                  fwrite( p_index->p_entry, sizeof(avi_entry_t), i_count,
+                          file ) != i_count;
     }
 
-    for( ;; )
+    if( cachefile_Commit( file, psz_tmp, p_idx->psz_cache, b_error ) )
+        msg_Warn( p_demux, "cannot save index to %s", p_idx->psz_cache );
+}
+
+/* Returns whether the scan stopped at the end of the file, rather than on a
+ * read error, a lost sync or a request to stop */
+static bool AVI_IndexerAtEnd( stream_t *s, const avi_indexer_t *p_idx )
+{
+    return vlc_stream_Tell( s ) + 16 > p_idx->i_size;
+}
+
+/* Indexes the movi list(s) read from s, returns true if it reached the end */
+static bool AVI_IndexerScan( demux_t *p_demux, avi_indexer_t *p_idx,
+                             stream_t *s )
+{
+    demux_sys_t   *p_sys = p_demux->p_sys;
+    unsigned int  i_count = 0;
+    mtime_t       i_dialog_update = mdate();
+
+    if( vlc_stream_Seek( s, p_idx->i_movi_pos + 12 ) )
+        return false;
+
+    while( !atomic_load( &p_idx->b_stop ) )
     {
         avi_packet_t pk;
 
         /* Don't update/check dialog too often */
-        if( p_dialog_id != NULL && mdate() - i_dialog_update > 100000 )
+        if( p_idx->p_dialog != NULL && mdate() - i_dialog_update > 100000 )
         {
-            if( vlc_dialog_is_cancelled( p_demux, p_dialog_id ) )
-                break;
+            if( vlc_dialog_is_cancelled( p_demux, p_idx->p_dialog ) )
+                return false;
 
-            double f_current = vlc_stream_Tell( p_demux->s );
-            double f_size    = stream_Size( p_demux->s );
-            double f_pos     = f_current / f_size;
-            vlc_dialog_update_progress( p_demux, p_dialog_id, f_pos );
+            double f_current = vlc_stream_Tell( s );
+            double f_size    = p_idx->i_size;
+            vlc_dialog_update_progress( p_demux, p_idx->p_dialog,
+                                        f_current / f_size );
 
             i_dialog_update = mdate();
         }
 
-        if( AVI_PacketGetHeader( p_demux, &pk ) )
-            break;
+        if( AVI_PacketGetHeader( s, &pk ) )
+            return AVI_IndexerAtEnd( s, p_idx );
 
         if( pk.i_stream < p_sys->i_track &&
             pk.i_cat == p_sys->track[pk.i_stream]->fmt.i_cat )
         {
-            avi_track_t *tk = p_sys->track[pk.i_stream];
-
             avi_entry_t index;
             index.i_id      = pk.i_fourcc;
-            index.i_flags   = AVI_GetKeyFlag(tk->fmt.i_codec, pk.i_peek);
+            index.i_flags   = AVI_GetKeyFlag( p_sys->track[pk.i_stream]->fmt.i_codec,
+                                              pk.i_peek );
             index.i_pos     = pk.i_pos;
             index.i_length  = pk.i_size;
             index.i_lengthtotal = pk.i_size;
-            avi_index_Append( &tk->idx, &p_sys->i_movi_lastchunk_pos, &index );
+
+            uint64_t i_last_pos;
+            vlc_mutex_lock( &p_idx->lock );
+            avi_index_Append( &p_idx->p_pending[pk.i_stream], &i_last_pos, &index );
+            if( !(++i_count % 256) )
+                vlc_cond_signal( &p_idx->wait );
+            vlc_mutex_unlock( &p_idx->lock );
         }
         else
         {
             switch( pk.i_fourcc )
             {
             case AVIFOURCC_idx1:
-                if( p_sys->b_odml )
+                if( p_sys->b_odml && p_idx->i_riff1_pos )
                 {
-                    avi_chunk_list_t *p_sysx;
-                    p_sysx = AVI_ChunkFind( &p_sys->ck_root,
-                                            AVIFOURCC_RIFF, 1, true );
-
                     msg_Dbg( p_demux, "looking for new RIFF chunk" );
-                    if( !p_sysx || vlc_stream_Seek( p_demux->s,
-                                         p_sysx->i_chunk_pos + 24 ) )
-                        goto print_stat;
-                    break;
+                    if( vlc_stream_Seek( s, p_idx->i_riff1_pos + 24 ) )
+                        return false;
+                    continue;
                 }
-                goto print_stat;
+                return true;
 
             case AVIFOURCC_RIFF:
-                    msg_Dbg( p_demux, "new RIFF chunk found" );
-                    break;
+                msg_Dbg( p_demux, "new RIFF chunk found" );
+                break;
 
             case AVIFOURCC_rec:
             case AVIFOURCC_JUNK:
@@ -2837,29 +3028,282 @@ static void AVI_IndexCreate( demux_t *p_demux )
 
             default:
                 msg_Warn( p_demux, "need resync, probably broken avi" );
-                if( AVI_PacketSearch( p_demux ) )
+                if( AVI_PacketSearch( p_demux, s ) )
                 {
-                    msg_Warn( p_demux, "lost sync, abord index creation" );
-                    goto print_stat;
+                    if( AVI_IndexerAtEnd( s, p_idx ) )
+                        return true;
+                    msg_Warn( p_demux, "lost sync, abort index creation" );
+                    return false;
                 }
             }
         }
 
-        if( ( !p_sys->b_odml && pk.i_pos + pk.i_size >= i_movi_end ) ||
-            AVI_PacketNext( p_demux ) )
+        if( !p_sys->b_odml && pk.i_pos + pk.i_size >= p_idx->i_movi_end )
+            return true;
+        if( AVI_PacketNext( s ) )
+            return AVI_IndexerAtEnd( s, p_idx );
+    }
+    return false;
+}
+
+static void *AVI_IndexerThread( void *data )
+{
+    demux_t       *p_demux = data;
+    demux_sys_t   *p_sys = p_demux->p_sys;
+    avi_indexer_t *p_idx = p_sys->p_indexer;
+    bool          b_complete = false;
+
+    stream_t *s = vlc_stream_NewURL( p_demux, p_idx->psz_url );
+    if( s == NULL )
+        goto end;
+
+    /* Identify the file for the cache */
+    const uint8_t *p_peek;
+    ssize_t i_peek = vlc_stream_Peek( s, &p_peek, AVI_INDEX_SIGNATURE );
+    if( i_peek <= 0 )
+        goto end;
+
+    struct md5_s md5;
+    InitMD5( &md5 );
+    AddMD5( &md5, p_peek, i_peek );
+    EndMD5( &md5 );
+    memcpy( p_idx->signature, md5.buf, 16 );
+
+    if( p_idx->psz_cache != NULL && AVI_IndexerLoad( p_demux, p_idx ) )
+    {
+        b_complete = true;
+        goto end;
+    }
+
+    b_complete = AVI_IndexerScan( p_demux, p_idx, s );
+
+end:
+    if( s != NULL )
+        vlc_stream_Delete( s );
+
+    vlc_mutex_lock( &p_idx->lock );
+    p_idx->b_done = true;
+    p_idx->b_complete = b_complete;
+    vlc_cond_signal( &p_idx->wait );
+    vlc_mutex_unlock( &p_idx->lock );
+    return NULL;
+}
+
+static avi_indexer_t *AVI_IndexerNew( demux_t *p_demux,
+                                      avi_chunk_list_t *p_movi )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    avi_indexer_t *p_idx = calloc( 1, sizeof(*p_idx) );
+    if( unlikely(p_idx == NULL) )
+        return NULL;
+    p_idx->p_pending = calloc( p_sys->i_track, sizeof(avi_index_t) );
+    if( unlikely(p_idx->p_pending == NULL) )
+    {
+        free( p_idx );
+        return NULL;
+    }
+
+    avi_chunk_list_t *p_riff1 = AVI_ChunkFind( &p_sys->ck_root,
+                                               AVIFOURCC_RIFF, 1, true );
+    p_idx->i_size = stream_Size( p_demux->s );
+    p_idx->i_movi_pos = p_movi->i_chunk_pos;
+    p_idx->i_movi_end = __MIN( p_movi->i_chunk_pos + p_movi->i_chunk_size,
+                               p_idx->i_size );
+    p_idx->i_riff1_pos = p_riff1 ? p_riff1->i_chunk_pos : 0;
+    atomic_init( &p_idx->b_stop, false );
+    vlc_mutex_init( &p_idx->lock );
+    vlc_cond_init( &p_idx->wait );
+
+    /* Start over, the demuxer then only extends the index */
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+    {
+        avi_index_Clean( &p_sys->track[i]->idx );
+        avi_index_Init( &p_sys->track[i]->idx );
+    }
+    p_sys->i_movi_lastchunk_pos = 0;
+    p_sys->b_indexloaded = true;
+    return p_idx;
+}
+
+static void AVI_IndexerDelete( demux_t *p_demux, avi_indexer_t *p_idx )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+        avi_index_Clean( &p_idx->p_pending[i] );
+    vlc_cond_destroy( &p_idx->wait );
+    vlc_mutex_destroy( &p_idx->lock );
+    free( p_idx->psz_cache );
+    free( p_idx->psz_url );
+    free( p_idx->p_pending );
+    free( p_idx );
+}
+
+static int AVI_IndexerStart( demux_t *p_demux, avi_chunk_list_t *p_movi )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    if( p_demux->s->psz_url == NULL )
+        return VLC_EGENERIC;
+
+    avi_indexer_t *p_idx = AVI_IndexerNew( p_demux, p_movi );
+    if( unlikely(p_idx == NULL) )
+        return VLC_ENOMEM;
+    p_idx->psz_url = strdup( p_demux->s->psz_url );
+    if( unlikely(p_idx->psz_url == NULL) )
+    {
+        AVI_IndexerDelete( p_demux, p_idx );
+        return VLC_ENOMEM;
+    }
+    if( var_InheritBool( p_demux, "avi-index-cache" ) )
+        p_idx->psz_cache = cachefile_GetPath( "avi-index", p_idx->psz_url,
+                                              strlen( p_idx->psz_url ) );
+
+    p_sys->p_indexer = p_idx;
+    if( vlc_clone( &p_idx->thread, AVI_IndexerThread, p_demux,
+                   VLC_THREAD_PRIORITY_LOW ) )
+    {
+        p_sys->p_indexer = NULL;
+        AVI_IndexerDelete( p_demux, p_idx );
+        return VLC_EGENERIC;
+    }
+    msg_Warn( p_demux, "creating index from LIST-movi while playing" );
+    return VLC_SUCCESS;
+}
+
+/* Builds the whole index before playing, when it cannot be done in
+ * background */
+static void AVI_IndexCreate( demux_t *p_demux, avi_chunk_list_t *p_movi )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    avi_indexer_t *p_idx = AVI_IndexerNew( p_demux, p_movi );
+    if( unlikely(p_idx == NULL) )
+        return;
+
+    msg_Warn( p_demux, "creating index from LIST-movi, will take time !" );
+
+    /* Only show dialog if AVI is > 10MB */
+    if( p_idx->i_size > 10000000 )
+        p_idx->p_dialog =
+            vlc_dialog_display_progress( p_demux, false, 0.0, _("Cancel"),
+                                         _("Broken or missing AVI Index"),
+                                         _("Fixing AVI Index...") );
+
+    p_idx->b_complete = AVI_IndexerScan( p_demux, p_idx, p_demux->s );
+    p_idx->b_done = true;
+
+    if( p_idx->p_dialog != NULL )
+        vlc_dialog_release( p_demux, p_idx->p_dialog );
+
+    p_sys->p_indexer = p_idx;
+    AVI_IndexerTake( p_demux );
+    p_sys->p_indexer = NULL;
+    AVI_IndexerDelete( p_demux, p_idx );
+}
+
+static void AVI_IndexerStop( demux_t *p_demux )
+{
+    demux_sys_t   *p_sys = p_demux->p_sys;
+    avi_indexer_t *p_idx = p_sys->p_indexer;
+
+    atomic_store( &p_idx->b_stop, true );
+    vlc_join( p_idx->thread, NULL );
+
+    AVI_IndexerTake( p_demux );
+    /* Only an index of the whole file is worth keeping */
+    if( p_idx->psz_cache != NULL && p_idx->b_complete && !p_idx->b_cached )
+        AVI_IndexerSave( p_demux, p_idx );
+
+    AVI_IndexerDelete( p_demux, p_idx );
+    p_sys->p_indexer = NULL;
+}
+
+/* Appends the entries found by the indexer to the tracks index */
+static void AVI_IndexerTake( demux_t *p_demux )
+{
+    demux_sys_t   *p_sys = p_demux->p_sys;
+    avi_indexer_t *p_idx = p_sys->p_indexer;
+
+    if( p_idx->b_finished )
+        return;
+
+    /* Everything up to the last known chunk is already indexed, as the
+     * demuxer indexes the chunks it reads past it */
+    const uint64_t i_known_pos = p_sys->i_movi_lastchunk_pos;
+
+    vlc_mutex_lock( &p_idx->lock );
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+    {
+        avi_index_t *p_pending = &p_idx->p_pending[i];
+
+        for( unsigned j = 0; j < p_pending->i_size; j++ )
         {
-            break;
+            if( p_pending->p_entry[j].i_pos > i_known_pos )
+                avi_index_Append( &p_sys->track[i]->idx,
+                                  &p_sys->i_movi_lastchunk_pos,
+                                  &p_pending->p_entry[j] );
         }
+        p_pending->i_size = 0;
     }
+    p_idx->b_finished = p_idx->b_done;
+    vlc_mutex_unlock( &p_idx->lock );
 
-print_stat:
-    if( p_dialog_id != NULL )
-        vlc_dialog_release( p_demux, p_dialog_id );
+    if( p_idx->b_finished )
+    {
+        for( unsigned i = 0; i < p_sys->i_track; i++ )
+            msg_Dbg( p_demux, "stream[%u] created %u index entries",
+                     i, p_sys->track[i]->idx.i_size );
+        if( p_idx->b_complete )
+            p_sys->i_length = AVI_MovieGetLength( p_demux );
+    }
+}
 
-    for( i_stream = 0; i_stream < p_sys->i_track; i_stream++ )
+/* Checks whether the selected tracks are indexed past i_date */
+static bool AVI_IndexCovers( demux_sys_t *p_sys, mtime_t i_date )
+{
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
     {
-        msg_Dbg( p_demux, "stream[%d] creating %d index entries",
-                i_stream, p_sys->track[i_stream]->idx.i_size );
+        avi_track_t *tk = p_sys->track[i];
+        mtime_t i_end;
+
+        if( !tk->b_activated )
+            continue;
+        if( tk->idx.i_size < 1 || !tk->idx.p_entry )
+            return false;
+
+        if( tk->i_samplesize )
+            i_end = AVI_GetDPTS( tk,
+                                 tk->idx.p_entry[tk->idx.i_size-1].i_lengthtotal +
+                                     tk->idx.p_entry[tk->idx.i_size-1].i_length );
+        else
+            i_end = AVI_GetDPTS( tk, tk->idx.i_size );
+        if( i_end <= i_date )
+            return false;
+    }
+    return true;
+}
+
+/* Waits until the indexer went past i_date, or past the byte i_pos if not 0 */
+static void AVI_IndexerWait( demux_t *p_demux, mtime_t i_date, uint64_t i_pos )
+{
+    demux_sys_t   *p_sys = p_demux->p_sys;
+    avi_indexer_t *p_idx = p_sys->p_indexer;
+
+    for( ;; )
+    {
+        AVI_IndexerTake( p_demux );
+        if( p_idx->b_finished || vlc_killed() ||
+            ( i_pos ? p_sys->i_movi_lastchunk_pos >= i_pos
+                    : AVI_IndexCovers( p_sys, i_date ) ) )
+            break;
+
+        vlc_mutex_lock( &p_idx->lock );
+        if( !p_idx->b_done )
+            vlc_cond_timedwait( &p_idx->wait, &p_idx->lock,
+                                mdate() + CLOCK_FREQ / 10 );
+        vlc_mutex_unlock( &p_idx->lock );
     }
 }
 
@@ -3150,10 +3594,15 @@ static mtime_t  AVI_MovieGetLength( demux_t *p_demux )
         /* fix length for each stream */
         if( tk->idx.i_size < 1 || !tk->idx.p_entry )
         {
-            continue;
+            /* use the OpenDML super index until it is loaded */
+            int64_t i_duration = AVI_IndexSuperDuration( p_demux, i );
+            if( i_duration <= 0 )
+                continue;
+            if( tk->i_samplesize )
+                i_duration *= tk->i_samplesize;
+            i_length = AVI_GetDPTS( tk, i_duration );
         }
-
-        if( tk->i_samplesize )
+        else if( tk->i_samplesize )
         {
             i_length = AVI_GetDPTS( tk,
                                     tk->idx.p_entry[tk->idx.i_size-1].i_lengthtotal +
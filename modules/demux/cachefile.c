@@ -0,0 +1,117 @@
+/*****************************************************************************
+ * cachefile.c: demuxer cache files
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_configuration.h>
+#include <vlc_fs.h>
+#include <vlc_md5.h>
+#include "cachefile.h"
+
+char *cachefile_GetDir( const char *psz_subdir )
+{
+    char *psz_cachedir = config_GetUserDir( VLC_CACHE_DIR );
+    char *psz_dir;
+
+    if( psz_cachedir == NULL )
+        return NULL;
+    if( asprintf( &psz_dir, "%s" DIR_SEP "%s", psz_cachedir, psz_subdir ) == -1 )
+        psz_dir = NULL;
+    free( psz_cachedir );
+    return psz_dir;
+}
+
+char *cachefile_GetPath( const char *psz_subdir, const char *psz_key,
+                         size_t i_key )
+{
+    char *psz_dir = cachefile_GetDir( psz_subdir );
+    char *psz_path = NULL;
+
+    if( psz_dir == NULL )
+        return NULL;
+
+    struct md5_s md5;
+    InitMD5( &md5 );
+    AddMD5( &md5, psz_key, i_key );
+    EndMD5( &md5 );
+
+    char *psz_hash = psz_md5_hash( &md5 );
+    if( psz_hash == NULL ||
+        asprintf( &psz_path, "%s" DIR_SEP "%s", psz_dir, psz_hash ) == -1 )
+        psz_path = NULL;
+    free( psz_hash );
+    free( psz_dir );
+    return psz_path;
+}
+
+FILE *cachefile_Create( const char *psz_path, char **ppsz_tmp )
+{
+    char *psz_tmp;
+    if( asprintf( &psz_tmp, "%s.XXXXXX", psz_path ) == -1 )
+        return NULL;
+
+    /* Create all the parent directories */
+    for( size_t i = 1; psz_tmp[i] != '\0'; i++ )
+    {
+        if( psz_tmp[i] != DIR_SEP_CHAR )
+            continue;
+        psz_tmp[i] = '\0';
+        vlc_mkdir( psz_tmp, 0700 );
+        psz_tmp[i] = DIR_SEP_CHAR;
+    }
+
+    int fd = vlc_mkstemp( psz_tmp );
+    if( fd == -1 )
+    {
+        free( psz_tmp );
+        return NULL;
+    }
+
+    FILE *file = fdopen( fd, "wb" );
+    if( file == NULL )
+    {
+        vlc_close( fd );
+        vlc_unlink( psz_tmp );
+        free( psz_tmp );
+        return NULL;
+    }
+    *ppsz_tmp = psz_tmp;
+    return file;
+}
+
+int cachefile_Commit( FILE *file, char *psz_tmp, const char *psz_path,
+                      bool b_error )
+{
+    /* Readers only ever see complete files */
+    if( fclose( file ) || b_error || vlc_rename( psz_tmp, psz_path ) )
+    {
+        vlc_unlink( psz_tmp );
+        free( psz_tmp );
+        return -1;
+    }
+    free( psz_tmp );
+    return 0;
+}
@@ -0,0 +1,73 @@
+/*****************************************************************************
+ * cachefile.h: demuxer cache files
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifndef VLC_DEMUX_CACHEFILE_H
+#define VLC_DEMUX_CACHEFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+# ifdef __cplusplus
+extern "C" {
+# endif
+
+/**
+ * Gets the directory of a kind of cache files, within the user cache
+ * directory. It is created on the first cachefile_Create() call.
+ *
+ * \return heap-allocated path, or NULL on error
+ */
+char *cachefile_GetDir( const char *psz_subdir );
+
+/**
+ * Gets the path of the cache file of a key (typically the URL of the
+ * media), which is named after its MD5 hash.
+ *
+ * \return heap-allocated path, or NULL on error
+ */
+char *cachefile_GetPath( const char *psz_subdir, const char *psz_key,
+                         size_t i_key );
+
+/**
+ * Opens a temporary file to write a cache file, creating the parent
+ * directories if needed. The temporary file name is unique, so that
+ * processes can write the same cache file concurrently.
+ *
+ * \param ppsz_tmp set to the heap-allocated temporary file path
+ * \return the temporary file, or NULL on error
+ */
+FILE *cachefile_Create( const char *psz_path, char **ppsz_tmp );
+
+/**
+ * Closes a file opened with cachefile_Create(), and replaces the cache file
+ * with it, unless an error occurred while writing it.
+ *
+ * \param psz_tmp temporary file path from cachefile_Create(), freed here
+ * \param b_error whether the caller failed to write the content
+ * \return 0 on success, -1 if the cache file was left unchanged
+ */
+int cachefile_Commit( FILE *file, char *psz_tmp, const char *psz_path,
+                      bool b_error );
+
+# ifdef __cplusplus
+}
+# endif
+
+#endif
@@ -25,6 +25,7 @@
 
 #include "Ebml_parser.hpp"
 #include "stream_io_callback.hpp"
+#include "util.hpp"
 
 /*****************************************************************************
  * Ebml Stream parser
@@ -341,6 +342,86 @@ next:
     return m_el[mi_level];
 }
 
+#define MKV_SIMPLEBLOCK_ID 0xA3
+
+bool EbmlParser::GetSimpleBlock( mkv_simpleblock_t & sblock )
+{
+    if( mi_user_level != mi_level || mi_level < 2 || m_got || mb_keep ||
+        !MKV_IS_ID( m_el[mi_level-1], KaxCluster ) )
+        return false;
+
+    EbmlElement *p_prev = m_el[mi_level];
+    EbmlElement *p_parent = m_el[mi_level-1];
+    if( p_prev && !p_prev->IsFiniteSize() )
+        return false;
+
+    vlc_stream_io_callback *p_io = static_cast<vlc_stream_io_callback *>( &m_es->I_O() );
+    stream_t *s = p_io->GetStream();
+
+    /* skip the previous element, like Get() */
+    uint64_t i_pos = p_prev ? p_prev->GetEndPosition() : p_io->getFilePointer();
+    p_io->setFilePointer( i_pos );
+    if( p_io->IsEOF() )
+        return false;
+
+    /* ID, size, track number, timecode and flags */
+    const uint8_t *p_peek;
+    ssize_t i_peek = vlc_stream_Peek( s, &p_peek, 1 + 8 + 8 + 3 );
+    if( i_peek < 1 + 1 + 1 + 3 || p_peek[0] != MKV_SIMPLEBLOCK_ID )
+        return false;
+
+    uint64_t i_size, i_track;
+    bool b_unknown;
+    size_t i_size_len = ReadEbmlVint( &p_peek[1], i_peek - 1, &i_size, false, &b_unknown );
+    if( i_size_len == 0 || b_unknown || i_size >= SIZE_MAX )
+        return false;
+
+    size_t i_track_len = ReadEbmlVint( &p_peek[1 + i_size_len], i_peek - 1 - i_size_len,
+                                       &i_track );
+    size_t i_header = 1 + i_size_len + i_track_len + 3;
+    if( i_track_len == 0 || i_header > (size_t)i_peek ||
+        i_size <= i_track_len + 3 || i_track > UINT_MAX )
+        return false;
+
+    const uint8_t i_flags = p_peek[i_header - 1];
+    if( i_flags & 0x06 ) /* laced */
+        return false;
+
+    if( p_parent->IsFiniteSize() &&
+        i_pos + 1 + i_size_len + i_size > p_parent->GetEndPosition() )
+        return false;
+
+    sblock.i_fpos           = i_pos;
+    sblock.i_track          = i_track;
+    sblock.i_local_timecode = (int16_t)GetWBE( &p_peek[i_header - 3] );
+    sblock.b_keyframe       = i_flags & 0x80;
+    sblock.b_discardable    = i_flags & 0x01;
+
+    /* the previous element is released as Get() would */
+    if( p_prev )
+    {
+        if( MKV_IS_ID( p_prev, KaxBlockVirtual ) )
+            static_cast<KaxBlockVirtualWorkaround*>(p_prev)->Fix();
+        delete p_prev;
+        m_el[mi_level] = NULL;
+    }
+
+    /* the frame is read in its own block, no copy needed later */
+    size_t i_frame = i_size - i_track_len - 3;
+    sblock.p_frame = NULL;
+    if( vlc_stream_Read( s, NULL, i_header ) != (ssize_t)i_header ||
+        ( sblock.p_frame = vlc_stream_Block( s, i_frame ) ) == NULL ||
+        sblock.p_frame->i_buffer != i_frame )
+    {
+        if( sblock.p_frame )
+            block_Release( sblock.p_frame );
+        sblock.p_frame = NULL;
+        p_io->setFilePointer( i_pos );
+        return false;
+    }
+    return true;
+}
+
 bool EbmlParser::IsTopPresent( EbmlElement *el ) const
 {
     for( int i = 0; i < mi_level; i++ )
@@ -42,6 +42,7 @@ class EbmlParser
     void Down( void );
     void Reset( demux_t *p_demux );
     EbmlElement *Get( bool allow_overshoot = true );
+    bool        GetSimpleBlock( mkv_simpleblock_t & );
     void        Keep( void );
     void        Unkeep( void );
 
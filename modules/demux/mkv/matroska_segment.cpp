@@ -28,6 +28,8 @@
 #include "util.hpp"
 #include "Ebml_parser.hpp"
 #include "Ebml_dispatcher.hpp"
+#include "matroska_segment_indexer.hpp"
+#include "stream_io_callback.hpp"
 
 #include <new>
 #include <iterator>
@@ -61,11 +63,14 @@ matroska_segment_c::matroska_segment_c( demux_sys_t & demuxer, EbmlStream & estr
     ,ep( EbmlParser(&estream, p_seg, &demuxer.demuxer ))
     ,b_preloaded(false)
     ,b_ref_external_segments(false)
+    ,p_indexer(NULL)
 {
 }
 
 matroska_segment_c::~matroska_segment_c()
 {
+    delete p_indexer;
+
     free( psz_writing_application );
     free( psz_muxing_application );
     free( psz_segment_filename );
@@ -698,7 +703,10 @@ bool matroska_segment_c::Preload( )
     b_preloaded = true;
 
     if( cluster )
+    {
         EnsureDuration();
+        StartIndexer();
+    }
 
     return true;
 }
@@ -848,6 +856,9 @@ bool matroska_segment_c::Seek( demux_t &demuxer, mtime_t i_absolute_mk_date, mti
 
     // find appropriate seekpoints //
 
+    if( p_indexer )
+        SyncIndexer( i_mk_date );
+
     try {
         seekpoints = _seeker.get_seekpoints( *this, i_mk_date, priority, selected_tracks );
     }
@@ -910,7 +921,8 @@ bool matroska_segment_c::Seek( demux_t &demuxer, mtime_t i_absolute_mk_date, mti
 
 
 mkv_track_t * matroska_segment_c::FindTrackByBlock(
-                                             const KaxBlock *p_block, const KaxSimpleBlock *p_simpleblock )
+                                             const KaxBlock *p_block, const KaxSimpleBlock *p_simpleblock,
+                                             const mkv_simpleblock_t *p_fastblock )
 {
     tracks_map_t::iterator track_it;
 
@@ -918,6 +930,8 @@ mkv_track_t * matroska_segment_c::FindTrackByBlock(
         track_it = tracks.find( p_block->TrackNum() );
     else if( p_simpleblock != NULL)
         track_it = tracks.find( p_simpleblock->TrackNum() );
+    else if( p_fastblock != NULL )
+        track_it = tracks.find( p_fastblock->i_track );
     else
         track_it = tracks.end();
 
@@ -1013,6 +1027,80 @@ void matroska_segment_c::ComputeTrackPriority()
     }
 }
 
+/* Cues every few seconds are enough to seek, otherwise all the clusters
+ * and keyframes are located in background */
+#define MKV_INDEX_CUES_INTERVAL 30000 /* ms */
+
+void matroska_segment_c::StartIndexer()
+{
+    stream_t *s = static_cast<vlc_stream_io_callback&>( es.I_O() ).GetStream();
+    bool b_fastseekable;
+
+    if( sys.demuxer.b_preparsing || s->psz_url == NULL ||
+        !var_InheritBool( &sys.demuxer, "mkv-index" ) ||
+        vlc_stream_Control( s, STREAM_CAN_FASTSEEK, &b_fastseekable ) || !b_fastseekable )
+        return;
+
+    if( b_cues && !priority_tracks.empty() && i_duration > 0 )
+    {
+        size_t i_cues = _seeker._tracks_seekpoints[ priority_tracks[0] ].size();
+        if( i_cues > 0 && i_duration / mtime_t( i_cues ) < MKV_INDEX_CUES_INTERVAL )
+            return;
+    }
+
+    std::string key;
+    if( var_InheritBool( &sys.demuxer, "mkv-index-cache" ) )
+    {
+        if( p_segment_uid && p_segment_uid->GetSize() )
+            key.assign( reinterpret_cast<const char *>( p_segment_uid->GetBuffer() ),
+                        p_segment_uid->GetSize() );
+        else
+            key = s->psz_url;
+    }
+
+    SegmentIndexer::track_ids_t track_ids;
+    for( tracks_map_t::const_iterator it = tracks.begin(); it != tracks.end(); ++it )
+        track_ids.push_back( it->first );
+
+    msg_Dbg( &sys.demuxer, "indexing the segment clusters in background" );
+    p_indexer = new SegmentIndexer( VLC_OBJECT( &sys.demuxer ), s->psz_url,
+                                    cluster->GetElementPosition(),
+                                    segment->IsFiniteSize() ? segment->GetEndPosition() : UINT64_MAX,
+                                    i_timescale, track_ids, priority_tracks, key );
+}
+
+/* Moves the background index to the seeker, once it gets past i_mk_date */
+void matroska_segment_c::SyncIndexer( mtime_t i_mk_date )
+{
+    SegmentIndexer::clusters_t  clusters;
+    SegmentIndexer::keyframes_t keyframes;
+
+    p_indexer->wait( i_mk_date );
+    SegmentSeeker::fptr_t i_indexed_end = p_indexer->take( clusters, keyframes );
+
+    for( SegmentIndexer::clusters_t::const_iterator it = clusters.begin(); it != clusters.end(); ++it )
+    {
+        SegmentSeeker::Cluster cinfo = {
+            /* fpos     */ it->fpos,
+            /* pts      */ it->pts,
+            /* duration */ mtime_t( -1 ),
+            /* size     */ it->size
+        };
+        _seeker.add_cluster( cinfo );
+    }
+
+    for( SegmentIndexer::keyframes_t::const_iterator it = keyframes.begin(); it != keyframes.end(); ++it )
+        _seeker.add_seekpoint( it->track_id, SegmentSeeker::Seekpoint( it->fpos, it->pts ) );
+
+    if( !clusters.empty() && i_indexed_end > clusters.front().fpos )
+        _seeker.mark_range_as_searched( SegmentSeeker::Range( clusters.front().fpos, i_indexed_end ) );
+}
+
+bool matroska_segment_c::IndexProgress( double *pf_progress )
+{
+    return p_indexer != NULL && p_indexer->progress( pf_progress );
+}
+
 void matroska_segment_c::EnsureDuration()
 {
     if ( i_duration > 0 )
@@ -1175,7 +1263,7 @@ void matroska_segment_c::ESDestroy( )
     }
 }
 
-int matroska_segment_c::BlockGet( KaxBlock * & pp_block, KaxSimpleBlock * & pp_simpleblock, bool *pb_key_picture, bool *pb_discardable_picture, int64_t *pi_duration )
+int matroska_segment_c::BlockGet( KaxBlock * & pp_block, KaxSimpleBlock * & pp_simpleblock, bool *pb_key_picture, bool *pb_discardable_picture, int64_t *pi_duration, mkv_simpleblock_t *p_fastblock )
 {
     pp_simpleblock = NULL;
     pp_block = NULL;
@@ -1336,6 +1424,30 @@ int matroska_segment_c::BlockGet( KaxBlock * & pp_block, KaxSimpleBlock * & pp_s
         EbmlElement *el = NULL;
         int         i_level;
 
+        /* Unlaced SimpleBlocks go through the EbmlParser fast path */
+        if( p_fastblock != NULL && pp_simpleblock == NULL && pp_block == NULL &&
+            cluster != NULL && payload.b_cluster_timecode && ep.GetLevel() == 2 &&
+            ep.GetSimpleBlock( *p_fastblock ) )
+        {
+            if( FindTrackByBlock( NULL, NULL, p_fastblock ) == NULL )
+            {
+                block_Release( p_fastblock->p_frame );
+                p_fastblock->p_frame = NULL;
+                continue;
+            }
+
+            p_fastblock->i_timecode = static_cast<int64_t>( cluster->GlobalTimecode() ) +
+                                      p_fastblock->i_local_timecode * static_cast<int64_t>( i_timescale );
+
+            if( p_fastblock->b_keyframe )
+                _seeker.add_seekpoint( p_fastblock->i_track,
+                    SegmentSeeker::Seekpoint( p_fastblock->i_fpos, p_fastblock->i_timecode / 1000 ) );
+
+            *pb_key_picture         = p_fastblock->b_keyframe;
+            *pb_discardable_picture = p_fastblock->b_discardable;
+            return VLC_SUCCESS;
+        }
+
         if( pp_simpleblock != NULL || ((el = ep.Get()) == NULL && pp_block != NULL) )
         {
             /* Check blocks validity to protect againts broken files */
@@ -37,6 +37,7 @@
 #include "Ebml_parser.hpp"
 
 class EbmlParser;
+class SegmentIndexer;
 
 class chapter_edition_c;
 class chapter_translation_c;
@@ -142,10 +143,11 @@ public:
     void InformationCreate();
 
     bool Seek( demux_t &, mtime_t i_mk_date, mtime_t i_mk_time_offset, bool b_accurate );
+    bool IndexProgress( double *pf_progress );
 
-    int BlockGet( KaxBlock * &, KaxSimpleBlock * &, bool *, bool *, int64_t *);
+    int BlockGet( KaxBlock * &, KaxSimpleBlock * &, bool *, bool *, int64_t *, mkv_simpleblock_t * = NULL );
 
-    mkv_track_t * FindTrackByBlock(const KaxBlock *, const KaxSimpleBlock * );
+    mkv_track_t * FindTrackByBlock(const KaxBlock *, const KaxSimpleBlock *, const mkv_simpleblock_t * = NULL );
 
     bool ESCreate( );
     void ESDestroy( );
@@ -171,8 +173,11 @@ private:
     bool TrackInit( mkv_track_t * p_tk );
     void ComputeTrackPriority();
     void EnsureDuration();
+    void StartIndexer();
+    void SyncIndexer( mtime_t i_mk_date );
 
     SegmentSeeker _seeker;
+    SegmentIndexer *p_indexer;
 
     friend SegmentSeeker;
 };
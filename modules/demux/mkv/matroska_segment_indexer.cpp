@@ -0,0 +1,474 @@
+/*****************************************************************************
+ * matroska_segment_indexer.cpp : matroska demuxer background index
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "matroska_segment_indexer.hpp"
+#include "util.hpp"
+#include "../cachefile.h"
+
+#include <vlc_fs.h>
+#include <vlc_interrupt.h>
+#include <vlc_stream.h>
+#include <vlc_url.h>
+
+#include <algorithm>
+#include <exception>
+#include <sys/stat.h>
+
+#define INDEXER_MAGIC "VLCMKVI1"
+
+namespace {
+    enum {
+        ID_CLUSTER        = 0x1F43B675,
+        ID_CUES           = 0x1C53BB6B,
+        ID_TAGS           = 0x1254C367,
+        ID_ATTACHMENTS    = 0x1941A469,
+        ID_CHAPTERS       = 0x1043A770,
+        ID_SEEKHEAD       = 0x114D9B74,
+        ID_INFO           = 0x1549A966,
+        ID_TRACKS         = 0x1654AE6B,
+        ID_SEGMENT        = 0x18538067,
+        ID_EBML           = 0x1A45DFA3,
+        ID_VOID           = 0xEC,
+        ID_CRC32          = 0xBF,
+        ID_TIMECODE       = 0xE7,
+        ID_SIMPLEBLOCK    = 0xA3,
+        ID_BLOCKGROUP     = 0xA0,
+        ID_BLOCK          = 0xA1,
+        ID_REFERENCEBLOCK = 0xFB,
+    };
+
+    /* Elements ending a cluster of unknown size */
+    bool is_top_level( uint32_t id )
+    {
+        switch( id )
+        {
+            case ID_CLUSTER: case ID_CUES: case ID_TAGS: case ID_ATTACHMENTS:
+            case ID_CHAPTERS: case ID_SEEKHEAD: case ID_INFO: case ID_TRACKS:
+            case ID_SEGMENT: case ID_EBML:
+                return true;
+        }
+        return false;
+    }
+
+    /* Cache file: header, then the clusters and keyframes, in host order */
+    struct header_t
+    {
+        char     magic[8];
+        uint64_t i_file_size;
+        int64_t  i_file_mtime;
+        uint64_t i_start;
+        uint64_t i_scan_pos;
+        int64_t  i_scan_pts;
+        uint64_t i_timescale;
+        uint32_t i_clusters;
+        uint32_t i_keyframes;
+    };
+}
+
+SegmentIndexer::SegmentIndexer( vlc_object_t *p_obj, std::string const& url, fptr_t start, fptr_t end,
+                                uint64_t timescale, track_ids_t const& tracks,
+                                track_ids_t const& dense_tracks, std::string const& key )
+    :obj( p_obj )
+    ,url( url )
+    ,i_start( start )
+    ,i_end( end )
+    ,i_timescale( timescale )
+    ,i_file_size( 0 )
+    ,i_file_mtime( 0 )
+    ,tracks( tracks )
+    ,dense_tracks( dense_tracks )
+    ,b_stop( false )
+    ,b_complete( false )
+    ,i_clusters_taken( 0 )
+    ,i_keyframes_taken( 0 )
+    ,i_scan_pos( start )
+    ,i_scan_pts( -1 )
+{
+    /* the cache is only kept for local files, checked by size and date */
+    char *psz_path = key.empty() ? NULL : vlc_uri2path( url.c_str() );
+    struct stat st;
+
+    if( psz_path != NULL && vlc_stat( psz_path, &st ) == 0 )
+    {
+        char psz_start[32];
+        snprintf( psz_start, sizeof(psz_start), "@%" PRIu64, start );
+
+        const std::string cache_key = key + psz_start;
+        char *psz_cache_path = cachefile_GetPath( "mkv-index", cache_key.data(),
+                                                  cache_key.size() );
+        if( psz_cache_path != NULL )
+        {
+            cache_path = psz_cache_path;
+            i_file_size = st.st_size;
+            i_file_mtime = st.st_mtime;
+        }
+        free( psz_cache_path );
+    }
+    free( psz_path );
+
+    vlc_mutex_init( &lock );
+    vlc_cond_init( &cond );
+
+    b_thread = !vlc_clone( &thread, Run, this, VLC_THREAD_PRIORITY_LOW );
+    b_ended = !b_thread;
+}
+
+SegmentIndexer::~SegmentIndexer()
+{
+    if( b_thread )
+    {
+        vlc_mutex_lock( &lock );
+        b_stop = true;
+        vlc_mutex_unlock( &lock );
+        vlc_join( thread, NULL );
+    }
+    vlc_cond_destroy( &cond );
+    vlc_mutex_destroy( &lock );
+}
+
+void SegmentIndexer::wait( mtime_t pts )
+{
+    vlc_mutex_lock( &lock );
+    while( !b_ended && !b_complete && i_scan_pts <= pts && !vlc_killed() )
+        vlc_cond_timedwait( &cond, &lock, mdate() + CLOCK_FREQ / 10 );
+    vlc_mutex_unlock( &lock );
+}
+
+SegmentIndexer::fptr_t SegmentIndexer::take( clusters_t & out_clusters, keyframes_t & out_keyframes )
+{
+    vlc_mutex_lock( &lock );
+    out_clusters.insert( out_clusters.end(), clusters.begin() + i_clusters_taken, clusters.end() );
+    out_keyframes.insert( out_keyframes.end(), keyframes.begin() + i_keyframes_taken, keyframes.end() );
+    i_clusters_taken = clusters.size();
+    i_keyframes_taken = keyframes.size();
+    fptr_t i_pos = i_scan_pos;
+    vlc_mutex_unlock( &lock );
+    return i_pos;
+}
+
+bool SegmentIndexer::progress( double *pf )
+{
+    vlc_mutex_lock( &lock );
+    bool b_running = !b_complete && !b_ended;
+    if( b_running )
+        *pf = ( i_end > i_start && i_end != UINT64_MAX )
+            ? double( i_scan_pos - i_start ) / ( i_end - i_start ) : 0.0;
+    vlc_mutex_unlock( &lock );
+    return b_running;
+}
+
+bool SegmentIndexer::ReadHeader( stream_t *s, fptr_t fpos, Element & el )
+{
+    const uint8_t *p_peek;
+    uint64_t i_id, i_size;
+
+    if( vlc_stream_Tell( s ) != fpos && vlc_stream_Seek( s, fpos ) )
+        return false;
+
+    ssize_t i_peek = vlc_stream_Peek( s, &p_peek, 12 );
+    if( i_peek <= 0 )
+        return false;
+
+    size_t i_idlen = ReadEbmlVint( p_peek, i_peek, &i_id, true );
+    if( i_idlen == 0 )
+        return false;
+    bool b_unknown;
+    size_t i_sizelen = ReadEbmlVint( p_peek + i_idlen, i_peek - i_idlen, &i_size,
+                                     false, &b_unknown );
+    if( i_sizelen == 0 )
+        return false;
+
+    el.id   = i_id;
+    el.fpos = fpos;
+    el.data = fpos + i_idlen + i_sizelen;
+    el.size = i_size;
+    el.b_unknown_size = b_unknown;
+    return vlc_stream_Read( s, NULL, i_idlen + i_sizelen ) == ssize_t( i_idlen + i_sizelen );
+}
+
+void SegmentIndexer::AddKeyframe( keyframes_t & out, track_id_t track_id, fptr_t fpos, mtime_t pts,
+                                  track_ids_t & found )
+{
+    if( std::find( tracks.begin(), tracks.end(), track_id ) == tracks.end() )
+        return;
+
+    if( std::find( dense_tracks.begin(), dense_tracks.end(), track_id ) == dense_tracks.end() )
+    {
+        /* one seekpoint per cluster is enough for these */
+        if( std::find( found.begin(), found.end(), track_id ) != found.end() )
+            return;
+        found.push_back( track_id );
+    }
+
+    Keyframe kf = { track_id, fpos, pts };
+    out.push_back( kf );
+}
+
+bool SegmentIndexer::ReadCluster( stream_t *s, Element const& cluster, fptr_t *next )
+{
+    const fptr_t i_cluster_end = cluster.b_unknown_size ? i_end : cluster.data + cluster.size;
+    keyframes_t cluster_keyframes;
+    track_ids_t found;
+    uint64_t i_cluster_tc = 0;
+    fptr_t fpos = cluster.data;
+    Element el;
+
+    while( fpos < i_cluster_end && ReadHeader( s, fpos, el ) )
+    {
+        if( cluster.b_unknown_size && is_top_level( el.id ) )
+            break;
+        if( el.b_unknown_size )
+            return false;
+
+        const uint8_t *p_peek;
+        ssize_t i_peek;
+
+        switch( el.id )
+        {
+            case ID_TIMECODE:
+                if( el.size > 8 || vlc_stream_Peek( s, &p_peek, el.size ) != ssize_t( el.size ) )
+                    return false;
+                i_cluster_tc = 0;
+                for( size_t i = 0; i < el.size; i++ )
+                    i_cluster_tc = ( i_cluster_tc << 8 ) | p_peek[i];
+                break;
+
+            case ID_SIMPLEBLOCK:
+            case ID_BLOCKGROUP:
+            {
+                fptr_t i_block = el.data;
+                bool b_key = true;
+                Element block;
+
+                if( el.id == ID_BLOCKGROUP )
+                {
+                    /* the Block, and any ReferenceBlock, within the group */
+                    i_block = 0;
+                    for( fptr_t i = el.data; i < el.data + el.size; i = block.data + block.size )
+                    {
+                        if( !ReadHeader( s, i, block ) || block.b_unknown_size )
+                            return false;
+                        if( block.id == ID_BLOCK )
+                            i_block = block.data;
+                        else if( block.id == ID_REFERENCEBLOCK )
+                            b_key = false;
+                    }
+                    if( i_block == 0 || vlc_stream_Seek( s, i_block ) )
+                        break;
+                }
+
+                uint64_t i_track;
+                i_peek = vlc_stream_Peek( s, &p_peek, 11 );
+                size_t i_tracklen = i_peek > 0 ? ReadEbmlVint( p_peek, i_peek, &i_track ) : 0;
+                if( i_tracklen == 0 || i_peek < ssize_t( i_tracklen + 3 ) )
+                    return false;
+
+                if( el.id == ID_SIMPLEBLOCK )
+                    b_key = p_peek[i_tracklen + 2] & 0x80;
+
+                if( b_key )
+                {
+                    int16_t i_block_tc = GetWBE( &p_peek[i_tracklen] );
+                    mtime_t pts = ( int64_t( i_cluster_tc ) + i_block_tc ) * int64_t( i_timescale ) / 1000;
+                    AddKeyframe( cluster_keyframes, i_track, el.fpos, pts, found );
+                }
+                break;
+            }
+        }
+        fpos = el.data + el.size;
+    }
+
+    *next = std::min( fpos, i_cluster_end );
+
+    Cluster c = {
+        /* fpos */ cluster.fpos,
+        /* pts  */ mtime_t( int64_t( i_cluster_tc ) * int64_t( i_timescale ) / 1000 ),
+        /* size */ cluster.b_unknown_size ? UINT64_MAX : cluster.data + cluster.size - cluster.fpos,
+    };
+
+    vlc_mutex_lock( &lock );
+    try
+    {
+        clusters.push_back( c );
+        keyframes.insert( keyframes.end(), cluster_keyframes.begin(), cluster_keyframes.end() );
+    }
+    catch( ... )
+    {
+        vlc_mutex_unlock( &lock );
+        throw;
+    }
+    i_scan_pos = *next;
+    i_scan_pts = std::max( i_scan_pts, c.pts );
+    bool stop = b_stop;
+    vlc_cond_broadcast( &cond );
+    vlc_mutex_unlock( &lock );
+    return !stop;
+}
+
+void SegmentIndexer::Scan( stream_t *s )
+{
+    uint64_t i_size;
+    if( vlc_stream_GetSize( s, &i_size ) == VLC_SUCCESS )
+        i_end = std::min( i_end, fptr_t( i_size ) );
+
+    fptr_t fpos = i_start;
+    Element el;
+    unsigned i_percent = 0;
+
+    while( fpos < i_end && ReadHeader( s, fpos, el ) )
+    {
+        if( el.id == ID_CLUSTER )
+        {
+            if( !ReadCluster( s, el, &fpos ) )
+                break;
+
+            /* progress, by steps of 10% */
+            if( i_end != UINT64_MAX &&
+                ( fpos - i_start ) * 100 / ( i_end - i_start ) >= i_percent + 10 )
+            {
+                i_percent = ( fpos - i_start ) * 10 / ( i_end - i_start ) * 10;
+                msg_Dbg( obj, "segment indexed up to %u%%", i_percent );
+            }
+        }
+        else if( !el.b_unknown_size && ( is_top_level( el.id ) ||
+                 el.id == ID_VOID || el.id == ID_CRC32 ) )
+            fpos = el.data + el.size;
+        else
+            break;
+    }
+
+    vlc_mutex_lock( &lock );
+    if( !b_stop )
+    {
+        b_complete = true;
+        msg_Dbg( obj, "segment index completed with %zu clusters, %zu keyframes",
+                 clusters.size(), keyframes.size() );
+    }
+    vlc_cond_broadcast( &cond );
+    vlc_mutex_unlock( &lock );
+}
+
+void SegmentIndexer::Load()
+{
+    FILE *file = vlc_fopen( cache_path.c_str(), "rb" );
+    if( file == NULL )
+        return;
+
+    /* the counts are only trusted if the file holds exactly these entries */
+    struct stat st;
+    header_t hdr;
+    if( fstat( fileno( file ), &st ) == 0 &&
+        fread( &hdr, sizeof(hdr), 1, file ) == 1 &&
+        !memcmp( hdr.magic, INDEXER_MAGIC, 8 ) &&
+        hdr.i_file_size == i_file_size && hdr.i_file_mtime == i_file_mtime &&
+        hdr.i_start == i_start && hdr.i_timescale == i_timescale &&
+        uint64_t( st.st_size ) == sizeof(hdr) + uint64_t( hdr.i_clusters ) * sizeof(Cluster)
+                                              + uint64_t( hdr.i_keyframes ) * sizeof(Keyframe) )
+    {
+        clusters_t c( hdr.i_clusters );
+        keyframes_t k( hdr.i_keyframes );
+
+        if( ( c.empty() || fread( &c[0], sizeof(c[0]), c.size(), file ) == c.size() ) &&
+            ( k.empty() || fread( &k[0], sizeof(k[0]), k.size(), file ) == k.size() ) )
+        {
+            msg_Dbg( obj, "loaded segment index with %u clusters, %u keyframes",
+                     hdr.i_clusters, hdr.i_keyframes );
+
+            vlc_mutex_lock( &lock );
+            clusters.swap( c );
+            keyframes.swap( k );
+            i_scan_pos = hdr.i_scan_pos;
+            i_scan_pts = hdr.i_scan_pts;
+            b_complete = true;
+            vlc_cond_broadcast( &cond );
+            vlc_mutex_unlock( &lock );
+        }
+    }
+    fclose( file );
+}
+
+void SegmentIndexer::Save()
+{
+    char *psz_tmp;
+    FILE *file = cachefile_Create( cache_path.c_str(), &psz_tmp );
+    if( file == NULL )
+        return;
+
+    header_t hdr;
+    memset( &hdr, 0, sizeof(hdr) );
+    memcpy( hdr.magic, INDEXER_MAGIC, 8 );
+    hdr.i_file_size = i_file_size;
+    hdr.i_file_mtime = i_file_mtime;
+    hdr.i_start = i_start;
+    hdr.i_scan_pos = i_scan_pos;
+    hdr.i_scan_pts = i_scan_pts;
+    hdr.i_timescale = i_timescale;
+    hdr.i_clusters = clusters.size();
+    hdr.i_keyframes = keyframes.size();
+
+    bool b_error =
+        fwrite( &hdr, sizeof(hdr), 1, file ) != 1 ||
+        ( !clusters.empty() &&
+          fwrite( &clusters[0], sizeof(clusters[0]), clusters.size(), file ) != clusters.size() ) ||
+        ( !keyframes.empty() &&
+          fwrite( &keyframes[0], sizeof(keyframes[0]), keyframes.size(), file ) != keyframes.size() );
+
+    if( cachefile_Commit( file, psz_tmp, cache_path.c_str(), b_error ) )
+        msg_Warn( obj, "cannot save segment index to %s", cache_path.c_str() );
+}
+
+void *SegmentIndexer::Run( void *data )
+{
+    SegmentIndexer *p_this = static_cast<SegmentIndexer*>( data );
+    stream_t *s = NULL;
+
+    try
+    {
+        if( !p_this->cache_path.empty() )
+            p_this->Load();
+
+        if( !p_this->b_complete )
+        {
+            s = vlc_stream_NewURL( p_this->obj, p_this->url.c_str() );
+            if( s != NULL )
+            {
+                p_this->Scan( s );
+                vlc_stream_Delete( s );
+                s = NULL;
+
+                if( p_this->b_complete && !p_this->cache_path.empty() )
+                    p_this->Save();
+            }
+        }
+    }
+    catch( const std::exception & e )
+    {
+        /* the demuxer falls back to its own cluster search */
+        msg_Err( p_this->obj, "segment indexing failed: %s", e.what() );
+        if( s != NULL )
+            vlc_stream_Delete( s );
+    }
+
+    vlc_mutex_lock( &p_this->lock );
+    p_this->b_ended = true;
+    vlc_cond_broadcast( &p_this->cond );
+    vlc_mutex_unlock( &p_this->lock );
+    return NULL;
+}
@@ -0,0 +1,121 @@
+/*****************************************************************************
+ * matroska_segment_indexer.hpp : matroska demuxer background index
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef MKV_MATROSKA_SEGMENT_INDEXER_HPP_
+#define MKV_MATROSKA_SEGMENT_INDEXER_HPP_
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc_common.h>
+
+#include <string>
+#include <vector>
+
+/* Locates the clusters and keyframes of a segment from a thread reading the
+ * stream through its own handle. Only the element headers, the cluster
+ * timecodes and the block headers are read, with plain EBML decoding, so
+ * that the demuxer data is never shared with the thread. */
+class SegmentIndexer
+{
+    public:
+        typedef uint64_t fptr_t;
+        typedef unsigned int track_id_t;
+
+        struct Cluster {
+            fptr_t  fpos;
+            mtime_t pts;
+            fptr_t  size; /* UINT64_MAX if unknown */
+        };
+
+        struct Keyframe {
+            track_id_t track_id;
+            fptr_t     fpos; /* SimpleBlock or BlockGroup */
+            mtime_t    pts;
+        };
+
+        typedef std::vector<Cluster>    clusters_t;
+        typedef std::vector<Keyframe>   keyframes_t;
+        typedef std::vector<track_id_t> track_ids_t;
+
+        /* All the keyframes of the dense tracks are indexed, only the first
+         * one of each cluster for the other tracks. An empty key disables
+         * the cache file. */
+        SegmentIndexer( vlc_object_t *, std::string const& url, fptr_t start, fptr_t end,
+                        uint64_t timescale, track_ids_t const& tracks,
+                        track_ids_t const& dense_tracks, std::string const& key );
+        ~SegmentIndexer();
+
+        /* Waits until the segment is indexed past pts, unless interrupted */
+        void wait( mtime_t pts );
+
+        /* Appends the entries indexed since the last call, and returns the
+         * end of the indexed area starting at the first cluster */
+        fptr_t take( clusters_t &, keyframes_t & );
+
+        /* Gets the indexed fraction of the segment, false once complete */
+        bool progress( double * );
+
+    private:
+        struct Element {
+            uint32_t id;
+            fptr_t   fpos;
+            fptr_t   data;
+            fptr_t   size;
+            bool     b_unknown_size;
+        };
+
+        static void *Run( void * );
+        bool ReadHeader( stream_t *, fptr_t, Element & );
+        bool ReadCluster( stream_t *, Element const&, fptr_t *next );
+        void AddKeyframe( keyframes_t &, track_id_t, fptr_t, mtime_t, track_ids_t & found );
+        void Scan( stream_t * );
+        void Load();
+        void Save();
+
+        vlc_object_t *obj;
+        std::string   url;
+        std::string   cache_path;
+        fptr_t        i_start;
+        fptr_t        i_end;
+        uint64_t      i_timescale;
+        uint64_t      i_file_size;
+        int64_t       i_file_mtime;
+        track_ids_t   tracks;
+        track_ids_t   dense_tracks;
+
+        vlc_thread_t  thread;
+        bool          b_thread;
+        vlc_mutex_t   lock;
+        vlc_cond_t    cond;
+        bool          b_stop;
+        bool          b_ended;    /* the thread will not index more */
+        bool          b_complete;
+
+        clusters_t    clusters;
+        keyframes_t   keyframes;
+        size_t        i_clusters_taken;
+        size_t        i_keyframes_taken;
+        fptr_t        i_scan_pos; /* end of the indexed area */
+        mtime_t       i_scan_pts; /* time of the last indexed cluster */
+};
+
+#endif /* include-guard */
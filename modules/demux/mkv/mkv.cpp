@@ -80,6 +80,14 @@ vlc_module_begin ()
             N_("Preload clusters"),
             N_("Find all cluster positions by jumping cluster-to-cluster before playback"), true );
 
+    add_bool( "mkv-index", true,
+            N_("Index clusters in background"),
+            N_("Find the clusters and keyframes from a background thread when the cues are missing or sparse"), true );
+
+    add_bool( "mkv-index-cache", false,
+            N_("Keep clusters index"),
+            N_("Store the background clusters index in the cache directory to seek right away next time"), true );
+
     add_shortcut( "mka", "mkv" )
 vlc_module_end ()
 
@@ -336,6 +344,15 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
                 *pi64 = VLC_TS_INVALID;
             return VLC_SUCCESS;
 
+        case DEMUX_GET_INDEX_PROGRESS:
+            pf = va_arg( args, double * );
+            if( p_sys->p_current_vsegment == NULL ||
+                p_sys->p_current_vsegment->CurrentSegment() == NULL ||
+                !p_sys->p_current_vsegment->CurrentSegment()->IndexProgress( &f ) )
+                return VLC_EGENERIC;
+            *pf = f;
+            return VLC_SUCCESS;
+
         case DEMUX_GET_POSITION:
             pf = va_arg( args, double * );
             if ( p_sys->f_duration > 0.0 )
@@ -487,6 +504,7 @@ static int Seek( demux_t *p_demux, mtime_t i_mk_date, double f_percent, virtual_
 
 /* Needed by matroska_segment::Seek() and Seek */
 void BlockDecode( demux_t *p_demux, KaxBlock *block, KaxSimpleBlock *simpleblock,
+                  mkv_simpleblock_t *fastblock,
                   mtime_t i_pts, mtime_t i_duration, bool b_key_picture,
                   bool b_discardable_picture )
 {
@@ -495,7 +513,7 @@ void BlockDecode( demux_t *p_demux, KaxBlock *block, KaxSimpleBlock *simpleblock
 
     if( !p_segment ) return;
 
-    mkv_track_t *p_track = p_segment->FindTrackByBlock( block, simpleblock );
+    mkv_track_t *p_track = p_segment->FindTrackByBlock( block, simpleblock, fastblock );
     if( p_track == NULL )
     {
         msg_Err( p_demux, "invalid track number" );
@@ -530,40 +548,63 @@ void BlockDecode( demux_t *p_demux, KaxBlock *block, KaxSimpleBlock *simpleblock
 
     if( simpleblock != NULL )
         block_size = simpleblock->GetSize();
-    else
+    else if( block != NULL )
         block_size = block->GetSize();
 
     const unsigned int i_number_frames = block != NULL ? block->NumberFrames() :
-            ( simpleblock != NULL ? simpleblock->NumberFrames() : 0 );
+            ( simpleblock != NULL ? simpleblock->NumberFrames() : ( fastblock != NULL ? 1 : 0 ) );
 
     for( unsigned int i_frame = 0; i_frame < i_number_frames; i_frame++ )
     {
         block_t *p_block;
-        DataBuffer *data;
-        if( simpleblock != NULL )
+        size_t extra_data = track.fmt.i_codec == VLC_CODEC_PRORES ? 8 : 0;
+
+        if( fastblock != NULL )
         {
-            data = &simpleblock->GetBuffer(i_frame);
+            /* the frame was read in its own block */
+            p_block = fastblock->p_frame;
+            fastblock->p_frame = NULL;
+
+            if( track.i_compression_type == MATROSKA_COMPRESSION_HEADER &&
+                track.p_compression_data != NULL &&
+                track.i_encoding_scope & MATROSKA_ENCODING_SCOPE_ALL_FRAMES )
+                p_block = block_Realloc( p_block, track.p_compression_data->GetSize() + extra_data, p_block->i_buffer );
+            else if( unlikely( track.fmt.i_codec == VLC_CODEC_WAVPACK ) )
+            {
+                block_t *p_packet = packetize_wavpack( track, p_block->p_buffer, p_block->i_buffer );
+                block_Release( p_block );
+                p_block = p_packet;
+            }
+            else if( extra_data )
+                p_block = block_Realloc( p_block, extra_data, p_block->i_buffer );
         }
         else
         {
-            data = &block->GetBuffer(i_frame);
-        }
-        frame_size += data->Size();
-        if( !data->Buffer() || data->Size() > frame_size || frame_size > block_size  )
-        {
-            msg_Warn( p_demux, "Cannot read frame (too long or no frame)" );
-            break;
-        }
-        size_t extra_data = track.fmt.i_codec == VLC_CODEC_PRORES ? 8 : 0;
+            DataBuffer *data;
+            if( simpleblock != NULL )
+            {
+                data = &simpleblock->GetBuffer(i_frame);
+            }
+            else
+            {
+                data = &block->GetBuffer(i_frame);
+            }
+            frame_size += data->Size();
+            if( !data->Buffer() || data->Size() > frame_size || frame_size > block_size  )
+            {
+                msg_Warn( p_demux, "Cannot read frame (too long or no frame)" );
+                break;
+            }
 
-        if( track.i_compression_type == MATROSKA_COMPRESSION_HEADER &&
-            track.p_compression_data != NULL &&
-            track.i_encoding_scope & MATROSKA_ENCODING_SCOPE_ALL_FRAMES )
-            p_block = MemToBlock( data->Buffer(), data->Size(), track.p_compression_data->GetSize() + extra_data );
-        else if( unlikely( track.fmt.i_codec == VLC_CODEC_WAVPACK ) )
-            p_block = packetize_wavpack( track, data->Buffer(), data->Size() );
-        else
-            p_block = MemToBlock( data->Buffer(), data->Size(), extra_data );
+            if( track.i_compression_type == MATROSKA_COMPRESSION_HEADER &&
+                track.p_compression_data != NULL &&
+                track.i_encoding_scope & MATROSKA_ENCODING_SCOPE_ALL_FRAMES )
+                p_block = MemToBlock( data->Buffer(), data->Size(), track.p_compression_data->GetSize() + extra_data );
+            else if( unlikely( track.fmt.i_codec == VLC_CODEC_WAVPACK ) )
+                p_block = packetize_wavpack( track, data->Buffer(), data->Size() );
+            else
+                p_block = MemToBlock( data->Buffer(), data->Size(), extra_data );
+        }
 
         if( p_block == NULL )
         {
@@ -706,11 +747,13 @@ static int Demux( demux_t *p_demux)
 
     KaxBlock *block;
     KaxSimpleBlock *simpleblock;
+    mkv_simpleblock_t fastblock;
     int64_t i_block_duration = 0;
     bool b_key_picture;
     bool b_discardable_picture;
 
-    if( p_segment->BlockGet( block, simpleblock, &b_key_picture, &b_discardable_picture, &i_block_duration ) )
+    fastblock.p_frame = NULL;
+    if( p_segment->BlockGet( block, simpleblock, &b_key_picture, &b_discardable_picture, &i_block_duration, &fastblock ) )
     {
         if ( p_vsegment->CurrentEdition() && p_vsegment->CurrentEdition()->b_ordered )
         {
@@ -731,13 +774,16 @@ static int Demux( demux_t *p_demux)
         return 0;
     }
 
+    mkv_simpleblock_t *p_fastblock = fastblock.p_frame != NULL ? &fastblock : NULL;
+
     {
-        mkv_track_t *p_track = p_segment->FindTrackByBlock( block, simpleblock );
+        mkv_track_t *p_track = p_segment->FindTrackByBlock( block, simpleblock, p_fastblock );
 
         if( p_track == NULL )
         {
             msg_Err( p_demux, "invalid track number" );
             delete block;
+            if( p_fastblock ) block_Release( p_fastblock->p_frame );
             return 0;
         }
 
@@ -748,12 +794,14 @@ static int Demux( demux_t *p_demux)
 
             uint64_t block_fpos = 0;
 
-            if( block ) block_fpos = block->GetElementPosition();
-            else        block_fpos = simpleblock->GetElementPosition();
+            if( block )            block_fpos = block->GetElementPosition();
+            else if( simpleblock ) block_fpos = simpleblock->GetElementPosition();
+            else                   block_fpos = p_fastblock->i_fpos;
 
             if ( track.i_skip_until_fpos > block_fpos )
             {
                 delete block;
+                if( p_fastblock ) block_Release( p_fastblock->p_frame );
                 return 1; // this block shall be ignored
             }
         }
@@ -798,7 +846,8 @@ static int Demux( demux_t *p_demux)
         p_sys->i_pts = p_sys->i_mk_chapter_time + VLC_TS_0;
 
         if( simpleblock != NULL ) p_sys->i_pts += simpleblock->GlobalTimecode() / INT64_C( 1000 );
-        else                      p_sys->i_pts +=       block->GlobalTimecode() / INT64_C( 1000 );
+        else if( block != NULL )  p_sys->i_pts +=       block->GlobalTimecode() / INT64_C( 1000 );
+        else                      p_sys->i_pts +=  p_fastblock->i_timecode / INT64_C( 1000 );
     }
 
     if ( p_vsegment->CurrentEdition() &&
@@ -807,12 +856,15 @@ static int Demux( demux_t *p_demux)
     {
         /* nothing left to read in this ordered edition */
         delete block;
+        if( p_fastblock ) block_Release( p_fastblock->p_frame );
         return 0;
     }
 
-    BlockDecode( p_demux, block, simpleblock, p_sys->i_pts, i_block_duration, b_key_picture, b_discardable_picture );
+    BlockDecode( p_demux, block, simpleblock, p_fastblock, p_sys->i_pts, i_block_duration, b_key_picture, b_discardable_picture );
 
     delete block;
+    if( p_fastblock && p_fastblock->p_frame )
+        block_Release( p_fastblock->p_frame );
 
     return 1;
 }
@@ -119,7 +119,21 @@ enum
 
 using namespace LIBMATROSKA_NAMESPACE;
 
+/* Unlaced SimpleBlock read straight from the stream by
+ * EbmlParser::GetSimpleBlock(), without any libebml element */
+struct mkv_simpleblock_t
+{
+    uint64_t     i_fpos;
+    unsigned int i_track;
+    int16_t      i_local_timecode;
+    int64_t      i_timecode;      /* set by BlockGet, in ns */
+    bool         b_keyframe;
+    bool         b_discardable;
+    block_t     *p_frame;         /* NULL once used */
+};
+
 void BlockDecode( demux_t *p_demux, KaxBlock *block, KaxSimpleBlock *simpleblock,
+                  mkv_simpleblock_t *fastblock,
                   mtime_t i_pts, mtime_t i_duration, bool b_key_picture,
                   bool b_discardable_picture );
 
@@ -162,6 +162,32 @@ block_t *MemToBlock( uint8_t *p_mem, size_t i_mem, size_t offset)
     return p_block;
 }
 
+/* Decodes an EBML variable size integer, returns its length or 0.
+ * IDs keep their length marker and are at most 4 bytes long. */
+size_t ReadEbmlVint( const uint8_t *p_buf, size_t i_buf, uint64_t *pi_value,
+                     bool b_id, bool *pb_unknown )
+{
+    if( i_buf == 0 || p_buf[0] == 0 )
+        return 0;
+
+    size_t i_len = 1;
+    while( !( p_buf[0] & ( 0x80 >> ( i_len - 1 ) ) ) )
+        i_len++;
+    if( i_len > i_buf || ( b_id && i_len > 4 ) )
+        return 0;
+
+    uint64_t i_value = b_id ? p_buf[0] : p_buf[0] & ( 0xff >> i_len );
+    bool b_unknown = !b_id && i_value == ( 0xffU >> i_len );
+    for( size_t i = 1; i < i_len; i++ )
+    {
+        i_value = ( i_value << 8 ) | p_buf[i];
+        b_unknown &= p_buf[i] == 0xff;
+    }
+    *pi_value = i_value;
+    if( pb_unknown )
+        *pb_unknown = b_unknown;
+    return i_len;
+}
 
 void handle_real_audio(demux_t * p_demux, mkv_track_t * p_tk, block_t * p_blk, mtime_t i_pts)
 {
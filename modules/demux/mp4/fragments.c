@@ -22,7 +22,13 @@
 #endif
 
 #include "fragments.h"
+#include "../cachefile.h"
+#include <vlc_fs.h>
+#include <vlc_interrupt.h>
+#include <vlc_md5.h>
+#include <vlc_stream.h>
 #include <limits.h>
+#include <sys/stat.h>
 
 void MP4_Fragments_Index_Delete( mp4_fragments_index_t *p_index )
 {
@@ -36,25 +42,59 @@ void MP4_Fragments_Index_Delete( mp4_fragments_index_t *p_index )
 
 mp4_fragments_index_t * MP4_Fragments_Index_New( unsigned i_tracks, unsigned i_num )
 {
-    if( !i_tracks || !i_num || SIZE_MAX / i_num < i_tracks )
+    /* an empty index can be filled with MP4_Fragments_Index_Append */
+    const unsigned i_alloc = __MAX( i_num, 16 );
+    if( !i_tracks || SIZE_MAX / i_alloc < i_tracks )
         return NULL;
     mp4_fragments_index_t *p_index = malloc( sizeof(*p_index) );
     if( p_index )
     {
-        p_index->p_times = calloc( (size_t)i_num * i_tracks, sizeof(*p_index->p_times) );
-        p_index->pi_pos = calloc( i_num, sizeof(*p_index->pi_pos) );
+        p_index->p_times = calloc( (size_t)i_alloc * i_tracks, sizeof(*p_index->p_times) );
+        p_index->pi_pos = calloc( i_alloc, sizeof(*p_index->pi_pos) );
         if( !p_index->p_times || !p_index->pi_pos )
         {
             MP4_Fragments_Index_Delete( p_index );
             return NULL;
         }
         p_index->i_entries = i_num;
+        p_index->i_alloc = i_alloc;
         p_index->i_last_time = 0;
         p_index->i_tracks = i_tracks;
     }
     return p_index;
 }
 
+bool MP4_Fragments_Index_Append( mp4_fragments_index_t *p_index, uint64_t i_pos,
+                                 const stime_t *p_times )
+{
+    if( p_index->i_entries > 0 && p_index->pi_pos[p_index->i_entries - 1] >= i_pos )
+        return false;
+
+    if( p_index->i_entries == p_index->i_alloc )
+    {
+        const unsigned i_alloc = p_index->i_alloc * 2;
+        if( i_alloc < p_index->i_alloc || SIZE_MAX / i_alloc < p_index->i_tracks )
+            return false;
+
+        uint64_t *pi_pos = realloc( p_index->pi_pos, i_alloc * sizeof(*pi_pos) );
+        if( !pi_pos )
+            return false;
+        p_index->pi_pos = pi_pos;
+
+        stime_t *p_alltimes = realloc( p_index->p_times,
+                                       (size_t)i_alloc * p_index->i_tracks * sizeof(*p_alltimes) );
+        if( !p_alltimes )
+            return false;
+        p_index->p_times = p_alltimes;
+        p_index->i_alloc = i_alloc;
+    }
+
+    memcpy( &p_index->p_times[(size_t)p_index->i_entries * p_index->i_tracks],
+            p_times, p_index->i_tracks * sizeof(*p_times) );
+    p_index->pi_pos[p_index->i_entries++] = i_pos;
+    return true;
+}
+
 stime_t MP4_Fragment_Index_GetTrackStartTime( mp4_fragments_index_t *p_index,
                                               unsigned i_track_index, uint64_t i_moof_pos )
 {
@@ -68,6 +108,8 @@ stime_t MP4_Fragment_Index_GetTrackStartTime( mp4_fragments_index_t *p_index,
 
 stime_t MP4_Fragment_Index_GetTrackDuration( mp4_fragments_index_t *p_index, unsigned i )
 {
+    if( p_index->i_entries == 0 )
+        return 0;
     return p_index->p_times[(size_t)(p_index->i_entries - 1) * p_index->i_tracks + i];
 }
 
@@ -93,6 +135,452 @@ bool MP4_Fragments_Index_Lookup( mp4_fragments_index_t *p_index, stime_t *pi_tim
     return true;
 }
 
+#define MP4_INDEXER_SIGNATURE (1 << 16) /* bytes identifying the stream */
+#define MP4_INDEXER_PREFETCH  (1 << 16) /* bytes prefetched at a time */
+#define MP4_INDEXER_MAGIC     "VLCMP4F1"
+#define MP4_INDEXER_MAX_ENTRIES (1 << 24) /* fragments in a cache file */
+
+struct mp4_fragments_indexer_t
+{
+    vlc_object_t *p_obj;
+    char         *psz_url;
+    char         *psz_path; /* cache file, or NULL */
+    unsigned      i_tracks;
+    unsigned      i_prefetch; /* fragments to read ahead */
+    mp4_fragments_moof_cb pf_moof;
+    void         *opaque;
+
+    vlc_thread_t  thread;
+    bool          b_thread;
+
+    vlc_mutex_t   lock;
+    vlc_cond_t    wait;
+    bool          b_stop;
+    bool          b_ended;    /* the thread will not index more */
+
+    mp4_fragments_index_t *p_index;
+    stime_t      *pi_track_times; /* track times after the last moof */
+    uint64_t      i_scan_pos;     /* next box to be indexed */
+    uint64_t      i_size;
+    uint8_t       signature[16];
+    bool          b_complete;
+    bool          b_dirty;
+
+    uint64_t      i_demux_pos;    /* moof being demuxed */
+    uint64_t      i_prefetched;   /* end of the data read ahead */
+};
+
+/*
+ * Cache file: header, the scan state of each track, and the index
+ * entries, in host byte order.
+ */
+typedef struct
+{
+    char     magic[8];
+    uint8_t  signature[16];
+    uint64_t i_size;
+    uint64_t i_scan_pos;
+    int64_t  i_last_time;
+    uint32_t i_tracks;
+    uint32_t i_entries;
+    uint8_t  b_complete;
+} mp4_fragments_header_t;
+
+static void IndexerLoad( mp4_fragments_indexer_t *p_idx )
+{
+    FILE *file = vlc_fopen( p_idx->psz_path, "rb" );
+    if( file == NULL )
+        return;
+
+    mp4_fragments_header_t hdr;
+    if( fread( &hdr, sizeof(hdr), 1, file ) != 1 ||
+        memcmp( hdr.magic, MP4_INDEXER_MAGIC, 8 ) ||
+        memcmp( hdr.signature, p_idx->signature, 16 ) ||
+        hdr.i_tracks != p_idx->i_tracks ||
+        hdr.i_scan_pos > p_idx->i_size || hdr.i_size > p_idx->i_size )
+        goto out;
+
+    /* Each indexed moof is a box before the scan position, and the file
+     * must hold exactly the entries of its header */
+    struct stat st;
+    if( hdr.i_entries > MP4_INDEXER_MAX_ENTRIES ||
+        hdr.i_entries > hdr.i_scan_pos / 8 ||
+        fstat( fileno( file ), &st ) ||
+        (uint64_t) st.st_size != sizeof(hdr)
+                               + (uint64_t) hdr.i_tracks * sizeof(stime_t)
+                               + (uint64_t) hdr.i_entries
+                                 * ( sizeof(uint64_t) + (uint64_t) hdr.i_tracks * sizeof(stime_t) ) )
+    {
+        msg_Warn( p_idx->p_obj, "discarding invalid fragments index %s",
+                  p_idx->psz_path );
+        goto out;
+    }
+
+    mp4_fragments_index_t *p_index = MP4_Fragments_Index_New( hdr.i_tracks, hdr.i_entries );
+    stime_t *pi_track_times = vlc_alloc( hdr.i_tracks, sizeof(*pi_track_times) );
+    if( p_index == NULL || pi_track_times == NULL ||
+        fread( pi_track_times, sizeof(*pi_track_times), hdr.i_tracks, file ) != hdr.i_tracks ||
+        fread( p_index->pi_pos, sizeof(*p_index->pi_pos), hdr.i_entries, file ) != hdr.i_entries ||
+        fread( p_index->p_times, sizeof(*p_index->p_times) * hdr.i_tracks,
+               hdr.i_entries, file ) != hdr.i_entries )
+    {
+        MP4_Fragments_Index_Delete( p_index );
+        free( pi_track_times );
+        goto out;
+    }
+    p_index->i_last_time = hdr.i_last_time;
+
+    vlc_mutex_lock( &p_idx->lock );
+    MP4_Fragments_Index_Delete( p_idx->p_index );
+    p_idx->p_index = p_index;
+    free( p_idx->pi_track_times );
+    p_idx->pi_track_times = pi_track_times;
+    p_idx->i_scan_pos = hdr.i_scan_pos;
+    /* A growing recording must be indexed up to its new end */
+    p_idx->b_complete = hdr.b_complete && hdr.i_size == p_idx->i_size;
+    vlc_cond_broadcast( &p_idx->wait );
+    vlc_mutex_unlock( &p_idx->lock );
+
+    msg_Dbg( p_idx->p_obj, "loaded %u fragments index entries%s",
+             hdr.i_entries, p_idx->b_complete ? " (complete)" : "" );
+out:
+    fclose( file );
+}
+
+static void IndexerSave( mp4_fragments_indexer_t *p_idx )
+{
+    const mp4_fragments_index_t *p_index = p_idx->p_index;
+
+    char *psz_tmp;
+    FILE *file = cachefile_Create( p_idx->psz_path, &psz_tmp );
+    if( file == NULL )
+        return;
+
+    mp4_fragments_header_t hdr;
+    memset( &hdr, 0, sizeof(hdr) );
+    memcpy( hdr.magic, MP4_INDEXER_MAGIC, 8 );
+    memcpy( hdr.signature, p_idx->signature, 16 );
+    hdr.i_size = p_idx->i_size;
+    hdr.i_scan_pos = p_idx->i_scan_pos;
+    hdr.i_last_time = p_index->i_last_time;
+    hdr.i_tracks = p_idx->i_tracks;
+    hdr.i_entries = p_index->i_entries;
+    hdr.b_complete = p_idx->b_complete;
+
+    bool b_error =
+        fwrite( &hdr, sizeof(hdr), 1, file ) != 1 ||
+        fwrite( p_idx->pi_track_times, sizeof(*p_idx->pi_track_times),
+                p_idx->i_tracks, file ) != p_idx->i_tracks ||
+        fwrite( p_index->pi_pos, sizeof(*p_index->pi_pos),
+                p_index->i_entries, file ) != p_index->i_entries ||
+        fwrite( p_index->p_times, sizeof(*p_index->p_times) * p_idx->i_tracks,
+                p_index->i_entries, file ) != p_index->i_entries;
+
+    if( cachefile_Commit( file, psz_tmp, p_idx->psz_path, b_error ) )
+        msg_Warn( p_idx->p_obj, "cannot save fragments index to %s",
+                  p_idx->psz_path );
+}
+
+/* Identifies the stream by its size and first bytes */
+static int IndexerSign( mp4_fragments_indexer_t *p_idx, stream_t *s )
+{
+    uint8_t *p_buf = malloc( MP4_INDEXER_SIGNATURE );
+    if( p_buf == NULL || vlc_stream_GetSize( s, &p_idx->i_size ) )
+    {
+        free( p_buf );
+        return VLC_EGENERIC;
+    }
+
+    ssize_t i_read = vlc_stream_Read( s, p_buf, MP4_INDEXER_SIGNATURE );
+    if( i_read > 0 )
+    {
+        struct md5_s md5;
+        InitMD5( &md5 );
+        AddMD5( &md5, p_buf, i_read );
+        EndMD5( &md5 );
+        memcpy( p_idx->signature, md5.buf, 16 );
+    }
+    free( p_buf );
+    return i_read > 0 ? VLC_SUCCESS : VLC_EGENERIC;
+}
+
+/* Reads the top level boxes, and indexes the moof ones */
+static void IndexerScan( mp4_fragments_indexer_t *p_idx, stream_t *s )
+{
+    stime_t *p_times = vlc_alloc( p_idx->i_tracks, sizeof(*p_times) );
+    bool b_stop = p_times == NULL;
+
+    while( !b_stop )
+    {
+        const uint64_t i_pos = vlc_stream_Tell( s );
+        MP4_Box_t *p_vroot = MP4_BoxGetNextChunk( s );
+        if( p_vroot == NULL || vlc_stream_Tell( s ) <= i_pos )
+        {
+            MP4_BoxFree( p_vroot );
+            break; /* end of the stream, or read error */
+        }
+
+        for( MP4_Box_t *p_moof = p_vroot->p_first; p_moof; p_moof = p_moof->p_next )
+        {
+            if( p_moof->i_type != ATOM_moof )
+                continue;
+
+            /* only this thread uses the scan state */
+            stime_t i_end = p_idx->pf_moof( p_idx->opaque, p_moof,
+                                            p_idx->pi_track_times, p_times );
+
+            vlc_mutex_lock( &p_idx->lock );
+            if( MP4_Fragments_Index_Append( p_idx->p_index, p_moof->i_pos, p_times ) &&
+                p_idx->p_index->i_last_time < i_end )
+                p_idx->p_index->i_last_time = i_end;
+            vlc_mutex_unlock( &p_idx->lock );
+        }
+        MP4_BoxFree( p_vroot );
+
+        vlc_mutex_lock( &p_idx->lock );
+        p_idx->i_scan_pos = vlc_stream_Tell( s );
+        p_idx->b_dirty = true;
+        b_stop = p_idx->b_stop;
+        vlc_cond_broadcast( &p_idx->wait );
+        vlc_mutex_unlock( &p_idx->lock );
+    }
+    free( p_times );
+
+    vlc_mutex_lock( &p_idx->lock );
+    if( !p_idx->b_stop )
+    {
+        p_idx->b_complete = true;
+        msg_Dbg( p_idx->p_obj, "fragments index completed with %u entries",
+                 p_idx->p_index->i_entries );
+    }
+    vlc_cond_broadcast( &p_idx->wait );
+    vlc_mutex_unlock( &p_idx->lock );
+}
+
+/* Gets the next range to read ahead of the demuxer, if any */
+static bool IndexerGetPrefetch( mp4_fragments_indexer_t *p_idx,
+                                uint64_t *pi_start, uint64_t *pi_end )
+{
+    const mp4_fragments_index_t *p_index = p_idx->p_index;
+
+    /* First fragment after the demux position; positions are increasing */
+    unsigned i = 0, i_high = p_index->i_entries;
+    while( i < i_high )
+    {
+        unsigned i_mid = i + (i_high - i) / 2;
+        if( p_index->pi_pos[i_mid] <= p_idx->i_demux_pos )
+            i = i_mid + 1;
+        else
+            i_high = i_mid;
+    }
+    if( i == p_index->i_entries )
+        return false;
+
+    *pi_start = __MAX( p_idx->i_prefetched, p_index->pi_pos[i] );
+    *pi_end = ( i + p_idx->i_prefetch < p_index->i_entries )
+            ? p_index->pi_pos[i + p_idx->i_prefetch] : p_idx->i_size;
+    return *pi_start < *pi_end;
+}
+
+/* Reads the next fragments ahead of the demuxer, so that they are
+ * cached by the system when it gets there */
+static void IndexerPrefetch( mp4_fragments_indexer_t *p_idx, stream_t *s )
+{
+    uint8_t *p_buf = malloc( MP4_INDEXER_PREFETCH );
+    if( p_buf == NULL )
+        return;
+
+    vlc_mutex_lock( &p_idx->lock );
+    for( ;; )
+    {
+        uint64_t i_start, i_end;
+
+        while( !p_idx->b_stop && !IndexerGetPrefetch( p_idx, &i_start, &i_end ) )
+            vlc_cond_wait( &p_idx->wait, &p_idx->lock );
+        if( p_idx->b_stop )
+            break;
+        const uint64_t i_prefetched = p_idx->i_prefetched;
+        vlc_mutex_unlock( &p_idx->lock );
+
+        ssize_t i_read = -1;
+        if( vlc_stream_Seek( s, i_start ) == VLC_SUCCESS )
+            i_read = vlc_stream_Read( s, p_buf,
+                                      __MIN( i_end - i_start, MP4_INDEXER_PREFETCH ) );
+
+        vlc_mutex_lock( &p_idx->lock );
+        if( i_read <= 0 )
+            break;
+        if( p_idx->i_prefetched == i_prefetched ) /* no seek meanwhile */
+            p_idx->i_prefetched = i_start + i_read;
+    }
+    vlc_mutex_unlock( &p_idx->lock );
+    free( p_buf );
+}
+
+static void *IndexerThread( void *data )
+{
+    mp4_fragments_indexer_t *p_idx = data;
+    stream_t *s = vlc_stream_NewURL( p_idx->p_obj, p_idx->psz_url );
+
+    if( s == NULL || IndexerSign( p_idx, s ) )
+        goto out;
+
+    if( p_idx->psz_path != NULL )
+        IndexerLoad( p_idx );
+
+    if( !p_idx->b_complete )
+    {
+        if( vlc_stream_Seek( s, p_idx->i_scan_pos ) )
+            goto out;
+        IndexerScan( p_idx, s );
+    }
+
+    if( p_idx->b_complete && p_idx->i_prefetch > 0 )
+        IndexerPrefetch( p_idx, s );
+
+out:
+    if( s != NULL )
+        vlc_stream_Delete( s );
+
+    vlc_mutex_lock( &p_idx->lock );
+    p_idx->b_ended = true;
+    vlc_cond_broadcast( &p_idx->wait );
+    vlc_mutex_unlock( &p_idx->lock );
+    return NULL;
+}
+
+mp4_fragments_indexer_t * MP4_Fragments_Indexer_New( vlc_object_t *p_obj, const char *psz_url,
+                                                     uint64_t i_start, unsigned i_tracks,
+                                                     const stime_t *pi_track_times,
+                                                     mp4_fragments_moof_cb pf_moof, void *opaque,
+                                                     unsigned i_prefetch, bool b_persistent )
+{
+    mp4_fragments_indexer_t *p_idx = calloc( 1, sizeof(*p_idx) );
+    if( unlikely(p_idx == NULL) )
+        return NULL;
+
+    p_idx->p_obj = p_obj;
+    p_idx->i_tracks = i_tracks;
+    p_idx->i_prefetch = i_prefetch;
+    p_idx->pf_moof = pf_moof;
+    p_idx->opaque = opaque;
+    p_idx->i_scan_pos = i_start;
+    p_idx->psz_url = strdup( psz_url );
+    p_idx->p_index = MP4_Fragments_Index_New( i_tracks, 0 );
+    p_idx->pi_track_times = vlc_alloc( i_tracks, sizeof(*pi_track_times) );
+    if( !p_idx->psz_url || !p_idx->p_index || !p_idx->pi_track_times )
+    {
+        MP4_Fragments_Index_Delete( p_idx->p_index );
+        free( p_idx->pi_track_times );
+        free( p_idx->psz_url );
+        free( p_idx );
+        return NULL;
+    }
+    memcpy( p_idx->pi_track_times, pi_track_times, i_tracks * sizeof(*pi_track_times) );
+
+    if( b_persistent )
+        p_idx->psz_path = cachefile_GetPath( "mp4-index", psz_url,
+                                             strlen( psz_url ) );
+
+    vlc_mutex_init( &p_idx->lock );
+    vlc_cond_init( &p_idx->wait );
+
+    p_idx->b_thread = !vlc_clone( &p_idx->thread, IndexerThread, p_idx,
+                                  VLC_THREAD_PRIORITY_LOW );
+    p_idx->b_ended = !p_idx->b_thread;
+    return p_idx;
+}
+
+void MP4_Fragments_Indexer_Delete( mp4_fragments_indexer_t *p_idx )
+{
+    if( p_idx->b_thread )
+    {
+        vlc_mutex_lock( &p_idx->lock );
+        p_idx->b_stop = true;
+        vlc_cond_broadcast( &p_idx->wait );
+        vlc_mutex_unlock( &p_idx->lock );
+        vlc_join( p_idx->thread, NULL );
+    }
+
+    if( p_idx->psz_path != NULL && p_idx->b_dirty )
+        IndexerSave( p_idx );
+
+    vlc_cond_destroy( &p_idx->wait );
+    vlc_mutex_destroy( &p_idx->lock );
+    MP4_Fragments_Index_Delete( p_idx->p_index );
+    free( p_idx->pi_track_times );
+    free( p_idx->psz_path );
+    free( p_idx->psz_url );
+    free( p_idx );
+}
+
+/* Waits for the indexer, unless the demuxer gets interrupted */
+static bool IndexerWait( mp4_fragments_indexer_t *p_idx )
+{
+    if( p_idx->b_ended || vlc_killed() )
+        return false;
+    vlc_cond_timedwait( &p_idx->wait, &p_idx->lock, mdate() + CLOCK_FREQ / 10 );
+    return true;
+}
+
+bool MP4_Fragments_Indexer_Lookup( mp4_fragments_indexer_t *p_idx, stime_t *pi_time,
+                                   uint64_t *pi_pos, unsigned i_track_index )
+{
+    vlc_mutex_lock( &p_idx->lock );
+    while( !p_idx->b_complete && *pi_time >= p_idx->p_index->i_last_time )
+        if( !IndexerWait( p_idx ) )
+            break;
+    bool b_ret = MP4_Fragments_Index_Lookup( p_idx->p_index, pi_time, pi_pos, i_track_index );
+    vlc_mutex_unlock( &p_idx->lock );
+    return b_ret;
+}
+
+static int IndexPosCmp( const void *key, const void *entry )
+{
+    const uint64_t i_pos = *(const uint64_t *)key;
+    const uint64_t i_entry = *(const uint64_t *)entry;
+    return ( i_pos > i_entry ) - ( i_pos < i_entry );
+}
+
+bool MP4_Fragments_Indexer_GetTrackStartTime( mp4_fragments_indexer_t *p_idx, unsigned i_track_index,
+                                              uint64_t i_moof_pos, stime_t *pi_time )
+{
+    vlc_mutex_lock( &p_idx->lock );
+    const mp4_fragments_index_t *p_index = p_idx->p_index;
+    /* positions are strictly increasing */
+    const uint64_t *pi_pos = bsearch( &i_moof_pos, p_index->pi_pos, p_index->i_entries,
+                                      sizeof(*p_index->pi_pos), IndexPosCmp );
+    if( pi_pos != NULL )
+        *pi_time = p_index->p_times[(size_t)(pi_pos - p_index->pi_pos) * p_index->i_tracks
+                                    + i_track_index];
+    vlc_mutex_unlock( &p_idx->lock );
+    return pi_pos != NULL;
+}
+
+mp4_fragments_index_t * MP4_Fragments_Indexer_GetIndex( mp4_fragments_indexer_t *p_idx,
+                                                        bool b_wait )
+{
+    vlc_mutex_lock( &p_idx->lock );
+    while( b_wait && !p_idx->b_complete )
+        if( !IndexerWait( p_idx ) )
+            break;
+    /* a complete index is not modified anymore */
+    mp4_fragments_index_t *p_index = p_idx->b_complete ? p_idx->p_index : NULL;
+    vlc_mutex_unlock( &p_idx->lock );
+    return p_index;
+}
+
+void MP4_Fragments_Indexer_SetPosition( mp4_fragments_indexer_t *p_idx, uint64_t i_pos )
+{
+    vlc_mutex_lock( &p_idx->lock );
+    /* restart reading ahead from there after seeking */
+    if( i_pos < p_idx->i_demux_pos || i_pos > p_idx->i_prefetched )
+        p_idx->i_prefetched = i_pos;
+    p_idx->i_demux_pos = i_pos;
+    vlc_cond_broadcast( &p_idx->wait );
+    vlc_mutex_unlock( &p_idx->lock );
+}
+
 #ifdef MP4_VERBOSE
 void MP4_Fragments_Index_Dump( vlc_object_t *p_obj, const mp4_fragments_index_t *p_index,
                                uint32_t i_movie_timescale )
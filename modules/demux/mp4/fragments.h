@@ -28,6 +28,7 @@ typedef struct mp4_fragments_index_t
     uint64_t *pi_pos;
     stime_t  *p_times; // movie scaled
     unsigned i_entries;
+    unsigned i_alloc;
     stime_t i_last_time; // movie scaled
     unsigned i_tracks;
 } mp4_fragments_index_t;
@@ -35,6 +36,9 @@ typedef struct mp4_fragments_index_t
 void MP4_Fragments_Index_Delete( mp4_fragments_index_t *p_index );
 mp4_fragments_index_t * MP4_Fragments_Index_New( unsigned i_tracks, unsigned i_num );
 
+bool MP4_Fragments_Index_Append( mp4_fragments_index_t *p_index, uint64_t i_pos,
+                                 const stime_t *p_times );
+
 stime_t MP4_Fragment_Index_GetTrackStartTime( mp4_fragments_index_t *p_index,
                                               unsigned i_track_index, uint64_t i_moof_pos );
 stime_t MP4_Fragment_Index_GetTrackDuration( mp4_fragments_index_t *p_index, unsigned i_track_index );
@@ -42,6 +46,37 @@ stime_t MP4_Fragment_Index_GetTrackDuration( mp4_fragments_index_t *p_index, uns
 bool MP4_Fragments_Index_Lookup( mp4_fragments_index_t *p_index,
                                  stime_t *pi_time, uint64_t *pi_pos, unsigned i_track_index );
 
+/* Background moof indexer, reading the stream through its own handle */
+typedef struct mp4_fragments_indexer_t mp4_fragments_indexer_t;
+
+/* Computes the movie scaled start times of each track of a moof,
+ * and returns its movie scaled end time. pi_track_times holds the track
+ * scaled time following the previous moof, and is updated.
+ * Called from the indexer thread: must only use read-only demuxer data. */
+typedef stime_t (*mp4_fragments_moof_cb)( void *opaque, MP4_Box_t *p_moof,
+                                          stime_t *pi_track_times, stime_t *p_times );
+
+mp4_fragments_indexer_t * MP4_Fragments_Indexer_New( vlc_object_t *p_obj, const char *psz_url,
+                                                     uint64_t i_start, unsigned i_tracks,
+                                                     const stime_t *pi_track_times,
+                                                     mp4_fragments_moof_cb pf_moof, void *opaque,
+                                                     unsigned i_prefetch, bool b_persistent );
+void MP4_Fragments_Indexer_Delete( mp4_fragments_indexer_t * );
+
+/* Same as MP4_Fragments_Index_Lookup, waiting until the time is indexed */
+bool MP4_Fragments_Indexer_Lookup( mp4_fragments_indexer_t *, stime_t *pi_time,
+                                   uint64_t *pi_pos, unsigned i_track_index );
+
+/* Gets the start time of an already indexed moof, without waiting */
+bool MP4_Fragments_Indexer_GetTrackStartTime( mp4_fragments_indexer_t *, unsigned i_track_index,
+                                              uint64_t i_moof_pos, stime_t *pi_time );
+
+/* Returns the index once complete, or NULL. It belongs to the indexer. */
+mp4_fragments_index_t * MP4_Fragments_Indexer_GetIndex( mp4_fragments_indexer_t *, bool b_wait );
+
+/* Tells the position of the moof being demuxed, for prefetching */
+void MP4_Fragments_Indexer_SetPosition( mp4_fragments_indexer_t *, uint64_t i_pos );
+
 #ifdef MP4_VERBOSE
 void MP4_Fragments_Index_Dump( vlc_object_t *p_obj, const mp4_fragments_index_t *p_index,
                                 uint32_t i_movie_timescale );
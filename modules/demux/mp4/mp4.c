@@ -50,6 +50,16 @@ static void Close( vlc_object_t * );
 #define MP4_M4A_TEXT     N_("M4A audio only")
 #define MP4_M4A_LONGTEXT N_("Ignore non audio tracks from iTunes audio files")
 
+#define MP4_FRAG_INDEX_TEXT     N_("Index fragments in background")
+#define MP4_FRAG_INDEX_LONGTEXT N_("Locate the fragments of local fragmented " \
+    "files without index in background, for fast seeking.")
+#define MP4_FRAG_CACHE_TEXT     N_("Keep fragments index")
+#define MP4_FRAG_CACHE_LONGTEXT N_("Save the fragments index in the cache " \
+    "directory, so that it can be reused when opening the file again.")
+#define MP4_FRAG_PREFETCH_TEXT     N_("Fragments read ahead")
+#define MP4_FRAG_PREFETCH_LONGTEXT N_("Number of fragments to read ahead " \
+    "of the playback position once they are indexed (0 disables).")
+
 vlc_module_begin ()
     set_category( CAT_INPUT )
     set_subcategory( SUBCAT_INPUT_DEMUX )
@@ -58,6 +68,13 @@ vlc_module_begin ()
     set_capability( "demux", 240 )
     set_callbacks( Open, Close )
 
+    add_bool( CFG_PREFIX"fragment-index", true, MP4_FRAG_INDEX_TEXT,
+              MP4_FRAG_INDEX_LONGTEXT, true )
+    add_bool( CFG_PREFIX"fragment-index-cache", false, MP4_FRAG_CACHE_TEXT,
+              MP4_FRAG_CACHE_LONGTEXT, true )
+    add_integer_with_range( CFG_PREFIX"fragment-prefetch", 2, 0, 64,
+                            MP4_FRAG_PREFETCH_TEXT, MP4_FRAG_PREFETCH_LONGTEXT, true )
+
     add_category_hint("Hacks", NULL, true)
     add_bool( CFG_PREFIX"m4a-audioonly", false, MP4_M4A_TEXT, MP4_M4A_LONGTEXT, true )
 vlc_module_end ()
@@ -121,6 +138,7 @@ struct demux_sys_t
     } hacks;
 
     mp4_fragments_index_t *p_fragsindex;
+    mp4_fragments_indexer_t *p_fragsindexer; /* owns p_fragsindex if set */
 };
 
 #define DEMUX_INCREMENT (CLOCK_FREQ / 4) /* How far the pcr will go, each round */
@@ -167,6 +185,8 @@ static stime_t GetMoovTrackDuration( demux_sys_t *p_sys, unsigned i_track_ID );
 
 static int  ProbeFragments( demux_t *p_demux, bool b_force, bool *pb_fragmented );
 static int  ProbeFragmentsChecked( demux_t *p_demux );
+static void FragStartIndexer( demux_t *p_demux );
+static void FragCheckIndexer( demux_t *p_demux, bool b_wait );
 static int  ProbeIndex( demux_t *p_demux );
 
 static int FragCreateTrunIndex( demux_t *, MP4_Box_t *, MP4_Box_t *, stime_t, bool );
@@ -294,31 +314,48 @@ static es_out_id_t * MP4_AddTrackES( es_out_t *out, mp4_track_t *p_track )
     return p_es;
 }
 
-/* Return time in microsecond of a track */
-static inline int64_t MP4_TrackGetDTS( demux_t *p_demux, mp4_track_t *p_track )
+/* Moves a stts or ctts table position forward by i_samples samples,
+ * or up to the end of the table. Returns the sum of the sample deltas
+ * walked over if pi_delta is not NULL. */
+static uint64_t MP4_TTSWalk( const uint32_t *pi_count, const int32_t *pi_delta,
+                             uint32_t i_entries, mp4_tts_pos_t *p_pos,
+                             uint32_t i_samples )
 {
-    demux_sys_t *p_sys = p_demux->p_sys;
-    const mp4_chunk_t *p_chunk = &p_track->chunk[p_track->i_chunk];
-
-    unsigned int i_index = 0;
-    unsigned int i_sample = p_track->i_sample - p_chunk->i_sample_first;
-    int64_t i_dts = p_chunk->i_first_dts;
+    uint64_t i_sum = 0;
 
-    while( i_sample > 0 && i_index < p_chunk->i_entries_dts )
+    while( i_samples > 0 && p_pos->i_index < i_entries )
     {
-        if( i_sample > p_chunk->p_sample_count_dts[i_index] )
+        const uint32_t i_left = pi_count[p_pos->i_index] - p_pos->i_skip;
+        const uint32_t i_count = __MIN( i_left, i_samples );
+
+        if( pi_delta )
+            i_sum += (uint64_t)i_count * (uint32_t)pi_delta[p_pos->i_index];
+        i_samples -= i_count;
+        if( i_count < i_left )
         {
-            i_dts += p_chunk->p_sample_count_dts[i_index] *
-                p_chunk->p_sample_delta_dts[i_index];
-            i_sample -= p_chunk->p_sample_count_dts[i_index];
-            i_index++;
+            p_pos->i_skip += i_count;
         }
         else
         {
-            i_dts += i_sample * p_chunk->p_sample_delta_dts[i_index];
-            break;
+            p_pos->i_index++;
+            p_pos->i_skip = 0;
         }
     }
+    return i_sum;
+}
+
+/* Return time in microsecond of a track */
+static inline int64_t MP4_TrackGetDTS( demux_t *p_demux, mp4_track_t *p_track )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    const mp4_chunk_t *p_chunk = &p_track->chunk[p_track->i_chunk];
+    const MP4_Box_data_stts_t *stts = p_track->p_stts;
+
+    mp4_tts_pos_t pos = p_chunk->dts_pos;
+    int64_t i_dts = p_chunk->i_first_dts +
+        MP4_TTSWalk( stts->pi_sample_count, stts->pi_sample_delta,
+                     stts->i_entry_count, &pos,
+                     p_track->i_sample - p_chunk->i_sample_first );
 
     i_dts = MP4_rescale( i_dts, p_track->i_timescale, CLOCK_FREQ );
 
@@ -348,26 +385,27 @@ static inline bool MP4_TrackGetPTSDelta( demux_t *p_demux, mp4_track_t *p_track,
                                          int64_t *pi_delta )
 {
     VLC_UNUSED( p_demux );
-    mp4_chunk_t *ck = &p_track->chunk[p_track->i_chunk];
-
-    unsigned int i_index = 0;
-    unsigned int i_sample = p_track->i_sample - ck->i_sample_first;
+    const mp4_chunk_t *ck = &p_track->chunk[p_track->i_chunk];
+    const MP4_Box_data_ctts_t *ctts = p_track->p_ctts;
 
-    if( ck->p_sample_count_pts == NULL || ck->p_sample_offset_pts == NULL )
+    if( ctts == NULL )
         return false;
 
-    for( i_index = 0; i_index < ck->i_entries_pts ; i_index++ )
-    {
-        if( i_sample < ck->p_sample_count_pts[i_index] )
-        {
-            *pi_delta = MP4_rescale( ck->p_sample_offset_pts[i_index],
-                                     p_track->i_timescale, CLOCK_FREQ );
-            return true;
-        }
+    mp4_tts_pos_t pos = ck->pts_pos;
+    MP4_TTSWalk( ctts->pi_sample_count, NULL, ctts->i_entry_count, &pos,
+                 p_track->i_sample - ck->i_sample_first );
 
-        i_sample -= ck->p_sample_count_pts[i_index];
-    }
-    return false;
+    /* skip empty entries */
+    while( pos.i_index < ctts->i_entry_count &&
+           ctts->pi_sample_count[pos.i_index] == 0 )
+        pos.i_index++;
+    if( pos.i_index >= ctts->i_entry_count )
+        return false;
+
+    *pi_delta = MP4_rescale( ctts->pi_sample_offset[pos.i_index] +
+                             p_track->i_cts_shift,
+                             p_track->i_timescale, CLOCK_FREQ );
+    return true;
 }
 
 static inline int64_t MP4_GetMoviePTS(demux_sys_t *p_sys )
@@ -974,8 +1012,13 @@ static int Open( vlc_object_t * p_this )
             if( !p_sys->b_fragmented /* as unknown */ )
             {
                 /* Probe remaining to check if there's really fragments
-                   or if that file is just ready to append fragments */
-                ProbeFragments( p_demux, (p_sys->i_duration == 0), &p_sys->b_fragmented );
+                   or if that file is just ready to append fragments.
+                   The whole file is read unless it can be indexed later. */
+                bool b_force = p_sys->b_fastseekable || p_sys->i_duration == 0;
+                if( p_sys->b_fastseekable && !p_demux->b_preparsing &&
+                    var_InheritBool( p_demux, CFG_PREFIX"fragment-index" ) )
+                    b_force = false;
+                ProbeFragments( p_demux, b_force, &p_sys->b_fragmented );
             }
 
             if( vlc_stream_Seek( p_demux->s, p_sys->p_moov->i_pos ) != VLC_SUCCESS )
@@ -993,6 +1036,11 @@ static int Open( vlc_object_t * p_this )
     {
         p_demux->pf_demux = DemuxFrag;
         msg_Dbg( p_demux, "Set Fragmented demux mode" );
+
+        if( p_sys->b_fastseekable && !p_sys->b_fragments_probed &&
+            !p_demux->b_preparsing && !MP4_BoxGet( p_sys->p_root, "sidx" ) &&
+            var_InheritBool( p_demux, CFG_PREFIX"fragment-index" ) )
+            FragStartIndexer( p_demux );
     }
 
     if( !p_sys->b_seekable && p_demux->pf_demux == Demux )
@@ -1579,6 +1627,8 @@ static int FragSeekLoadFragment( demux_t *p_demux, uint32_t i_moox, stime_t i_mo
 
     if( i_moox == ATOM_moof )
     {
+        if( p_sys->p_fragsindexer )
+            MP4_Fragments_Indexer_SetPosition( p_sys->p_fragsindexer, p_moox->i_pos );
         FragPrepareChunk( p_demux, p_moox, NULL, i_moox_time, true );
         p_sys->context.i_lastseqnumber = FragGetMoofSequenceNumber( p_moox );
 
@@ -1661,8 +1711,12 @@ static int FragSeekToTime( demux_t *p_demux, mtime_t i_nztime, bool b_accurate )
     mtime_t i_sync_time = i_nztime;
     bool b_iframesync = false;
 
+    FragCheckIndexer( p_demux, false );
+
+    /* the indexer can get further than the duration known so far */
     const uint64_t i_duration = __MAX(p_sys->i_duration, p_sys->i_cumulated_duration);
-    if ( !p_sys->i_timescale || !i_duration || !p_sys->b_seekable )
+    if ( !p_sys->i_timescale || !p_sys->b_seekable ||
+         ( !i_duration && !p_sys->p_fragsindexer ) )
          return VLC_EGENERIC;
 
     uint64_t i_backup_pos = vlc_stream_Tell( p_demux->s );
@@ -1696,6 +1750,20 @@ static int FragSeekToTime( demux_t *p_demux, mtime_t i_nztime, bool b_accurate )
             msg_Dbg( p_demux, "seeking to sync point %" PRId64, i_sync_time );
             b_iframesync = true;
         }
+        else if( !p_sys->b_fragments_probed && p_sys->p_fragsindexer )
+        {
+            /* Waits until the background indexer gets there */
+            stime_t i_basetime = MP4_rescale( i_sync_time, CLOCK_FREQ, p_sys->i_timescale );
+            if( !MP4_Fragments_Indexer_Lookup( p_sys->p_fragsindexer, &i_basetime,
+                                               &i64, i_seek_track_index ) )
+            {
+                p_sys->b_error = (vlc_stream_Seek( p_demux->s, i_backup_pos ) != VLC_SUCCESS);
+                return VLC_EGENERIC;
+            }
+            i_segment_time = i_basetime;
+            msg_Dbg( p_demux, "seeking to fragment indexer pos %" PRId64 " %" PRId64, i64,
+                     MP4_rescale( i_basetime, p_sys->i_timescale, CLOCK_FREQ ) );
+        }
         else if( !p_sys->b_fragments_probed )
         {
             int i_ret = ProbeFragmentsChecked( p_demux );
@@ -1771,7 +1839,12 @@ static int FragSeekToPos( demux_t *p_demux, double f, bool b_accurate )
         return VLC_EGENERIC;
 
     uint64_t i_duration = __MAX(p_sys->i_duration, p_sys->i_cumulated_duration);
-    if( !i_duration && !p_sys->b_fragments_probed )
+    if( !i_duration && p_sys->p_fragsindexer )
+    {
+        FragCheckIndexer( p_demux, true );
+        i_duration = __MAX(p_sys->i_duration, p_sys->i_cumulated_duration);
+    }
+    else if( !i_duration && !p_sys->b_fragments_probed )
     {
         int i_ret = ProbeFragmentsChecked( p_demux );
         if( i_ret != VLC_SUCCESS )
@@ -2118,6 +2191,12 @@ static void Close ( vlc_object_t * p_this )
 
     msg_Dbg( p_demux, "freeing all memory" );
 
+    /* The indexer thread uses the tracks and boxes */
+    if( p_sys->p_fragsindexer )
+        MP4_Fragments_Indexer_Delete( p_sys->p_fragsindexer );
+    else
+        MP4_Fragments_Index_Delete( p_sys->p_fragsindex );
+
     FragResetContext( p_sys );
 
     MP4_BoxFree( p_sys->p_root );
@@ -2128,8 +2207,6 @@ static void Close ( vlc_object_t * p_this )
     if( p_sys->p_meta )
         vlc_meta_Delete( p_sys->p_meta );
 
-    MP4_Fragments_Index_Delete( p_sys->p_fragsindex );
-
     for( i_track = 0; i_track < p_sys->i_tracks; i_track++ )
         MP4_TrackClean( p_demux->out, &p_sys->track[i_track] );
     free( p_sys->track );
@@ -2322,14 +2399,6 @@ static int TrackCreateChunksIndex( demux_t *p_demux,
         mp4_chunk_t *ck = &p_demux_track->chunk[i_chunk];
 
         ck->i_offset = BOXDATA(p_co64)->i_chunk_offset[i_chunk];
-
-        ck->i_first_dts = 0;
-        ck->i_entries_dts = 0;
-        ck->p_sample_count_dts = NULL;
-        ck->p_sample_delta_dts = NULL;
-        ck->i_entries_pts = 0;
-        ck->p_sample_count_pts = NULL;
-        ck->p_sample_offset_pts = NULL;
     }
 
     /* now we read index for SampleEntry( soun vide mp4a mp4v ...)
@@ -2391,54 +2460,6 @@ static int TrackCreateChunksIndex( demux_t *p_demux,
     return VLC_SUCCESS;
 }
 
-static int xTTS_CountEntries( demux_t *p_demux, uint32_t *pi_entry /* out */,
-                              const uint32_t i_index,
-                              uint32_t i_index_samples_left,
-                              uint32_t i_sample_count,
-                              const uint32_t *pi_index_sample_count,
-                              const uint32_t i_table_count )
-{
-    uint32_t i_array_offset;
-    while( i_sample_count > 0 )
-    {
-        if ( likely((UINT32_MAX - i_index) >= *pi_entry) )
-            i_array_offset = i_index + *pi_entry;
-        else
-            return VLC_EGENERIC;
-
-        if ( i_array_offset >= i_table_count )
-        {
-            msg_Err( p_demux, "invalid index counting total samples %u %u", i_array_offset,  i_table_count );
-            return VLC_ENOVAR;
-        }
-
-        if ( i_index_samples_left )
-        {
-            if ( i_index_samples_left > i_sample_count )
-            {
-                i_index_samples_left -= i_sample_count;
-                i_sample_count = 0;
-                *pi_entry +=1; /* No samples left, go copy */
-                break;
-            }
-            else
-            {
-                i_sample_count -= i_index_samples_left;
-                i_index_samples_left = 0;
-                *pi_entry += 1;
-                continue;
-            }
-        }
-        else
-        {
-            i_sample_count -= __MIN( i_sample_count, pi_index_sample_count[i_array_offset] );
-            *pi_entry += 1;
-        }
-    }
-
-    return VLC_SUCCESS;
-}
-
 static int TrackCreateSamplesIndex( demux_t *p_demux,
                                     mp4_track_t *p_demux_track )
 {
@@ -2476,18 +2497,9 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
     }
     else
     {
-        /* 2: each sample can have a different size */
+        /* 2: each sample can have a different size, read from the box */
         p_demux_track->i_sample_size = 0;
-        p_demux_track->p_sample_size =
-            calloc( p_demux_track->i_sample_count, sizeof( uint32_t ) );
-        if( p_demux_track->p_sample_size == NULL )
-            return VLC_ENOMEM;
-
-        for( uint32_t i_sample = 0; i_sample < p_demux_track->i_sample_count; i_sample++ )
-        {
-            p_demux_track->p_sample_size[i_sample] =
-                    stsz->i_entry_size[i_sample];
-        }
+        p_demux_track->p_sample_size = stsz->i_entry_size;
     }
 
     if ( p_demux_track->i_chunk_count && p_demux_track->i_sample_size == 0 )
@@ -2500,220 +2512,67 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
         }
     }
 
-    /* Use stts table to create a sample number -> dts table.
-     * XXX: if we don't want to waste too much memory, we can't expand
-     *  the box! so each chunk will contain an "extract" of this table
-     *  for fast research (problem with raw stream where a sample is sometime
-     *  just channels*bits_per_sample/8 */
-
-     /* FIXME: refactor STTS & CTTS, STTS having now only few extra lines and
-      *        differing in 2/2 fields and 1 signedness */
+    /* The stts and ctts tables are not expanded per chunk: each chunk only
+     * records where its first sample is in them, and sample times are
+     * computed from there when needed. This keeps opening huge files fast
+     * and their memory use low. */
 
     mtime_t i_next_dts = 0;
     /* Find stts
      *  Gives mapping between sample and decoding time
      */
     p_box = MP4_BoxGet( p_demux_track->p_stbl, "stts" );
-    if( !p_box )
+    if( !p_box || !p_box->data.p_stts )
     {
         msg_Warn( p_demux, "cannot find STTS box" );
         return VLC_EGENERIC;
     }
     else
     {
-        MP4_Box_data_stts_t *stts = p_box->data.p_stts;
+        const MP4_Box_data_stts_t *stts = p_box->data.p_stts;
+        mp4_tts_pos_t pos = { 0, 0 };
 
         msg_Warn( p_demux, "STTS table of %"PRIu32" entries", stts->i_entry_count );
 
-        /* Create sample -> dts table per chunk */
-        uint32_t i_index = 0;
-        uint32_t i_current_index_samples_left = 0;
-
         for( uint32_t i_chunk = 0; i_chunk < p_demux_track->i_chunk_count; i_chunk++ )
         {
             mp4_chunk_t *ck = &p_demux_track->chunk[i_chunk];
-            uint32_t i_sample_count;
 
-            /* save first dts */
             ck->i_first_dts = i_next_dts;
-
-            /* count how many entries are needed for this chunk
-             * for p_sample_delta_dts and p_sample_count_dts */
-            ck->i_entries_dts = 0;
-
-            int i_ret = xTTS_CountEntries( p_demux, &ck->i_entries_dts, i_index,
-                                           i_current_index_samples_left,
-                                           ck->i_sample_count,
-                                           stts->pi_sample_count,
-                                           stts->i_entry_count );
-            if ( i_ret == VLC_EGENERIC )
-                return i_ret;
-
-            /* allocate them */
-            ck->p_sample_count_dts = calloc( ck->i_entries_dts, sizeof( uint32_t ) );
-            ck->p_sample_delta_dts = calloc( ck->i_entries_dts, sizeof( uint32_t ) );
-            if( !ck->p_sample_count_dts || !ck->p_sample_delta_dts )
-            {
-                free( ck->p_sample_count_dts );
-                free( ck->p_sample_delta_dts );
-                msg_Err( p_demux, "can't allocate memory for i_entry=%"PRIu32, ck->i_entries_dts );
-                ck->i_entries_dts = 0;
-                return VLC_ENOMEM;
-            }
-
-            /* now copy */
-            i_sample_count = ck->i_sample_count;
-
-            for( uint32_t i = 0; i < ck->i_entries_dts; i++ )
-            {
-                if ( i_current_index_samples_left )
-                {
-                    if ( i_current_index_samples_left > i_sample_count )
-                    {
-                        ck->p_sample_count_dts[i] = i_sample_count;
-                        ck->p_sample_delta_dts[i] = stts->pi_sample_delta[i_index];
-                        i_next_dts += ck->p_sample_count_dts[i] * stts->pi_sample_delta[i_index];
-                        if ( i_sample_count ) ck->i_duration = i_next_dts - ck->i_first_dts;
-                        i_current_index_samples_left -= i_sample_count;
-                        i_sample_count = 0;
-                        assert( i == ck->i_entries_dts - 1 );
-                        break;
-                    }
-                    else
-                    {
-                        ck->p_sample_count_dts[i] = i_current_index_samples_left;
-                        ck->p_sample_delta_dts[i] = stts->pi_sample_delta[i_index];
-                        i_next_dts += ck->p_sample_count_dts[i] * stts->pi_sample_delta[i_index];
-                        if ( i_current_index_samples_left ) ck->i_duration = i_next_dts - ck->i_first_dts;
-                        i_sample_count -= i_current_index_samples_left;
-                        i_current_index_samples_left = 0;
-                        i_index++;
-                    }
-                }
-                else
-                {
-                    if ( stts->pi_sample_count[i_index] > i_sample_count )
-                    {
-                        ck->p_sample_count_dts[i] = i_sample_count;
-                        ck->p_sample_delta_dts[i] = stts->pi_sample_delta[i_index];
-                        i_next_dts += ck->p_sample_count_dts[i] * stts->pi_sample_delta[i_index];
-                        if ( i_sample_count ) ck->i_duration = i_next_dts - ck->i_first_dts;
-                        i_current_index_samples_left = stts->pi_sample_count[i_index] - i_sample_count;
-                        i_sample_count = 0;
-                        assert( i == ck->i_entries_dts - 1 );
-                        // keep building from same index
-                    }
-                    else
-                    {
-                        ck->p_sample_count_dts[i] = stts->pi_sample_count[i_index];
-                        ck->p_sample_delta_dts[i] = stts->pi_sample_delta[i_index];
-                        i_next_dts += ck->p_sample_count_dts[i] * stts->pi_sample_delta[i_index];
-                        if ( stts->pi_sample_count[i_index] ) ck->i_duration = i_next_dts - ck->i_first_dts;
-                        i_sample_count -= stts->pi_sample_count[i_index];
-                        i_index++;
-                    }
-                }
-
-            }
+            ck->dts_pos = pos;
+            ck->i_duration = MP4_TTSWalk( stts->pi_sample_count,
+                                          stts->pi_sample_delta,
+                                          stts->i_entry_count, &pos,
+                                          ck->i_sample_count );
+            i_next_dts += ck->i_duration;
         }
+        p_demux_track->p_stts = stts;
     }
 
-
     /* Find ctts
      *  Gives the delta between decoding time (dts) and composition table (pts)
      */
     p_box = MP4_BoxGet( p_demux_track->p_stbl, "ctts" );
     if( p_box && p_box->data.p_ctts )
     {
-        MP4_Box_data_ctts_t *ctts = p_box->data.p_ctts;
+        const MP4_Box_data_ctts_t *ctts = p_box->data.p_ctts;
+        mp4_tts_pos_t pos = { 0, 0 };
 
         msg_Warn( p_demux, "CTTS table of %"PRIu32" entries", ctts->i_entry_count );
 
-        int64_t i_cts_shift = 0;
         const MP4_Box_t *p_cslg = MP4_BoxGet( p_demux_track->p_stbl, "cslg" );
         if( p_cslg && BOXDATA(p_cslg) )
-            i_cts_shift = BOXDATA(p_cslg)->ct_to_dts_shift;
-
-        /* Create pts-dts table per chunk */
-        uint32_t i_index = 0;
-        uint32_t i_current_index_samples_left = 0;
+            p_demux_track->i_cts_shift = BOXDATA(p_cslg)->ct_to_dts_shift;
 
         for( uint32_t i_chunk = 0; i_chunk < p_demux_track->i_chunk_count; i_chunk++ )
         {
             mp4_chunk_t *ck = &p_demux_track->chunk[i_chunk];
-            uint32_t i_sample_count;
-
-            /* count how many entries are needed for this chunk
-             * for p_sample_offset_pts and p_sample_count_pts */
-            ck->i_entries_pts = 0;
-            int i_ret = xTTS_CountEntries( p_demux, &ck->i_entries_pts, i_index,
-                                           i_current_index_samples_left,
-                                           ck->i_sample_count,
-                                           ctts->pi_sample_count,
-                                           ctts->i_entry_count );
-            if ( i_ret == VLC_EGENERIC )
-                return i_ret;
-
-            /* allocate them */
-            ck->p_sample_count_pts = calloc( ck->i_entries_pts, sizeof( uint32_t ) );
-            ck->p_sample_offset_pts = calloc( ck->i_entries_pts, sizeof( int32_t ) );
-            if( !ck->p_sample_count_pts || !ck->p_sample_offset_pts )
-            {
-                free( ck->p_sample_count_pts );
-                free( ck->p_sample_offset_pts );
-                msg_Err( p_demux, "can't allocate memory for i_entry=%"PRIu32, ck->i_entries_pts );
-                ck->i_entries_pts = 0;
-                return VLC_ENOMEM;
-            }
-
-            /* now copy */
-            i_sample_count = ck->i_sample_count;
-
-            for( uint32_t i = 0; i < ck->i_entries_pts; i++ )
-            {
-                if ( i_current_index_samples_left )
-                {
-                    if ( i_current_index_samples_left > i_sample_count )
-                    {
-                        ck->p_sample_count_pts[i] = i_sample_count;
-                        ck->p_sample_offset_pts[i] = ctts->pi_sample_offset[i_index] + i_cts_shift;
-                        i_current_index_samples_left -= i_sample_count;
-                        i_sample_count = 0;
-                        assert( i == ck->i_entries_pts - 1 );
-                        break;
-                    }
-                    else
-                    {
-                        ck->p_sample_count_pts[i] = i_current_index_samples_left;
-                        ck->p_sample_offset_pts[i] = ctts->pi_sample_offset[i_index] + i_cts_shift;
-                        i_sample_count -= i_current_index_samples_left;
-                        i_current_index_samples_left = 0;
-                        i_index++;
-                    }
-                }
-                else
-                {
-                    if ( ctts->pi_sample_count[i_index] > i_sample_count )
-                    {
-                        ck->p_sample_count_pts[i] = i_sample_count;
-                        ck->p_sample_offset_pts[i] = ctts->pi_sample_offset[i_index] + i_cts_shift;
-                        i_current_index_samples_left = ctts->pi_sample_count[i_index] - i_sample_count;
-                        i_sample_count = 0;
-                        assert( i == ck->i_entries_pts - 1 );
-                        // keep building from same index
-                    }
-                    else
-                    {
-                        ck->p_sample_count_pts[i] = ctts->pi_sample_count[i_index];
-                        ck->p_sample_offset_pts[i] = ctts->pi_sample_offset[i_index] + i_cts_shift;
-                        i_sample_count -= ctts->pi_sample_count[i_index];
-                        i_index++;
-                    }
-                }
 
-
-            }
+            ck->pts_pos = pos;
+            MP4_TTSWalk( ctts->pi_sample_count, NULL, ctts->i_entry_count,
+                         &pos, ck->i_sample_count );
         }
+        p_demux_track->p_ctts = ctts;
     }
 
     msg_Dbg( p_demux, "track[Id 0x%x] read %"PRIu32" samples length:%"PRId64"s",
@@ -2968,7 +2827,6 @@ static int TrackTimeToSampleChunk( demux_t *p_demux, mp4_track_t *p_track,
     uint64_t     i_dts;
     unsigned int i_sample;
     unsigned int i_chunk;
-    int          i_index;
 
     /* FIXME see if it's needed to check p_track->i_chunk_count */
     if( p_track->i_chunk_count == 0 )
@@ -3032,30 +2890,30 @@ static int TrackTimeToSampleChunk( demux_t *p_demux, mp4_track_t *p_track,
     }
 
     /* *** find sample in the chunk *** */
+    const MP4_Box_data_stts_t *stts = p_track->p_stts;
+    mp4_tts_pos_t pos = p_track->chunk[i_chunk].dts_pos;
+    uint32_t i_left = p_track->chunk[i_chunk].i_sample_count;
+
     i_sample = p_track->chunk[i_chunk].i_sample_first;
     i_dts    = p_track->chunk[i_chunk].i_first_dts;
-    for( i_index = 0;  i_index < p_track->chunk[i_chunk].i_entries_dts &&
-                       i_sample < p_track->chunk[i_chunk].i_sample_count; )
+    while( i_left > 0 && pos.i_index < stts->i_entry_count )
     {
-        if( i_dts +
-            p_track->chunk[i_chunk].p_sample_count_dts[i_index] *
-            p_track->chunk[i_chunk].p_sample_delta_dts[i_index] < (uint64_t)i_start )
-        {
-            i_dts    +=
-                p_track->chunk[i_chunk].p_sample_count_dts[i_index] *
-                p_track->chunk[i_chunk].p_sample_delta_dts[i_index];
+        const uint32_t i_count =
+            __MIN( i_left, stts->pi_sample_count[pos.i_index] - pos.i_skip );
+        const uint32_t i_delta = stts->pi_sample_delta[pos.i_index];
 
-            i_sample += p_track->chunk[i_chunk].p_sample_count_dts[i_index];
-            i_index++;
+        if( i_dts + (uint64_t)i_count * i_delta < (uint64_t)i_start )
+        {
+            i_dts    += (uint64_t)i_count * i_delta;
+            i_sample += i_count;
+            i_left   -= i_count;
+            pos.i_index++;
+            pos.i_skip = 0;
         }
         else
         {
-            if( p_track->chunk[i_chunk].p_sample_delta_dts[i_index] <= 0 )
-            {
-                break;
-            }
-            i_sample += ( i_start - i_dts ) /
-                p_track->chunk[i_chunk].p_sample_delta_dts[i_index];
+            if( i_delta > 0 )
+                i_sample += ( i_start - i_dts ) / i_delta;
             break;
         }
     }
@@ -3486,15 +3344,6 @@ static void MP4_TrackSetup( demux_t *p_demux, mp4_track_t *p_track,
     p_track->b_ok = true;
 }
 
-static void DestroyChunk( mp4_chunk_t *ck )
-{
-    free( ck->p_sample_count_dts );
-    free( ck->p_sample_delta_dts );
-    free( ck->p_sample_count_pts );
-    free( ck->p_sample_offset_pts );
-    free( ck->p_sample_size );
-}
-
 /****************************************************************************
  * MP4_TrackClean:
  ****************************************************************************
@@ -3507,16 +3356,8 @@ static void MP4_TrackClean( es_out_t *out, mp4_track_t *p_track )
     if( p_track->p_es )
         es_out_Del( out, p_track->p_es );
 
-    if( p_track->chunk )
-    {
-        for( unsigned int i_chunk = 0; i_chunk < p_track->i_chunk_count; i_chunk++ )
-            DestroyChunk( &p_track->chunk[i_chunk] );
-    }
     free( p_track->chunk );
 
-    if( !p_track->i_sample_size )
-        free( p_track->p_sample_size );
-
     if ( p_track->asfinfo.p_frame )
         block_ChainRelease( p_track->asfinfo.p_frame );
 
@@ -4131,6 +3972,91 @@ static bool GetMoofTrackDuration( MP4_Box_t *p_moov, MP4_Box_t *p_moof,
     return true;
 }
 
+/* Sets the track scaled times before the first moof */
+static void FragIndexInitTimes( demux_sys_t *p_sys, stime_t *pi_track_times )
+{
+    for( unsigned i=0; i<p_sys->i_tracks; i++ )
+    {
+        stime_t i_duration = GetMoovTrackDuration( p_sys, p_sys->track[i].i_track_ID );
+        pi_track_times[i] = MP4_rescale( i_duration, p_sys->i_timescale, p_sys->track[i].i_timescale );
+    }
+}
+
+/* Gets the movie scaled times of each track of a moof, and its end time.
+ * Also used from the indexer thread: only reads the moov and tracks setup */
+static stime_t FragIndexMoof( void *opaque, MP4_Box_t *p_moof,
+                              stime_t *pi_track_times, stime_t *p_times )
+{
+    demux_sys_t *p_sys = opaque;
+    stime_t i_end = 0;
+
+    for( unsigned i=0; i<p_sys->i_tracks; i++ )
+    {
+        stime_t i_duration = 0;
+        MP4_Box_t *p_tfdt = NULL;
+        MP4_Box_t *p_traf = MP4_GetTrafByTrackID( p_moof, p_sys->track[i].i_track_ID );
+        if( p_traf )
+            p_tfdt = MP4_BoxGet( p_traf, "tfdt" );
+
+        if( p_tfdt && BOXDATA(p_tfdt) )
+            pi_track_times[i] = p_tfdt->data.p_tfdt->i_base_media_decode_time;
+
+        p_times[i] = MP4_rescale( pi_track_times[i], p_sys->track[i].i_timescale, p_sys->i_timescale );
+
+        if( GetMoofTrackDuration( p_sys->p_moov, p_moof, p_sys->track[i].i_track_ID, &i_duration ) )
+            pi_track_times[i] += i_duration;
+
+        stime_t i_movietime = MP4_rescale( pi_track_times[i], p_sys->track[i].i_timescale, p_sys->i_timescale );
+        i_end = __MAX( i_end, i_movietime );
+    }
+
+    return i_end;
+}
+
+static void FragStartIndexer( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    /* the indexer reads through its own stream */
+    if( p_demux->s->psz_url == NULL )
+        return;
+
+    stime_t *pi_track_times = vlc_alloc( p_sys->i_tracks, sizeof(*pi_track_times) );
+    if( pi_track_times )
+    {
+        FragIndexInitTimes( p_sys, pi_track_times );
+        p_sys->p_fragsindexer = MP4_Fragments_Indexer_New( VLC_OBJECT(p_demux), p_demux->s->psz_url,
+                                    p_sys->p_moov->i_pos + p_sys->p_moov->i_size,
+                                    p_sys->i_tracks, pi_track_times, FragIndexMoof, p_sys,
+                                    var_InheritInteger( p_demux, CFG_PREFIX"fragment-prefetch" ),
+                                    var_InheritBool( p_demux, CFG_PREFIX"fragment-index-cache" ) );
+        free( pi_track_times );
+    }
+}
+
+/* Uses the background index once complete */
+static void FragCheckIndexer( demux_t *p_demux, bool b_wait )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    if( p_sys->p_fragsindexer == NULL || p_sys->b_fragments_probed )
+        return;
+
+    mp4_fragments_index_t *p_index = MP4_Fragments_Indexer_GetIndex( p_sys->p_fragsindexer, b_wait );
+    if( p_index == NULL )
+        return;
+
+    p_sys->p_fragsindex = p_index;
+    p_sys->b_fragments_probed = true;
+#ifdef MP4_VERBOSE
+    MP4_Fragments_Index_Dump( VLC_OBJECT(p_demux), p_sys->p_fragsindex, p_sys->i_timescale );
+#endif
+
+    MP4_Box_t *p_mehd = MP4_BoxGet( p_sys->p_moov, "mvex/mehd");
+    if ( !p_mehd )
+        p_sys->i_cumulated_duration = GetCumulatedDuration( p_demux );
+}
+
 static int ProbeFragments( demux_t *p_demux, bool b_force, bool *pb_fragmented )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
@@ -4143,7 +4069,7 @@ static int ProbeFragments( demux_t *p_demux, bool b_force, bool *pb_fragmented )
     if( !p_vroot )
         return VLC_EGENERIC;
 
-    if( p_sys->b_seekable && (p_sys->b_fastseekable || b_force) )
+    if( p_sys->b_seekable && b_force )
     {
         MP4_ReadBoxContainerChildren( p_demux->s, p_vroot, NULL ); /* Get the rest of the file */
         p_sys->b_fragments_probed = true;
@@ -4160,8 +4086,11 @@ static int ProbeFragments( demux_t *p_demux, bool b_force, bool *pb_fragmented )
             }
 
             stime_t *pi_track_times = calloc( p_sys->i_tracks, sizeof(*pi_track_times) );
-            if( !pi_track_times )
+            stime_t *p_times = calloc( p_sys->i_tracks, sizeof(*p_times) );
+            if( !pi_track_times || !p_times )
             {
+                free( pi_track_times );
+                free( p_times );
                 MP4_Fragments_Index_Delete( p_sys->p_fragsindex );
                 p_sys->p_fragsindex = NULL;
                 MP4_BoxFree( p_vroot );
@@ -4170,50 +4099,22 @@ static int ProbeFragments( demux_t *p_demux, bool b_force, bool *pb_fragmented )
 
             unsigned index = 0;
 
+            FragIndexInitTimes( p_sys, pi_track_times );
             for( MP4_Box_t *p_moof = p_vroot->p_first; p_moof; p_moof = p_moof->p_next )
             {
                 if( p_moof->i_type != ATOM_moof )
                     continue;
 
-                for( unsigned i=0; i<p_sys->i_tracks; i++ )
-                {
-                    stime_t i_duration = 0;
-                    MP4_Box_t *p_tfdt = NULL;
-                    MP4_Box_t *p_traf = MP4_GetTrafByTrackID( p_moof, p_sys->track[i].i_track_ID );
-                    if( p_traf )
-                        p_tfdt = MP4_BoxGet( p_traf, "tfdt" );
-
-                    /* Set first fragment time offset from moov */
-                    if( index == 0 )
-                        pi_track_times[i] = GetMoovTrackDuration( p_sys, p_sys->track[i].i_track_ID );
-
-                    if( p_tfdt && BOXDATA(p_tfdt) )
-                    {
-                        pi_track_times[i] = p_tfdt->data.p_tfdt->i_base_media_decode_time;
-                    }
-                    else if( index == 0 ) /* Set first fragment time offset from moov */
-                    {
-                        i_duration = GetMoovTrackDuration( p_sys, p_sys->track[i].i_track_ID );
-                        pi_track_times[i] = MP4_rescale( i_duration, p_sys->i_timescale, p_sys->track[i].i_timescale );
-                    }
-
-                    stime_t i_movietime = MP4_rescale( pi_track_times[i], p_sys->track[i].i_timescale, p_sys->i_timescale );
-                    p_sys->p_fragsindex->p_times[index * p_sys->i_tracks + i] = i_movietime;
-
-                    if( GetMoofTrackDuration( p_sys->p_moov, p_moof, p_sys->track[i].i_track_ID, &i_duration ) )
-                        pi_track_times[i] += i_duration;
-                }
+                stime_t i_end = FragIndexMoof( p_sys, p_moof, pi_track_times, p_times );
+                if( p_sys->p_fragsindex->i_last_time < i_end )
+                    p_sys->p_fragsindex->i_last_time = i_end;
 
+                memcpy( &p_sys->p_fragsindex->p_times[index * p_sys->i_tracks], p_times,
+                        p_sys->i_tracks * sizeof(*p_times) );
                 p_sys->p_fragsindex->pi_pos[index++] = p_moof->i_pos;
             }
 
-            for( unsigned i=0; i<p_sys->i_tracks; i++ )
-            {
-                stime_t i_movietime = MP4_rescale( pi_track_times[i], p_sys->track[i].i_timescale, p_sys->i_timescale );
-                if( p_sys->p_fragsindex->i_last_time < i_movietime )
-                    p_sys->p_fragsindex->i_last_time = i_movietime;
-            }
-
+            free( p_times );
             free( pi_track_times );
 #ifdef MP4_VERBOSE
             MP4_Fragments_Index_Dump( VLC_OBJECT(p_demux), p_sys->p_fragsindex, p_sys->i_timescale );
@@ -4602,6 +4503,16 @@ static int FragCreateTrunIndex( demux_t *p_demux, MP4_Box_t *p_moof,
                                                  p_sys->i_timescale, p_track->i_timescale );
                 b_has_base_media_decode_time = true;
             }
+            /* or the fragments are still being indexed */
+            else if( !b_has_base_media_decode_time && p_sys->p_fragsindexer &&
+                     MP4_Fragments_Indexer_GetTrackStartTime( p_sys->p_fragsindexer,
+                                                              p_track - p_sys->track,
+                                                              p_moof->i_pos, &i_traf_start_time ) )
+            {
+                i_traf_start_time = MP4_rescale( i_traf_start_time,
+                                                 p_sys->i_timescale, p_track->i_timescale );
+                b_has_base_media_decode_time = true;
+            }
 
             if( !b_has_base_media_decode_time && p_chunksidx )
             {
@@ -4860,6 +4771,8 @@ static int DemuxFrag( demux_t *p_demux )
         goto end;
     }
 
+    FragCheckIndexer( p_demux, false );
+
     /* check for newly selected/unselected track */
     for( unsigned i_track = 0; i_track < p_sys->i_tracks; i_track++ )
     {
@@ -4932,6 +4845,9 @@ static int DemuxFrag( demux_t *p_demux )
                 else
                 {
                     p_sys->context.p_fragment_atom = MP4_BoxExtract( &p_vroot->p_first, p_box->i_type );
+                    if( p_sys->p_fragsindexer )
+                        MP4_Fragments_Indexer_SetPosition( p_sys->p_fragsindexer,
+                                                           p_sys->context.p_fragment_atom->i_pos );
 
                     /* Detect and Handle Passive Seek */
                     const uint32_t i_sequence_number = FragGetMoofSequenceNumber( p_sys->context.p_fragment_atom );
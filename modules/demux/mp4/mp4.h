@@ -30,6 +30,13 @@
 #include "fragments.h"
 #include "../asf/asfpacket.h"
 
+/* Position in a stts or ctts table */
+typedef struct
+{
+    uint32_t     i_index; /* entry of the sample */
+    uint32_t     i_skip;  /* samples of that entry before the sample */
+} mp4_tts_pos_t;
+
 /* Contain all information about a chunk */
 typedef struct
 {
@@ -40,24 +47,13 @@ typedef struct
     uint32_t     i_sample; /* index of the next sample to read in this chunk */
     uint32_t     i_virtual_run_number; /* chunks interleaving sequence */
 
-    /* now provide way to calculate pts, dts, and offset without too
-        much memory and with fast access */
-
-    /* with this we can calculate dts/pts without waste memory */
+    /* with this we can calculate dts/pts without waste memory:
+        the stts and ctts tables are walked from the chunk first sample */
     uint64_t     i_first_dts;   /* DTS of the first sample */
     uint64_t     i_duration;    /* total duration of all samples */
 
-    uint32_t     i_entries_dts;
-    uint32_t     *p_sample_count_dts;
-    uint32_t     *p_sample_delta_dts;   /* dts delta */
-
-    uint32_t     i_entries_pts;
-    uint32_t     *p_sample_count_pts;
-    int32_t      *p_sample_offset_pts;  /* pts-dts */
-
-    uint32_t     *p_sample_size;
-    /* TODO if needed add pts
-        but quickly *add* support for edts and seeking */
+    mp4_tts_pos_t dts_pos;      /* stts position of the first sample */
+    mp4_tts_pos_t pts_pos;      /* ctts position of the first sample */
 
 } mp4_chunk_t;
 
@@ -120,8 +116,12 @@ typedef struct
     /* sample size, p_sample_size defined only if i_sample_size == 0
         else i_sample_size is size for all sample */
     uint32_t         i_sample_size;
-    uint32_t         *p_sample_size; /* XXX perhaps add file offset if take
-//                                    too much time to do sumations each time*/
+    const uint32_t   *p_sample_size; /* points into the stsz box */
+
+    /* sample timing tables, from the stbl box */
+    const MP4_Box_data_stts_t *p_stts;
+    const MP4_Box_data_ctts_t *p_ctts; /* could be NULL */
+    int64_t          i_cts_shift;
 
     uint32_t     i_sample_first; /* i_sample_first value
                                                    of the next chunk */
@@ -24,6 +24,7 @@
     typedef struct arib_instance_t arib_instance_t;
 #endif
 typedef struct csa_t csa_t;
+typedef struct ts_index_t ts_index_t;
 
 #define TS_USER_PMT_NUMBER (0)
 
@@ -60,6 +61,13 @@ struct demux_sys_t
     /* how many TS packet we read at once */
     unsigned    i_ts_read;
 
+    /* Bulk reading: packets per stream read, and packets not demuxed yet */
+    unsigned    i_bulk_packets;
+    block_t    *p_bulk;
+
+    /* PCR seek index, or NULL */
+    ts_index_t *p_index;
+
     bool        b_cc_check;
     bool        b_ignore_time_for_positions;
 
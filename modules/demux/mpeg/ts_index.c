@@ -0,0 +1,463 @@
+/*****************************************************************************
+ * ts_index.c: Transport Stream PCR seek index
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc_common.h>
+#include <vlc_demux.h>
+#include <vlc_atomic.h>
+#include <vlc_fs.h>
+#include <vlc_md5.h>
+
+#include "ts_index.h"
+#include "../cachefile.h"
+#include "timestamps.h"
+
+#include <assert.h>
+
+#define TS_INDEX_INTERVAL  (90000 / 2) /* between index points, in PCR ticks */
+#define TS_INDEX_MAX_PIDS  16
+#define TS_INDEX_CHUNK     (1 << 17)
+#define TS_INDEX_SIGNATURE (1 << 16) /* bytes identifying the stream */
+#define TS_INDEX_MAGIC     "VLCTSIX1"
+
+typedef struct
+{
+    int64_t  i_pcr;
+    uint64_t i_pos;
+} ts_index_entry_t;
+
+typedef struct
+{
+    uint16_t i_pid;
+    bool     b_broken; /* PCR went backward, cannot be searched */
+    int64_t  i_last_pcr;
+    uint64_t i_last_pos;
+    uint32_t i_count;
+    uint32_t i_alloc;
+    ts_index_entry_t *p_entries;
+} ts_index_pid_t;
+
+struct ts_index_t
+{
+    vlc_object_t *p_obj;
+    char         *psz_url;
+    char         *psz_path; /* cache file, or NULL */
+    unsigned      i_packet_size;
+    unsigned      i_header_size;
+    uint64_t      i_size;
+    uint8_t       signature[16];
+
+    vlc_thread_t  thread;
+    bool          b_thread;
+    atomic_bool   b_stop;
+
+    vlc_mutex_t   lock;
+    uint64_t      i_pos; /* stream offset indexed so far */
+    bool          b_complete;
+    bool          b_dirty;
+    unsigned      i_pids;
+    ts_index_pid_t pids[TS_INDEX_MAX_PIDS];
+};
+
+static ts_index_pid_t * IndexGetPID( ts_index_t *p_index, uint16_t i_pid,
+                                     bool b_create )
+{
+    for( unsigned i = 0; i < p_index->i_pids; i++ )
+        if( p_index->pids[i].i_pid == i_pid )
+            return &p_index->pids[i];
+
+    if( !b_create || p_index->i_pids >= TS_INDEX_MAX_PIDS )
+        return NULL;
+
+    ts_index_pid_t *p_pid = &p_index->pids[p_index->i_pids++];
+    memset( p_pid, 0, sizeof(*p_pid) );
+    p_pid->i_pid = i_pid;
+    return p_pid;
+}
+
+static void IndexPacket( ts_index_t *p_index, const uint8_t *p, uint64_t i_pos )
+{
+    /* Not corrupt, with an adaptation field carrying a PCR */
+    if( (p[1] & 0x80) || !(p[3] & 0x20) || p[4] < 7 || !(p[5] & 0x10) )
+        return;
+
+    const uint16_t i_pid = ((p[1] & 0x1f) << 8) | p[2];
+    const int64_t i_pcr = ((int64_t)p[6] << 25) | ((int64_t)p[7] << 17) |
+                          ((int64_t)p[8] << 9) | ((int64_t)p[9] << 1) |
+                          ((int64_t)p[10] >> 7);
+
+    ts_index_pid_t *p_pid = IndexGetPID( p_index, i_pid, true );
+    if( p_pid == NULL || p_pid->b_broken )
+        return;
+
+    if( p_pid->i_count > 0 )
+    {
+        /* Going backward, or far forward past a wrap around */
+        if( ((i_pcr - p_pid->i_last_pcr) & 0x1FFFFFFFF) > 0xFFFFFFFF )
+        {
+            p_pid->b_broken = true;
+            return;
+        }
+        p_pid->i_last_pcr = i_pcr;
+        p_pid->i_last_pos = i_pos;
+
+        const ts_index_entry_t *p_last = &p_pid->p_entries[p_pid->i_count - 1];
+        if( ((i_pcr - p_last->i_pcr) & 0x1FFFFFFFF) < TS_INDEX_INTERVAL )
+            return;
+    }
+
+    if( p_pid->i_count >= p_pid->i_alloc )
+    {
+        uint32_t i_alloc = p_pid->i_alloc ? p_pid->i_alloc * 2 : 256;
+        ts_index_entry_t *p_realloc = realloc( p_pid->p_entries,
+                                               i_alloc * sizeof(*p_realloc) );
+        if( unlikely(p_realloc == NULL) )
+            return;
+        p_pid->p_entries = p_realloc;
+        p_pid->i_alloc = i_alloc;
+    }
+
+    p_pid->p_entries[p_pid->i_count].i_pcr = i_pcr;
+    p_pid->p_entries[p_pid->i_count].i_pos = i_pos;
+    p_pid->i_count++;
+    p_pid->i_last_pcr = i_pcr;
+    p_pid->i_last_pos = i_pos;
+    p_index->b_dirty = true;
+}
+
+static void *IndexThread( void *data )
+{
+    ts_index_t *p_index = data;
+    stream_t *s = vlc_stream_NewURL( p_index->p_obj, p_index->psz_url );
+    uint8_t *p_buf = malloc( TS_INDEX_CHUNK );
+
+    if( s == NULL || p_buf == NULL )
+        goto out;
+
+    vlc_mutex_lock( &p_index->lock );
+    uint64_t i_base = p_index->i_pos;
+    vlc_mutex_unlock( &p_index->lock );
+
+    if( vlc_stream_Seek( s, i_base ) )
+        goto out;
+
+    size_t i_buf = 0;
+    while( !atomic_load( &p_index->b_stop ) )
+    {
+        ssize_t i_read = vlc_stream_Read( s, p_buf + i_buf,
+                                          TS_INDEX_CHUNK - i_buf );
+        if( i_read <= 0 )
+        {
+            vlc_mutex_lock( &p_index->lock );
+            p_index->b_complete = i_read == 0;
+            p_index->b_dirty = true;
+            vlc_mutex_unlock( &p_index->lock );
+            msg_Dbg( p_index->p_obj, "PCR index %s at %"PRIu64,
+                     i_read ? "failed" : "completed", i_base + i_buf );
+            break;
+        }
+        i_buf += i_read;
+
+        const unsigned i_size = p_index->i_packet_size;
+        const unsigned i_header = p_index->i_header_size;
+        size_t i = 0;
+
+        vlc_mutex_lock( &p_index->lock );
+        while( i + i_size <= i_buf )
+        {
+            const uint8_t *p = &p_buf[i + i_header];
+
+            /* Resynchronize on two consecutive sync bytes */
+            if( p[0] != 0x47 ||
+               ( i + i_size + i_header < i_buf && p[i_size] != 0x47 ) )
+            {
+                i++;
+                continue;
+            }
+            IndexPacket( p_index, p, i_base + i );
+            i += i_size;
+        }
+        p_index->i_pos = i_base + i;
+        vlc_mutex_unlock( &p_index->lock );
+
+        memmove( p_buf, &p_buf[i], i_buf - i );
+        i_base += i;
+        i_buf -= i;
+    }
+
+out:
+    free( p_buf );
+    if( s != NULL )
+        vlc_stream_Delete( s );
+    return NULL;
+}
+
+/*
+ * Cache file: header, then for each PID its state and index points,
+ * in host byte order.
+ */
+typedef struct
+{
+    char     magic[8];
+    uint32_t i_packet_size;
+    uint32_t i_header_size;
+    uint8_t  signature[16];
+    uint64_t i_size;
+    uint64_t i_pos;
+    uint32_t i_pids;
+    uint8_t  b_complete;
+} ts_index_header_t;
+
+typedef struct
+{
+    uint16_t i_pid;
+    uint8_t  b_broken;
+    int64_t  i_last_pcr;
+    uint64_t i_last_pos;
+    uint32_t i_count;
+} ts_index_pid_header_t;
+
+static void IndexLoad( ts_index_t *p_index )
+{
+    FILE *file = vlc_fopen( p_index->psz_path, "rb" );
+    if( file == NULL )
+        return;
+
+    ts_index_header_t hdr;
+    if( fread( &hdr, sizeof(hdr), 1, file ) != 1 ||
+        memcmp( hdr.magic, TS_INDEX_MAGIC, 8 ) ||
+        hdr.i_packet_size != p_index->i_packet_size ||
+        hdr.i_header_size != p_index->i_header_size ||
+        memcmp( hdr.signature, p_index->signature, 16 ) ||
+        hdr.i_pos > p_index->i_size || hdr.i_size > p_index->i_size ||
+        hdr.i_pids > TS_INDEX_MAX_PIDS )
+        goto out;
+
+    for( unsigned i = 0; i < hdr.i_pids; i++ )
+    {
+        ts_index_pid_header_t pidhdr;
+        ts_index_pid_t *p_pid = &p_index->pids[i];
+
+        if( fread( &pidhdr, sizeof(pidhdr), 1, file ) != 1 ||
+            pidhdr.i_count == 0 || pidhdr.i_count > UINT32_MAX / 2 )
+            goto error;
+
+        p_pid->i_pid = pidhdr.i_pid;
+        p_pid->b_broken = pidhdr.b_broken;
+        p_pid->i_last_pcr = pidhdr.i_last_pcr;
+        p_pid->i_last_pos = pidhdr.i_last_pos;
+        p_pid->p_entries = vlc_alloc( pidhdr.i_count, sizeof(ts_index_entry_t) );
+        if( p_pid->p_entries == NULL ||
+            fread( p_pid->p_entries, sizeof(ts_index_entry_t), pidhdr.i_count,
+                   file ) != pidhdr.i_count )
+        {
+            free( p_pid->p_entries );
+            goto error;
+        }
+        p_pid->i_count = p_pid->i_alloc = pidhdr.i_count;
+        p_index->i_pids = i + 1;
+    }
+
+    p_index->i_pos = hdr.i_pos;
+    /* A growing recording must be indexed up to its new end */
+    p_index->b_complete = hdr.b_complete && hdr.i_size == p_index->i_size;
+    msg_Dbg( p_index->p_obj, "loaded PCR index up to %"PRIu64"%s",
+             hdr.i_pos, p_index->b_complete ? " (complete)" : "" );
+    goto out;
+
+error:
+    for( unsigned i = 0; i < p_index->i_pids; i++ )
+        free( p_index->pids[i].p_entries );
+    p_index->i_pids = 0;
+out:
+    fclose( file );
+}
+
+static void IndexSave( ts_index_t *p_index )
+{
+    char *psz_tmp;
+    FILE *file = cachefile_Create( p_index->psz_path, &psz_tmp );
+    if( file == NULL )
+        return;
+
+    ts_index_header_t hdr;
+    memset( &hdr, 0, sizeof(hdr) );
+    memcpy( hdr.magic, TS_INDEX_MAGIC, 8 );
+    hdr.i_packet_size = p_index->i_packet_size;
+    hdr.i_header_size = p_index->i_header_size;
+    memcpy( hdr.signature, p_index->signature, 16 );
+    hdr.i_size = p_index->i_size;
+    hdr.i_pos = p_index->i_pos;
+    hdr.b_complete = p_index->b_complete;
+
+    /* PIDs without any index point are of no use */
+    for( unsigned i = 0; i < p_index->i_pids; i++ )
+        if( p_index->pids[i].i_count > 0 )
+            hdr.i_pids++;
+
+    bool b_error = fwrite( &hdr, sizeof(hdr), 1, file ) != 1;
+    for( unsigned i = 0; i < p_index->i_pids && !b_error; i++ )
+    {
+        const ts_index_pid_t *p_pid = &p_index->pids[i];
+        ts_index_pid_header_t pidhdr;
+
+        if( p_pid->i_count == 0 )
+            continue;
+        memset( &pidhdr, 0, sizeof(pidhdr) );
+        pidhdr.i_pid = p_pid->i_pid;
+        pidhdr.b_broken = p_pid->b_broken;
+        pidhdr.i_last_pcr = p_pid->i_last_pcr;
+        pidhdr.i_last_pos = p_pid->i_last_pos;
+        pidhdr.i_count = p_pid->i_count;
+        b_error = fwrite( &pidhdr, sizeof(pidhdr), 1, file ) != 1 ||
+                  fwrite( p_pid->p_entries, sizeof(ts_index_entry_t),
+                          p_pid->i_count, file ) != p_pid->i_count;
+    }
+
+    if( cachefile_Commit( file, psz_tmp, p_index->psz_path, b_error ) )
+        msg_Warn( p_index->p_obj, "cannot save PCR index to %s",
+                  p_index->psz_path );
+}
+
+ts_index_t * ts_index_New( demux_t *p_demux, unsigned i_packet_size,
+                           unsigned i_packet_header_size, bool b_persistent )
+{
+    const int64_t i_size = stream_Size( p_demux->s );
+    const uint8_t *p_peek;
+    ssize_t i_peek;
+
+    if( i_size <= 0 || p_demux->psz_access == NULL ||
+        p_demux->psz_location == NULL ||
+        (i_peek = vlc_stream_Peek( p_demux->s, &p_peek,
+                                   TS_INDEX_SIGNATURE )) <= 0 )
+        return NULL;
+
+    ts_index_t *p_index = calloc( 1, sizeof(*p_index) );
+    if( unlikely(p_index == NULL) )
+        return NULL;
+
+    if( asprintf( &p_index->psz_url, "%s://%s", p_demux->psz_access,
+                  p_demux->psz_location ) == -1 )
+    {
+        free( p_index );
+        return NULL;
+    }
+
+    p_index->p_obj = VLC_OBJECT(p_demux);
+    p_index->i_packet_size = i_packet_size;
+    p_index->i_header_size = i_packet_header_size;
+    p_index->i_size = i_size;
+    atomic_init( &p_index->b_stop, false );
+    vlc_mutex_init( &p_index->lock );
+
+    struct md5_s md5;
+    InitMD5( &md5 );
+    AddMD5( &md5, p_peek, i_peek );
+    EndMD5( &md5 );
+    memcpy( p_index->signature, md5.buf, 16 );
+
+    if( b_persistent )
+    {
+        p_index->psz_path = cachefile_GetPath( "ts-index", p_index->psz_url,
+                                               strlen( p_index->psz_url ) );
+        if( p_index->psz_path != NULL )
+            IndexLoad( p_index );
+    }
+
+    if( !p_index->b_complete )
+        p_index->b_thread = !vlc_clone( &p_index->thread, IndexThread, p_index,
+                                        VLC_THREAD_PRIORITY_LOW );
+    return p_index;
+}
+
+void ts_index_Delete( ts_index_t *p_index )
+{
+    if( p_index->b_thread )
+    {
+        atomic_store( &p_index->b_stop, true );
+        vlc_join( p_index->thread, NULL );
+    }
+
+    if( p_index->psz_path != NULL && p_index->b_dirty )
+        IndexSave( p_index );
+
+    for( unsigned i = 0; i < p_index->i_pids; i++ )
+        free( p_index->pids[i].p_entries );
+    vlc_mutex_destroy( &p_index->lock );
+    free( p_index->psz_path );
+    free( p_index->psz_url );
+    free( p_index );
+}
+
+int ts_index_Find( ts_index_t *p_index, uint16_t i_pid, int64_t i_first_pcr,
+                   int64_t i_scaledtime, uint64_t *pi_pos, uint64_t *pi_next )
+{
+    int i_ret = VLC_EGENERIC;
+
+    vlc_mutex_lock( &p_index->lock );
+
+    const ts_index_pid_t *p_pid = IndexGetPID( p_index, i_pid, false );
+    if( p_pid == NULL || p_pid->b_broken || p_pid->i_count == 0 ||
+        TimeStampWrapAround( i_first_pcr, p_pid->i_last_pcr ) < i_scaledtime )
+        goto out; /* not indexed (yet) */
+
+    /* Last index point not after the requested time */
+    uint32_t i_low = 0, i_high = p_pid->i_count;
+    while( i_high - i_low > 1 )
+    {
+        uint32_t i_mid = (i_low + i_high) / 2;
+        if( TimeStampWrapAround( i_first_pcr,
+                                 p_pid->p_entries[i_mid].i_pcr ) <= i_scaledtime )
+            i_low = i_mid;
+        else
+            i_high = i_mid;
+    }
+
+    *pi_pos = p_pid->p_entries[i_low].i_pos;
+    *pi_next = (i_low + 1 < p_pid->i_count) ? p_pid->p_entries[i_low + 1].i_pos
+                                            : p_pid->i_last_pos;
+    i_ret = VLC_SUCCESS;
+out:
+    vlc_mutex_unlock( &p_index->lock );
+    return i_ret;
+}
+
+int ts_index_GetBounds( ts_index_t *p_index, uint16_t i_pid, int64_t *pi_first,
+                        int64_t *pi_last, uint64_t *pi_last_pos )
+{
+    int i_ret = VLC_EGENERIC;
+
+    vlc_mutex_lock( &p_index->lock );
+
+    const ts_index_pid_t *p_pid = IndexGetPID( p_index, i_pid, false );
+    if( p_index->b_complete && p_pid != NULL && !p_pid->b_broken &&
+        p_pid->i_count > 0 )
+    {
+        *pi_first = p_pid->p_entries[0].i_pcr;
+        *pi_last = p_pid->i_last_pcr;
+        *pi_last_pos = p_pid->i_last_pos;
+        i_ret = VLC_SUCCESS;
+    }
+
+    vlc_mutex_unlock( &p_index->lock );
+    return i_ret;
+}
@@ -0,0 +1,42 @@
+/*****************************************************************************
+ * ts_index.h: Transport Stream PCR seek index
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifndef VLC_TS_INDEX_H
+#define VLC_TS_INDEX_H
+
+/* Maps the PCR of each PCR carrying PID to byte offsets of the stream.
+ * The index is built by a background thread reading the stream through its
+ * own handle, and can be kept in the user cache directory across runs. */
+typedef struct ts_index_t ts_index_t;
+
+ts_index_t * ts_index_New( demux_t *, unsigned i_packet_size,
+                           unsigned i_packet_header_size, bool b_persistent );
+void ts_index_Delete( ts_index_t * );
+
+/* Finds the offset of the last indexed packet of i_pid with a PCR before
+ * i_scaledtime (wrapped around i_first_pcr like PCR values), and the offset
+ * of the next index point, or 0 if none. */
+int ts_index_Find( ts_index_t *, uint16_t i_pid, int64_t i_first_pcr,
+                   int64_t i_scaledtime, uint64_t *pi_pos, uint64_t *pi_next );
+
+/* Gets the first and last PCR of i_pid, once the whole stream is indexed */
+int ts_index_GetBounds( ts_index_t *, uint16_t i_pid, int64_t *pi_first,
+                        int64_t *pi_last, uint64_t *pi_last_pos );
+
+#endif
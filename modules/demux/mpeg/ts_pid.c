@@ -30,9 +30,23 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define PID_ALLOC_CHUNK 16
 
+static void ts_pid_list_Index( ts_pid_list_t *p_list, ts_pid_t *p_pid )
+{
+    ts_pid_t ***ppp_page = &p_list->pp_index[p_pid->i_pid >> TS_PID_PAGE_BITS];
+
+    if( *ppp_page == NULL )
+    {
+        *ppp_page = calloc( 1 << TS_PID_PAGE_BITS, sizeof(ts_pid_t *) );
+        if( !*ppp_page )
+            abort();
+    }
+    (*ppp_page)[p_pid->i_pid & ((1 << TS_PID_PAGE_BITS) - 1)] = p_pid;
+}
+
 void ts_pid_list_Init( ts_pid_list_t *p_list )
 {
     p_list->dummy.i_pid = 8191;
@@ -41,8 +55,11 @@ void ts_pid_list_Init( ts_pid_list_t *p_list )
     p_list->pp_all = NULL;
     p_list->i_all = 0;
     p_list->i_all_alloc = 0;
-    p_list->i_last_pid = 0;
-    p_list->p_last = NULL;
+    memset( p_list->pp_index, 0, sizeof(p_list->pp_index) );
+
+    ts_pid_list_Index( p_list, &p_list->pat );
+    ts_pid_list_Index( p_list, &p_list->base_si );
+    ts_pid_list_Index( p_list, &p_list->dummy );
 }
 
 void ts_pid_list_Release( demux_t *p_demux, ts_pid_list_t *p_list )
@@ -59,100 +76,70 @@ void ts_pid_list_Release( demux_t *p_demux, ts_pid_list_t *p_list )
         free( pid );
     }
     free( p_list->pp_all );
-}
-
-struct searchkey
-{
-    int16_t i_pid;
-    ts_pid_t **pp_last;
-};
 
-static int ts_bsearch_searchkey_Compare( void *key, void *other )
-{
-    struct searchkey *p_key = (struct searchkey *) key;
-    ts_pid_t *p_pid = *((ts_pid_t **) other);
-    p_key->pp_last = (ts_pid_t **) other;
-    return ( p_key->i_pid >= p_pid->i_pid ) ? p_key->i_pid - p_pid->i_pid : -1;
+    for( int i = 0; i < TS_PID_PAGES; i++ )
+        free( p_list->pp_index[i] );
 }
 
-ts_pid_t * ts_pid_Get( ts_pid_list_t *p_list, uint16_t i_pid )
+static ts_pid_t * ts_pid_Create( ts_pid_list_t *p_list, uint16_t i_pid )
 {
-    switch( i_pid )
+    if( p_list->i_all >= p_list->i_all_alloc )
     {
-        case 0:
-            return &p_list->pat;
-        case 0x1FFB:
-            return &p_list->base_si;
-        case 0x1FFF:
-            return &p_list->dummy;
-        default:
-            if( p_list->i_last_pid == i_pid )
-                return p_list->p_last;
-        break;
+        ts_pid_t **p_realloc = realloc( p_list->pp_all,
+                                        (p_list->i_all_alloc + PID_ALLOC_CHUNK) * sizeof(ts_pid_t *) );
+        if( !p_realloc )
+        {
+            abort();
+            //return NULL;
+        }
+        p_list->pp_all = p_realloc;
+        p_list->i_all_alloc += PID_ALLOC_CHUNK;
     }
 
-    size_t i_index = 0;
-    ts_pid_t *p_pid = NULL;
-
-    if( p_list->pp_all )
+    ts_pid_t *p_pid = calloc( 1, sizeof(*p_pid) );
+    if( !p_pid )
     {
-        struct searchkey pidkey;
-        pidkey.i_pid = i_pid;
-        pidkey.pp_last = NULL;
-
-        ts_pid_t **pp_pidk = bsearch( &pidkey, p_list->pp_all, p_list->i_all,
-                                      sizeof(ts_pid_t *), ts_bsearch_searchkey_Compare );
-        if ( pp_pidk )
-            p_pid = *pp_pidk;
-        else
-            i_index = (pidkey.pp_last - p_list->pp_all); /* Last visited index */
+        abort();
+        //return NULL;
     }
 
-    if( p_pid == NULL )
+    p_pid->i_cc  = 0xff;
+    p_pid->i_pid = i_pid;
+
+    /* Keep the list sorted for ts_pid_Next() */
+    int i_low = 0, i_high = p_list->i_all;
+    while( i_low < i_high )
     {
-        if( p_list->i_all >= p_list->i_all_alloc )
-        {
-            ts_pid_t **p_realloc = realloc( p_list->pp_all,
-                                            (p_list->i_all_alloc + PID_ALLOC_CHUNK) * sizeof(ts_pid_t *) );
-            if( !p_realloc )
-            {
-                abort();
-                //return NULL;
-            }
-            p_list->pp_all = p_realloc;
-            p_list->i_all_alloc += PID_ALLOC_CHUNK;
-        }
+        int i_mid = (i_low + i_high) / 2;
+        if( p_list->pp_all[i_mid]->i_pid < i_pid )
+            i_low = i_mid + 1;
+        else
+            i_high = i_mid;
+    }
 
-        p_pid = calloc( 1, sizeof(*p_pid) );
-        if( !p_pid )
-        {
-            abort();
-            //return NULL;
-        }
+    memmove( &p_list->pp_all[i_low + 1], &p_list->pp_all[i_low],
+             (p_list->i_all - i_low) * sizeof(ts_pid_t *) );
+    p_list->pp_all[i_low] = p_pid;
+    p_list->i_all++;
 
-        p_pid->i_cc  = 0xff;
-        p_pid->i_pid = i_pid;
+    ts_pid_list_Index( p_list, p_pid );
 
-        /* Do insertion based on last bsearch mid point */
-        if( p_list->i_all )
-        {
-            if( p_list->pp_all[i_index]->i_pid < i_pid )
-                i_index++;
-
-            memmove( &p_list->pp_all[i_index + 1],
-                    &p_list->pp_all[i_index],
-                    (p_list->i_all - i_index) * sizeof(ts_pid_t *) );
-        }
+    return p_pid;
+}
 
-        p_list->pp_all[i_index] = p_pid;
-        p_list->i_all++;
+ts_pid_t * ts_pid_Get( ts_pid_list_t *p_list, uint16_t i_pid )
+{
+    assert( i_pid < 8192 );
 
+    ts_pid_t **pp_page = p_list->pp_index[i_pid >> TS_PID_PAGE_BITS];
+    if( likely(pp_page) )
+    {
+        ts_pid_t *p_pid = pp_page[i_pid & ((1 << TS_PID_PAGE_BITS) - 1)];
+        if( likely(p_pid) )
+            return p_pid;
     }
 
-    p_list->p_last = p_pid;
-    p_list->i_last_pid = i_pid;
-
-    return p_pid;
+    return ts_pid_Create( p_list, i_pid );
 }
 
 ts_pid_t * ts_pid_Next( ts_pid_list_t *p_list, ts_pid_next_context_t *p_ctx )
@@ -82,19 +82,20 @@ struct ts_pid_t
 
 };
 
+#define TS_PID_PAGE_BITS 8
+#define TS_PID_PAGES (8192 >> TS_PID_PAGE_BITS)
+
 struct ts_pid_list_t
 {
     ts_pid_t   pat;
     ts_pid_t   dummy;
     ts_pid_t   base_si;
-    /* all non commons ones, dynamically allocated */
+    /* all non commons ones, dynamically allocated, sorted by PID */
     ts_pid_t **pp_all;
     int        i_all;
     int        i_all_alloc;
-    /* last recently used */
-    uint16_t   i_last_pid;
-    ts_pid_t  *p_last;
-
+    /* direct lookup of all pids, by pages allocated on demand */
+    ts_pid_t **pp_index[TS_PID_PAGES];
 };
 
 /* opacified pid list */
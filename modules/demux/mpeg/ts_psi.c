@@ -54,6 +54,7 @@
 #include "ts_psip.h"
 #include "ts_si.h"
 #include "ts_metadata.h"
+#include "ts_index.h"
 
 #include "../access/dtv/en50221_capmt.h"
 
@@ -2023,9 +2024,24 @@ static void PMTCallBack( void *data, dvbpsi_pmt_t *p_dvbpsipmt )
     /* Probe Boundaries */
     if( p_sys->b_canfastseek && p_pmt->i_last_dts == -1 )
     {
+        int64_t i_first, i_last;
+        uint64_t i_last_pos;
+
         p_pmt->i_last_dts = 0;
-        ProbeStart( p_demux, p_pmt->i_number );
-        ProbeEnd( p_demux, p_pmt->i_number );
+        if( p_sys->p_index &&
+            ts_index_GetBounds( p_sys->p_index, p_pmt->i_pid_pcr,
+                                &i_first, &i_last, &i_last_pos ) == VLC_SUCCESS )
+        {
+            /* The whole stream is already indexed */
+            p_pmt->pcr.i_first = i_first;
+            p_pmt->i_last_dts = i_last;
+            p_pmt->i_last_dts_byte = i_last_pos;
+        }
+        else
+        {
+            ProbeStart( p_demux, p_pmt->i_number );
+            ProbeEnd( p_demux, p_pmt->i_number );
+        }
     }
 
     dvbpsi_pmt_delete( p_dvbpsipmt );
@@ -52,6 +52,10 @@
 static int  Open ( vlc_object_t * );
 static void Close( vlc_object_t * );
 
+#define INDEX_TEXT N_("Index the whole file")
+#define INDEX_LONGTEXT N_("Scan the whole file in the background to locate " \
+    "its pages, so that seeking does not need to search for them.")
+
 vlc_module_begin ()
     set_shortname ( "OGG" )
     set_description( N_("OGG demuxer" ) )
@@ -60,6 +64,7 @@ vlc_module_begin ()
     set_capability( "demux", 50 )
     set_callbacks( Open, Close )
     add_shortcut( "ogg" )
+    add_bool( "ogg-index", false, INDEX_TEXT, INDEX_LONGTEXT, true )
 vlc_module_end ()
 
 
@@ -262,6 +267,9 @@ static void Close( vlc_object_t *p_this )
     demux_t *p_demux = (demux_t *)p_this;
     demux_sys_t *p_sys = p_demux->p_sys  ;
 
+    if( p_sys->p_indexer )
+        Oggseek_IndexerDelete( p_sys->p_indexer );
+
     /* Cleanup the bitstream parser */
     ogg_sync_clear( &p_sys->oy );
 
@@ -285,6 +293,7 @@ static int Demux( demux_t * p_demux )
     int         i_stream;
     bool b_skipping = false;
     bool b_canseek;
+    int64_t i_page_pos = -1;
 
     int i_active_streams = p_sys->i_streams;
     for ( int i=0; i < p_sys->i_streams; i++ )
@@ -339,7 +348,15 @@ static int Demux( demux_t * p_demux )
             /* Find the real duration */
             vlc_stream_Control( p_demux->s, STREAM_CAN_SEEK, &b_canseek );
             if ( b_canseek )
+            {
                 Oggseek_ProbeEnd( p_demux );
+
+                bool b_canfastseek;
+                vlc_stream_Control( p_demux->s, STREAM_CAN_FASTSEEK, &b_canfastseek );
+                if ( b_canfastseek && !p_sys->p_indexer &&
+                     var_InheritBool( p_demux, "ogg-index" ) )
+                    p_sys->p_indexer = Oggseek_IndexerNew( p_demux );
+            }
         }
         else
         {
@@ -350,6 +367,8 @@ static int Demux( demux_t * p_demux )
     if ( p_sys->b_preparsing_done && !p_sys->b_es_created )
         Ogg_CreateES( p_demux );
 
+    Oggseek_IndexerTake( p_demux );
+
     /*
      * The first data page of a physical stream is stored in the relevant logical stream
      * in Ogg_FindLogicalStreams. Therefore, we must not read a page and only update the
@@ -371,6 +390,9 @@ static int Demux( demux_t * p_demux )
          */
         if( Ogg_ReadPage( p_demux, &p_sys->current_page ) != VLC_SUCCESS )
             return VLC_DEMUXER_EOF; /* EOF */
+        /* Offset of the page, to index it */
+        i_page_pos = vlc_stream_Tell( p_demux->s ) - ( p_sys->oy.fill - p_sys->oy.returned )
+                   - p_sys->current_page.header_len - p_sys->current_page.body_len;
         /* Test for End of Stream */
         if( ogg_page_eos( &p_sys->current_page ) )
         {
@@ -429,6 +451,10 @@ static int Demux( demux_t * p_demux )
             {
                 continue;
             }
+
+            if( i_page_pos >= p_stream->i_data_start )
+                OggSeek_IndexAdd( p_stream, ogg_page_granulepos( &p_sys->current_page ),
+                                  i_page_pos );
         }
 
         /* clear the finished flag if pages after eos (ex: after a seek) */
@@ -2242,8 +2268,9 @@ static int Ogg_BeginningOfStream( demux_t *p_demux )
 
         p_stream->p_es = NULL;
 
-        /* initialise kframe index */
-        p_stream->idx=NULL;
+        /* initialise page index */
+        p_stream->idx = NULL;
+        p_stream->i_idx = p_stream->i_idx_alloc = 0;
 
         if ( p_stream->fmt.i_bitrate == 0  &&
              ( p_stream->fmt.i_cat == VIDEO_ES ||
@@ -2335,10 +2362,7 @@ static void Ogg_LogicalStreamDelete( demux_t *p_demux, logical_stream_t *p_strea
     es_format_Clean( &p_stream->fmt_old );
     es_format_Clean( &p_stream->fmt );
 
-    if ( p_stream->idx != NULL)
-    {
-        oggseek_index_entries_free( p_stream->idx );
-    }
+    oggseek_index_entries_free( p_stream );
 
     Ogg_FreeSkeleton( p_stream->p_skel );
     p_stream->p_skel = NULL;
@@ -49,6 +49,7 @@
 #define PACKET_IS_SYNCPOINT  0x08
 
 typedef struct oggseek_index_entry demux_index_entry_t;
+typedef struct oggseek_indexer oggseek_indexer_t;
 typedef struct ogg_skeleton_t ogg_skeleton_t;
 
 typedef struct backup_queue
@@ -100,8 +101,10 @@ typedef struct logical_stream_s
     /* offset of first keyframe for theora; can be 0 or 1 depending on version number */
     int8_t i_keyframe_offset;
 
-    /* keyframe index for seeking, created as we discover keyframes */
+    /* page index for seeking, created as we discover pages */
     demux_index_entry_t *idx;
+    size_t i_idx;
+    size_t i_idx_alloc;
 
     /* Skeleton data */
     ogg_skeleton_t *p_skel;
@@ -233,6 +236,9 @@ struct demux_sys_t
     /* Length, if available. */
     int64_t i_length;
 
+    /* background page indexing */
+    oggseek_indexer_t *p_indexer;
+
     bool b_slave;
 
 };
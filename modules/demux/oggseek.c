@@ -32,6 +32,7 @@
 
 #include <vlc_common.h>
 #include <vlc_demux.h>
+#include <vlc_atomic.h>
 
 #include <ogg/ogg.h>
 #include <limits.h>
@@ -67,115 +68,92 @@ typedef struct packetStartCoordinates
 * index entries
 *************************************************************/
 
-/* free all entries in index list */
+/* free all entries in index */
 
-void oggseek_index_entries_free ( demux_index_entry_t *idx )
+void oggseek_index_entries_free ( logical_stream_t *p_stream )
 {
-    demux_index_entry_t *idx_next;
-
-    while ( idx != NULL )
-    {
-        idx_next = idx->p_next;
-        free( idx );
-        idx = idx_next;
-    }
+    free( p_stream->idx );
+    p_stream->idx = NULL;
+    p_stream->i_idx = p_stream->i_idx_alloc = 0;
 }
 
+/* returns the number of entries up to i_timestamp */
 
-/* internal function to create a new list member */
-
-static demux_index_entry_t *index_entry_new( void )
+static size_t OggSeekIndexCount ( const logical_stream_t *p_stream,
+                                  int64_t i_timestamp )
 {
-    demux_index_entry_t *idx = xmalloc( sizeof( demux_index_entry_t ) );
-    if ( !idx ) return NULL;
-    idx->p_next = idx->p_prev = NULL;
-    idx->i_pagepos_end = -1;
-    return idx;
+    size_t i_low = 0, i_high = p_stream->i_idx;
+
+    while ( i_low < i_high )
+    {
+        size_t i_mid = ( i_low + i_high ) / 2;
+        if ( p_stream->idx[i_mid].i_value <= i_timestamp )
+            i_low = i_mid + 1;
+        else
+            i_high = i_mid;
+    }
+    return i_low;
 }
 
-/* We insert into index, sorting by pagepos (as a page can match multiple
-   time stamps) */
-const demux_index_entry_t *OggSeek_IndexAdd ( logical_stream_t *p_stream,
-                                             int64_t i_timestamp,
-                                             int64_t i_pagepos )
+/* We insert into index, sorting by timestamp (which also sorts pagepos), with
+   at most one entry per OGGSEEK_INDEX_INTERVAL */
+void OggSeek_IndexAdd ( logical_stream_t *p_stream, int64_t i_granule,
+                        int64_t i_pagepos )
 {
-    demux_index_entry_t *idx;
-    demux_index_entry_t *last_idx = NULL;
-
-    if ( p_stream == NULL ) return NULL;
+    if ( p_stream == NULL || i_granule < 1 || i_pagepos < 1 ) return;
 
-    idx = p_stream->idx;
+    int64_t i_timestamp = Oggseek_GranuleToAbsTimestamp( p_stream, i_granule, false );
+    if ( i_timestamp < 1 ) return;
 
-    if ( i_timestamp < 1 || i_pagepos < 1 ) return NULL;
+    size_t i = OggSeekIndexCount( p_stream, i_timestamp );
+    const demux_index_entry_t *p_prev = ( i > 0 ) ? &p_stream->idx[i - 1] : NULL;
+    const demux_index_entry_t *p_next = ( i < p_stream->i_idx ) ? &p_stream->idx[i] : NULL;
 
-    if ( idx == NULL )
-    {
-        demux_index_entry_t *ie = index_entry_new();
-        if ( !ie ) return NULL;
-        ie->i_value = i_timestamp;
-        ie->i_pagepos = i_pagepos;
-        p_stream->idx = ie;
-        return ie;
-    }
-
-    while ( idx != NULL )
-    {
-        if ( idx->i_pagepos > i_pagepos ) break;
-        last_idx = idx;
-        idx = idx->p_next;
-    }
+    if ( ( p_prev && i_timestamp - p_prev->i_value < OGGSEEK_INDEX_INTERVAL ) ||
+         ( p_next && p_next->i_value - i_timestamp < OGGSEEK_INDEX_INTERVAL ) )
+        return;
 
-    /* new entry; insert after last_idx */
-    idx = index_entry_new();
-    if ( !idx ) return NULL;
-    if ( last_idx != NULL )
-    {
-        idx->p_next = last_idx->p_next;
-        last_idx->p_next = idx;
-        idx->p_prev = last_idx;
-    }
-    else
-    {
-        idx->p_next = p_stream->idx;
-        p_stream->idx = idx;
-    }
+    /* not the stream we indexed (chained) or broken granules */
+    if ( ( p_prev && p_prev->i_pagepos >= i_pagepos ) ||
+         ( p_next && p_next->i_pagepos <= i_pagepos ) )
+        return;
 
-    if ( idx->p_next != NULL )
+    if ( p_stream->i_idx == p_stream->i_idx_alloc )
     {
-        idx->p_next->p_prev = idx;
+        size_t i_alloc = __MAX( 64, p_stream->i_idx_alloc * 2 );
+        demux_index_entry_t *p_realloc = realloc( p_stream->idx,
+                                                  i_alloc * sizeof( *p_realloc ) );
+        if ( !p_realloc ) return;
+        p_stream->idx = p_realloc;
+        p_stream->i_idx_alloc = i_alloc;
     }
 
-    idx->i_value = i_timestamp;
-    idx->i_pagepos = i_pagepos;
-
-    return idx;
+    memmove( &p_stream->idx[i + 1], &p_stream->idx[i],
+             ( p_stream->i_idx - i ) * sizeof( demux_index_entry_t ) );
+    p_stream->idx[i].i_value = i_timestamp;
+    p_stream->idx[i].i_granule = i_granule;
+    p_stream->idx[i].i_pagepos = i_pagepos;
+    p_stream->i_idx++;
 }
 
+/* narrows the bounds to the indexed pages around i_timestamp, returns
+   whether a page before it was found */
+
 static bool OggSeekIndexFind ( logical_stream_t *p_stream, int64_t i_timestamp,
                                int64_t *pi_pos_lower, int64_t *pi_pos_upper )
 {
-    demux_index_entry_t *idx = p_stream->idx;
+    size_t i = OggSeekIndexCount( p_stream, i_timestamp );
 
-    while ( idx != NULL )
-    {
-        if ( idx->i_value <= i_timestamp )
-        {
-            if ( !idx->p_next ) /* found on last index */
-            {
-                *pi_pos_lower = idx->i_pagepos;
-                return true;
-            }
-            if ( idx->p_next->i_value > i_timestamp )
-            {
-                *pi_pos_lower = idx->i_pagepos;
-                *pi_pos_upper = idx->p_next->i_pagepos;
-                return true;
-            }
-        }
-        idx = idx->p_next;
-    }
+    if ( i < p_stream->i_idx &&
+         ( *pi_pos_upper < 0 || p_stream->idx[i].i_pagepos < *pi_pos_upper ) )
+        *pi_pos_upper = p_stream->idx[i].i_pagepos;
 
-    return false;
+    if ( i == 0 )
+        return false;
+
+    if ( p_stream->idx[i - 1].i_pagepos > *pi_pos_lower )
+        *pi_pos_lower = p_stream->idx[i - 1].i_pagepos;
+    return true;
 }
 
 /*********************************************************************
@@ -772,6 +750,25 @@ static int64_t OggBisectSearchByTime( demux_t *p_demux, logical_stream_t *p_stre
     i_pos_upper = __MIN( i_pos_upper, p_sys->i_total_length );
     if ( i_pos_upper < 0 ) i_pos_upper = p_sys->i_total_length;
 
+    /* Start from the indexed pages around the target */
+    size_t i_idx = OggSeekIndexCount( p_stream, i_targettime );
+    if ( i_idx > 0 && p_stream->idx[i_idx - 1].i_pagepos >= i_pos_lower &&
+         p_stream->idx[i_idx - 1].i_pagepos < i_pos_upper )
+    {
+        const demux_index_entry_t *p_entry = &p_stream->idx[i_idx - 1];
+        bestlower.i_pos = i_pos_lower = p_entry->i_pagepos;
+        bestlower.i_timestamp = p_entry->i_value;
+        bestlower.i_granule = p_entry->i_granule;
+    }
+    if ( i_idx < p_stream->i_idx && p_stream->idx[i_idx].i_pagepos > i_pos_lower &&
+         p_stream->idx[i_idx].i_pagepos < i_pos_upper )
+    {
+        const demux_index_entry_t *p_entry = &p_stream->idx[i_idx];
+        lowestupper.i_pos = i_pos_upper = p_entry->i_pagepos;
+        lowestupper.i_timestamp = p_entry->i_value;
+        lowestupper.i_granule = p_entry->i_granule;
+    }
+
     i_start_pos = i_pos_lower;
     i_end_pos = i_pos_upper;
 
@@ -789,11 +786,11 @@ static int64_t OggBisectSearchByTime( demux_t *p_demux, logical_stream_t *p_stre
 
         if ( i_start_pos >= i_end_pos )
         {
-            if ( i_start_pos == i_pos_lower)
+            if ( i_start_pos == i_pos_lower && bestlower.i_granule == -1 )
             {
                 return i_start_pos;
             }
-            return -1;
+            break;
         }
 
 
@@ -817,7 +814,8 @@ static int64_t OggBisectSearchByTime( demux_t *p_demux, logical_stream_t *p_stre
 
         if ( current.i_pos != -1 && current.i_granule != -1 )
         {
-            /* found a page */
+            /* found a page, keep it for the next seeks */
+            OggSeek_IndexAdd( p_stream, current.i_granule, current.i_pos );
 
             if ( current.i_timestamp <= i_targettime )
             {
@@ -906,8 +904,11 @@ int Oggseek_BlindSeektoAbsoluteTime( demux_t *p_demux, logical_stream_t *p_strea
     Ogg_GetBoundsUsingSkeletonIndex( p_stream, i_time, &i_lowerpos, &i_upperpos );
     if ( i_lowerpos != -1 ) b_found = true;
 
-    /* And also search in our own index */
-    if ( !b_found && OggSeekIndexFind( p_stream, i_time, &i_lowerpos, &i_upperpos ) )
+    /* And also search in our own index. Its pages only bound the search,
+       unless decoding can start from any of them and we can't bisect */
+    Oggseek_IndexerTake( p_demux );
+    if ( !b_found && OggSeekIndexFind( p_stream, i_time, &i_lowerpos, &i_upperpos ) &&
+         !b_fastseek && Ogg_GetKeyframeGranule( p_stream, 0xFF00FF00 ) == 0xFF00FF00 )
     {
         b_found = true;
     }
@@ -926,7 +927,7 @@ int Oggseek_BlindSeektoAbsoluteTime( demux_t *p_demux, logical_stream_t *p_strea
     if ( !b_found && b_fastseek )
     {
         i_lowerpos = OggBisectSearchByTime( p_demux, p_stream, i_time,
-                                            p_stream->i_data_start, p_sys->i_total_length );
+                                            i_lowerpos, i_upperpos );
         b_found = ( i_lowerpos != -1 );
     }
 
@@ -1010,9 +1011,8 @@ int Oggseek_SeektoAbsolutetime( demux_t *p_demux, logical_stream_t *p_stream,
     }
     OggDebug( msg_Dbg( p_demux, "Search bounds set to %"PRId64" %"PRId64" using skeleton index", i_offset_lower, i_offset_upper ) );
 
-    OggNoDebug(
-        OggSeekIndexFind( p_stream, i_time, &i_offset_lower, &i_offset_upper )
-    );
+    /* the bisection also starts from our own index */
+    Oggseek_IndexerTake( p_demux );
 
     i_offset_lower = __MAX( i_offset_lower, p_stream->i_data_start );
     i_offset_upper = __MIN( i_offset_upper, p_sys->i_total_length );
@@ -1026,12 +1026,6 @@ int Oggseek_SeektoAbsolutetime( demux_t *p_demux, logical_stream_t *p_stream,
         p_sys->i_input_position = i_pagepos;
         seek_byte( p_demux, p_sys->i_input_position );
     }
-    /* Insert keyframe position into index */
-    OggNoDebug(
-    if ( i_pagepos >= p_stream->i_data_start )
-        OggSeek_IndexAdd( p_stream, i_time, i_pagepos )
-    );
-
     OggDebug( msg_Dbg( p_demux, "=================== Seeked To %"PRId64" time %"PRId64, i_pagepos, i_time ) );
     return i_pagepos;
 }
@@ -1112,3 +1106,167 @@ int64_t oggseek_read_page( demux_t *p_demux )
     return i_result + PAGE_HEADER_BYTES + i_nsegs;
 }
 
+/************************************************************************
+ * background indexer
+ *************************************************************************/
+
+#define OGGSEEK_INDEXER_READ_SIZE 65536
+
+struct oggseek_indexer
+{
+    demux_t      *p_demux;
+    char         *psz_url;
+    vlc_thread_t  thread;
+    atomic_bool   b_stop;
+
+    /* pages found and not taken yet */
+    vlc_mutex_t   lock;
+    struct
+    {
+        int     i_serial_no;
+        int64_t i_granule;
+        int64_t i_pagepos;
+    }            *p_pages;
+    size_t        i_pages;
+    size_t        i_pages_alloc;
+};
+
+static void OggIndexerAddPage( oggseek_indexer_t *p_indexer, int i_serial_no,
+                               int64_t i_granule, int64_t i_pagepos )
+{
+    vlc_mutex_lock( &p_indexer->lock );
+    if ( p_indexer->i_pages == p_indexer->i_pages_alloc )
+    {
+        size_t i_alloc = __MAX( 256, p_indexer->i_pages_alloc * 2 );
+        void *p_realloc = realloc( p_indexer->p_pages,
+                                   i_alloc * sizeof( *p_indexer->p_pages ) );
+        if ( !p_realloc )
+        {
+            vlc_mutex_unlock( &p_indexer->lock );
+            return;
+        }
+        p_indexer->p_pages = p_realloc;
+        p_indexer->i_pages_alloc = i_alloc;
+    }
+    p_indexer->p_pages[p_indexer->i_pages].i_serial_no = i_serial_no;
+    p_indexer->p_pages[p_indexer->i_pages].i_granule = i_granule;
+    p_indexer->p_pages[p_indexer->i_pages].i_pagepos = i_pagepos;
+    p_indexer->i_pages++;
+    vlc_mutex_unlock( &p_indexer->lock );
+}
+
+/* Reads the whole file through its own stream, and reports every page
+   ending a packet */
+static void *OggIndexerThread( void *data )
+{
+    oggseek_indexer_t *p_indexer = data;
+    demux_t *p_demux = p_indexer->p_demux;
+
+    stream_t *s = vlc_stream_NewURL( p_demux, p_indexer->psz_url );
+    if ( s == NULL )
+        return NULL;
+
+    ogg_sync_state oy;
+    ogg_page page;
+    int64_t i_pagepos = 0;
+
+    ogg_sync_init( &oy );
+
+    while ( !atomic_load( &p_indexer->b_stop ) )
+    {
+        long i_ret = ogg_sync_pageseek( &oy, &page );
+        if ( i_ret == 0 )
+        {
+            char *p_buffer = ogg_sync_buffer( &oy, OGGSEEK_INDEXER_READ_SIZE );
+            if ( p_buffer == NULL )
+                break;
+            ssize_t i_read = vlc_stream_Read( s, p_buffer, OGGSEEK_INDEXER_READ_SIZE );
+            if ( i_read <= 0 )
+                break;
+            ogg_sync_wrote( &oy, i_read );
+            continue;
+        }
+        else if ( i_ret < 0 )
+        {
+            /* skipped garbage */
+            i_pagepos -= i_ret;
+            continue;
+        }
+
+        if ( ogg_page_granulepos( &page ) > 0 )
+            OggIndexerAddPage( p_indexer, ogg_page_serialno( &page ),
+                               ogg_page_granulepos( &page ), i_pagepos );
+        i_pagepos += i_ret;
+    }
+
+    msg_Dbg( p_demux, "indexed %"PRId64" bytes", i_pagepos );
+
+    ogg_sync_clear( &oy );
+    vlc_stream_Delete( s );
+    return NULL;
+}
+
+oggseek_indexer_t *Oggseek_IndexerNew( demux_t *p_demux )
+{
+    if ( p_demux->s->psz_url == NULL )
+        return NULL;
+
+    oggseek_indexer_t *p_indexer = calloc( 1, sizeof( *p_indexer ) );
+    if ( !p_indexer )
+        return NULL;
+
+    p_indexer->p_demux = p_demux;
+    p_indexer->psz_url = strdup( p_demux->s->psz_url );
+    atomic_init( &p_indexer->b_stop, false );
+    vlc_mutex_init( &p_indexer->lock );
+
+    if ( p_indexer->psz_url == NULL ||
+         vlc_clone( &p_indexer->thread, OggIndexerThread, p_indexer,
+                    VLC_THREAD_PRIORITY_LOW ) )
+    {
+        vlc_mutex_destroy( &p_indexer->lock );
+        free( p_indexer->psz_url );
+        free( p_indexer );
+        return NULL;
+    }
+
+    return p_indexer;
+}
+
+void Oggseek_IndexerDelete( oggseek_indexer_t *p_indexer )
+{
+    atomic_store( &p_indexer->b_stop, true );
+    vlc_join( p_indexer->thread, NULL );
+
+    vlc_mutex_destroy( &p_indexer->lock );
+    free( p_indexer->p_pages );
+    free( p_indexer->psz_url );
+    free( p_indexer );
+}
+
+/* Moves the pages found by the indexer to the index of their stream */
+void Oggseek_IndexerTake( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    oggseek_indexer_t *p_indexer = p_sys->p_indexer;
+
+    if ( p_indexer == NULL )
+        return;
+
+    vlc_mutex_lock( &p_indexer->lock );
+    for ( size_t i = 0; i < p_indexer->i_pages; i++ )
+    {
+        for ( int j = 0; j < p_sys->i_streams; j++ )
+        {
+            logical_stream_t *p_stream = p_sys->pp_stream[j];
+            if ( p_stream->i_serial_no == p_indexer->p_pages[i].i_serial_no )
+            {
+                OggSeek_IndexAdd( p_stream, p_indexer->p_pages[i].i_granule,
+                                  p_indexer->p_pages[i].i_pagepos );
+                break;
+            }
+        }
+    }
+    p_indexer->i_pages = 0;
+    vlc_mutex_unlock( &p_indexer->lock );
+}
@@ -30,23 +30,20 @@
 
 #define OGGSEEK_BYTES_TO_READ 8500
 
-/* index entries are structured as follows:
- *   - for theora, highest granulepos -> pagepos (bytes) where keyframe begins
- *  - for dirac, kframe (sync point) -> pagepos of sequence start (?)
- */
+/* minimum time between two index entries of a logical stream */
+#define OGGSEEK_INDEX_INTERVAL CLOCK_FREQ
+
+/* index entries map the timestamp of a page granulepos to the offset of that
+ * page, and bound the bisection when seeking. They are collected from the
+ * pages read during playback and bisection, and optionally from a background
+ * scan of the whole file, and kept sorted by timestamp (and offset). */
 
 /* this is typedefed to demux_index_entry_t in ogg.h */
 struct oggseek_index_entry
 {
-    demux_index_entry_t *p_next;
-    demux_index_entry_t *p_prev;
-
-    /* value is highest granulepos for theora, sync frame for dirac */
-    int64_t i_value;
+    int64_t i_value;   /* timestamp */
+    int64_t i_granule;
     int64_t i_pagepos;
-
-    /* not used for theora because the granulepos tells us this */
-    int64_t i_pagepos_end;
 };
 
 int64_t Ogg_GetKeyframeGranule ( logical_stream_t *p_stream, int64_t i_granule );
@@ -57,9 +54,14 @@ int64_t Oggseek_GranuleToAbsTimestamp ( logical_stream_t *p_stream, int64_t i_gr
 int     Oggseek_BlindSeektoAbsoluteTime ( demux_t *, logical_stream_t *, int64_t, bool );
 int     Oggseek_BlindSeektoPosition ( demux_t *, logical_stream_t *, double f, bool );
 int     Oggseek_SeektoAbsolutetime ( demux_t *, logical_stream_t *, int64_t i_granulepos );
-const demux_index_entry_t *OggSeek_IndexAdd ( logical_stream_t *, int64_t, int64_t );
+void    OggSeek_IndexAdd ( logical_stream_t *, int64_t i_granule, int64_t i_pagepos );
 void    Oggseek_ProbeEnd( demux_t * );
 
-void oggseek_index_entries_free ( demux_index_entry_t * );
+void oggseek_index_entries_free ( logical_stream_t * );
+
+/* background scan of the file pages, feeding the streams index */
+oggseek_indexer_t *Oggseek_IndexerNew( demux_t * );
+void    Oggseek_IndexerDelete( oggseek_indexer_t * );
+void    Oggseek_IndexerTake( demux_t * );
 
 int64_t oggseek_read_page ( demux_t * );
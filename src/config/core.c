@@ -35,8 +35,10 @@
 #include <errno.h>
 #include <assert.h>
 
+#include "libvlc.h"
 #include "configuration.h"
 #include "modules/modules.h"
+#include "misc/variables.h"
 
 vlc_rwlock_t config_lock = VLC_STATIC_RWLOCK;
 bool config_dirty = false;
@@ -210,6 +212,7 @@ void config_PutPsz( vlc_object_t *p_this,
     p_config->value.psz = str;
     config_dirty = true;
     vlc_rwlock_unlock (&config_lock);
+    var_InheritChanged (psz_name);
 
     free (oldstr);
 }
@@ -245,6 +248,7 @@ void config_PutInt( vlc_object_t *p_this, const char *psz_name,
     p_config->value.i = i_value;
     config_dirty = true;
     vlc_rwlock_unlock (&config_lock);
+    var_InheritChanged (psz_name);
 }
 
 #undef config_PutFloat
@@ -280,6 +284,7 @@ void config_PutFloat( vlc_object_t *p_this,
     p_config->value.f = f_value;
     config_dirty = true;
     vlc_rwlock_unlock (&config_lock);
+    var_InheritChanged (psz_name);
 }
 
 /**
@@ -582,6 +587,7 @@ void config_ResetAll( vlc_object_t *p_this )
         }
     }
     vlc_rwlock_unlock (&config_lock);
+    var_InheritChanged (NULL);
 
     VLC_UNUSED(p_this);
 }
@@ -47,6 +47,7 @@
 
 #include "configuration.h"
 #include "modules/modules.h"
+#include "misc/variables.h"
 
 static inline char *strdupnull (const char *src)
 {
@@ -242,6 +243,7 @@ int config_LoadConfigFile( vlc_object_t *p_this )
         }
     }
     vlc_rwlock_unlock (&config_lock);
+    var_InheritChanged (NULL);
     free (line);
 
     if (ferror (file))
@@ -1703,8 +1703,9 @@ static decoder_t * CreateDecoder( vlc_object_t *p_parent,
 
     es_format_Init( &p_owner->fmt, fmt->i_cat, 0 );
 
-    /* decoder fifo */
-    p_owner->p_fifo = block_FifoNew();
+    /* decoder fifo: blocks are queued by a single thread (the input thread,
+     * or the parent decoder thread for closed captions) */
+    p_owner->p_fifo = block_FifoNewSPSC();
     if( unlikely(p_owner->p_fifo == NULL) )
     {
         free( p_owner );
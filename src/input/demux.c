@@ -469,6 +469,7 @@ int demux_vaControlHelper( stream_t *s,
             *va_arg( args, bool * ) = false;
             return VLC_SUCCESS;
 
+        case DEMUX_GET_INDEX_PROGRESS:
         case DEMUX_GET_FPS:
         case DEMUX_HAS_UNSUPPORTED_META:
         case DEMUX_SET_NEXT_DEMUX_TIME:
@@ -32,6 +32,7 @@
 #include <vlc_common.h>
 
 #include <limits.h>
+#include <math.h>
 #include <assert.h>
 #include <sys/stat.h>
 
@@ -2497,6 +2498,18 @@ static void UpdateGenericFromDemux( input_thread_t *p_input )
         if( !demux_Control( p_demux, DEMUX_GET_SIGNAL, &quality, &strength ) )
             input_SendEventSignal( p_input, quality, strength );
     }
+
+    {
+        double progress;
+
+        /* by steps of 1%, not to trigger the callbacks at each block */
+        if( demux_Control( p_demux, DEMUX_GET_INDEX_PROGRESS, &progress ) )
+            progress = -1.;
+        else
+            progress = floor( progress * 100. ) / 100.;
+        if( progress != var_GetFloat( p_input, "index-progress" ) )
+            var_SetFloat( p_input, "index-progress", progress );
+    }
 }
 
 static void UpdateTitleListfromDemux( input_thread_t *p_input )
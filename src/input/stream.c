@@ -108,7 +108,7 @@ void stream_CommonDelete(stream_t *s)
     if (priv->peek != NULL)
         block_Release(priv->peek);
     if (priv->block != NULL)
-        block_Release(priv->block);
+        block_ChainRelease(priv->block);
 
     free(s->psz_url);
     vlc_object_release(s);
@@ -379,9 +379,10 @@ static ssize_t vlc_stream_CopyBlock(block_t **restrict pp,
     block->i_buffer -= len;
 
     if (block->i_buffer == 0)
-    {
+    {   /* pf_block() may return a chain: keep the remaining blocks */
+        *pp = block->p_next;
+        block->p_next = NULL;
         block_Release(block);
-        *pp = NULL;
     }
 
     return likely(len > 0) ? (ssize_t)len : -1;
@@ -413,18 +414,27 @@ static ssize_t vlc_stream_ReadRaw(stream_t *s, void *buf, size_t len)
         return ret;
     }
 
-    ret = vlc_stream_CopyBlock(&priv->block, buf, len);
-    if (ret >= 0)
-        return ret;
+    if (unlikely(len == 0))
+        return 0; /* nothing would be consumed from the blocks */
+
+    while (priv->block != NULL)
+    {
+        ret = vlc_stream_CopyBlock(&priv->block, buf, len);
+        if (ret >= 0)
+            return ret;
+    }
 
     if (s->pf_block != NULL)
     {
         bool eof = false;
 
         priv->block = s->pf_block(s, &eof);
-        ret = vlc_stream_CopyBlock(&priv->block, buf, len);
-        if (ret >= 0)
-            return ret;
+        while (priv->block != NULL)
+        {
+            ret = vlc_stream_CopyBlock(&priv->block, buf, len);
+            if (ret >= 0)
+                return ret;
+        }
         return eof ? 0 : -1;
     }
 
@@ -486,6 +496,11 @@ ssize_t vlc_stream_Peek(stream_t *s, const uint8_t **restrict bufp, size_t len)
         peek = priv->block;
         priv->peek = peek;
         priv->block = NULL;
+        if (peek != NULL)
+        {   /* Only peek into the first block of a chain */
+            priv->block = peek->p_next;
+            peek->p_next = NULL;
+        }
     }
 
     if (peek == NULL)
@@ -548,12 +563,18 @@ block_t *vlc_stream_ReadBlock(stream_t *s)
     else if (priv->block != NULL)
     {
         block = priv->block;
-        priv->block = NULL;
+        priv->block = block->p_next;
+        block->p_next = NULL;
     }
     else if (s->pf_block != NULL)
     {
         priv->eof = false;
         block = s->pf_block(s, &priv->eof);
+        if (block != NULL)
+        {   /* Hand chained blocks out one at a time */
+            priv->block = block->p_next;
+            block->p_next = NULL;
+        }
     }
     else
     {
@@ -643,7 +664,7 @@ int vlc_stream_Seek(stream_t *s, uint64_t offset)
 
     if (priv->block != NULL)
     {
-        block_Release(priv->block);
+        block_ChainRelease(priv->block);
         priv->block = NULL;
     }
 
@@ -678,7 +699,7 @@ int vlc_stream_vaControl(stream_t *s, int cmd, va_list args)
 
             if (priv->block != NULL)
             {
-                block_Release(priv->block);
+                block_ChainRelease(priv->block);
                 priv->block = NULL;
             }
 
@@ -87,6 +87,13 @@ static const char *const ppsz_snap_formats[] =
     "This is the verbosity level (0=only errors and " \
     "standard messages, 1=warnings, 2=debug).")
 
+#define LOG_ASYNC_TEXT N_("Deferred logging")
+#define LOG_ASYNC_LONGTEXT N_( \
+    "Queue log messages in per-thread buffers, and write them to the " \
+    "log from a dedicated thread. This avoids blocking the emitting " \
+    "threads on the log output, but messages may be dropped if they " \
+    "are emitted faster than they can be written.")
+
 #define OPEN_TEXT N_("Default stream")
 #define OPEN_LONGTEXT N_( \
     "This stream will always be opened at VLC startup." )
@@ -814,6 +821,11 @@ static const char *const ppsz_prefres[] = {
     "Specify an IP address (e.g. ::1 or 127.0.0.1) or a host name " \
     "(e.g. localhost) to restrict them to a specific network interface." )
 
+#define HTTP_THREADS_TEXT N_( "HTTP server threads" )
+#define HTTP_THREADS_LONGTEXT N_( \
+    "Number of threads serving the clients of each HTTP server. " \
+    "0 uses one thread per CPU." )
+
 #define HTTP_PORT_TEXT N_( "HTTP server port" )
 #define HTTP_PORT_LONGTEXT N_( \
     "The HTTP server will listen on this TCP port. " \
@@ -1086,6 +1098,14 @@ static const char *const ppsz_prefres[] = {
 #define ONEINSTANCEWHENSTARTEDFROMFILE_TEXT N_( \
     "Use only one instance when started from file manager")
 
+#define BLOCK_CACHE_TEXT N_("Block allocator cache size (KiB)")
+#define BLOCK_CACHE_LONGTEXT N_( \
+    "Recycle data blocks of common sizes (TS packets, datagrams, 64 KiB " \
+    "buffers) through per-thread caches of up to this many kibibytes, " \
+    "rather than going through the system allocator every time. " \
+    "This can reduce allocator contention when running many inputs in " \
+    "one process. 0 disables the cache.")
+
 #define HPRIORITY_TEXT N_("Increase the priority of the process")
 #define HPRIORITY_LONGTEXT N_( \
     "Increasing the priority of the process will very likely improve your " \
@@ -1798,6 +1818,9 @@ vlc_module_begin ()
     add_string( "http-host", NULL, HTTP_HOST_TEXT, HOST_LONGTEXT, true )
     add_integer( "http-port", 8080, HTTP_PORT_TEXT, HTTP_PORT_LONGTEXT, true )
         change_integer_range( 1, 65535 )
+    add_integer( "http-threads", 0, HTTP_THREADS_TEXT,
+                 HTTP_THREADS_LONGTEXT, true )
+        change_integer_range( 0, 64 )
     add_integer( "https-port", 8443, HTTPS_PORT_TEXT, HTTPS_PORT_LONGTEXT, true )
         change_integer_range( 1, 65535 )
     add_string( "rtsp-host", NULL, RTSP_HOST_TEXT, RTSP_HOST_LONGTEXT, true )
@@ -2053,6 +2076,10 @@ vlc_module_begin ()
     add_obsolete_bool( "inhibit" ) /* since 3.0.0 */
 #endif
 
+    add_integer( "block-cache", 0, BLOCK_CACHE_TEXT,
+                 BLOCK_CACHE_LONGTEXT, true )
+        change_integer_range( 0, 1 << 20 )
+
 #if defined(_WIN32) || defined(__OS2__)
     add_bool( "high-priority", 0, HPRIORITY_TEXT,
               HPRIORITY_LONGTEXT, false )
@@ -2140,6 +2167,7 @@ vlc_module_begin ()
                  false )
         change_short('v')
         change_volatile ()
+    add_bool( "log-async", false, LOG_ASYNC_TEXT, LOG_ASYNC_LONGTEXT, true )
     add_obsolete_string( "verbose-objects" ) /* since 2.1.0 */
 #if !defined(_WIN32) && !defined(__OS2__)
     add_bool( "daemon", 0, DAEMON_TEXT, DAEMON_LONGTEXT, true )
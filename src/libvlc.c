@@ -93,6 +93,7 @@ libvlc_int_t * libvlc_InternalCreate( void )
     priv = libvlc_priv (p_libvlc);
     priv->playlist = NULL;
     priv->p_vlm = NULL;
+    priv->b_block_cache = false;
 
     vlc_ExitInit( &priv->exit );
 
@@ -231,6 +232,11 @@ int libvlc_InternalInit( libvlc_int_t *p_libvlc, int i_argc,
 
     priv->b_stats = var_InheritBool( p_libvlc, "stats" );
 
+    int64_t i_block_cache = var_InheritInteger( p_libvlc, "block-cache" );
+    if( i_block_cache > 0 )
+        priv->b_block_cache =
+            vlc_block_cache_Init( i_block_cache << 10 ) == VLC_SUCCESS;
+
     /*
      * Initialize hotkey handling
      */
@@ -422,6 +428,9 @@ void libvlc_InternalCleanup( libvlc_int_t *p_libvlc )
     if( !var_InheritBool( p_libvlc, "ignore-config" ) )
         config_AutoSaveConfigFile( VLC_OBJECT(p_libvlc) );
 
+    if( priv->b_block_cache )
+        vlc_block_cache_Deinit( VLC_OBJECT(p_libvlc) );
+
     /* Free module bank. It is refcounted, so we call this each time  */
     vlc_LogDeinit (p_libvlc);
     module_EndBank (true);
@@ -65,6 +65,12 @@ void vlc_assert_locked (vlc_mutex_t *);
 # define vlc_assert_locked( m ) (void)m
 #endif
 
+/*
+ * Block allocator cache
+ */
+int vlc_block_cache_Init(size_t budget);
+void vlc_block_cache_Deinit(vlc_object_t *);
+
 /*
  * Logging
  */
@@ -182,6 +188,7 @@ typedef struct libvlc_priv_t
 
     /* Logging */
     bool               b_stats;     ///< Whether to collect stats
+    bool               b_block_cache; ///< Whether the block cache is in use
 
     /* Singleton objects */
     vlc_logger_t      *logger;
@@ -34,6 +34,8 @@
 #include <vlc_common.h>
 #include <vlc_block.h>
 #include <vlc_fs.h>
+#include <vlc_atomic.h>
+#include "../libvlc.h"
 
 #ifndef NDEBUG
 static void BlockNoRelease( block_t *b )
@@ -91,12 +93,15 @@ void block_Init( block_t *restrict b, void *buf, size_t size )
 #endif
 }
 
+static bool block_cache_Put (block_t *);
+
 static void block_generic_Release (block_t *block)
 {
     /* That is always true for blocks allocated with block_Alloc(). */
     assert (block->p_start == (unsigned char *)(block + 1));
     block_Invalidate (block);
-    free (block);
+    if (!block_cache_Put (block))
+        free (block);
 }
 
 static void BlockMetaCopy( block_t *restrict out, const block_t *in )
@@ -117,6 +122,357 @@ static void BlockMetaCopy( block_t *restrict out, const block_t *in )
 /** Initial reserved header and footer size. */
 #define BLOCK_PADDING      32
 
+/*
+ * Block cache
+ *
+ * When enabled, blocks of the most common sizes are recycled through
+ * per-thread LIFO free lists rather than going back to the C heap.
+ * A block is cached by the thread releasing it, which is often not the one
+ * that allocated it (e.g. demuxer to decoder). Free lists exceeding their
+ * bound spill half of their content to a shared depot, where allocating
+ * threads refill from in batches. Both levels are bounded.
+ */
+
+/* 2 * BLOCK_PADDING: pre + post padding */
+#define BLOCK_OVERHEAD (BLOCK_ALIGN + (2 * BLOCK_PADDING))
+
+/** Cached payload sizes: TS packet, RTP/UDP TS datagram, MTU, 64 KiB */
+static const size_t block_cache_classes[] = { 188, 7 * 188, 1500, 65536 };
+#define BLOCK_CACHE_CLASSES ARRAY_SIZE(block_cache_classes)
+#define BLOCK_CACHE_DEPOT_RATIO 4 /* depot bound relative to a thread's */
+#define BLOCK_CACHE_STATS_PERIOD 1024
+
+struct block_cache_list
+{
+    block_t *head;
+    unsigned count;
+};
+
+struct block_cache_depot
+{
+    block_t *head;
+    atomic_uint count;
+};
+
+struct block_cache_thread
+{
+    struct block_cache_thread *next; /* registered with the cache */
+    struct block_cache_list lists[BLOCK_CACHE_CLASSES];
+    /* Statistics not yet accounted for globally */
+    unsigned ops;
+    uint64_t hits;
+    uint64_t misses;
+    ssize_t resident;
+};
+
+static struct
+{
+    vlc_mutex_t lock;
+    unsigned refs;
+    vlc_threadvar_t key;
+    struct block_cache_thread *threads;
+    atomic_bool enabled;
+    unsigned max[BLOCK_CACHE_CLASSES]; /* per-thread bound (in blocks) */
+    struct block_cache_depot depot[BLOCK_CACHE_CLASSES];
+    atomic_uint_fast64_t hits;
+    atomic_uint_fast64_t misses;
+    atomic_size_t resident;
+} block_cache = {
+    .lock = VLC_STATIC_MUTEX,
+    .enabled = ATOMIC_VAR_INIT(false),
+    .hits = ATOMIC_VAR_INIT(0),
+    .misses = ATOMIC_VAR_INIT(0),
+    .resident = ATOMIC_VAR_INIT(0),
+};
+
+static int block_cache_Class (size_t size)
+{
+    for (unsigned i = 0; i < BLOCK_CACHE_CLASSES; i++)
+        if (size <= block_cache_classes[i])
+            /* Do not waste more than half of a cached block */
+            return (size > block_cache_classes[i] / 2) ? (int)i : -1;
+    return -1;
+}
+
+static void block_cache_Flush (struct block_cache_thread *tc)
+{
+    atomic_fetch_add_explicit (&block_cache.hits, tc->hits,
+                               memory_order_relaxed);
+    atomic_fetch_add_explicit (&block_cache.misses, tc->misses,
+                               memory_order_relaxed);
+    atomic_fetch_add_explicit (&block_cache.resident, tc->resident,
+                               memory_order_relaxed);
+    tc->ops = 0;
+    tc->hits = tc->misses = 0;
+    tc->resident = 0;
+}
+
+static void block_cache_Account (struct block_cache_thread *tc)
+{
+    if (++tc->ops >= BLOCK_CACHE_STATS_PERIOD)
+        block_cache_Flush (tc);
+}
+
+/** Frees a list of cached blocks, returns the number of freed bytes. */
+static size_t block_cache_Free (block_t *b)
+{
+    size_t bytes = 0;
+
+    while (b != NULL)
+    {
+        block_t *next = b->p_next;
+
+        bytes += sizeof (*b) + b->i_size;
+        free (b);
+        b = next;
+    }
+    return bytes;
+}
+
+/** Releases a thread cache, with the lock held. */
+static void block_cache_ThreadRelease (struct block_cache_thread *tc)
+{
+    for (unsigned i = 0; i < BLOCK_CACHE_CLASSES; i++)
+        tc->resident -= block_cache_Free (tc->lists[i].head);
+    block_cache_Flush (tc);
+    free (tc);
+}
+
+/** Unregisters a thread cache, returns false if it was not registered. */
+static bool block_cache_ThreadRemove (struct block_cache_thread *tc)
+{
+    for (struct block_cache_thread **pp = &block_cache.threads; *pp != NULL;
+         pp = &(*pp)->next)
+        if (*pp == tc)
+        {
+            *pp = tc->next;
+            return true;
+        }
+    return false;
+}
+
+static void block_cache_ThreadDestroy (void *data)
+{
+    struct block_cache_thread *tc = data;
+
+    vlc_mutex_lock (&block_cache.lock);
+    /* Otherwise the cache was torn down as the thread was exiting */
+    if (block_cache_ThreadRemove (tc))
+        block_cache_ThreadRelease (tc);
+    vlc_mutex_unlock (&block_cache.lock);
+}
+
+static struct block_cache_thread *block_cache_Thread (void)
+{
+    struct block_cache_thread *tc = vlc_threadvar_get (block_cache.key);
+
+    if (unlikely(tc == NULL))
+    {
+        tc = calloc (1, sizeof (*tc));
+        if (unlikely(tc == NULL))
+            return NULL;
+
+        /* Registered so that the cache can be torn down while the thread
+         * lives on */
+        vlc_mutex_lock (&block_cache.lock);
+        if (!atomic_load_explicit (&block_cache.enabled, memory_order_relaxed)
+         || vlc_threadvar_set (block_cache.key, tc))
+        {
+            vlc_mutex_unlock (&block_cache.lock);
+            free (tc);
+            return NULL;
+        }
+        tc->next = block_cache.threads;
+        block_cache.threads = tc;
+        vlc_mutex_unlock (&block_cache.lock);
+    }
+    return tc;
+}
+
+static block_t *block_cache_Get (size_t size)
+{
+    int i = block_cache_Class (size);
+    if (i < 0)
+        return NULL;
+
+    struct block_cache_thread *tc = block_cache_Thread ();
+    if (unlikely(tc == NULL))
+        return NULL;
+
+    struct block_cache_list *list = &tc->lists[i];
+    struct block_cache_depot *depot = &block_cache.depot[i];
+
+    if (list->head == NULL
+     && atomic_load_explicit (&depot->count, memory_order_relaxed) > 0)
+    {   /* Refill half of the free list from the depot */
+        vlc_mutex_lock (&block_cache.lock);
+        /* The depot is empty if the cache was disabled meanwhile */
+        for (unsigned n = (block_cache.max[i] + 1) / 2;
+             n > 0 && depot->head != NULL; n--)
+        {
+            block_t *b = depot->head;
+
+            depot->head = b->p_next;
+            atomic_fetch_sub_explicit (&depot->count, 1,
+                                       memory_order_relaxed);
+            b->p_next = list->head;
+            list->head = b;
+            list->count++;
+        }
+        vlc_mutex_unlock (&block_cache.lock);
+    }
+
+    block_t *b = list->head;
+    if (b != NULL)
+    {
+        list->head = b->p_next;
+        list->count--;
+        tc->resident -= sizeof (*b) + b->i_size;
+        tc->hits++;
+    }
+    else
+    {   /* Miss: allocate with the full class size for later recycling */
+        b = malloc (sizeof (*b) + BLOCK_OVERHEAD + block_cache_classes[i]);
+        if (likely(b != NULL))
+            b->i_size = BLOCK_OVERHEAD + block_cache_classes[i];
+        tc->misses++;
+    }
+    block_cache_Account (tc);
+    return b;
+}
+
+static bool block_cache_Put (block_t *b)
+{
+    if (!atomic_load_explicit (&block_cache.enabled, memory_order_acquire))
+        return false;
+
+    unsigned i = 0;
+    while (b->i_size != block_cache_classes[i] + BLOCK_OVERHEAD)
+        if (++i >= BLOCK_CACHE_CLASSES)
+            return false;
+
+    struct block_cache_thread *tc = block_cache_Thread ();
+    if (unlikely(tc == NULL))
+        return false;
+
+    struct block_cache_list *list = &tc->lists[i];
+    const unsigned max = block_cache.max[i];
+
+    if (list->count >= max)
+    {   /* Spill half of the free list to the depot, or drop it if full */
+        struct block_cache_depot *depot = &block_cache.depot[i];
+        block_t *spill = list->head;
+        unsigned n = (max + 1) / 2;
+
+        for (unsigned k = 1; k < n; k++)
+            list->head = list->head->p_next;
+
+        block_t *last = list->head;
+        list->head = last->p_next;
+        list->count -= n;
+
+        vlc_mutex_lock (&block_cache.lock);
+        /* Once the cache is disabled, the depot is not drained anymore */
+        if (atomic_load_explicit (&block_cache.enabled, memory_order_relaxed)
+         && atomic_load_explicit (&depot->count, memory_order_relaxed) + n
+                                             <= max * BLOCK_CACHE_DEPOT_RATIO)
+        {
+            last->p_next = depot->head;
+            depot->head = spill;
+            atomic_fetch_add_explicit (&depot->count, n,
+                                       memory_order_relaxed);
+            spill = NULL;
+        }
+        vlc_mutex_unlock (&block_cache.lock);
+
+        if (spill != NULL)
+        {
+            last->p_next = NULL;
+            tc->resident -= block_cache_Free (spill);
+        }
+    }
+
+    b->p_next = list->head;
+    list->head = b;
+    list->count++;
+    tc->resident += sizeof (*b) + b->i_size;
+    block_cache_Account (tc);
+    return true;
+}
+
+int vlc_block_cache_Init (size_t budget)
+{
+    int ret = VLC_SUCCESS;
+
+    vlc_mutex_lock (&block_cache.lock);
+    if (block_cache.refs == 0)
+    {
+        if (vlc_threadvar_create (&block_cache.key,
+                                  block_cache_ThreadDestroy))
+        {
+            ret = VLC_ENOMEM;
+            goto out;
+        }
+
+        /* Split the per-thread budget evenly amongst size classes */
+        for (unsigned i = 0; i < BLOCK_CACHE_CLASSES; i++)
+        {
+            size_t size = sizeof (block_t) + BLOCK_OVERHEAD
+                        + block_cache_classes[i];
+            size_t max = budget / BLOCK_CACHE_CLASSES / size;
+
+            block_cache.max[i] = (max > 0) ? max : 1;
+        }
+        atomic_store (&block_cache.hits, 0);
+        atomic_store (&block_cache.misses, 0);
+        atomic_store (&block_cache.enabled, true);
+    }
+    block_cache.refs++;
+out:
+    vlc_mutex_unlock (&block_cache.lock);
+    return ret;
+}
+
+void vlc_block_cache_Deinit (vlc_object_t *obj)
+{
+    vlc_mutex_lock (&block_cache.lock);
+    assert (block_cache.refs > 0);
+    if (--block_cache.refs == 0)
+    {
+        /* No other thread allocates nor releases blocks by now. The caches
+         * of threads still running are freed here, along with the key. */
+        atomic_store (&block_cache.enabled, false);
+
+        while (block_cache.threads != NULL)
+        {
+            struct block_cache_thread *tc = block_cache.threads;
+
+            block_cache.threads = tc->next;
+            block_cache_ThreadRelease (tc);
+        }
+        vlc_threadvar_delete (&block_cache.key);
+
+        for (unsigned i = 0; i < BLOCK_CACHE_CLASSES; i++)
+        {
+            struct block_cache_depot *depot = &block_cache.depot[i];
+
+            atomic_fetch_sub (&block_cache.resident,
+                              block_cache_Free (depot->head));
+            depot->head = NULL;
+            atomic_store (&depot->count, 0);
+        }
+
+        uint64_t hits = atomic_load (&block_cache.hits);
+        uint64_t misses = atomic_load (&block_cache.misses);
+
+        msg_Dbg (obj, "block cache: %"PRIu64" hits, %"PRIu64" misses "
+                 "(%.1f%% hit rate), %zu KiB still resident", hits, misses,
+                 (hits + misses) ? 100. * hits / (hits + misses) : 0.,
+                 atomic_load (&block_cache.resident) >> 10);
+    }
+    vlc_mutex_unlock (&block_cache.lock);
+}
+
 block_t *block_Alloc (size_t size)
 {
     if (unlikely(size >> 27))
@@ -125,17 +481,25 @@ block_t *block_Alloc (size_t size)
         return NULL;
     }
 
-    /* 2 * BLOCK_PADDING: pre + post padding */
-    const size_t alloc = sizeof (block_t) + BLOCK_ALIGN + (2 * BLOCK_PADDING)
-                       + size;
+    const size_t alloc = sizeof (block_t) + BLOCK_OVERHEAD + size;
     if (unlikely(alloc <= size))
         return NULL;
 
-    block_t *b = malloc (alloc);
-    if (unlikely(b == NULL))
-        return NULL;
+    block_t *b = NULL;
+
+    if (atomic_load_explicit (&block_cache.enabled, memory_order_acquire))
+        b = block_cache_Get (size);
+
+    if (b == NULL)
+    {
+        b = malloc (alloc);
+        if (unlikely(b == NULL))
+            return NULL;
 
-    block_Init (b, b + 1, alloc - sizeof (*b));
+        block_Init (b, b + 1, alloc - sizeof (*b));
+    }
+    else
+        block_Init (b, b + 1, b->i_size);
     static_assert ((BLOCK_PADDING % BLOCK_ALIGN) == 0,
                    "BLOCK_PADDING must be a multiple of BLOCK_ALIGN");
     b->p_buffer += BLOCK_PADDING + BLOCK_ALIGN - 1;
@@ -30,8 +30,47 @@
 
 #include <vlc_common.h>
 #include <vlc_block.h>
+#include <vlc_atomic.h>
 #include "libvlc.h"
 
+/**
+ * Lock-free single-producer single-consumer queue
+ *
+ * Blocks are stored in a linked list of fixed-size segments. Only the
+ * producer writes the tail and only the consumer reads the head, so neither
+ * side needs the FIFO lock. The lock is only taken to wake up a consumer that
+ * went to sleep in vlc_fifo_Wait().
+ */
+#define SPSC_SEGMENT_SIZE 256
+
+struct spsc_segment
+{
+    atomic_uintptr_t next;
+    block_t *slots[SPSC_SEGMENT_SIZE];
+};
+
+/* Number of dequeue attempts before going to sleep */
+#define SPSC_SPIN_COUNT 64
+
+struct spsc_queue
+{
+    /* Consumer side */
+    struct spsc_segment *head_segment;
+    atomic_size_t head;
+    atomic_size_t bytes_out;
+    char pad_head[64]; /* keep both sides in separate cache lines */
+
+    /* Producer side */
+    struct spsc_segment *tail_segment;
+    atomic_size_t tail;
+    atomic_size_t bytes_in;
+    char pad_tail[64];
+
+    atomic_uintptr_t spare; /**< Recycled segment */
+    atomic_bool sleeping; /**< Whether the consumer waits on the FIFO */
+    size_t lock_tail; /**< Tail when the lock was last acquired */
+};
+
 /**
  * Internal state for block queues
  */
@@ -44,11 +83,123 @@ struct block_fifo_t
     block_t             **pp_last;
     size_t              i_depth;
     size_t              i_size;
+
+    struct spsc_queue   *spsc; /**< Lock-free queue (or NULL) */
 };
 
+static struct spsc_segment *spsc_segment_New(struct spsc_queue *q)
+{
+    struct spsc_segment *seg;
+
+    seg = (struct spsc_segment *)atomic_exchange(&q->spare, 0);
+    if (seg == NULL)
+    {
+        seg = malloc(sizeof (*seg));
+        if (unlikely(seg == NULL))
+            return NULL;
+    }
+    atomic_init(&seg->next, 0);
+    return seg;
+}
+
+static bool spsc_Push(struct spsc_queue *q, block_t *block)
+{
+    size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    size_t idx = pos % SPSC_SEGMENT_SIZE;
+
+    if (idx == 0 && pos != 0)
+    {   /* Current segment is full */
+        struct spsc_segment *seg = spsc_segment_New(q);
+        if (unlikely(seg == NULL))
+            return false;
+
+        atomic_store_explicit(&q->tail_segment->next, (uintptr_t)seg,
+                              memory_order_relaxed);
+        q->tail_segment = seg;
+    }
+
+    q->tail_segment->slots[idx] = block;
+    atomic_store_explicit(&q->bytes_in,
+        atomic_load_explicit(&q->bytes_in, memory_order_relaxed)
+        + block->i_buffer, memory_order_relaxed);
+    atomic_store(&q->tail, pos + 1);
+    return true;
+}
+
+static block_t *spsc_Peek(struct spsc_queue *q)
+{
+    size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+    if (pos == atomic_load(&q->tail))
+        return NULL;
+
+    size_t idx = pos % SPSC_SEGMENT_SIZE;
+    struct spsc_segment *seg = q->head_segment;
+
+    if (idx == 0 && pos != 0)
+        seg = (struct spsc_segment *)atomic_load_explicit(&seg->next,
+                                                          memory_order_relaxed);
+    return seg->slots[idx];
+}
+
+static block_t *spsc_Pop(struct spsc_queue *q)
+{
+    size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+    if (pos == atomic_load(&q->tail))
+        return NULL;
+
+    size_t idx = pos % SPSC_SEGMENT_SIZE;
+
+    if (idx == 0 && pos != 0)
+    {   /* Move to the next segment and recycle the previous one */
+        struct spsc_segment *seg = q->head_segment;
+
+        q->head_segment = (struct spsc_segment *)
+            atomic_load_explicit(&seg->next, memory_order_relaxed);
+        free((void *)atomic_exchange(&q->spare, (uintptr_t)seg));
+    }
+
+    block_t *block = q->head_segment->slots[idx];
+
+    atomic_store_explicit(&q->bytes_out,
+        atomic_load_explicit(&q->bytes_out, memory_order_relaxed)
+        + block->i_buffer, memory_order_relaxed);
+    atomic_store_explicit(&q->head, pos + 1, memory_order_release);
+    return block;
+}
+
+/** Queues blocks from the producer thread without the FIFO lock */
+static void spsc_Queue(block_fifo_t *fifo, block_t *block)
+{
+    struct spsc_queue *q = fifo->spsc;
+
+    while (block != NULL)
+    {
+        block_t *next = block->p_next;
+
+        block->p_next = NULL;
+        if (unlikely(!spsc_Push(q, block)))
+            block_Release(block);
+        block = next;
+    }
+}
+
+static void spsc_Wake(block_fifo_t *fifo)
+{
+    if (atomic_load(&fifo->spsc->sleeping))
+    {
+        vlc_mutex_lock(&fifo->lock);
+        vlc_cond_signal(&fifo->wait);
+        vlc_mutex_unlock(&fifo->lock);
+    }
+}
+
 void vlc_fifo_Lock(vlc_fifo_t *fifo)
 {
     vlc_mutex_lock(&fifo->lock);
+    if (fifo->spsc != NULL)
+        fifo->spsc->lock_tail = atomic_load(&fifo->spsc->tail);
 }
 
 void vlc_fifo_Unlock(vlc_fifo_t *fifo)
@@ -63,32 +214,74 @@ void vlc_fifo_Signal(vlc_fifo_t *fifo)
 
 void vlc_fifo_Wait(vlc_fifo_t *fifo)
 {
-    vlc_fifo_WaitCond(fifo, &fifo->wait);
+    struct spsc_queue *q = fifo->spsc;
+
+    if (q == NULL)
+    {
+        vlc_fifo_WaitCond(fifo, &fifo->wait);
+        return;
+    }
+
+    /* Blocks queued without the lock after it was acquired would not have
+     * signaled the condition: do not wait for them. */
+    atomic_store(&q->sleeping, true);
+    if (atomic_load(&q->tail) == q->lock_tail)
+        vlc_cond_wait(&fifo->wait, &fifo->lock);
+    atomic_store(&q->sleeping, false);
+    q->lock_tail = atomic_load(&q->tail);
 }
 
 void vlc_fifo_WaitCond(vlc_fifo_t *fifo, vlc_cond_t *condvar)
 {
     vlc_cond_wait(condvar, &fifo->lock);
+    if (fifo->spsc != NULL)
+        fifo->spsc->lock_tail = atomic_load(&fifo->spsc->tail);
 }
 
 int vlc_fifo_TimedWaitCond(vlc_fifo_t *fifo, vlc_cond_t *condvar, mtime_t deadline)
 {
-    return vlc_cond_timedwait(condvar, &fifo->lock, deadline);
+    int ret = vlc_cond_timedwait(condvar, &fifo->lock, deadline);
+
+    if (fifo->spsc != NULL)
+        fifo->spsc->lock_tail = atomic_load(&fifo->spsc->tail);
+    return ret;
 }
 
 size_t vlc_fifo_GetCount(const vlc_fifo_t *fifo)
 {
+    struct spsc_queue *q = fifo->spsc;
+
+    if (q != NULL)
+    {   /* Load the consumer side first so that the result cannot underflow */
+        size_t head = atomic_load(&q->head);
+        return atomic_load(&q->tail) - head;
+    }
     return fifo->i_depth;
 }
 
 size_t vlc_fifo_GetBytes(const vlc_fifo_t *fifo)
 {
+    struct spsc_queue *q = fifo->spsc;
+
+    if (q != NULL)
+    {
+        size_t out = atomic_load(&q->bytes_out);
+        return atomic_load(&q->bytes_in) - out;
+    }
     return fifo->i_size;
 }
 
 void vlc_fifo_QueueUnlocked(block_fifo_t *fifo, block_t *block)
 {
     vlc_assert_locked(&fifo->lock);
+
+    if (fifo->spsc != NULL)
+    {
+        spsc_Queue(fifo, block);
+        vlc_fifo_Signal(fifo);
+        return;
+    }
+
     assert(*(fifo->pp_last) == NULL);
 
     *(fifo->pp_last) = block;
@@ -109,6 +302,9 @@ block_t *vlc_fifo_DequeueUnlocked(block_fifo_t *fifo)
 {
     vlc_assert_locked(&fifo->lock);
 
+    if (fifo->spsc != NULL)
+        return spsc_Pop(fifo->spsc);
+
     block_t *block = fifo->p_first;
 
     if (block == NULL)
@@ -131,6 +327,18 @@ block_t *vlc_fifo_DequeueAllUnlocked(block_fifo_t *fifo)
 {
     vlc_assert_locked(&fifo->lock);
 
+    if (fifo->spsc != NULL)
+    {
+        block_t *head = NULL, **pp = &head, *block;
+
+        while ((block = spsc_Pop(fifo->spsc)) != NULL)
+        {
+            *pp = block;
+            pp = &block->p_next;
+        }
+        return head;
+    }
+
     block_t *block = fifo->p_first;
 
     fifo->p_first = NULL;
@@ -152,12 +360,56 @@ block_fifo_t *block_FifoNew( void )
     p_fifo->p_first = NULL;
     p_fifo->pp_last = &p_fifo->p_first;
     p_fifo->i_depth = p_fifo->i_size = 0;
+    p_fifo->spsc = NULL;
+
+    return p_fifo;
+}
+
+block_fifo_t *block_FifoNewSPSC( void )
+{
+    block_fifo_t *p_fifo = block_FifoNew();
+    if( !p_fifo )
+        return NULL;
+
+    struct spsc_queue *q = malloc( sizeof( *q ) );
+    struct spsc_segment *seg = malloc( sizeof( *seg ) );
+    if( unlikely(q == NULL || seg == NULL) )
+    {
+        free( seg );
+        free( q );
+        block_FifoRelease( p_fifo );
+        return NULL;
+    }
+
+    atomic_init( &seg->next, 0 );
+    q->head_segment = q->tail_segment = seg;
+    atomic_init( &q->head, 0 );
+    atomic_init( &q->bytes_out, 0 );
+    atomic_init( &q->tail, 0 );
+    atomic_init( &q->bytes_in, 0 );
+    atomic_init( &q->spare, 0 );
+    atomic_init( &q->sleeping, false );
+    q->lock_tail = 0;
+    p_fifo->spsc = q;
 
     return p_fifo;
 }
 
 void block_FifoRelease( block_fifo_t *p_fifo )
 {
+    struct spsc_queue *q = p_fifo->spsc;
+
+    if( q != NULL )
+    {
+        block_t *block;
+
+        while( (block = spsc_Pop( q )) != NULL )
+            block_Release( block );
+        free( q->head_segment );
+        free( (void *)atomic_load( &q->spare ) );
+        free( q );
+    }
+
     block_ChainRelease( p_fifo->p_first );
     vlc_cond_destroy( &p_fifo->wait );
     vlc_mutex_destroy( &p_fifo->lock );
@@ -176,6 +428,13 @@ void block_FifoEmpty(block_fifo_t *fifo)
 
 void block_FifoPut(block_fifo_t *fifo, block_t *block)
 {
+    if (fifo->spsc != NULL)
+    {
+        spsc_Queue(fifo, block);
+        spsc_Wake(fifo);
+        return;
+    }
+
     vlc_fifo_Lock(fifo);
     vlc_fifo_QueueUnlocked(fifo, block);
     vlc_fifo_Unlock(fifo);
@@ -187,14 +446,23 @@ block_t *block_FifoGet(block_fifo_t *fifo)
 
     vlc_testcancel();
 
+    if (fifo->spsc != NULL)
+    {   /* Spin a little before going to sleep */
+        for (unsigned i = 0; i < SPSC_SPIN_COUNT; i++)
+        {
+            block = spsc_Pop(fifo->spsc);
+            if (block != NULL)
+                return block;
+        }
+    }
+
     vlc_fifo_Lock(fifo);
-    while (vlc_fifo_IsEmpty(fifo))
+    while ((block = vlc_fifo_DequeueUnlocked(fifo)) == NULL)
     {
         vlc_fifo_CleanupPush(fifo);
         vlc_fifo_Wait(fifo);
         vlc_cleanup_pop();
     }
-    block = vlc_fifo_DequeueUnlocked(fifo);
     vlc_fifo_Unlock(fifo);
 
     return block;
@@ -204,6 +472,13 @@ block_t *block_FifoShow( block_fifo_t *p_fifo )
 {
     block_t *b;
 
+    if( p_fifo->spsc != NULL )
+    {
+        b = spsc_Peek( p_fifo->spsc );
+        assert(b != NULL);
+        return b;
+    }
+
     vlc_mutex_lock( &p_fifo->lock );
     assert(p_fifo->p_first != NULL);
     b = p_fifo->p_first;
@@ -217,6 +492,9 @@ size_t block_FifoSize (block_fifo_t *fifo)
 {
     size_t size;
 
+    if (fifo->spsc != NULL)
+        return vlc_fifo_GetBytes(fifo);
+
     vlc_mutex_lock (&fifo->lock);
     size = fifo->i_size;
     vlc_mutex_unlock (&fifo->lock);
@@ -228,6 +506,9 @@ size_t block_FifoCount (block_fifo_t *fifo)
 {
     size_t depth;
 
+    if (fifo->spsc != NULL)
+        return vlc_fifo_GetCount(fifo);
+
     vlc_mutex_lock (&fifo->lock);
     depth = fifo->i_depth;
     vlc_mutex_unlock (&fifo->lock);
@@ -34,6 +34,7 @@
 
 #include <stdlib.h>
 #include <stdarg.h>                                       /* va_list for BSD */
+#include <stdalign.h>
 #include <unistd.h>
 #include <assert.h>
 
@@ -41,8 +42,11 @@
 #include <vlc_interface.h>
 #include <vlc_charset.h>
 #include <vlc_modules.h>
+#include <vlc_atomic.h>
 #include "../libvlc.h"
 
+typedef struct vlc_log_async vlc_log_async_t;
+
 struct vlc_logger_t
 {
     VLC_COMMON_MEMBERS
@@ -50,6 +54,7 @@ struct vlc_logger_t
     vlc_log_cb log;
     void *sys;
     module_t *module;
+    vlc_log_async_t *async; /**< Deferred logging state, or NULL */
 };
 
 static void vlc_vaLogCallback(libvlc_int_t *vlc, int type,
@@ -82,6 +87,446 @@ static void Win32DebugOutputMsg (void *, int , const vlc_log_t *,
                                  const char *, va_list);
 #endif
 
+/*
+ * Deferred logging
+ *
+ * Each emitting thread formats its messages into its own single-producer
+ * single-consumer ring buffer, without taking any lock. A dedicated thread
+ * drains the rings periodically, or as soon as a ring gets half full, and
+ * passes the messages to the logger callback. Messages that do not fit in a
+ * full ring are dropped and counted.
+ */
+#define VLC_LOG_RING_SIZE (1 << 16)
+#define VLC_LOG_PERIOD (CLOCK_FREQ / 20)
+#define VLC_LOG_ALIGN 8
+
+typedef struct vlc_log_ring vlc_log_ring_t;
+
+struct vlc_log_ring
+{
+    vlc_log_ring_t *next; /**< Next ring of the same logger */
+    vlc_log_async_t *owner;
+    atomic_uint refs; /**< One for the thread, one for the logger */
+    atomic_bool detached; /**< Whether the logger is gone */
+    atomic_size_t head; /**< Consumer offset */
+    atomic_size_t tail; /**< Producer offset */
+    atomic_uint dropped; /**< Messages dropped since last drained */
+    alignas (VLC_LOG_ALIGN) unsigned char data[VLC_LOG_RING_SIZE];
+};
+
+/** Ring buffer record. Strings follow, each NUL-terminated. */
+typedef struct
+{
+    uint32_t size; /**< Record size, including strings and padding */
+    int32_t type; /**< Message type, or -1 for padding up to the ring end */
+    uintptr_t object_id;
+    unsigned long tid;
+    int line;
+    uint8_t flags; /**< Optional strings present */
+} vlc_log_record_t;
+
+#define VLC_LOG_HEADER 0x1
+#define VLC_LOG_FILE   0x2
+#define VLC_LOG_FUNC   0x4
+
+struct vlc_log_async
+{
+    vlc_logger_t *logger;
+    vlc_mutex_t lock; /**< Protects the rings list and the consumer side */
+    vlc_cond_t wait;
+    vlc_log_ring_t *rings;
+    vlc_thread_t thread;
+    bool stop;
+};
+
+static vlc_mutex_t vlc_log_key_lock = VLC_STATIC_MUTEX;
+static vlc_threadvar_t vlc_log_key;
+static unsigned vlc_log_key_refs = 0; /**< Running asynchronous loggers */
+static vlc_log_ring_t *vlc_log_orphans = NULL; /**< Rings of stopped loggers */
+
+static void vlc_log_RingRelease(vlc_log_ring_t *ring)
+{
+    if (atomic_fetch_sub(&ring->refs, 1) == 1)
+        free(ring);
+}
+
+static void vlc_log_RingThreadExit(void *data)
+{
+    vlc_log_RingRelease(data);
+}
+
+/**
+ * Gets the ring buffer of the calling thread for a given logger.
+ * \return the ring or NULL if the thread already logs to another logger.
+ */
+static vlc_log_ring_t *vlc_log_GetRing(vlc_log_async_t *async)
+{
+    vlc_log_ring_t *ring = vlc_threadvar_get(vlc_log_key);
+
+    if (ring != NULL && atomic_load_explicit(&ring->detached,
+                                             memory_order_acquire))
+    {
+        vlc_threadvar_set(vlc_log_key, NULL);
+        vlc_log_RingRelease(ring);
+        ring = NULL;
+    }
+
+    if (likely(ring != NULL))
+        return (ring->owner == async) ? ring : NULL;
+
+    ring = malloc(sizeof (*ring));
+    if (unlikely(ring == NULL))
+        return NULL;
+
+    ring->owner = async;
+    atomic_init(&ring->refs, 2);
+    atomic_init(&ring->detached, false);
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->dropped, 0);
+
+    if (vlc_threadvar_set(vlc_log_key, ring))
+    {
+        free(ring);
+        return NULL;
+    }
+
+    vlc_mutex_lock(&async->lock);
+    ring->next = async->rings;
+    async->rings = ring;
+    vlc_mutex_unlock(&async->lock);
+    return ring;
+}
+
+static size_t vlc_log_Align(size_t size)
+{
+    static_assert (alignof (vlc_log_record_t) <= VLC_LOG_ALIGN,
+                   "Misaligned log records");
+    return (size + VLC_LOG_ALIGN - 1) & ~(size_t)(VLC_LOG_ALIGN - 1);
+}
+
+/**
+ * Queues a message into the ring buffer of the calling thread.
+ * \return 0 if the message was queued or dropped, -1 if the caller must
+ * log synchronously.
+ */
+static int vlc_log_Push(vlc_log_async_t *async, int type,
+                        const vlc_log_t *item, const char *format,
+                        va_list ap)
+{
+    vlc_log_ring_t *ring = vlc_log_GetRing(async);
+    if (unlikely(ring == NULL))
+        return -1;
+
+    const char *strv[5] = {
+        item->psz_object_type, item->psz_module, item->psz_header,
+        item->file, item->func,
+    };
+    size_t lenv[5];
+    size_t fixed = sizeof (vlc_log_record_t);
+    uint8_t flags = 0;
+
+    for (size_t i = 0; i < ARRAY_SIZE(strv); i++)
+    {
+        if (strv[i] == NULL)
+        {
+            lenv[i] = 0;
+            continue;
+        }
+        if (i >= 2)
+            flags |= 1 << (i - 2);
+        lenv[i] = strlen(strv[i]) + 1;
+        fixed += lenv[i];
+    }
+
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t avail = VLC_LOG_RING_SIZE - (tail - head);
+    size_t offset = tail % VLC_LOG_RING_SIZE;
+    size_t contig = VLC_LOG_RING_SIZE - offset;
+    size_t room = (avail < contig) ? avail : contig;
+    bool empty = tail == head;
+    bool wrapped = false;
+    int len = -1;
+
+    for (;;)
+    {
+        if (room > fixed)
+        {
+            va_list aq;
+
+            va_copy(aq, ap);
+            len = vsnprintf((char *)ring->data + offset + fixed, room - fixed,
+                            format, aq);
+            va_end(aq);
+            if (unlikely(len < 0))
+                return 0; /* invalid format, nothing to log */
+            if ((size_t)len < room - fixed)
+                break; /* fits */
+        }
+
+        if (!wrapped && avail > contig)
+        {   /* Retry at the start of the ring */
+            wrapped = true;
+            avail -= contig;
+            offset = 0;
+            room = avail;
+            continue;
+        }
+
+        if (empty && room > fixed)
+            break; /* message larger than the free space: truncate it */
+
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return 0;
+    }
+
+    if (wrapped)
+    {   /* Pad the end of the ring */
+        vlc_log_record_t *pad = (void *)(ring->data + tail % VLC_LOG_RING_SIZE);
+
+        pad->size = contig;
+        pad->type = -1;
+        tail += contig;
+    }
+
+    vlc_log_record_t *rec = (void *)(ring->data + offset);
+    char *str = (char *)(rec + 1);
+    size_t size = fixed + (((size_t)len < room - fixed) ? (size_t)len + 1
+                                                        : room - fixed);
+
+    rec->size = vlc_log_Align(size);
+    if (rec->size > room)
+        rec->size = room;
+    rec->type = type;
+    rec->object_id = item->i_object_id;
+    rec->tid = item->tid;
+    rec->line = item->line;
+    rec->flags = flags;
+
+    for (size_t i = 0; i < ARRAY_SIZE(strv); i++)
+        if (lenv[i] > 0)
+        {
+            memcpy(str, strv[i], lenv[i]);
+            str += lenv[i];
+        }
+
+    size_t used = tail + rec->size - head;
+
+    atomic_store_explicit(&ring->tail, tail + rec->size, memory_order_release);
+
+    /* Wake the drain thread up when crossing the half of the ring. If the
+     * lock is busy, the drain thread is running anyway. */
+    if (used >= VLC_LOG_RING_SIZE / 2 && used - rec->size < VLC_LOG_RING_SIZE / 2
+     && vlc_mutex_trylock(&async->lock) == 0)
+    {
+        vlc_cond_signal(&async->wait);
+        vlc_mutex_unlock(&async->lock);
+    }
+    return 0;
+}
+
+static void vlc_log_Drain(vlc_log_async_t *async)
+{
+    libvlc_int_t *vlc = async->logger->obj.libvlc;
+
+    vlc_assert_locked(&async->lock);
+
+    for (vlc_log_ring_t **pp = &async->rings, *ring; (ring = *pp) != NULL;)
+    {
+        size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+        while (head != tail)
+        {
+            const vlc_log_record_t *rec =
+                (const void *)(ring->data + head % VLC_LOG_RING_SIZE);
+            uint32_t size = rec->size;
+
+            if (rec->type >= 0)
+            {
+                const char *str = (const char *)(rec + 1);
+                vlc_log_t meta;
+
+                meta.i_object_id = rec->object_id;
+                meta.psz_object_type = str;
+                str += strlen(str) + 1;
+                meta.psz_module = str;
+                str += strlen(str) + 1;
+                meta.psz_header = meta.file = meta.func = NULL;
+                if (rec->flags & VLC_LOG_HEADER)
+                {
+                    meta.psz_header = str;
+                    str += strlen(str) + 1;
+                }
+                if (rec->flags & VLC_LOG_FILE)
+                {
+                    meta.file = str;
+                    str += strlen(str) + 1;
+                }
+                if (rec->flags & VLC_LOG_FUNC)
+                {
+                    meta.func = str;
+                    str += strlen(str) + 1;
+                }
+                meta.line = rec->line;
+                meta.tid = rec->tid;
+                vlc_LogCallback(vlc, rec->type, &meta, "%s", str);
+            }
+
+            head += size;
+            atomic_store_explicit(&ring->head, head, memory_order_release);
+        }
+
+        unsigned dropped = atomic_exchange_explicit(&ring->dropped, 0,
+                                                    memory_order_relaxed);
+        if (dropped > 0)
+        {
+            const vlc_log_t meta = {
+                .i_object_id = (uintptr_t)async->logger,
+                .psz_object_type = "logger",
+                .psz_module = "core",
+                .line = -1,
+                .tid = 0,
+            };
+
+            vlc_LogCallback(vlc, VLC_MSG_WARN, &meta,
+                            "%u log message(s) dropped", dropped);
+        }
+
+        /* Reclaim the rings of exited threads */
+        if (atomic_load(&ring->refs) == 1
+         && atomic_load(&ring->tail) == head)
+        {
+            *pp = ring->next;
+            vlc_log_RingRelease(ring);
+        }
+        else
+            pp = &ring->next;
+    }
+}
+
+static void *vlc_log_Thread(void *data)
+{
+    vlc_log_async_t *async = data;
+
+    vlc_mutex_lock(&async->lock);
+    while (!async->stop)
+    {
+        vlc_log_Drain(async);
+        vlc_cond_timedwait(&async->wait, &async->lock,
+                           mdate() + VLC_LOG_PERIOD);
+    }
+    vlc_mutex_unlock(&async->lock);
+    return NULL;
+}
+
+static int vlc_log_KeyHold(void)
+{
+    int ret = 0;
+
+    vlc_mutex_lock(&vlc_log_key_lock);
+    if (vlc_log_key_refs == 0)
+        ret = vlc_threadvar_create(&vlc_log_key, vlc_log_RingThreadExit);
+    if (ret == 0)
+        vlc_log_key_refs++;
+    vlc_mutex_unlock(&vlc_log_key_lock);
+    return ret;
+}
+
+/**
+ * Releases the thread variable, and the rings of a stopped logger.
+ *
+ * Running threads may still hold those rings: they let them go the next time
+ * they log, or when they exit. The last logger deletes the thread variable,
+ * and then frees all the rings, as no threads log by then.
+ */
+static void vlc_log_KeyRelease(vlc_log_ring_t *rings)
+{
+    vlc_mutex_lock(&vlc_log_key_lock);
+    for (vlc_log_ring_t *ring = rings, *next; ring != NULL; ring = next)
+    {
+        next = ring->next;
+        atomic_store_explicit(&ring->detached, true, memory_order_release);
+        ring->next = vlc_log_orphans;
+        vlc_log_orphans = ring;
+    }
+
+    assert(vlc_log_key_refs > 0);
+    if (--vlc_log_key_refs == 0)
+        vlc_threadvar_delete(&vlc_log_key);
+
+    for (vlc_log_ring_t **pp = &vlc_log_orphans, *ring; (ring = *pp) != NULL;)
+        if (vlc_log_key_refs == 0 || atomic_load(&ring->refs) == 1)
+        {
+            *pp = ring->next;
+            free(ring);
+        }
+        else
+            pp = &ring->next;
+    vlc_mutex_unlock(&vlc_log_key_lock);
+}
+
+static vlc_log_async_t *vlc_log_AsyncStart(vlc_logger_t *logger)
+{
+    if (vlc_log_KeyHold())
+        return NULL;
+
+    vlc_log_async_t *async = malloc(sizeof (*async));
+    if (unlikely(async == NULL))
+    {
+        vlc_log_KeyRelease(NULL);
+        return NULL;
+    }
+
+    async->logger = logger;
+    vlc_mutex_init(&async->lock);
+    vlc_cond_init(&async->wait);
+    async->rings = NULL;
+    async->stop = false;
+
+    if (vlc_clone(&async->thread, vlc_log_Thread, async,
+                  VLC_THREAD_PRIORITY_LOW))
+    {
+        vlc_cond_destroy(&async->wait);
+        vlc_mutex_destroy(&async->lock);
+        free(async);
+        vlc_log_KeyRelease(NULL);
+        return NULL;
+    }
+    return async;
+}
+
+/**
+ * Passes all queued messages to the logger callback.
+ */
+static void vlc_log_AsyncFlush(vlc_log_async_t *async)
+{
+    vlc_mutex_lock(&async->lock);
+    vlc_log_Drain(async);
+    vlc_mutex_unlock(&async->lock);
+}
+
+static void vlc_log_AsyncStop(vlc_log_async_t *async)
+{
+    vlc_mutex_lock(&async->lock);
+    async->stop = true;
+    vlc_cond_signal(&async->wait);
+    vlc_mutex_unlock(&async->lock);
+    vlc_join(async->thread, NULL);
+
+    vlc_mutex_lock(&async->lock);
+    vlc_log_Drain(async);
+    vlc_log_ring_t *rings = async->rings;
+    async->rings = NULL;
+    vlc_mutex_unlock(&async->lock);
+
+    vlc_cond_destroy(&async->wait);
+    vlc_mutex_destroy(&async->lock);
+    free(async);
+    vlc_log_KeyRelease(rings);
+}
+
 /**
  * Emit a log message. This function is the variable argument list equivalent
  * to vlc_Log().
@@ -137,7 +582,14 @@ void vlc_vaLog (vlc_object_t *obj, int type, const char *module,
 
     /* Pass message to the callback */
     if (obj != NULL)
+    {
+        vlc_logger_t *logger = libvlc_priv(obj->obj.libvlc)->logger;
+
+        if (logger->async != NULL
+         && vlc_log_Push(logger->async, type, &msg, format, args) == 0)
+            return;
         vlc_vaLogCallback(obj->obj.libvlc, type, &msg, format, args);
+    }
 }
 
 /**
@@ -330,6 +782,7 @@ int vlc_LogPreinit(libvlc_int_t *vlc)
         return -1;
 
     vlc_rwlock_init(&logger->lock);
+    logger->async = NULL;
 
     if (vlc_LogEarlyOpen(logger))
     {
@@ -379,6 +832,12 @@ int vlc_LogInit(libvlc_int_t *vlc)
     if (early_sys != NULL)
         vlc_LogEarlyClose(logger, early_sys);
 
+    if (var_InheritBool(vlc, "log-async"))
+    {
+        logger->async = vlc_log_AsyncStart(logger);
+        if (logger->async == NULL)
+            msg_Err(vlc, "cannot start deferred logging");
+    }
     return 0;
 }
 
@@ -400,6 +859,10 @@ void vlc_LogSet(libvlc_int_t *vlc, vlc_log_cb cb, void *opaque)
     if (cb == NULL)
         cb = vlc_vaLogDiscard;
 
+    /* Queued messages go to the previous callback */
+    if (logger->async != NULL)
+        vlc_log_AsyncFlush(logger->async);
+
     vlc_rwlock_wrlock(&logger->lock);
     sys = logger->sys;
     module = logger->module;
@@ -426,6 +889,12 @@ void vlc_LogDeinit(libvlc_int_t *vlc)
     if (unlikely(logger == NULL))
         return;
 
+    if (logger->async != NULL)
+    {
+        vlc_log_AsyncStop(logger->async);
+        logger->async = NULL;
+    }
+
     if (logger->module != NULL)
         vlc_module_unload(vlc, logger->module, vlc_logger_unload, logger->sys);
     else
@@ -34,9 +34,14 @@
 #include <vlc_atomic.h>
 #include "picture.h"
 
-#define POOL_MAX (CHAR_BIT * sizeof (unsigned long long))
+/* Availability is tracked in a bitmap of native atomic words */
+#define POOL_WORD_BITS (CHAR_BIT * sizeof (unsigned long))
+#define POOL_WORDS(count) (((count) + POOL_WORD_BITS - 1) / POOL_WORD_BITS)
 
-static_assert ((POOL_MAX & (POOL_MAX - 1)) == 0, "Not a power of two");
+struct picture_pool_slot {
+    picture_pool_t *pool;
+    picture_t      *picture;
+};
 
 struct picture_pool_t {
     int       (*pic_lock)(picture_t *);
@@ -44,11 +49,12 @@ struct picture_pool_t {
     vlc_mutex_t lock;
     vlc_cond_t  wait;
 
-    bool               canceled;
-    unsigned long long available;
-    atomic_ushort      refs;
-    unsigned short     picture_count;
-    picture_t  *picture[];
+    atomic_bool   canceled;
+    atomic_uint   waiters;
+    atomic_uint   refs;
+    unsigned      picture_count;
+    atomic_ulong *available;
+    struct picture_pool_slot slot[];
 };
 
 static void picture_pool_Destroy(picture_pool_t *pool)
@@ -58,23 +64,65 @@ static void picture_pool_Destroy(picture_pool_t *pool)
 
     vlc_cond_destroy(&pool->wait);
     vlc_mutex_destroy(&pool->lock);
-    aligned_free(pool);
+    free(pool);
 }
 
 void picture_pool_Release(picture_pool_t *pool)
 {
     for (unsigned i = 0; i < pool->picture_count; i++)
-        picture_Release(pool->picture[i]);
+        picture_Release(pool->slot[i].picture);
     picture_pool_Destroy(pool);
 }
 
+/**
+ * Marks a picture as taken, starting the search from the given index.
+ * \return the picture index, or -1 if none is available
+ */
+static int picture_pool_Take(picture_pool_t *pool, unsigned start)
+{
+    unsigned words = POOL_WORDS(pool->picture_count);
+    unsigned long mask = ~0UL << (start % POOL_WORD_BITS);
+
+    for (unsigned w = start / POOL_WORD_BITS; w < words; w++) {
+        unsigned long word = atomic_load(&pool->available[w]);
+
+        while (word & mask) {
+            unsigned bit = ffsll(word & mask) - 1;
+
+            if (atomic_compare_exchange_weak_explicit(&pool->available[w],
+                                    &word, word & ~(1UL << bit),
+                                    memory_order_acquire, memory_order_relaxed))
+                return w * POOL_WORD_BITS + bit;
+        }
+        mask = ~0UL;
+    }
+    return -1;
+}
+
+/** Marks a picture as available again, and wakes up a waiter if any. */
+static void picture_pool_Put(picture_pool_t *pool, unsigned offset)
+{
+    unsigned long bit = 1UL << (offset % POOL_WORD_BITS);
+    unsigned long old =
+        atomic_fetch_or(&pool->available[offset / POOL_WORD_BITS], bit);
+
+    assert(!(old & bit));
+    (void) old;
+
+    /* Pairs with the waiters increment in picture_pool_Wait() */
+    if (atomic_load(&pool->waiters) > 0) {
+        vlc_mutex_lock(&pool->lock);
+        vlc_cond_signal(&pool->wait);
+        vlc_mutex_unlock(&pool->lock);
+    }
+}
+
 static void picture_pool_ReleasePicture(picture_t *clone)
 {
     picture_priv_t *priv = (picture_priv_t *)clone;
-    uintptr_t sys = (uintptr_t)priv->gc.opaque;
-    picture_pool_t *pool = (void *)(sys & ~(POOL_MAX - 1));
-    unsigned offset = sys & (POOL_MAX - 1);
-    picture_t *picture = pool->picture[offset];
+    struct picture_pool_slot *slot = priv->gc.opaque;
+    picture_pool_t *pool = slot->pool;
+    picture_t *picture = slot->picture;
 
     free(clone);
 
@@ -82,20 +130,14 @@ static void picture_pool_ReleasePicture(picture_t *clone)
         pool->pic_unlock(picture);
     picture_Release(picture);
 
-    vlc_mutex_lock(&pool->lock);
-    assert(!(pool->available & (1ULL << offset)));
-    pool->available |= 1ULL << offset;
-    vlc_cond_signal(&pool->wait);
-    vlc_mutex_unlock(&pool->lock);
-
+    picture_pool_Put(pool, slot - pool->slot);
     picture_pool_Destroy(pool);
 }
 
 static picture_t *picture_pool_ClonePicture(picture_pool_t *pool,
                                             unsigned offset)
 {
-    picture_t *picture = pool->picture[offset];
-    uintptr_t sys = ((uintptr_t)pool) + offset;
+    picture_t *picture = pool->slot[offset].picture;
     picture_resource_t res = {
         .p_sys = picture->p_sys,
         .pf_destroy = picture_pool_ReleasePicture,
@@ -109,7 +151,7 @@ static picture_t *picture_pool_ClonePicture(picture_pool_t *pool,
 
     picture_t *clone = picture_NewFromResource(&picture->format, &res);
     if (likely(clone != NULL)) {
-        ((picture_priv_t *)clone)->gc.opaque = (void *)sys;
+        ((picture_priv_t *)clone)->gc.opaque = &pool->slot[offset];
         picture_Hold(picture);
     }
     return clone;
@@ -117,14 +159,12 @@ static picture_t *picture_pool_ClonePicture(picture_pool_t *pool,
 
 picture_pool_t *picture_pool_NewExtended(const picture_pool_configuration_t *cfg)
 {
-    if (unlikely(cfg->picture_count > POOL_MAX))
-        return NULL;
-
+    unsigned count = cfg->picture_count;
+    unsigned words = POOL_WORDS(count);
     picture_pool_t *pool;
-    size_t size = sizeof (*pool) + cfg->picture_count * sizeof (picture_t *);
 
-    size += (-size) & (POOL_MAX - 1);
-    pool = aligned_alloc(POOL_MAX, size);
+    pool = malloc(sizeof (*pool) + count * sizeof (pool->slot[0])
+                  + words * sizeof (pool->available[0]));
     if (unlikely(pool == NULL))
         return NULL;
 
@@ -132,15 +172,23 @@ picture_pool_t *picture_pool_NewExtended(const picture_pool_configuration_t *cfg
     pool->pic_unlock = cfg->unlock;
     vlc_mutex_init(&pool->lock);
     vlc_cond_init(&pool->wait);
-    if (cfg->picture_count == POOL_MAX)
-        pool->available = ~0ULL;
-    else
-        pool->available = (1ULL << cfg->picture_count) - 1;
+    atomic_init(&pool->canceled, false);
+    atomic_init(&pool->waiters, 0);
     atomic_init(&pool->refs,  1);
-    pool->picture_count = cfg->picture_count;
-    memcpy(pool->picture, cfg->picture,
-           cfg->picture_count * sizeof (picture_t *));
-    pool->canceled = false;
+    pool->picture_count = count;
+    pool->available = (atomic_ulong *)&pool->slot[count];
+
+    for (unsigned i = 0; i < words; i++) {
+        unsigned bits = count - i * POOL_WORD_BITS;
+
+        atomic_init(&pool->available[i], (bits >= POOL_WORD_BITS)
+                                         ? ~0UL : (1UL << bits) - 1);
+    }
+
+    for (unsigned i = 0; i < count; i++) {
+        pool->slot[i].pool = pool;
+        pool->slot[i].picture = cfg->picture[i];
+    }
     return pool;
 }
 
@@ -201,83 +249,77 @@ error:
     return NULL;
 }
 
-/** Find next (bit) set */
-static int fnsll(unsigned long long x, unsigned i)
-{
-    if (i >= CHAR_BIT * sizeof (x))
-        return 0;
-    return ffsll(x & ~((1ULL << i) - 1));
-}
-
 picture_t *picture_pool_Get(picture_pool_t *pool)
 {
-    vlc_mutex_lock(&pool->lock);
-    assert(pool->refs > 0);
+    assert(atomic_load(&pool->refs) > 0);
 
-    if (pool->canceled)
-    {
-        vlc_mutex_unlock(&pool->lock);
+    if (atomic_load(&pool->canceled))
         return NULL;
-    }
 
-    for (unsigned i = ffsll(pool->available); i; i = fnsll(pool->available, i))
+    for (int i = picture_pool_Take(pool, 0); i >= 0;
+         i = picture_pool_Take(pool, i + 1))
     {
-        pool->available &= ~(1ULL << (i - 1));
-        vlc_mutex_unlock(&pool->lock);
-
-        picture_t *picture = pool->picture[i - 1];
+        picture_t *picture = pool->slot[i].picture;
 
         if (pool->pic_lock != NULL && pool->pic_lock(picture) != VLC_SUCCESS) {
-            vlc_mutex_lock(&pool->lock);
-            pool->available |= 1ULL << (i - 1);
+            picture_pool_Put(pool, i);
             continue;
         }
 
-        picture_t *clone = picture_pool_ClonePicture(pool, i - 1);
+        picture_t *clone = picture_pool_ClonePicture(pool, i);
         if (clone != NULL) {
             assert(clone->p_next == NULL);
             atomic_fetch_add(&pool->refs, 1);
         }
         return clone;
     }
+    return NULL;
+}
+
+static void picture_pool_WaitCleanup(void *data)
+{
+    picture_pool_t *pool = data;
 
+    atomic_fetch_sub(&pool->waiters, 1);
     vlc_mutex_unlock(&pool->lock);
-    return NULL;
 }
 
 picture_t *picture_pool_Wait(picture_pool_t *pool)
 {
-    unsigned i;
+    int i;
 
-    vlc_mutex_lock(&pool->lock);
-    assert(pool->refs > 0);
+    assert(atomic_load(&pool->refs) > 0);
 
-    while (pool->available == 0)
+    i = picture_pool_Take(pool, 0);
+    if (i < 0)
     {
-        if (pool->canceled)
+        vlc_mutex_lock(&pool->lock);
+        /* Releasing threads check for waiters after making a picture
+         * available, so either they signal or this thread sees it. */
+        atomic_fetch_add(&pool->waiters, 1);
+        vlc_cleanup_push(picture_pool_WaitCleanup, pool);
+
+        while ((i = picture_pool_Take(pool, 0)) < 0)
         {
-            vlc_mutex_unlock(&pool->lock);
-            return NULL;
+            if (atomic_load(&pool->canceled))
+                break;
+            vlc_cond_wait(&pool->wait, &pool->lock);
         }
-        vlc_cond_wait(&pool->wait, &pool->lock);
-    }
+        vlc_cleanup_pop();
+        picture_pool_WaitCleanup(pool);
 
-    i = ffsll(pool->available);
-    assert(i > 0);
-    pool->available &= ~(1ULL << (i - 1));
-    vlc_mutex_unlock(&pool->lock);
+        if (i < 0)
+            return NULL;
+    }
 
-    picture_t *picture = pool->picture[i - 1];
+    picture_t *picture = pool->slot[i].picture;
 
     if (pool->pic_lock != NULL && pool->pic_lock(picture) != VLC_SUCCESS) {
-        vlc_mutex_lock(&pool->lock);
-        pool->available |= 1ULL << (i - 1);
-        vlc_cond_signal(&pool->wait);
-        vlc_mutex_unlock(&pool->lock);
+        picture_pool_Put(pool, i);
         return NULL;
     }
 
-    picture_t *clone = picture_pool_ClonePicture(pool, i - 1);
+    picture_t *clone = picture_pool_ClonePicture(pool, i);
     if (clone != NULL) {
         assert(clone->p_next == NULL);
         atomic_fetch_add(&pool->refs, 1);
@@ -288,9 +330,9 @@ picture_t *picture_pool_Wait(picture_pool_t *pool)
 void picture_pool_Cancel(picture_pool_t *pool, bool canceled)
 {
     vlc_mutex_lock(&pool->lock);
-    assert(pool->refs > 0);
+    assert(atomic_load(&pool->refs) > 0);
 
-    pool->canceled = canceled;
+    atomic_store(&pool->canceled, canceled);
     if (canceled)
         vlc_cond_broadcast(&pool->wait);
     vlc_mutex_unlock(&pool->lock);
@@ -305,9 +347,8 @@ bool picture_pool_OwnsPic(picture_pool_t *pool, picture_t *pic)
         priv = (picture_priv_t *)pic;
     }
 
-    uintptr_t sys = (uintptr_t)priv->gc.opaque;
-    picture_pool_t *picpool = (void *)(sys & ~(POOL_MAX - 1));
-    return pool == picpool;
+    const struct picture_pool_slot *slot = priv->gc.opaque;
+    return pool == slot->pool;
 }
 
 unsigned picture_pool_GetSize(const picture_pool_t *pool)
@@ -321,5 +362,5 @@ void picture_pool_Enum(picture_pool_t *pool, void (*cb)(void *, picture_t *),
     /* NOTE: So far, the pictures table cannot change after the pool is created
      * so there is no need to lock the pool mutex here. */
     for (unsigned i = 0; i < pool->picture_count; i++)
-        cb(opaque, pool->picture[i]);
+        cb(opaque, pool->slot[i].picture);
 }
@@ -28,9 +28,6 @@
 # include "config.h"
 #endif
 
-#ifdef HAVE_SEARCH_H
-# include <search.h>
-#endif
 #include <assert.h>
 #include <float.h>
 #include <math.h>
@@ -73,7 +70,8 @@ typedef struct callback_table_t
  */
 struct variable_t
 {
-    char *       psz_name; /**< The variable unique name (must be first) */
+    char *       psz_name; /**< The variable unique name */
+    uint32_t     i_hash;   /**< Hash of the name */
 
     /** The variable's exported value */
     vlc_value_t  val;
@@ -141,23 +139,245 @@ int_ops    = { CmpInt,     DupDummy,  FreeDummy,  },
 string_ops = { CmpString,  DupString, FreeString, },
 coords_ops = { NULL,       DupDummy,  FreeDummy,  };
 
-static int varcmp( const void *a, const void *b )
+static uint32_t VarHash( const char *psz_name )
 {
-    const variable_t *va = a, *vb = b;
+    uint32_t h = 2166136261u; /* FNV-1a */
 
-    /* psz_name must be first */
-    assert( va == (const void *)&va->psz_name );
-    return strcmp( va->psz_name, vb->psz_name );
+    while( *psz_name )
+        h = (h ^ (unsigned char)*(psz_name++)) * 16777619u;
+    return h ^ (h >> 16);
+}
+
+/**
+ * Finds the slot of a variable in the hash table of an object.
+ * \return the slot of the variable, or of the free slot where the variable
+ *         would be inserted
+ */
+static size_t Probe( const vlc_object_internals_t *priv, const char *psz_name,
+                     uint32_t i_hash )
+{
+    size_t mask = priv->var_size - 1;
+    size_t i = i_hash & mask;
+    variable_t *var;
+
+    while( (var = priv->var_table[i]) != NULL )
+    {
+        if( var->i_hash == i_hash && !strcmp( var->psz_name, psz_name ) )
+            break;
+        i = (i + 1) & mask;
+    }
+    return i;
 }
 
 static variable_t *Lookup( vlc_object_t *obj, const char *psz_name )
 {
     vlc_object_internals_t *priv = vlc_internals( obj );
-    variable_t **pp_var;
+    uint32_t i_hash = VarHash( psz_name );
 
     vlc_mutex_lock(&priv->var_lock);
-    pp_var = tfind( &psz_name, &priv->var_root, varcmp );
-    return (pp_var != NULL) ? *pp_var : NULL;
+    if( priv->var_count == 0 )
+        return NULL;
+    return priv->var_table[Probe( priv, psz_name, i_hash )];
+}
+
+/**
+ * Inserts a variable in the hash table of an object, unless a variable
+ * with the same name is already present.
+ * \return the variable in the table, or NULL on memory error
+ */
+static variable_t *Insert( vlc_object_internals_t *priv, variable_t *p_var )
+{
+    /* Keep the load factor at most 3/4 */
+    if( 4 * (priv->var_count + 1) > 3 * priv->var_size )
+    {
+        size_t size = priv->var_size ? 2 * priv->var_size : 16;
+        variable_t **tab = calloc( size, sizeof( *tab ) );
+        if( unlikely(tab == NULL) )
+            return NULL;
+
+        for( size_t i = 0; i < priv->var_size; i++ )
+        {
+            variable_t *var = priv->var_table[i];
+            if( var == NULL )
+                continue;
+
+            size_t j = var->i_hash & (size - 1);
+            while( tab[j] != NULL )
+                j = (j + 1) & (size - 1);
+            tab[j] = var;
+        }
+        free( priv->var_table );
+        priv->var_table = tab;
+        priv->var_size = size;
+    }
+
+    size_t i = Probe( priv, p_var->psz_name, p_var->i_hash );
+    if( priv->var_table[i] == NULL )
+    {
+        priv->var_table[i] = p_var;
+        priv->var_count++;
+    }
+    return priv->var_table[i];
+}
+
+/**
+ * Removes a variable from the hash table of an object.
+ */
+static void Remove( vlc_object_internals_t *priv, variable_t *p_var )
+{
+    size_t mask = priv->var_size - 1;
+    size_t i = Probe( priv, p_var->psz_name, p_var->i_hash );
+
+    assert( priv->var_table[i] == p_var );
+    priv->var_table[i] = NULL;
+    priv->var_count--;
+
+    /* Shift back the following entries of the cluster, so that linear
+     * probing never stops at the hole (no tombstones needed). */
+    for( size_t j = (i + 1) & mask; priv->var_table[j] != NULL;
+         j = (j + 1) & mask )
+    {
+        size_t k = priv->var_table[j]->i_hash & mask;
+
+        /* Move the entry unless its home slot is cyclically within (i, j] */
+        if( (i < j) ? (k <= i || k > j) : (k <= i && k > j) )
+        {
+            priv->var_table[i] = priv->var_table[j];
+            priv->var_table[j] = NULL;
+            i = j;
+        }
+    }
+}
+
+/**
+ * Inherited values cache.
+ *
+ * Each object caches the last values found by var_Inherit(). Names are hashed
+ * into a table of generation counters, which are incremented whenever a
+ * variable or configuration item of that name is created, destroyed or
+ * changed anywhere. A cached value is valid as long as the counter of its
+ * name did not change since the value was looked up.
+ */
+#define VAR_INHERIT_GENS 256
+#define VAR_INHERIT_CACHE 16
+
+typedef struct var_inherit_entry
+{
+    char        *psz_name;
+    uint32_t     i_hash;
+    unsigned     i_gen;
+    int          i_type;
+    vlc_value_t  val;
+} var_inherit_entry_t;
+
+static atomic_uint var_inherit_gens[VAR_INHERIT_GENS];
+
+static atomic_uint *InheritGen( uint32_t i_hash )
+{
+    return &var_inherit_gens[i_hash % VAR_INHERIT_GENS];
+}
+
+void var_InheritChanged( const char *psz_name )
+{
+    if( psz_name != NULL )
+    {
+        atomic_fetch_add( InheritGen( VarHash( psz_name ) ), 1 );
+        return;
+    }
+
+    for( size_t i = 0; i < VAR_INHERIT_GENS; i++ )
+        atomic_fetch_add( &var_inherit_gens[i], 1 );
+}
+
+static void InheritCacheFree( var_inherit_entry_t *cache )
+{
+    if( cache == NULL )
+        return;
+
+    for( size_t i = 0; i < VAR_INHERIT_CACHE; i++ )
+    {
+        if( cache[i].psz_name == NULL )
+            continue;
+        if( (cache[i].i_type & VLC_VAR_CLASS) == VLC_VAR_STRING )
+            free( cache[i].val.psz_string );
+        free( cache[i].psz_name );
+    }
+    free( cache );
+}
+
+static var_inherit_entry_t *InheritCacheSlot( vlc_object_internals_t *priv,
+                                              uint32_t i_hash )
+{
+    var_inherit_entry_t *cache = priv->var_cache;
+    /* Use other hash bits than the generation counters */
+    return (cache != NULL) ? &cache[(i_hash >> 8) % VAR_INHERIT_CACHE] : NULL;
+}
+
+static bool InheritCacheGet( vlc_object_t *obj, const char *psz_name,
+                             uint32_t i_hash, int i_type, vlc_value_t *p_val )
+{
+    vlc_object_internals_t *priv = vlc_internals( obj );
+    bool found = false;
+
+    vlc_mutex_lock( &priv->var_lock );
+    var_inherit_entry_t *entry = InheritCacheSlot( priv, i_hash );
+    if( entry != NULL && entry->psz_name != NULL
+     && entry->i_hash == i_hash && entry->i_type == i_type
+     && entry->i_gen == atomic_load( InheritGen( i_hash ) )
+     && !strcmp( entry->psz_name, psz_name ) )
+    {
+        *p_val = entry->val;
+        if( i_type == VLC_VAR_STRING )
+            p_val->psz_string = strdup( p_val->psz_string );
+        found = i_type != VLC_VAR_STRING || p_val->psz_string != NULL;
+    }
+    vlc_mutex_unlock( &priv->var_lock );
+    return found;
+}
+
+static void InheritCachePut( vlc_object_t *obj, const char *psz_name,
+                             uint32_t i_hash, unsigned i_gen, int i_type,
+                             vlc_value_t val )
+{
+    vlc_object_internals_t *priv = vlc_internals( obj );
+    char *name = strdup( psz_name );
+
+    if( i_type == VLC_VAR_STRING )
+        val.psz_string = strdup( val.psz_string );
+    if( unlikely(name == NULL
+              || (i_type == VLC_VAR_STRING && val.psz_string == NULL)) )
+        goto error;
+
+    vlc_mutex_lock( &priv->var_lock );
+    if( priv->var_cache == NULL )
+        priv->var_cache = calloc( VAR_INHERIT_CACHE,
+                                  sizeof( var_inherit_entry_t ) );
+
+    var_inherit_entry_t *entry = InheritCacheSlot( priv, i_hash );
+    if( likely(entry != NULL) )
+    {
+        var_inherit_entry_t old = *entry;
+
+        entry->psz_name = name;
+        entry->i_hash = i_hash;
+        entry->i_gen = i_gen;
+        entry->i_type = i_type;
+        entry->val = val;
+        vlc_mutex_unlock( &priv->var_lock );
+
+        if( old.psz_name != NULL )
+        {
+            if( old.i_type == VLC_VAR_STRING )
+                free( old.val.psz_string );
+            free( old.psz_name );
+        }
+        return;
+    }
+    vlc_mutex_unlock( &priv->var_lock );
+error:
+    if( i_type == VLC_VAR_STRING )
+        free( val.psz_string );
+    free( name );
 }
 
 static void Destroy( variable_t *p_var )
@@ -304,6 +524,7 @@ int var_Create( vlc_object_t *p_this, const char *psz_name, int i_type )
         return VLC_ENOMEM;
 
     p_var->psz_name = strdup( psz_name );
+    p_var->i_hash = VarHash( psz_name );
     p_var->psz_text = NULL;
 
     p_var->i_type = i_type & ~VLC_VAR_DOINHERIT;
@@ -362,16 +583,19 @@ int var_Create( vlc_object_t *p_this, const char *psz_name, int i_type )
         var_Inherit(p_this, psz_name, i_type, &p_var->val);
 
     vlc_object_internals_t *p_priv = vlc_internals( p_this );
-    variable_t **pp_var, *p_oldvar;
+    variable_t *p_oldvar;
     int ret = VLC_SUCCESS;
 
     vlc_mutex_lock( &p_priv->var_lock );
 
-    pp_var = tsearch( p_var, &p_priv->var_root, varcmp );
-    if( unlikely(pp_var == NULL) )
+    p_oldvar = Insert( p_priv, p_var );
+    if( unlikely(p_oldvar == NULL) )
         ret = VLC_ENOMEM;
-    else if( (p_oldvar = *pp_var) == p_var ) /* Variable create */
+    else if( p_oldvar == p_var ) /* Variable create */
+    {
+        var_InheritChanged( psz_name );
         p_var = NULL; /* Variable created */
+    }
     else /* Variable already exists */
     {
         assert (((i_type ^ p_oldvar->i_type) & VLC_VAR_CLASS) == 0);
@@ -410,7 +634,8 @@ void (var_Destroy)(vlc_object_t *p_this, const char *psz_name)
     else if( --p_var->i_usage == 0 )
     {
         assert(!p_var->b_incallback);
-        tdelete( p_var, &p_priv->var_root, varcmp );
+        Remove( p_priv, p_var );
+        var_InheritChanged( psz_name );
     }
     else
     {
@@ -423,17 +648,19 @@ void (var_Destroy)(vlc_object_t *p_this, const char *psz_name)
         Destroy( p_var );
 }
 
-static void CleanupVar( void *var )
-{
-    Destroy( var );
-}
-
 void var_DestroyAll( vlc_object_t *obj )
 {
     vlc_object_internals_t *priv = vlc_internals( obj );
 
-    tdestroy( priv->var_root, CleanupVar );
-    priv->var_root = NULL;
+    for( size_t i = 0; i < priv->var_size; i++ )
+        if( priv->var_table[i] != NULL )
+            Destroy( priv->var_table[i] );
+    free( priv->var_table );
+    priv->var_table = NULL;
+    priv->var_count = priv->var_size = 0;
+
+    InheritCacheFree( priv->var_cache );
+    priv->var_cache = NULL;
 }
 
 #undef var_Change
@@ -477,11 +704,13 @@ int var_Change( vlc_object_t *p_this, const char *psz_name,
             assert(p_var->ops->pf_free == FreeDummy);
             p_var->min = *p_val;
             p_var->max = *p_val2;
+            var_InheritChanged( psz_name );
             break;
         case VLC_VAR_SETSTEP:
             assert(p_var->ops->pf_free == FreeDummy);
             p_var->step = *p_val;
             CheckValue( p_var, &p_var->val );
+            var_InheritChanged( psz_name );
             break;
         case VLC_VAR_GETSTEP:
             switch (p_var->i_type & VLC_VAR_TYPE)
@@ -569,6 +798,7 @@ int var_Change( vlc_object_t *p_this, const char *psz_name,
             CheckValue( p_var, &newval );
             /* Set the variable */
             p_var->val = newval;
+            var_InheritChanged( psz_name );
             /* Free data if needed */
             p_var->ops->pf_free( &oldval );
             break;
@@ -681,6 +911,7 @@ int var_GetAndSet( vlc_object_t *p_this, const char *psz_name, int i_action,
     /*  Check boundaries */
     CheckValue( p_var, &p_var->val );
     *p_val = p_var->val;
+    var_InheritChanged( psz_name );
 
     /* Deal with callbacks.*/
     TriggerCallback( p_this, p_var, psz_name, oldval );
@@ -753,6 +984,7 @@ int var_SetChecked( vlc_object_t *p_this, const char *psz_name,
 
     /* Set the variable */
     p_var->val = val;
+    var_InheritChanged( psz_name );
 
     /* Deal with callbacks */
     TriggerCallback( p_this, p_var, psz_name, oldval );
@@ -1173,11 +1405,23 @@ int var_LocationParse (vlc_object_t *obj, const char *mrl, const char *pref)
 int var_Inherit( vlc_object_t *p_this, const char *psz_name, int i_type,
                  vlc_value_t *p_val )
 {
+    uint32_t i_hash = VarHash( psz_name );
+
     i_type &= VLC_VAR_CLASS;
+    if( InheritCacheGet( p_this, psz_name, i_hash, i_type, p_val ) )
+        return VLC_SUCCESS;
+
+    /* Sample the generation before looking up, so that any concurrent
+     * change invalidates the cached value. */
+    unsigned i_gen = atomic_load( InheritGen( i_hash ) );
+
     for( vlc_object_t *obj = p_this; obj != NULL; obj = obj->obj.parent )
     {
         if( var_GetChecked( obj, psz_name, i_type, p_val ) == VLC_SUCCESS )
+        {
+            InheritCachePut( p_this, psz_name, i_hash, i_gen, i_type, *p_val );
             return VLC_SUCCESS;
+        }
     }
 
     /* else take value from config */
@@ -1201,6 +1445,7 @@ int var_Inherit( vlc_object_t *p_this, const char *psz_name, int i_type,
         case VLC_VAR_ADDRESS:
             return VLC_ENOOBJ;
     }
+    InheritCachePut( p_this, psz_name, i_hash, i_gen, i_type, *p_val );
     return VLC_SUCCESS;
 }
 
@@ -1309,13 +1554,34 @@ void var_FreeList( vlc_value_t *p_val, vlc_value_t *p_val2 )
     }
 }
 
-static void DumpVariable(const void *data, const VISIT which, const int depth)
+static int varcmp(const void *a, const void *b)
 {
-    if (which != postorder && which != leaf)
-        return;
-    (void) depth;
+    const variable_t *const *va = a, *const *vb = b;
+
+    return strcmp((*va)->psz_name, (*vb)->psz_name);
+}
 
-    const variable_t *var = *(const variable_t **)data;
+/**
+ * Returns the variables of an object, sorted by name.
+ * \note The variables lock must be held.
+ */
+static variable_t **SortedVariables(vlc_object_internals_t *priv)
+{
+    variable_t **tab = vlc_alloc(priv->var_count, sizeof (*tab));
+    if (unlikely(tab == NULL))
+        return NULL;
+
+    size_t n = 0;
+    for (size_t i = 0; i < priv->var_size; i++)
+        if (priv->var_table[i] != NULL)
+            tab[n++] = priv->var_table[i];
+    assert(n == priv->var_count);
+    qsort(tab, n, sizeof (*tab), varcmp);
+    return tab;
+}
+
+static void DumpVariable(const variable_t *var)
+{
     const char *typename = "unknown";
 
     switch (var->i_type & VLC_VAR_TYPE)
@@ -1370,43 +1636,52 @@ static void DumpVariable(const void *data, const VISIT which, const int depth)
 
 void DumpVariables(vlc_object_t *obj)
 {
-    vlc_mutex_lock(&vlc_internals(obj)->var_lock);
-    if (vlc_internals(obj)->var_root == NULL)
+    vlc_object_internals_t *priv = vlc_internals(obj);
+
+    vlc_mutex_lock(&priv->var_lock);
+    if (priv->var_count == 0)
         puts(" `-o No variables");
     else
-        twalk(vlc_internals(obj)->var_root, DumpVariable);
-    vlc_mutex_unlock(&vlc_internals(obj)->var_lock);
-}
-
-static thread_local void *twalk_ctx;
-
-static void TwalkGetNames(const void *data, const VISIT which, const int depth)
-{
-    if (which != postorder && which != leaf)
-        return;
-    (void) depth;
-
-    const variable_t *var = *(const variable_t **)data;
-    DECL_ARRAY(char *) *names = twalk_ctx;
-    char *dup = strdup(var->psz_name);
-    if (dup != NULL)
-        ARRAY_APPEND(*names, dup);
+    {
+        variable_t **tab = SortedVariables(priv);
+        if (tab != NULL)
+        {
+            for (size_t i = 0; i < priv->var_count; i++)
+                DumpVariable(tab[i]);
+            free(tab);
+        }
+    }
+    vlc_mutex_unlock(&priv->var_lock);
 }
 
 char **var_GetAllNames(vlc_object_t *obj)
 {
     vlc_object_internals_t *priv = vlc_internals(obj);
+    char **names = NULL;
 
-    DECL_ARRAY(char *) names;
-    ARRAY_INIT(names);
-
-    twalk_ctx = &names;
     vlc_mutex_lock(&priv->var_lock);
-    twalk(priv->var_root, TwalkGetNames);
-    vlc_mutex_unlock(&priv->var_lock);
+    if (priv->var_count == 0)
+        goto out;
 
-    if (names.i_size == 0)
-        return NULL;
-    ARRAY_APPEND(names, NULL);
-    return names.p_elems;
+    variable_t **tab = SortedVariables(priv);
+    if (tab == NULL)
+        goto out;
+
+    names = vlc_alloc(priv->var_count + 1, sizeof (*names));
+    if (names != NULL)
+    {
+        size_t n = 0;
+
+        for (size_t i = 0; i < priv->var_count; i++)
+        {
+            char *dup = strdup(tab[i]->psz_name);
+            if (dup != NULL)
+                names[n++] = dup;
+        }
+        names[n] = NULL;
+    }
+    free(tab);
+out:
+    vlc_mutex_unlock(&priv->var_lock);
+    return names;
 }
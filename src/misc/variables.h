@@ -39,7 +39,10 @@ struct vlc_object_internals
     char           *psz_name; /* given name */
 
     /* Object variables */
-    void           *var_root;
+    struct variable_t **var_table; /* open addressing hash table */
+    size_t          var_count;
+    size_t          var_size;
+    void           *var_cache; /* inherited values cache */
     vlc_mutex_t     var_lock;
     vlc_cond_t      var_wait;
 
@@ -64,6 +67,15 @@ void DumpVariables(vlc_object_t *obj);
 
 extern void var_DestroyAll( vlc_object_t * );
 
+/**
+ * Invalidates the cached inherited values of a variable.
+ *
+ * This must be called after the value of a configuration item changes.
+ *
+ * @param name variable name, or NULL for all variables
+ */
+void var_InheritChanged(const char *name);
+
 /**
  * Return a list of all variable names
  *
@@ -36,9 +36,6 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
-#ifdef HAVE_SEARCH_H
-# include <search.h>
-#endif
 
 #include <vlc_common.h>
 #include <vlc_plugin.h>
@@ -51,94 +48,239 @@
 
 typedef struct vlc_modcap
 {
-    char *name;
+    const char *name;
     module_t **modv;
     size_t modc;
 } vlc_modcap_t;
 
-static int vlc_modcap_cmp(const void *a, const void *b)
+/**
+ * Capabilities index.
+ *
+ * Modules are grouped by capability, and sorted by decreasing score, in a
+ * single table. Capabilities are looked up with a minimal perfect hash
+ * (hash and displace): the first hash selects a displacement seed, which is
+ * then used to compute the second hash, i.e. the slot of the capability.
+ */
+typedef struct vlc_modcap_index
 {
-    const vlc_modcap_t *capa = a, *capb = b;
-    return strcmp(capa->name, capb->name);
-}
-
-static void vlc_modcap_free(void *data)
+    module_t **modv; /**< All modules, grouped by capability */
+    vlc_modcap_t *capv; /**< Capabilities, indexed by their hash */
+    uint32_t *seedv; /**< Displacement seeds */
+    size_t capc; /**< Number of capabilities */
+    size_t seedc; /**< Number of displacement seeds */
+} vlc_modcap_index_t;
+
+static uint32_t vlc_modcap_hash(const char *name, uint32_t seed)
 {
-    vlc_modcap_t *cap = data;
-
-    free(cap->modv);
-    free(cap->name);
-    free(cap);
+    uint32_t h = 2166136261u ^ (seed * 0x9E3779B9u);
+
+    /* FNV-1a followed by a final avalanche */
+    while (*name)
+        h = (h ^ (unsigned char)*(name++)) * 16777619u;
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    return h;
 }
 
 static int vlc_module_cmp (const void *a, const void *b)
 {
-    const module_t *const *ma = a, *const *mb = b;
+    const module_t *ma = *(module_t *const *)a, *mb = *(module_t *const *)b;
+    int ret = strcmp(module_get_capability(ma), module_get_capability(mb));
+    if (ret != 0)
+        return ret;
+
     /* Note that qsort() uses _ascending_ order,
      * so the smallest module is the one with the biggest score. */
-    return (*mb)->i_score - (*ma)->i_score;
+    return mb->i_score - ma->i_score;
 }
 
-static void vlc_modcap_sort(const void *node, const VISIT which,
-                            const int depth)
+static void vlc_modcap_index_clear(vlc_modcap_index_t *index)
 {
-    vlc_modcap_t *const *cp = node, *cap = *cp;
+    free(index->seedv);
+    free(index->capv);
+    free(index->modv);
+    index->modv = NULL;
+    index->capv = NULL;
+    index->seedv = NULL;
+    index->capc = 0;
+    index->seedc = 0;
+}
 
-    if (which != postorder && which != leaf)
-        return;
+static int vlc_modcap_bucket_cmp(const void *a, const void *b)
+{
+    const size_t *ba = a, *bb = b;
+    /* Largest buckets first */
+    return (bb[1] > ba[1]) - (bb[1] < ba[1]);
+}
+
+/**
+ * Computes the displacement seeds of the perfect hash table.
+ */
+static int vlc_modcap_index_hash(vlc_modcap_index_t *index,
+                                 const vlc_modcap_t *caps)
+{
+    size_t capc = index->capc, seedc = index->seedc;
+    size_t (*buckets)[2] = vlc_alloc(seedc, sizeof (*buckets));
+    uint32_t *bucketv = vlc_alloc(capc, sizeof (*bucketv));
+    size_t *slots = vlc_alloc(capc, sizeof (*slots));
+    bool *used = calloc(capc, sizeof (*used));
+    int ret = -1;
+
+    if (unlikely(buckets == NULL || bucketv == NULL || slots == NULL
+              || used == NULL))
+        goto out;
+
+    for (size_t i = 0; i < seedc; i++)
+    {
+        buckets[i][0] = i;
+        buckets[i][1] = 0;
+    }
+    for (size_t i = 0; i < capc; i++)
+    {
+        bucketv[i] = vlc_modcap_hash(caps[i].name, 0) % seedc;
+        buckets[bucketv[i]][1]++;
+    }
+    qsort(buckets, seedc, sizeof (*buckets), vlc_modcap_bucket_cmp);
+
+    for (size_t b = 0; b < seedc && buckets[b][1] > 0; b++)
+    {
+        size_t bucket = buckets[b][0];
+        uint32_t seed = 0;
+        size_t n;
+
+        do
+        {
+            if (++seed > 1000000) /* cannot happen with sane hashes */
+                goto out;
+
+            n = 0;
+            for (size_t i = 0; i < capc; i++)
+            {
+                if (bucketv[i] != bucket)
+                    continue;
+
+                size_t slot = vlc_modcap_hash(caps[i].name, seed) % capc;
+                bool taken = used[slot];
+
+                for (size_t j = 0; j < n && !taken; j++)
+                    taken = slots[j] == slot;
+                if (taken)
+                    break;
+                slots[n++] = slot;
+            }
+        }
+        while (n < buckets[b][1]);
 
-    qsort(cap->modv, cap->modc, sizeof (*cap->modv), vlc_module_cmp);
-    (void) depth;
+        for (size_t j = 0; j < n; j++)
+            used[slots[j]] = true;
+        index->seedv[bucket] = seed;
+    }
+
+    /* Now place the capabilities into their slots */
+    for (size_t i = 0; i < capc; i++)
+    {
+        uint32_t seed = index->seedv[bucketv[i]];
+        size_t slot = vlc_modcap_hash(caps[i].name, seed) % capc;
+
+        index->capv[slot] = caps[i];
+    }
+    ret = 0;
+out:
+    free(used);
+    free(slots);
+    free(bucketv);
+    free(buckets);
+    return ret;
 }
 
 static struct
 {
     vlc_mutex_t lock;
     block_t *caches;
-    void *caps_tree;
+    vlc_modcap_index_t caps;
     unsigned usage;
-} modules = { VLC_STATIC_MUTEX, NULL, NULL, 0 };
+} modules = { VLC_STATIC_MUTEX, NULL, { NULL, NULL, NULL, 0, 0 }, 0 };
 
 vlc_plugin_t *vlc_plugins = NULL;
 
 /**
- * Adds a module to the bank
+ * (Re)builds the capabilities index from the list of plug-ins.
  */
-static int vlc_module_store(module_t *mod)
+static void vlc_modcap_index_build(void)
 {
-    const char *name = module_get_capability(mod);
-    vlc_modcap_t *cap = malloc(sizeof (*cap));
-    if (unlikely(cap == NULL))
-        return -1;
+    vlc_modcap_index_t *index = &modules.caps;
+    vlc_modcap_t *caps = NULL;
+    size_t modc = 0, capc = 0;
+
+    vlc_modcap_index_clear(index);
 
-    cap->name = strdup(name);
-    cap->modv = NULL;
-    cap->modc = 0;
+    for (const vlc_plugin_t *lib = vlc_plugins; lib != NULL; lib = lib->next)
+        modc += lib->modules_count;
 
-    if (unlikely(cap->name == NULL))
+    index->modv = vlc_alloc(modc, sizeof (*index->modv));
+    if (unlikely(index->modv == NULL))
         goto error;
 
-    vlc_modcap_t **cp = tsearch(cap, &modules.caps_tree, vlc_modcap_cmp);
-    if (unlikely(cp == NULL))
+    modc = 0;
+    for (vlc_plugin_t *lib = vlc_plugins; lib != NULL; lib = lib->next)
+        for (module_t *m = lib->module; m != NULL; m = m->next)
+            index->modv[modc++] = m;
+
+    qsort(index->modv, modc, sizeof (*index->modv), vlc_module_cmp);
+
+    for (size_t i = 0; i < modc; i++)
+        if (i == 0 || strcmp(module_get_capability(index->modv[i - 1]),
+                             module_get_capability(index->modv[i])))
+            capc++;
+
+    if (capc == 0)
+        return;
+
+    caps = vlc_alloc(capc, sizeof (*caps));
+    index->capv = vlc_alloc(capc, sizeof (*index->capv));
+    index->seedc = (capc + 3) / 4;
+    index->seedv = calloc(index->seedc, sizeof (*index->seedv));
+    if (unlikely(caps == NULL || index->capv == NULL || index->seedv == NULL))
         goto error;
 
-    if (*cp != cap)
+    capc = 0;
+    for (size_t i = 0; i < modc; i++)
     {
-        vlc_modcap_free(cap);
-        cap = *cp;
-    }
+        const char *name = module_get_capability(index->modv[i]);
 
-    module_t **modv = realloc(cap->modv, sizeof (*modv) * (cap->modc + 1));
-    if (unlikely(modv == NULL))
-        return -1;
+        if (capc == 0 || strcmp(caps[capc - 1].name, name))
+        {
+            caps[capc].name = name;
+            caps[capc].modv = index->modv + i;
+            caps[capc].modc = 0;
+            capc++;
+        }
+        caps[capc - 1].modc++;
+    }
+    index->capc = capc;
 
-    cap->modv = modv;
-    cap->modv[cap->modc] = mod;
-    cap->modc++;
-    return 0;
+    if (vlc_modcap_index_hash(index, caps))
+        goto error;
+    free(caps);
+    return;
 error:
-    vlc_modcap_free(cap);
-    return -1;
+    free(caps);
+    vlc_modcap_index_clear(index);
+}
+
+static const vlc_modcap_t *vlc_modcap_find(const char *name)
+{
+    const vlc_modcap_index_t *index = &modules.caps;
+
+    if (index->capc == 0)
+        return NULL;
+
+    uint32_t seed = index->seedv[vlc_modcap_hash(name, 0) % index->seedc];
+    const vlc_modcap_t *cap =
+        &index->capv[vlc_modcap_hash(name, seed) % index->capc];
+
+    return strcmp(cap->name, name) ? NULL : cap;
 }
 
 /**
@@ -150,9 +292,6 @@ static void vlc_plugin_store(vlc_plugin_t *lib)
 
     lib->next = vlc_plugins;
     vlc_plugins = lib;
-
-    for (module_t *m = lib->module; m != NULL; m = m->next)
-        vlc_module_store(m);
 }
 
 /**
@@ -590,6 +729,7 @@ void module_InitBank (void)
         if (likely(plugin != NULL))
             vlc_plugin_store(plugin);
         config_SortConfig ();
+        vlc_modcap_index_build ();
     }
     modules.usage++;
 
@@ -611,7 +751,7 @@ void module_EndBank (bool b_plugins)
 {
     vlc_plugin_t *libs = NULL;
     block_t *caches = NULL;
-    void *caps_tree = NULL;
+    vlc_modcap_index_t caps = { NULL, NULL, NULL, 0, 0 };
 
     /* If plugins were _not_ loaded, then the caller still has the bank lock
      * from module_InitBank(). */
@@ -626,14 +766,14 @@ void module_EndBank (bool b_plugins)
         config_UnsortConfig ();
         libs = vlc_plugins;
         caches = modules.caches;
-        caps_tree = modules.caps_tree;
+        caps = modules.caps;
         vlc_plugins = NULL;
         modules.caches = NULL;
-        modules.caps_tree = NULL;
+        memset(&modules.caps, 0, sizeof (modules.caps));
     }
     vlc_mutex_unlock (&modules.lock);
 
-    tdestroy(caps_tree, vlc_modcap_free);
+    vlc_modcap_index_clear(&caps);
 
     while (libs != NULL)
     {
@@ -668,8 +808,7 @@ size_t module_LoadPlugins (vlc_object_t *obj)
 #endif
         config_UnsortConfig ();
         config_SortConfig ();
-
-        twalk(modules.caps_tree, vlc_modcap_sort);
+        vlc_modcap_index_build ();
     }
     vlc_mutex_unlock (&modules.lock);
 
@@ -732,14 +871,13 @@ module_t **module_list_get (size_t *n)
  */
 ssize_t module_list_cap (module_t ***restrict list, const char *name)
 {
-    const vlc_modcap_t **cp = tfind(&name, &modules.caps_tree, vlc_modcap_cmp);
-    if (cp == NULL)
+    const vlc_modcap_t *cap = vlc_modcap_find(name);
+    if (cap == NULL)
     {
         *list = NULL;
         return 0;
     }
 
-    const vlc_modcap_t *cap = *cp;
     size_t n = cap->modc;
     module_t **tab = vlc_alloc (n, sizeof (*tab));
     *list = tab;
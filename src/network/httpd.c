@@ -59,6 +59,12 @@
 #   include <sys/socket.h>
 #endif
 
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_EVENTFD_H)
+# include <sys/epoll.h>
+# include <sys/eventfd.h>
+# define HTTPD_USE_EPOLL 1
+#endif
+
 #if defined(_WIN32)
 /* We need HUGE buffer otherwise TCP throughput is very limited */
 #define HTTPD_CL_BUFSIZE 1000000
@@ -66,10 +72,44 @@
 #define HTTPD_CL_BUFSIZE 10000
 #endif
 
+/* Maximum number of consecutive I/O operations on a client (or accepted
+ * connections) before moving on to others */
+#define HTTPD_CL_BURST 16
+
+/* Period to check for idle clients */
+#define HTTPD_SWEEP_PERIOD INT64_C(1000000)
+
 static void httpd_ClientDestroy(httpd_client_t *cl);
 static void httpd_AppendData(httpd_stream_t *stream, uint8_t *p_data, int i_data);
+static void httpd_HostWake(httpd_host_t *host);
+static void httpd_StreamWake(httpd_stream_t *stream);
+static void httpd_ClientSetStream(httpd_client_t *cl, httpd_stream_t *stream);
+
+/* each worker thread serves its own subset of the clients of a host */
+typedef struct httpd_worker_t
+{
+    httpd_host_t *host;
+    vlc_thread_t thread;
+    vlc_mutex_t  lock;
+
+    int            i_client;
+    httpd_client_t **client;
+
+#ifdef HTTPD_USE_EPOLL
+    int epfd;
+    int evfd; /* wakes the worker up on new stream data */
+    httpd_client_t *active; /* clients that can make progress */
+    vlc_mutex_t wake_lock;
+    httpd_client_t *woken; /* clients woken up by new stream data */
+    mtime_t i_sweep_date;
+#endif
+} httpd_worker_t;
 
-/* each host run in his own thread */
+#ifdef HTTPD_USE_EPOLL
+static void httpd_WorkerActivate(httpd_worker_t *w, httpd_client_t *cl);
+#endif
+
+/* each host run in its own worker threads */
 struct httpd_host_t
 {
     VLC_COMMON_MEMBERS
@@ -82,7 +122,8 @@ struct httpd_host_t
     unsigned     nfd;
     unsigned     port;
 
-    vlc_thread_t thread;
+    unsigned        i_worker;
+    httpd_worker_t *worker;
     vlc_mutex_t lock;
     vlc_cond_t  wait;
 
@@ -93,9 +134,6 @@ struct httpd_host_t
     int         i_url;
     httpd_url_t **url;
 
-    int            i_client;
-    httpd_client_t **client;
-
     /* TLS data */
     vlc_tls_creds_t *p_tls;
 };
@@ -142,9 +180,26 @@ struct httpd_client_t
 
     int     i_ref;
 
-    bool    b_stream_mode;
+    /* worker thread serving the client */
+    httpd_worker_t *worker;
+
+    /* stream being served, or NULL if not in stream mode */
+    httpd_stream_t *stream;
     uint8_t i_state;
 
+    /* whether the socket is not known to block (edge-triggered polling) */
+    bool    b_readable;
+    bool    b_writable;
+    bool    b_active;
+    struct httpd_client_t *p_next_active;
+
+    /* waiting list of the stream, protected by the stream lock */
+    struct httpd_client_t *p_next_waiting;
+    struct httpd_client_t **pp_prev_waiting; /* NULL if not waiting */
+    /* woken list of the worker, protected by the worker wake lock */
+    bool    b_woken;
+    struct httpd_client_t *p_next_woken;
+
     mtime_t i_activity_date;
     mtime_t i_activity_timeout;
 
@@ -615,6 +670,9 @@ struct httpd_stream_t
     /* custom headers */
     size_t        i_http_headers;
     httpd_header * p_http_headers;
+
+    /* clients waiting for new data, only those are woken up */
+    httpd_client_t *waiting;
 };
 
 static int httpd_StreamCallBack(httpd_callback_sys_t *p_sys,
@@ -627,47 +685,8 @@ static int httpd_StreamCallBack(httpd_callback_sys_t *p_sys,
         return VLC_SUCCESS;
 
     if (answer->i_body_offset > 0) {
-        int     i_pos;
-
-        if (answer->i_body_offset >= stream->i_buffer_pos)
-            return VLC_EGENERIC;    /* wait, no data available */
-
-        if (cl->i_keyframe_wait_to_pass >= 0) {
-            if (stream->i_last_keyframe_seen_pos <= cl->i_keyframe_wait_to_pass)
-                /* still waiting for the next keyframe */
-                return VLC_EGENERIC;
-
-            /* seek to the new keyframe */
-            answer->i_body_offset = stream->i_last_keyframe_seen_pos;
-            cl->i_keyframe_wait_to_pass = -1;
-        }
-
-        if (answer->i_body_offset + stream->i_buffer_size < stream->i_buffer_pos)
-            answer->i_body_offset = stream->i_buffer_last_pos; /* this client isn't fast enough */
-
-        i_pos   = answer->i_body_offset % stream->i_buffer_size;
-        int64_t i_write = stream->i_buffer_pos - answer->i_body_offset;
-
-        if (i_write > HTTPD_CL_BUFSIZE)
-            i_write = HTTPD_CL_BUFSIZE;
-        else if (i_write <= 0)
-            return VLC_EGENERIC;    /* wait, no data available */
-
-        /* Don't go past the end of the circular buffer */
-        i_write = __MIN(i_write, stream->i_buffer_size - i_pos);
-
-        /* using HTTPD_MSG_ANSWER -> data available */
-        answer->i_proto  = HTTPD_PROTO_HTTP;
-        answer->i_version= 0;
-        answer->i_type   = HTTPD_MSG_ANSWER;
-
-        answer->i_body = i_write;
-        answer->p_body = xmalloc(i_write);
-        memcpy(answer->p_body, &stream->p_buffer[i_pos], i_write);
-
-        answer->i_body_offset += i_write;
-
-        return VLC_SUCCESS;
+        /* Stream data is written by httpd_StreamWrite() */
+        return VLC_EGENERIC;
     } else {
         answer->i_proto  = HTTPD_PROTO_HTTP;
         answer->i_version= 0;
@@ -692,7 +711,7 @@ static int httpd_StreamCallBack(httpd_callback_sys_t *p_sys,
         vlc_mutex_unlock(&stream->lock);
 
         if (query->i_type != HTTPD_MSG_HEAD) {
-            cl->b_stream_mode = true;
+            httpd_ClientSetStream(cl, stream);
             vlc_mutex_lock(&stream->lock);
             /* Send the header */
             if (stream->i_header > 0) {
@@ -773,6 +792,7 @@ httpd_stream_t *httpd_StreamNew(httpd_host_t *host,
     stream->i_last_keyframe_seen_pos = 0;
     stream->i_http_headers = 0;
     stream->p_http_headers = NULL;
+    stream->waiting = NULL;
 
     httpd_UrlCatch(stream->url, HTTPD_MSG_HEAD, httpd_StreamCallBack,
                     (httpd_callback_sys_t*)stream);
@@ -784,6 +804,98 @@ httpd_stream_t *httpd_StreamNew(httpd_host_t *host,
     return stream;
 }
 
+/**
+ * Computes how many bytes of the circular buffer are pending for a client.
+ * This applies the keyframe wait and the slow client catch up.
+ * The stream lock must be held.
+ */
+static int64_t httpd_StreamPending(httpd_stream_t *stream, httpd_client_t *cl)
+{
+    int64_t *offset = &cl->answer.i_body_offset;
+
+    if (*offset >= stream->i_buffer_pos)
+        return 0;    /* wait, no data available */
+
+    if (cl->i_keyframe_wait_to_pass >= 0) {
+        if (stream->i_last_keyframe_seen_pos <= cl->i_keyframe_wait_to_pass)
+            /* still waiting for the next keyframe */
+            return 0;
+
+        /* seek to the new keyframe */
+        *offset = stream->i_last_keyframe_seen_pos;
+        cl->i_keyframe_wait_to_pass = -1;
+    }
+
+    /* This client isn't fast enough. The oldest data is not sent either, as
+     * it could be overwritten while it is being written unlocked. */
+    if (*offset + stream->i_buffer_size - stream->i_buffer_size / 8
+            < stream->i_buffer_pos)
+        *offset = stream->i_buffer_last_pos;
+
+    return stream->i_buffer_pos - *offset;
+}
+
+/**
+ * Writes pending stream data to a client socket, straight from the circular
+ * buffer shared by all clients of the stream.
+ * The write is done unlocked, so that slow (e.g. TLS) clients do not hold up
+ * other clients and the producer. The data is checked afterwards to not have
+ * been overwritten meanwhile.
+ */
+static void httpd_StreamWrite(httpd_stream_t *stream, httpd_client_t *cl)
+{
+    struct iovec iov[2];
+    unsigned iovcnt = 1;
+    ssize_t val;
+
+    vlc_mutex_lock(&stream->lock);
+    int64_t i_write = httpd_StreamPending(stream, cl);
+    if (i_write <= 0) {
+        vlc_mutex_unlock(&stream->lock);
+        cl->i_state = HTTPD_CLIENT_SEND_DONE;
+        return;
+    }
+    if (i_write > HTTPD_CL_BUFSIZE)
+        i_write = HTTPD_CL_BUFSIZE;
+
+    /* Wrap around the end of the circular buffer */
+    int i_pos = cl->answer.i_body_offset % stream->i_buffer_size;
+
+    iov[0].iov_base = &stream->p_buffer[i_pos];
+    iov[0].iov_len = __MIN(i_write, stream->i_buffer_size - i_pos);
+    if ((int64_t)iov[0].iov_len < i_write) {
+        iov[1].iov_base = stream->p_buffer;
+        iov[1].iov_len = i_write - iov[0].iov_len;
+        iovcnt++;
+    }
+
+    int64_t i_offset = cl->answer.i_body_offset;
+    vlc_mutex_unlock(&stream->lock);
+
+    val = cl->sock->writev(cl->sock, iov, iovcnt);
+#if defined(_WIN32)
+    bool b_error = val < 0 && WSAGetLastError() != WSAEWOULDBLOCK;
+#else
+    bool b_error = val < 0 && errno != EAGAIN;
+#endif
+
+    if (val > 0) {
+        vlc_mutex_lock(&stream->lock);
+        /* Data is overwritten once it is a full buffer behind */
+        if (i_offset + stream->i_buffer_size < stream->i_buffer_pos) {
+            msg_Warn(cl->worker->host, "stream data overwritten while sent");
+            b_error = true;
+        }
+        vlc_mutex_unlock(&stream->lock);
+        cl->answer.i_body_offset = i_offset + val;
+    }
+    else if (!b_error)
+        cl->b_writable = false;
+
+    if (b_error)
+        cl->i_state = HTTPD_CLIENT_DEAD;
+}
+
 int httpd_StreamHeader(httpd_stream_t *stream, uint8_t *p_data, int i_data)
 {
     vlc_mutex_lock(&stream->lock);
@@ -834,6 +946,7 @@ int httpd_StreamSend(httpd_stream_t *stream, const block_t *p_block)
     }
 
     httpd_AppendData(stream, p_block->p_buffer, p_block->i_buffer);
+    httpd_StreamWake(stream);
 
     vlc_mutex_unlock(&stream->lock);
     return VLC_SUCCESS;
@@ -857,7 +970,7 @@ void httpd_StreamDelete(httpd_stream_t *stream)
 /*****************************************************************************
  * Low level
  *****************************************************************************/
-static void* httpd_HostThread(void *);
+static void* httpd_WorkerThread(void *);
 static httpd_host_t *httpd_HostCreate(vlc_object_t *, const char *,
                                        const char *, vlc_tls_creds_t *);
 
@@ -896,6 +1009,154 @@ httpd_host_t *vlc_rtsp_HostNew(vlc_object_t *p_this)
     return httpd_HostCreate(p_this, "rtsp-host", "rtsp-port", NULL);
 }
 
+static void httpd_HostWake(httpd_host_t *host)
+{
+#ifdef HTTPD_USE_EPOLL
+    for (unsigned i = 0; i < host->i_worker; i++)
+        eventfd_write(host->worker[i].evfd, 1);
+#else
+    (void) host; /* clients waiting for data are polled */
+#endif
+}
+
+/* adds a client to the waiting list of its stream, with the stream lock held */
+static void httpd_StreamAddWaiting(httpd_stream_t *stream, httpd_client_t *cl)
+{
+    if (cl->pp_prev_waiting != NULL)
+        return;
+    cl->p_next_waiting = stream->waiting;
+    if (stream->waiting != NULL)
+        stream->waiting->pp_prev_waiting = &cl->p_next_waiting;
+    cl->pp_prev_waiting = &stream->waiting;
+    stream->waiting = cl;
+}
+
+static void httpd_StreamRemoveWaiting(httpd_client_t *cl)
+{
+    if (cl->pp_prev_waiting == NULL)
+        return;
+    *cl->pp_prev_waiting = cl->p_next_waiting;
+    if (cl->p_next_waiting != NULL)
+        cl->p_next_waiting->pp_prev_waiting = cl->pp_prev_waiting;
+    cl->pp_prev_waiting = NULL;
+}
+
+/* wakes up the clients waiting for a stream, with the stream lock held */
+static void httpd_StreamWake(httpd_stream_t *stream)
+{
+#ifdef HTTPD_USE_EPOLL
+    httpd_client_t *cl;
+
+    while ((cl = stream->waiting) != NULL) {
+        httpd_worker_t *w = cl->worker;
+        bool b_idle;
+
+        httpd_StreamRemoveWaiting(cl);
+
+        vlc_mutex_lock(&w->wake_lock);
+        b_idle = w->woken == NULL;
+        if (!cl->b_woken) {
+            cl->b_woken = true;
+            cl->p_next_woken = w->woken;
+            w->woken = cl;
+        }
+        vlc_mutex_unlock(&w->wake_lock);
+
+        if (b_idle)
+            eventfd_write(w->evfd, 1);
+    }
+#else
+    (void) stream; /* clients waiting for data are polled */
+#endif
+}
+
+/* attaches a client to a stream, with its worker lock held */
+static void httpd_ClientSetStream(httpd_client_t *cl, httpd_stream_t *stream)
+{
+    if (cl->stream == stream)
+        return;
+    if (cl->stream != NULL) {
+        vlc_mutex_lock(&cl->stream->lock);
+        httpd_StreamRemoveWaiting(cl);
+        vlc_mutex_unlock(&cl->stream->lock);
+    }
+    cl->stream = stream;
+}
+
+static int httpd_WorkerStart(httpd_host_t *host, httpd_worker_t *w)
+{
+    w->host = host;
+    vlc_mutex_init(&w->lock);
+    w->i_client = 0;
+    w->client = NULL;
+#ifdef HTTPD_USE_EPOLL
+    w->active = NULL;
+    w->woken = NULL;
+    vlc_mutex_init(&w->wake_lock);
+    w->i_sweep_date = 0;
+    w->epfd = epoll_create1(EPOLL_CLOEXEC);
+    w->evfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (w->epfd == -1 || w->evfd == -1)
+        goto error;
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = w };
+    if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->evfd, &ev))
+        goto error;
+
+    /* All workers accept connections, on a first come first served basis */
+    for (unsigned i = 0; i < host->nfd; i++) {
+        ev.events = EPOLLIN;
+# ifdef EPOLLEXCLUSIVE
+        ev.events |= EPOLLEXCLUSIVE;
+# endif
+        ev.data.ptr = &host->fds[i];
+        if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, host->fds[i], &ev))
+            goto error;
+    }
+#endif
+
+    if (vlc_clone(&w->thread, httpd_WorkerThread, w, VLC_THREAD_PRIORITY_LOW))
+        goto error;
+    return 0;
+
+error:
+#ifdef HTTPD_USE_EPOLL
+    if (w->evfd != -1)
+        vlc_close(w->evfd);
+    if (w->epfd != -1)
+        vlc_close(w->epfd);
+    vlc_mutex_destroy(&w->wake_lock);
+#endif
+    vlc_mutex_destroy(&w->lock);
+    return -1;
+}
+
+/* stop the worker threads and close their remaining clients */
+static void httpd_HostStop(httpd_host_t *host)
+{
+    for (unsigned i = 0; i < host->i_worker; i++) {
+        httpd_worker_t *w = &host->worker[i];
+
+        vlc_cancel(w->thread);
+        vlc_join(w->thread, NULL);
+
+        for (int j = 0; j < w->i_client; j++) {
+            msg_Warn(host, "client still connected");
+            httpd_ClientDestroy(w->client[j]);
+        }
+        TAB_CLEAN(w->i_client, w->client);
+#ifdef HTTPD_USE_EPOLL
+        vlc_close(w->evfd);
+        vlc_close(w->epfd);
+        vlc_mutex_destroy(&w->wake_lock);
+#endif
+        vlc_mutex_destroy(&w->lock);
+    }
+    free(host->worker);
+    host->worker = NULL;
+    host->i_worker = 0;
+}
+
 static struct httpd
 {
     vlc_mutex_t  mutex;
@@ -946,6 +1207,8 @@ static httpd_host_t *httpd_HostCreate(vlc_object_t *p_this,
     vlc_mutex_init(&host->lock);
     vlc_cond_init(&host->wait);
     host->i_ref = 1;
+    host->i_worker = 0;
+    host->worker = NULL;
 
     char *hostname = var_InheritString(p_this, hostvar);
 
@@ -961,16 +1224,26 @@ static httpd_host_t *httpd_HostCreate(vlc_object_t *p_this,
     host->port     = port;
     host->i_url    = 0;
     host->url      = NULL;
-    host->i_client = 0;
-    host->client   = NULL;
     host->p_tls    = p_tls;
 
-    /* create the thread */
-    if (vlc_clone(&host->thread, httpd_HostThread, host,
-                   VLC_THREAD_PRIORITY_LOW)) {
-        msg_Err(p_this, "cannot spawn http host thread");
+#ifdef HTTPD_USE_EPOLL
+    unsigned workers = var_InheritInteger(p_this, "http-threads");
+    if (workers == 0)
+        workers = vlc_GetCPUCount();
+#else
+    unsigned workers = 1;
+#endif
+    host->worker = calloc(workers, sizeof (*host->worker));
+    if (unlikely(host->worker == NULL))
         goto error;
-    }
+
+    /* create the threads */
+    for (host->i_worker = 0; host->i_worker < workers; host->i_worker++)
+        if (httpd_WorkerStart(host, &host->worker[host->i_worker])) {
+            msg_Err(p_this, "cannot spawn http host thread");
+            goto error;
+        }
+    msg_Dbg(host, "HTTP host running %u thread(s)", workers);
 
     /* now add it to httpd */
     TAB_APPEND(httpd.i_host, httpd.host, host);
@@ -982,6 +1255,7 @@ error:
     vlc_mutex_unlock(&httpd.mutex);
 
     if (host) {
+        httpd_HostStop(host);
         net_ListenClose(host->fds);
         vlc_cond_destroy(&host->wait);
         vlc_mutex_destroy(&host->lock);
@@ -1012,20 +1286,13 @@ void httpd_HostDelete(httpd_host_t *host)
     }
     TAB_REMOVE(httpd.i_host, httpd.host, host);
 
-    vlc_cancel(host->thread);
-    vlc_join(host->thread, NULL);
+    httpd_HostStop(host);
 
     msg_Dbg(host, "HTTP host removed");
 
     for (int i = 0; i < host->i_url; i++)
         msg_Err(host, "url still registered: %s", host->url[i]->psz_url);
 
-    for (int i = 0; i < host->i_client; i++) {
-        msg_Warn(host, "client still connected");
-        httpd_ClientDestroy(host->client[i]);
-    }
-    TAB_CLEAN(host->i_client, host->client);
-
     vlc_tls_Delete(host->p_tls);
     net_ListenClose(host->fds);
     vlc_cond_destroy(&host->wait);
@@ -1088,26 +1355,38 @@ void httpd_UrlDelete(httpd_url_t *url)
 
     vlc_mutex_lock(&host->lock);
     TAB_REMOVE(host->i_url, host->url, url);
+    vlc_mutex_unlock(&host->lock);
 
-    vlc_mutex_destroy(&url->lock);
-    free(url->psz_url);
-    free(url->psz_user);
-    free(url->psz_password);
+    /* Once the URL is unlisted, no new client can use it. Detach existing
+     * ones: they are closed by their worker thread. */
+    for (unsigned i = 0; i < host->i_worker; i++) {
+        httpd_worker_t *w = &host->worker[i];
 
-    for (int i = 0; i < host->i_client; i++) {
-        httpd_client_t *client = host->client[i];
+        vlc_mutex_lock(&w->lock);
+        for (int j = 0; j < w->i_client; j++) {
+            httpd_client_t *client = w->client[j];
 
-        if (client->url != url)
-            continue;
+            if (client->url != url)
+                continue;
 
-        /* TODO complete it */
-        msg_Warn(host, "force closing connections");
-        TAB_REMOVE(host->i_client, host->client, client);
-        httpd_ClientDestroy(client);
-        i--;
+            /* TODO complete it */
+            msg_Warn(host, "force closing connections");
+            client->url = NULL;
+            httpd_ClientSetStream(client, NULL);
+            client->i_state = HTTPD_CLIENT_DEAD;
+#ifdef HTTPD_USE_EPOLL
+            httpd_WorkerActivate(w, client);
+#endif
+        }
+        vlc_mutex_unlock(&w->lock);
     }
+    httpd_HostWake(host);
+
+    vlc_mutex_destroy(&url->lock);
+    free(url->psz_url);
+    free(url->psz_user);
+    free(url->psz_password);
     free(url);
-    vlc_mutex_unlock(&host->lock);
 }
 
 static void httpd_MsgInit(httpd_message_t *msg)
@@ -1188,7 +1467,12 @@ static void httpd_ClientInit(httpd_client_t *cl, mtime_t now)
     cl->i_buffer = 0;
     cl->p_buffer = xmalloc(cl->i_buffer_size);
     cl->i_keyframe_wait_to_pass = -1;
-    cl->b_stream_mode = false;
+    cl->stream = NULL;
+    cl->b_readable = false;
+    cl->b_writable = false;
+    cl->b_active = false;
+    cl->pp_prev_waiting = NULL;
+    cl->b_woken = false;
 
     httpd_MsgInit(&cl->query);
     httpd_MsgInit(&cl->answer);
@@ -1206,6 +1490,20 @@ char* httpd_ServerIP(const httpd_client_t *cl, char *ip, int *port)
 
 static void httpd_ClientDestroy(httpd_client_t *cl)
 {
+    httpd_ClientSetStream(cl, NULL);
+#ifdef HTTPD_USE_EPOLL
+    httpd_worker_t *w = cl->worker;
+
+    vlc_mutex_lock(&w->wake_lock);
+    if (cl->b_woken) {
+        httpd_client_t **pp = &w->woken;
+
+        while (*pp != cl)
+            pp = &(*pp)->p_next_woken;
+        *pp = cl->p_next_woken;
+    }
+    vlc_mutex_unlock(&w->wake_lock);
+#endif
     vlc_tls_Close(cl->sock);
     httpd_MsgClean(&cl->answer);
     httpd_MsgClean(&cl->query);
@@ -1233,7 +1531,10 @@ ssize_t httpd_NetRecv (httpd_client_t *cl, uint8_t *p, size_t i_len)
 {
     vlc_tls_t *sock = cl->sock;
     struct iovec iov = { .iov_base = p, .iov_len = i_len };
-    return sock->readv(sock, &iov, 1);
+    ssize_t val = sock->readv(sock, &iov, 1);
+    if (val < 0 && errno == EAGAIN)
+        cl->b_readable = false;
+    return val;
 }
 
 static
@@ -1241,7 +1542,10 @@ ssize_t httpd_NetSend (httpd_client_t *cl, const uint8_t *p, size_t i_len)
 {
     vlc_tls_t *sock = cl->sock;
     const struct iovec iov = { .iov_base = (void *)p, .iov_len = i_len };
-    return sock->writev(sock, &iov, 1);
+    ssize_t val = sock->writev(sock, &iov, 1);
+    if (val < 0 && errno == EAGAIN)
+        cl->b_writable = false;
+    return val;
 }
 
 
@@ -1555,6 +1859,12 @@ static void httpd_ClientSend(httpd_client_t *cl)
 {
     int i_len;
 
+    if (cl->stream != NULL && cl->p_buffer == NULL) {
+        /* Stream mode: the client only keeps an offset in the stream */
+        httpd_StreamWrite(cl->stream, cl);
+        return;
+    }
+
     if (cl->i_buffer < 0) {
         /* We need to create the header */
         int i_size = 0;
@@ -1592,6 +1902,17 @@ static void httpd_ClientSend(httpd_client_t *cl)
         cl->i_buffer += i_len;
 
         if (cl->i_buffer >= cl->i_buffer_size) {
+            if (cl->answer.i_body == 0 && cl->answer.i_body_offset > 0
+             && cl->stream != NULL) {
+                /* headers sent, switch to stream data */
+                free(cl->p_buffer);
+                cl->p_buffer = NULL;
+                cl->i_buffer = 0;
+                cl->i_buffer_size = 0;
+                httpd_StreamWrite(cl->stream, cl);
+                return;
+            }
+
             if (cl->answer.i_body == 0  && cl->answer.i_body_offset > 0) {
                 /* catch more body data */
                 int     i_msg = cl->query.i_type;
@@ -1635,8 +1956,14 @@ static void httpd_ClientTlsHandshake(httpd_host_t *host, httpd_client_t *cl)
     {
         case -1: cl->i_state = HTTPD_CLIENT_DEAD;       break;
         case 0:  cl->i_state = HTTPD_CLIENT_RECEIVING;  break;
-        case 1:  cl->i_state = HTTPD_CLIENT_TLS_HS_IN;  break;
-        case 2:  cl->i_state = HTTPD_CLIENT_TLS_HS_OUT; break;
+        case 1:
+            cl->i_state = HTTPD_CLIENT_TLS_HS_IN;
+            cl->b_readable = false;
+            break;
+        case 2:
+            cl->i_state = HTTPD_CLIENT_TLS_HS_OUT;
+            cl->b_writable = false;
+            break;
     }
 }
 
@@ -1680,264 +2007,498 @@ auth_failed:
     return false;
 }
 
-static void httpdLoop(httpd_host_t *host)
+/* Handles a client which is not waiting for its socket */
+static void httpd_ClientProcess(httpd_host_t *host, httpd_client_t *cl)
 {
-    struct pollfd ufd[host->nfd + host->i_client];
-    unsigned nfd;
-    for (nfd = 0; nfd < host->nfd; nfd++) {
-        ufd[nfd].fd = host->fds[nfd];
-        ufd[nfd].events = POLLIN;
-        ufd[nfd].revents = 0;
+    switch (cl->i_state) {
+        case HTTPD_CLIENT_RECEIVE_DONE: {
+            httpd_message_t *answer = &cl->answer;
+            httpd_message_t *query  = &cl->query;
+
+            httpd_MsgInit(answer);
+
+            /* Handle what we received */
+            switch (query->i_type) {
+                case HTTPD_MSG_ANSWER:
+                    cl->url     = NULL;
+                    cl->i_state = HTTPD_CLIENT_DEAD;
+                    break;
+
+                case HTTPD_MSG_OPTIONS:
+                    answer->i_type   = HTTPD_MSG_ANSWER;
+                    answer->i_proto  = query->i_proto;
+                    answer->i_status = 200;
+                    answer->i_body = 0;
+                    answer->p_body = NULL;
+
+                    httpd_MsgAdd(answer, "Server", "VLC/%s", VERSION);
+                    httpd_MsgAdd(answer, "Content-Length", "0");
+
+                    switch(query->i_proto) {
+                    case HTTPD_PROTO_HTTP:
+                        answer->i_version = 1;
+                        httpd_MsgAdd(answer, "Allow", "GET,HEAD,POST,OPTIONS");
+                        break;
+
+                    case HTTPD_PROTO_RTSP:
+                        answer->i_version = 0;
+
+                        const char *p = httpd_MsgGet(query, "Cseq");
+                        if (p)
+                            httpd_MsgAdd(answer, "Cseq", "%s", p);
+                        p = httpd_MsgGet(query, "Timestamp");
+                        if (p)
+                            httpd_MsgAdd(answer, "Timestamp", "%s", p);
+
+                        p = httpd_MsgGet(query, "Require");
+                        if (p) {
+                            answer->i_status = 551;
+                            httpd_MsgAdd(query, "Unsupported", "%s", p);
+                        }
+
+                        httpd_MsgAdd(answer, "Public", "DESCRIBE,SETUP,"
+                                "TEARDOWN,PLAY,PAUSE,GET_PARAMETER");
+                        break;
+                    }
+
+                    if (httpd_MsgGet(&cl->query, "Connection") != NULL)
+                        httpd_MsgAdd(answer, "Connection", "close");
+
+                    cl->i_buffer = -1;  /* Force the creation of the answer in
+                                         * httpd_ClientSend */
+                    cl->i_state = HTTPD_CLIENT_SENDING;
+                    break;
+
+                case HTTPD_MSG_NONE:
+                    if (query->i_proto == HTTPD_PROTO_NONE) {
+                        cl->url = NULL;
+                        cl->i_state = HTTPD_CLIENT_DEAD;
+                    } else {
+                        /* unimplemented */
+                        answer->i_proto  = query->i_proto ;
+                        answer->i_type   = HTTPD_MSG_ANSWER;
+                        answer->i_version= 0;
+                        answer->i_status = 501;
+
+                        char *p;
+                        answer->i_body = httpd_HtmlError (&p, 501, NULL);
+                        answer->p_body = (uint8_t *)p;
+                        httpd_MsgAdd(answer, "Content-Length", "%d", answer->i_body);
+                        httpd_MsgAdd(answer, "Connection", "close");
+
+                        cl->i_buffer = -1;  /* Force the creation of the answer in httpd_ClientSend */
+                        cl->i_state = HTTPD_CLIENT_SENDING;
+                    }
+                    break;
+
+                default: {
+                    int i_msg = query->i_type;
+                    bool b_auth_failed = false;
+
+                    /* Search the url and trigger callbacks */
+                    vlc_mutex_lock(&host->lock);
+                    for (int i = 0; i < host->i_url; i++) {
+                        httpd_url_t *url = host->url[i];
+
+                        if (strcmp(url->psz_url, query->psz_url))
+                            continue;
+                        if (!url->catch[i_msg].cb)
+                            continue;
+
+                        if (answer) {
+                            b_auth_failed = !httpdAuthOk(url->psz_user,
+                               url->psz_password,
+                               httpd_MsgGet(query, "Authorization")); /* BASIC id */
+                            if (b_auth_failed)
+                               break;
+                        }
+
+                        if (url->catch[i_msg].cb(url->catch[i_msg].p_sys, cl, answer, query))
+                            continue;
+
+                        if (answer->i_proto == HTTPD_PROTO_NONE)
+                            cl->i_buffer = cl->i_buffer_size; /* Raw answer from a CGI */
+                        else
+                            cl->i_buffer = -1;
+
+                        /* only one url can answer */
+                        answer = NULL;
+                        if (!cl->url)
+                            cl->url = url;
+                    }
+                    vlc_mutex_unlock(&host->lock);
+
+                    if (answer) {
+                        answer->i_proto  = query->i_proto;
+                        answer->i_type   = HTTPD_MSG_ANSWER;
+                        answer->i_version= 0;
+
+                       if (b_auth_failed) {
+                            httpd_MsgAdd(answer, "WWW-Authenticate",
+                                    "Basic realm=\"VLC stream\"");
+                            answer->i_status = 401;
+                        } else
+                            answer->i_status = 404; /* no url registered */
+
+                        char *p;
+                        answer->i_body = httpd_HtmlError (&p, answer->i_status,
+                                query->psz_url);
+                        answer->p_body = (uint8_t *)p;
+
+                        cl->i_buffer = -1;  /* Force the creation of the answer in httpd_ClientSend */
+                        httpd_MsgAdd(answer, "Content-Length", "%d", answer->i_body);
+                        httpd_MsgAdd(answer, "Content-Type", "%s", "text/html");
+                        if (httpd_MsgGet(&cl->query, "Connection") != NULL)
+                            httpd_MsgAdd(answer, "Connection", "close");
+                    }
+
+                    cl->i_state = HTTPD_CLIENT_SENDING;
+                }
+            }
+            break;
+        }
+
+        case HTTPD_CLIENT_SEND_DONE:
+            if (cl->stream == NULL || cl->answer.i_body_offset == 0) {
+                bool do_close = false;
+
+                cl->url = NULL;
+                httpd_ClientSetStream(cl, NULL);
+
+                if (cl->query.i_proto != HTTPD_PROTO_HTTP
+                 || cl->query.i_version > 0)
+                {
+                    const char *psz_connection = httpd_MsgGet(&cl->answer,
+                                                             "Connection");
+                    if (psz_connection != NULL)
+                        do_close = !strcasecmp(psz_connection, "close");
+                }
+                else
+                    do_close = true;
+
+                if (!do_close) {
+                    httpd_MsgClean(&cl->query);
+                    httpd_MsgInit(&cl->query);
+
+                    cl->i_buffer = 0;
+                    cl->i_buffer_size = 1000;
+                    free(cl->p_buffer);
+                    // Allocate an extra byte for the null terminating byte
+                    cl->p_buffer = xmalloc(cl->i_buffer_size + 1);
+                    cl->i_state = HTTPD_CLIENT_RECEIVING;
+                } else
+                    cl->i_state = HTTPD_CLIENT_DEAD;
+                httpd_MsgClean(&cl->answer);
+            } else {
+                int64_t i_offset = cl->answer.i_body_offset;
+                httpd_MsgClean(&cl->answer);
+
+                cl->answer.i_body_offset = i_offset;
+                free(cl->p_buffer);
+                cl->p_buffer = NULL;
+                cl->i_buffer = 0;
+                cl->i_buffer_size = 0;
+
+                cl->i_state = HTTPD_CLIENT_WAITING;
+            }
+            break;
+
+        case HTTPD_CLIENT_WAITING:
+            if (cl->stream != NULL) {
+                int64_t i_pending;
+
+                vlc_mutex_lock(&cl->stream->lock);
+                i_pending = httpd_StreamPending(cl->stream, cl);
+#ifdef HTTPD_USE_EPOLL
+                /* woken up by httpd_StreamSend() */
+                if (i_pending <= 0)
+                    httpd_StreamAddWaiting(cl->stream, cl);
+#endif
+                vlc_mutex_unlock(&cl->stream->lock);
+
+                /* we have new data, so re-enter send mode */
+                if (i_pending > 0)
+                    cl->i_state = HTTPD_CLIENT_SENDING;
+            }
+            break;
     }
+}
 
-    /* add all socket that should be read/write and close dead connection */
-    while (host->i_url <= 0) {
-        mutex_cleanup_push(&host->lock);
-        vlc_cond_wait(&host->wait, &host->lock);
-        vlc_cleanup_pop();
+/* Handles a client whose socket is ready */
+static void httpd_ClientIO(httpd_host_t *host, httpd_client_t *cl)
+{
+    switch (cl->i_state) {
+        case HTTPD_CLIENT_RECEIVING: httpd_ClientRecv(cl); break;
+        case HTTPD_CLIENT_SENDING:   httpd_ClientSend(cl); break;
+        case HTTPD_CLIENT_TLS_HS_IN:
+        case HTTPD_CLIENT_TLS_HS_OUT:
+            httpd_ClientTlsHandshake(host, cl);
+            break;
     }
+}
 
-    mtime_t now = mdate();
-    bool b_low_delay = false;
+/* Accepts a new connection on a listening socket */
+static httpd_client_t *httpd_HostAccept(httpd_worker_t *w, int fd,
+                                        mtime_t now)
+{
+    httpd_host_t *host = w->host;
 
-    int canc = vlc_savecancel();
-    for (int i_client = 0; i_client < host->i_client; i_client++) {
-        int64_t i_offset;
-        httpd_client_t *cl = host->client[i_client];
-        if (cl->i_ref < 0 || (cl->i_ref == 0 &&
-                    (cl->i_state == HTTPD_CLIENT_DEAD ||
-                      (cl->i_activity_timeout > 0 &&
-                        cl->i_activity_date+cl->i_activity_timeout < now)))) {
-            TAB_REMOVE(host->i_client, host->client, cl);
-            i_client--;
-            httpd_ClientDestroy(cl);
-            continue;
+    fd = vlc_accept (fd, NULL, NULL, true);
+    if (fd == -1)
+        return NULL;
+    setsockopt (fd, SOL_SOCKET, SO_REUSEADDR,
+            &(int){ 1 }, sizeof(int));
+
+    vlc_tls_t *sk = vlc_tls_SocketOpen(fd);
+    if (unlikely(sk == NULL))
+    {
+        vlc_close(fd);
+        return NULL;
+    }
+
+    if (host->p_tls != NULL)
+    {
+        const char *alpn[] = { "http/1.1", NULL };
+        vlc_tls_t *tls;
+
+        tls = vlc_tls_ServerSessionCreate(host->p_tls, sk, alpn);
+        if (tls == NULL)
+        {
+            vlc_tls_SessionDelete(sk);
+            return NULL;
         }
+        sk = tls;
+    }
 
-        struct pollfd *pufd = ufd + nfd;
-        assert (pufd < ufd + (sizeof (ufd) / sizeof (ufd[0])));
+    httpd_client_t *cl = httpd_ClientNew(sk, now);
+    if (unlikely(cl == NULL))
+    {
+        vlc_tls_Close(sk);
+        return NULL;
+    }
 
-        pufd->fd = vlc_tls_GetFD(cl->sock);
-        pufd->events = pufd->revents = 0;
+    cl->worker = w;
+    if (host->p_tls != NULL)
+        cl->i_state = HTTPD_CLIENT_TLS_HS_OUT;
+    return cl;
+}
+
+/* Waits until at least one URL is registered */
+static void httpd_HostWaitUrl(httpd_host_t *host)
+{
+    vlc_mutex_lock(&host->lock);
+    mutex_cleanup_push(&host->lock);
+    while (host->i_url <= 0)
+        vlc_cond_wait(&host->wait, &host->lock);
+    vlc_cleanup_pop();
+    vlc_mutex_unlock(&host->lock);
+}
+
+#ifdef HTTPD_USE_EPOLL
+static void httpd_WorkerActivate(httpd_worker_t *w, httpd_client_t *cl)
+{
+    if (cl->b_active)
+        return;
+    cl->b_active = true;
+    cl->p_next_active = w->active;
+    w->active = cl;
+}
+
+/**
+ * Runs a client state machine until it needs to wait for its socket or for
+ * stream data. Returns true if the client is still ready to make progress.
+ */
+static bool httpd_ClientRun(httpd_host_t *host, httpd_client_t *cl,
+                            mtime_t now)
+{
+    for (unsigned i = 0; i < HTTPD_CL_BURST; i++) {
+        uint8_t i_state = cl->i_state;
+
+        switch (i_state) {
+            case HTTPD_CLIENT_DEAD:
+                return false;
 
-        switch (cl->i_state) {
             case HTTPD_CLIENT_RECEIVING:
             case HTTPD_CLIENT_TLS_HS_IN:
-                pufd->events = POLLIN;
+                if (!cl->b_readable)
+                    return false;
+                cl->i_activity_date = now;
+                httpd_ClientIO(host, cl);
                 break;
 
             case HTTPD_CLIENT_SENDING:
             case HTTPD_CLIENT_TLS_HS_OUT:
-                pufd->events = POLLOUT;
+                if (!cl->b_writable)
+                    return false;
+                cl->i_activity_date = now;
+                httpd_ClientIO(host, cl);
                 break;
 
-            case HTTPD_CLIENT_RECEIVE_DONE: {
-                httpd_message_t *answer = &cl->answer;
-                httpd_message_t *query  = &cl->query;
+            default:
+                httpd_ClientProcess(host, cl);
+                if (cl->i_state == i_state)
+                    return false; /* waiting for stream data */
+        }
+    }
+    return true;
+}
 
-                httpd_MsgInit(answer);
+static void httpdLoop(httpd_worker_t *w)
+{
+    httpd_host_t *host = w->host;
+    struct epoll_event ev[64];
 
-                /* Handle what we received */
-                switch (query->i_type) {
-                    case HTTPD_MSG_ANSWER:
-                        cl->url     = NULL;
-                        cl->i_state = HTTPD_CLIENT_DEAD;
-                        break;
+    httpd_HostWaitUrl(host);
 
-                    case HTTPD_MSG_OPTIONS:
-                        answer->i_type   = HTTPD_MSG_ANSWER;
-                        answer->i_proto  = query->i_proto;
-                        answer->i_status = 200;
-                        answer->i_body = 0;
-                        answer->p_body = NULL;
+    vlc_mutex_lock(&w->lock);
+    int timeout = (w->active != NULL) ? 0 : HTTPD_SWEEP_PERIOD / 1000;
+    vlc_mutex_unlock(&w->lock);
 
-                        httpd_MsgAdd(answer, "Server", "VLC/%s", VERSION);
-                        httpd_MsgAdd(answer, "Content-Length", "0");
+    int n = epoll_wait(w->epfd, ev, ARRAY_SIZE(ev), timeout);
+    if (n < 0 && errno != EINTR)
+        msg_Err(host, "polling error: %s", vlc_strerror_c(errno));
 
-                        switch(query->i_proto) {
-                        case HTTPD_PROTO_HTTP:
-                            answer->i_version = 1;
-                            httpd_MsgAdd(answer, "Allow", "GET,HEAD,POST,OPTIONS");
-                            break;
+    int canc = vlc_savecancel();
+    mtime_t now = mdate();
 
-                        case HTTPD_PROTO_RTSP:
-                            answer->i_version = 0;
+    vlc_mutex_lock(&w->lock);
+    for (int i = 0; i < n; i++) {
+        void *data = ev[i].data.ptr;
 
-                            const char *p = httpd_MsgGet(query, "Cseq");
-                            if (p)
-                                httpd_MsgAdd(answer, "Cseq", "%s", p);
-                            p = httpd_MsgGet(query, "Timestamp");
-                            if (p)
-                                httpd_MsgAdd(answer, "Timestamp", "%s", p);
+        if (data == w) {
+            /* New stream data (or closed clients) */
+            uint64_t dummy;
 
-                            p = httpd_MsgGet(query, "Require");
-                            if (p) {
-                                answer->i_status = 551;
-                                httpd_MsgAdd(query, "Unsupported", "%s", p);
-                            }
+            if (read(w->evfd, &dummy, sizeof (dummy)) < 0)
+                continue;
 
-                            httpd_MsgAdd(answer, "Public", "DESCRIBE,SETUP,"
-                                    "TEARDOWN,PLAY,PAUSE,GET_PARAMETER");
-                            break;
-                        }
+            vlc_mutex_lock(&w->wake_lock);
+            httpd_client_t *cl = w->woken;
+            w->woken = NULL;
+            for (; cl != NULL; cl = cl->p_next_woken) {
+                cl->b_woken = false;
+                httpd_WorkerActivate(w, cl);
+            }
+            vlc_mutex_unlock(&w->wake_lock);
+        } else if ((int *)data >= host->fds
+                && (int *)data < host->fds + host->nfd) {
+            /* Accept new connections on this worker */
+            for (unsigned j = 0; j < HTTPD_CL_BURST; j++) {
+                httpd_client_t *cl = httpd_HostAccept(w, *(int *)data, now);
+                if (cl == NULL)
+                    break;
+
+                struct epoll_event cev = {
+                    .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+                    .data.ptr = cl,
+                };
+
+                if (epoll_ctl(w->epfd, EPOLL_CTL_ADD,
+                              vlc_tls_GetFD(cl->sock), &cev)) {
+                    httpd_ClientDestroy(cl);
+                    continue;
+                }
+                TAB_APPEND(w->i_client, w->client, cl);
+            }
+        } else {
+            httpd_client_t *cl = data;
+
+            /* Edge-triggered: the socket stays ready until EAGAIN */
+            if (ev[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                cl->b_readable = true;
+            if (ev[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+                cl->b_writable = true;
+            httpd_WorkerActivate(w, cl);
+        }
+    }
 
-                        if (httpd_MsgGet(&cl->query, "Connection") != NULL)
-                            httpd_MsgAdd(answer, "Connection", "close");
+    /* Expire idle clients */
+    if (now >= w->i_sweep_date) {
+        for (int i = 0; i < w->i_client; i++) {
+            httpd_client_t *cl = w->client[i];
 
-                        cl->i_buffer = -1;  /* Force the creation of the answer in
-                                             * httpd_ClientSend */
-                        cl->i_state = HTTPD_CLIENT_SENDING;
-                        break;
+            if (cl->i_activity_timeout > 0
+             && cl->i_activity_date + cl->i_activity_timeout < now) {
+                cl->i_state = HTTPD_CLIENT_DEAD;
+                httpd_WorkerActivate(w, cl);
+            }
+        }
+        w->i_sweep_date = now + HTTPD_SWEEP_PERIOD;
+    }
 
-                    case HTTPD_MSG_NONE:
-                        if (query->i_proto == HTTPD_PROTO_NONE) {
-                            cl->url = NULL;
-                            cl->i_state = HTTPD_CLIENT_DEAD;
-                        } else {
-                            /* unimplemented */
-                            answer->i_proto  = query->i_proto ;
-                            answer->i_type   = HTTPD_MSG_ANSWER;
-                            answer->i_version= 0;
-                            answer->i_status = 501;
-
-                            char *p;
-                            answer->i_body = httpd_HtmlError (&p, 501, NULL);
-                            answer->p_body = (uint8_t *)p;
-                            httpd_MsgAdd(answer, "Content-Length", "%d", answer->i_body);
-                            httpd_MsgAdd(answer, "Connection", "close");
+    /* Run only the clients that can make progress */
+    httpd_client_t *cl = w->active;
 
-                            cl->i_buffer = -1;  /* Force the creation of the answer in httpd_ClientSend */
-                            cl->i_state = HTTPD_CLIENT_SENDING;
-                        }
-                        break;
+    w->active = NULL;
+    while (cl != NULL) {
+        httpd_client_t *next = cl->p_next_active;
 
-                    default: {
-                        int i_msg = query->i_type;
-                        bool b_auth_failed = false;
-
-                        /* Search the url and trigger callbacks */
-                        for (int i = 0; i < host->i_url; i++) {
-                            httpd_url_t *url = host->url[i];
-
-                            if (strcmp(url->psz_url, query->psz_url))
-                                continue;
-                            if (!url->catch[i_msg].cb)
-                                continue;
-
-                            if (answer) {
-                                b_auth_failed = !httpdAuthOk(url->psz_user,
-                                   url->psz_password,
-                                   httpd_MsgGet(query, "Authorization")); /* BASIC id */
-                                if (b_auth_failed)
-                                   break;
-                            }
-
-                            if (url->catch[i_msg].cb(url->catch[i_msg].p_sys, cl, answer, query))
-                                continue;
-
-                            if (answer->i_proto == HTTPD_PROTO_NONE)
-                                cl->i_buffer = cl->i_buffer_size; /* Raw answer from a CGI */
-                            else
-                                cl->i_buffer = -1;
-
-                            /* only one url can answer */
-                            answer = NULL;
-                            if (!cl->url)
-                                cl->url = url;
-                        }
+        cl->b_active = false;
+        if (httpd_ClientRun(host, cl, now))
+            httpd_WorkerActivate(w, cl);
+        else if (cl->i_state == HTTPD_CLIENT_DEAD) {
+            TAB_REMOVE(w->i_client, w->client, cl);
+            httpd_ClientDestroy(cl);
+        }
+        cl = next;
+    }
+    vlc_mutex_unlock(&w->lock);
+    vlc_restorecancel(canc);
+}
 
-                        if (answer) {
-                            answer->i_proto  = query->i_proto;
-                            answer->i_type   = HTTPD_MSG_ANSWER;
-                            answer->i_version= 0;
-
-                           if (b_auth_failed) {
-                                httpd_MsgAdd(answer, "WWW-Authenticate",
-                                        "Basic realm=\"VLC stream\"");
-                                answer->i_status = 401;
-                            } else
-                                answer->i_status = 404; /* no url registered */
-
-                            char *p;
-                            answer->i_body = httpd_HtmlError (&p, answer->i_status,
-                                    query->psz_url);
-                            answer->p_body = (uint8_t *)p;
-
-                            cl->i_buffer = -1;  /* Force the creation of the answer in httpd_ClientSend */
-                            httpd_MsgAdd(answer, "Content-Length", "%d", answer->i_body);
-                            httpd_MsgAdd(answer, "Content-Type", "%s", "text/html");
-                            if (httpd_MsgGet(&cl->query, "Connection") != NULL)
-                                httpd_MsgAdd(answer, "Connection", "close");
-                        }
+#else /* !HTTPD_USE_EPOLL */
+static void httpdLoop(httpd_worker_t *w)
+{
+    httpd_host_t *host = w->host;
 
-                        cl->i_state = HTTPD_CLIENT_SENDING;
-                    }
-                }
-                break;
-            }
+    httpd_HostWaitUrl(host);
 
-            case HTTPD_CLIENT_SEND_DONE:
-                if (!cl->b_stream_mode || cl->answer.i_body_offset == 0) {
-                    bool do_close = false;
+    int canc = vlc_savecancel();
+    vlc_mutex_lock(&w->lock);
 
-                    cl->url = NULL;
+    struct pollfd ufd[host->nfd + w->i_client];
+    unsigned nfd;
+    for (nfd = 0; nfd < host->nfd; nfd++) {
+        ufd[nfd].fd = host->fds[nfd];
+        ufd[nfd].events = POLLIN;
+        ufd[nfd].revents = 0;
+    }
 
-                    if (cl->query.i_proto != HTTPD_PROTO_HTTP
-                     || cl->query.i_version > 0)
-                    {
-                        const char *psz_connection = httpd_MsgGet(&cl->answer,
-                                                                 "Connection");
-                        if (psz_connection != NULL)
-                            do_close = !strcasecmp(psz_connection, "close");
-                    }
-                    else
-                        do_close = true;
-
-                    if (!do_close) {
-                        httpd_MsgClean(&cl->query);
-                        httpd_MsgInit(&cl->query);
-
-                        cl->i_buffer = 0;
-                        cl->i_buffer_size = 1000;
-                        free(cl->p_buffer);
-                        // Allocate an extra byte for the null terminating byte
-                        cl->p_buffer = xmalloc(cl->i_buffer_size + 1);
-                        cl->i_state = HTTPD_CLIENT_RECEIVING;
-                    } else
-                        cl->i_state = HTTPD_CLIENT_DEAD;
-                    httpd_MsgClean(&cl->answer);
-                } else {
-                    i_offset = cl->answer.i_body_offset;
-                    httpd_MsgClean(&cl->answer);
+    mtime_t now = mdate();
+    bool b_low_delay = false;
 
-                    cl->answer.i_body_offset = i_offset;
-                    free(cl->p_buffer);
-                    cl->p_buffer = NULL;
-                    cl->i_buffer = 0;
-                    cl->i_buffer_size = 0;
+    /* add all socket that should be read/write and close dead connection */
+    for (int i_client = 0; i_client < w->i_client; i_client++) {
+        httpd_client_t *cl = w->client[i_client];
+        if (cl->i_ref < 0 || (cl->i_ref == 0 &&
+                    (cl->i_state == HTTPD_CLIENT_DEAD ||
+                      (cl->i_activity_timeout > 0 &&
+                        cl->i_activity_date+cl->i_activity_timeout < now)))) {
+            TAB_REMOVE(w->i_client, w->client, cl);
+            i_client--;
+            httpd_ClientDestroy(cl);
+            continue;
+        }
 
-                    cl->i_state = HTTPD_CLIENT_WAITING;
-                }
-                break;
+        struct pollfd *pufd = ufd + nfd;
+        assert (pufd < ufd + (sizeof (ufd) / sizeof (ufd[0])));
 
-            case HTTPD_CLIENT_WAITING:
-                i_offset = cl->answer.i_body_offset;
-                int i_msg = cl->query.i_type;
+        pufd->fd = vlc_tls_GetFD(cl->sock);
+        pufd->events = pufd->revents = 0;
 
-                httpd_MsgInit(&cl->answer);
-                cl->answer.i_body_offset = i_offset;
+        switch (cl->i_state) {
+            case HTTPD_CLIENT_RECEIVING:
+            case HTTPD_CLIENT_TLS_HS_IN:
+                pufd->events = POLLIN;
+                break;
 
-                cl->url->catch[i_msg].cb(cl->url->catch[i_msg].p_sys, cl,
-                        &cl->answer, &cl->query);
-                if (cl->answer.i_type != HTTPD_MSG_NONE) {
-                    /* we have new data, so re-enter send mode */
-                    cl->i_buffer      = 0;
-                    cl->p_buffer      = cl->answer.p_body;
-                    cl->i_buffer_size = cl->answer.i_body;
-                    cl->answer.p_body = NULL;
-                    cl->answer.i_body = 0;
-                    cl->i_state = HTTPD_CLIENT_SENDING;
-                }
+            case HTTPD_CLIENT_SENDING:
+            case HTTPD_CLIENT_TLS_HS_OUT:
+                pufd->events = POLLOUT;
+                break;
+
+            default:
+                httpd_ClientProcess(host, cl);
         }
 
         if (pufd->events != 0)
@@ -1945,25 +2506,25 @@ static void httpdLoop(httpd_host_t *host)
         else
             b_low_delay = true;
     }
-    vlc_mutex_unlock(&host->lock);
+    vlc_mutex_unlock(&w->lock);
     vlc_restorecancel(canc);
 
     /* we will wait 20ms (not too big) if HTTPD_CLIENT_WAITING */
-    while (poll(ufd, nfd, b_low_delay ? 20 : -1) < 0)
+    while (poll(ufd, nfd, b_low_delay ? 20 : HTTPD_SWEEP_PERIOD / 1000) < 0)
     {
         if (errno != EINTR)
             msg_Err(host, "polling error: %s", vlc_strerror_c(errno));
     }
 
     canc = vlc_savecancel();
-    vlc_mutex_lock(&host->lock);
+    vlc_mutex_lock(&w->lock);
 
     /* Handle client sockets */
     now = mdate();
     nfd = host->nfd;
 
-    for (int i_client = 0; i_client < host->i_client; i_client++) {
-        httpd_client_t *cl = host->client[i_client];
+    for (int i_client = 0; i_client < w->i_client; i_client++) {
+        httpd_client_t *cl = w->client[i_client];
         const struct pollfd *pufd = &ufd[nfd];
 
         assert(pufd < &ufd[sizeof(ufd) / sizeof(ufd[0])]);
@@ -1975,74 +2536,32 @@ static void httpdLoop(httpd_host_t *host)
             continue; // no event received
 
         cl->i_activity_date = now;
-
-        switch (cl->i_state) {
-            case HTTPD_CLIENT_RECEIVING: httpd_ClientRecv(cl); break;
-            case HTTPD_CLIENT_SENDING:   httpd_ClientSend(cl); break;
-            case HTTPD_CLIENT_TLS_HS_IN:
-            case HTTPD_CLIENT_TLS_HS_OUT:
-                httpd_ClientTlsHandshake(host, cl);
-                break;
-        }
+        httpd_ClientIO(host, cl);
     }
 
     /* Handle server sockets (accept new connections) */
     for (nfd = 0; nfd < host->nfd; nfd++) {
-        httpd_client_t *cl;
-        int fd = ufd[nfd].fd;
-
-        assert (fd == host->fds[nfd]);
+        assert (ufd[nfd].fd == host->fds[nfd]);
 
         if (ufd[nfd].revents == 0)
             continue;
 
-        /* */
-        fd = vlc_accept (fd, NULL, NULL, true);
-        if (fd == -1)
-            continue;
-        setsockopt (fd, SOL_SOCKET, SO_REUSEADDR,
-                &(int){ 1 }, sizeof(int));
-
-        vlc_tls_t *sk = vlc_tls_SocketOpen(fd);
-        if (unlikely(sk == NULL))
-        {
-            vlc_close(fd);
-            continue;
-        }
-
-        if (host->p_tls != NULL)
-        {
-            const char *alpn[] = { "http/1.1", NULL };
-            vlc_tls_t *tls;
-
-            tls = vlc_tls_ServerSessionCreate(host->p_tls, sk, alpn);
-            if (tls == NULL)
-            {
-                vlc_tls_SessionDelete(sk);
-                continue;
-            }
-            sk = tls;
-        }
-
-        cl = httpd_ClientNew(sk, now);
-
-        if (host->p_tls != NULL)
-            cl->i_state = HTTPD_CLIENT_TLS_HS_OUT;
-
-        TAB_APPEND(host->i_client, host->client, cl);
+        httpd_client_t *cl = httpd_HostAccept(w, ufd[nfd].fd, now);
+        if (cl != NULL)
+            TAB_APPEND(w->i_client, w->client, cl);
     }
 
+    vlc_mutex_unlock(&w->lock);
     vlc_restorecancel(canc);
 }
+#endif /* !HTTPD_USE_EPOLL */
 
-static void* httpd_HostThread(void *data)
+static void* httpd_WorkerThread(void *data)
 {
-    httpd_host_t *host = data;
+    httpd_worker_t *w = data;
 
-    vlc_mutex_lock(&host->lock);
-    while (host->i_ref > 0)
-        httpdLoop(host);
-    vlc_mutex_unlock(&host->lock);
+    for (;;)
+        httpdLoop(w);
     return NULL;
 }
 
@@ -23,12 +23,14 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #undef NDEBUG
 #include <assert.h>
 
 #include <vlc_common.h>
 #include <vlc_block.h>
+#include "../../lib/libvlc_internal.h"
 
 static const char text[] =
     "This is a test!\n"
@@ -86,11 +88,132 @@ static void test_block (void)
     //assert (block == NULL);
 }
 
+#define BLOCK_COUNT 5000
+
+/* Cached size classes, sizes around them, and sizes never cached */
+static const size_t sizes[] = {
+    188, 100, 94, 1316, 1000, 1500, 1400, 65536, 40000, 16, 5000, 100000,
+};
+
+static uint8_t pattern(unsigned seq, size_t i)
+{
+    return (seq * 31 + i) % 251;
+}
+
+static block_t *CacheAlloc(unsigned seq)
+{
+    size_t size = sizes[seq % ARRAY_SIZE(sizes)];
+    block_t *block = block_Alloc(size);
+
+    assert(block != NULL);
+    assert(block->i_buffer == size);
+    assert(((uintptr_t)block->p_buffer % 32) == 0);
+    block->i_dts = seq;
+    for (size_t i = 0; i < size; i++)
+        block->p_buffer[i] = pattern(seq, i);
+    return block;
+}
+
+static void CacheCheck(block_t *block, unsigned seq)
+{
+    assert(block->i_dts == (mtime_t)seq);
+    assert(block->i_buffer == sizes[seq % ARRAY_SIZE(sizes)]);
+    for (size_t i = 0; i < block->i_buffer; i++)
+        assert(block->p_buffer[i] == pattern(seq, i));
+}
+
+struct consumer
+{
+    block_fifo_t *fifo;
+    vlc_sem_t released;
+};
+
+/* Releases the blocks in another thread than the allocating one, so that
+ * they go through the depot before they are allocated again */
+static void *Consumer(void *data)
+{
+    struct consumer *c = data;
+
+    for (unsigned seq = 0; seq < BLOCK_COUNT; seq++)
+    {
+        block_t *block = block_FifoGet(c->fifo);
+
+        CacheCheck(block, seq);
+        block_Release(block);
+        vlc_sem_post(&c->released);
+    }
+    return NULL;
+}
+
+static void test_cache_cross_thread(void)
+{
+    struct consumer c;
+    vlc_thread_t th;
+
+    c.fifo = block_FifoNew();
+    assert(c.fifo != NULL);
+    vlc_sem_init(&c.released, 0);
+    assert(vlc_clone(&th, Consumer, &c, VLC_THREAD_PRIORITY_LOW) == 0);
+    for (unsigned seq = 0; seq < BLOCK_COUNT; seq++)
+    {
+        /* Keep few blocks in flight, for them to get recycled */
+        if (seq >= 64)
+            vlc_sem_wait(&c.released);
+        block_FifoPut(c.fifo, CacheAlloc(seq));
+    }
+    vlc_join(th, NULL);
+    vlc_sem_destroy(&c.released);
+    block_FifoRelease(c.fifo);
+}
+
+static void test_cache_same_thread(void)
+{
+    block_t *blocks[256];
+
+    for (unsigned round = 0; round < 4; round++)
+    {
+        for (unsigned seq = 0; seq < ARRAY_SIZE(blocks); seq++)
+            blocks[seq] = CacheAlloc(seq);
+        for (unsigned seq = 0; seq < ARRAY_SIZE(blocks); seq++)
+        {
+            CacheCheck(blocks[seq], seq);
+            block_Release(blocks[seq]);
+        }
+    }
+}
+
+/* Block cache of the size classes of block_Alloc() */
+static void test_cache (void)
+{
+    const char *args[] = { "--ignore-config", "--block-cache=256" };
+
+    setenv ("VLC_PLUGIN_PATH", "../modules", 1);
+    /* Twice, to enable the cache again after it was disabled */
+    for (unsigned i = 0; i < 2; i++)
+    {
+        libvlc_int_t *vlc = libvlc_InternalCreate ();
+        assert (vlc != NULL);
+        assert (libvlc_InternalInit (vlc, ARRAY_SIZE(args), args) == 0);
+
+        test_cache_same_thread ();
+        test_cache_cross_thread ();
+        test_cache_same_thread ();
+
+        /* This thread keeps running: its cached blocks are freed now */
+        libvlc_InternalCleanup (vlc);
+        libvlc_InternalDestroy (vlc);
+    }
+
+    /* Without the cache, blocks go back to the heap */
+    test_cache_same_thread ();
+}
+
 int main (void)
 {
     test_block_File(false);
     test_block_File(true);
     test_block ();
+    test_cache ();
     return 0;
 }
 
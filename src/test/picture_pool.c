@@ -35,31 +35,31 @@
 static video_format_t fmt;
 static picture_pool_t *pool, *reserve;
 
-static void test(bool zombie)
+static void test(unsigned count, bool zombie)
 {
-    picture_t *pics[PICTURES];
+    picture_t *pics[count];
 
-    pool = picture_pool_NewFromFormat(&fmt, PICTURES);
+    pool = picture_pool_NewFromFormat(&fmt, count);
     assert(pool != NULL);
 
-    for (unsigned i = 0; i < PICTURES; i++) {
+    for (unsigned i = 0; i < count; i++) {
         pics[i] = picture_pool_Get(pool);
         assert(pics[i] != NULL);
     }
 
-    for (unsigned i = 0; i < PICTURES; i++)
+    for (unsigned i = 0; i < count; i++)
         assert(picture_pool_Get(pool) == NULL);
 
     // Reserve currently assumes that all pictures are free (or reserved).
     //assert(picture_pool_Reserve(pool, 1) == NULL);
 
-    for (unsigned i = 0; i < PICTURES / 2; i++)
+    for (unsigned i = 0; i < count / 2; i++)
         picture_Hold(pics[i]);
 
-    for (unsigned i = 0; i < PICTURES / 2; i++)
+    for (unsigned i = 0; i < count / 2; i++)
         picture_Release(pics[i]);
 
-    for (unsigned i = 0; i < PICTURES; i++) {
+    for (unsigned i = 0; i < count; i++) {
         void *plane = pics[i]->p[0].p_pixels;
         assert(plane != NULL);
         picture_Release(pics[i]);
@@ -69,43 +69,86 @@ static void test(bool zombie)
         assert(pics[i]->p[0].p_pixels == plane);
     }
 
-    for (unsigned i = 0; i < PICTURES; i++)
+    for (unsigned i = 0; i < count; i++)
         picture_Release(pics[i]);
 
-    for (unsigned i = 0; i < PICTURES; i++) {
+    for (unsigned i = 0; i < count; i++) {
         pics[i] = picture_pool_Wait(pool);
         assert(pics[i] != NULL);
     }
 
-    for (unsigned i = 0; i < PICTURES; i++)
+    for (unsigned i = 0; i < count; i++)
         picture_Release(pics[i]);
 
-    reserve = picture_pool_Reserve(pool, PICTURES / 2);
+    reserve = picture_pool_Reserve(pool, count / 2);
     assert(reserve != NULL);
 
-    for (unsigned i = 0; i < PICTURES / 2; i++) {
+    for (unsigned i = 0; i < count / 2; i++) {
         pics[i] = picture_pool_Get(pool);
         assert(pics[i] != NULL);
     }
 
-    for (unsigned i = PICTURES / 2; i < PICTURES; i++) {
+    for (unsigned i = count / 2; i < count; i++) {
         assert(picture_pool_Get(pool) == NULL);
         pics[i] = picture_pool_Get(reserve);
         assert(pics[i] != NULL);
     }
 
     if (!zombie)
-        for (unsigned i = 0; i < PICTURES; i++)
+        for (unsigned i = 0; i < count; i++)
             picture_Release(pics[i]);
 
     picture_pool_Release(reserve);
     picture_pool_Release(pool);
 
     if (zombie)
-        for (unsigned i = 0; i < PICTURES; i++)
+        for (unsigned i = 0; i < count; i++)
             picture_Release(pics[i]);
 }
 
+static void *WaitThread(void *data)
+{
+    picture_t **pic = data;
+
+    *pic = picture_pool_Wait(pool);
+    return NULL;
+}
+
+static void test_wait(void)
+{
+    picture_t *pics[PICTURES], *pic;
+    vlc_thread_t th;
+
+    pool = picture_pool_NewFromFormat(&fmt, PICTURES);
+    assert(pool != NULL);
+
+    for (unsigned i = 0; i < PICTURES; i++) {
+        pics[i] = picture_pool_Get(pool);
+        assert(pics[i] != NULL);
+    }
+
+    /* A waiting thread is woken up by a released picture */
+    assert(vlc_clone(&th, WaitThread, &pic, VLC_THREAD_PRIORITY_LOW) == 0);
+    msleep(VLC_HARD_MIN_SLEEP);
+    picture_Release(pics[PICTURES - 1]);
+    vlc_join(th, NULL);
+    assert(pic != NULL);
+    pics[PICTURES - 1] = pic;
+
+    /* ...or by cancellation */
+    assert(vlc_clone(&th, WaitThread, &pic, VLC_THREAD_PRIORITY_LOW) == 0);
+    msleep(VLC_HARD_MIN_SLEEP);
+    picture_pool_Cancel(pool, true);
+    vlc_join(th, NULL);
+    assert(pic == NULL);
+    assert(picture_pool_Get(pool) == NULL);
+    picture_pool_Cancel(pool, false);
+
+    for (unsigned i = 0; i < PICTURES; i++)
+        picture_Release(pics[i]);
+    picture_pool_Release(pool);
+}
+
 int main(void)
 {
     video_format_Setup(&fmt, VLC_CODEC_I420, 320, 200, 320, 200, 1, 1);
@@ -120,8 +163,12 @@ int main(void)
     picture_pool_Release(reserve);
     picture_pool_Release(pool);
 
-    test(false);
-    test(true);
+    test(PICTURES, false);
+    test(PICTURES, true);
+    /* Pools larger than the bits of a machine word */
+    test(200, false);
+    test(200, true);
+    test_wait();
 
     return 0;
 }
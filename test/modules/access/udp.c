@@ -0,0 +1,166 @@
+/*****************************************************************************
+ * udp.c: UDP input module test
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <vlc_common.h>
+#include <vlc_access.h>
+#include <vlc_block.h>
+#include "../../../lib/libvlc_internal.h"
+
+#include <vlc/vlc.h>
+
+#define BURST 50   /* datagrams sent before reading */
+#define ROUNDS 20
+#define MTU (7 * 188)
+#define TRUNC_SEQ 123 /* larger than the MTU */
+
+static size_t datagram_size(unsigned seq)
+{
+    return (seq == TRUNC_SEQ) ? 2000 : 1 + (seq * 97) % MTU;
+}
+
+static uint8_t pattern(unsigned seq, size_t i)
+{
+    return (seq * 31 + i) % 251;
+}
+
+static void test_udp(vlc_object_t *obj, unsigned batch)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    socklen_t addrlen = sizeof (addr);
+    char mrl[40];
+    uint8_t buf[2000];
+
+    /* Find a free port for the access to bind */
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(fd != -1);
+    assert(bind(fd, (struct sockaddr *)&addr, sizeof (addr)) == 0);
+    assert(getsockname(fd, (struct sockaddr *)&addr, &addrlen) == 0);
+    close(fd);
+
+#ifdef HAVE_RECVMMSG
+    var_SetInteger(obj, "udp-batch", batch);
+#endif
+    snprintf(mrl, sizeof (mrl), "udp://@127.0.0.1:%u", ntohs(addr.sin_port));
+    stream_t *access = vlc_access_NewMRL(obj, mrl);
+    assert(access != NULL);
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(fd != -1);
+    assert(connect(fd, (struct sockaddr *)&addr, sizeof (addr)) == 0);
+
+    for (unsigned round = 0; round < ROUNDS; round++)
+    {
+        block_t *blocks[BURST];
+
+        for (unsigned i = 0; i < BURST; i++)
+        {
+            unsigned seq = round * BURST + i;
+            size_t size = datagram_size(seq);
+
+            for (size_t j = 0; j < size; j++)
+                buf[j] = pattern(seq, j);
+            assert(send(fd, buf, size, 0) == (ssize_t)size);
+        }
+
+        /* Datagrams come out one block each, in order */
+        for (unsigned i = 0; i < BURST; i++)
+        {
+            unsigned seq = round * BURST + i;
+            block_t *block = vlc_stream_ReadBlock(access);
+
+            assert(block != NULL);
+            assert(block->p_next == NULL);
+            if (seq == TRUNC_SEQ)
+            {
+                assert(block->i_flags & BLOCK_FLAG_CORRUPTED);
+                assert(block->i_buffer == MTU);
+            }
+            else
+            {
+                assert(!(block->i_flags & BLOCK_FLAG_CORRUPTED));
+                assert(block->i_buffer == datagram_size(seq));
+            }
+            for (size_t j = 0; j < block->i_buffer; j++)
+                assert(block->p_buffer[j] == pattern(seq, j));
+            blocks[i] = block;
+        }
+
+        /* Release out of order, as receive buffers may be shared */
+        for (unsigned i = 0; i < BURST; i += 2)
+            block_Release(blocks[i]);
+        for (unsigned i = 1; i < BURST; i += 2)
+            block_Release(blocks[i]);
+    }
+
+#ifdef HAVE_RECVMMSG
+    if (batch > 1)
+    {
+        int64_t datagrams = var_GetInteger(access, "udp-datagrams");
+        int64_t syscalls = var_GetInteger(access, "udp-syscalls");
+
+        printf("batch %u: %"PRId64" datagrams in %"PRId64" calls\n", batch,
+               datagrams, syscalls);
+        assert(datagrams == BURST * ROUNDS);
+        /* Each burst is pending at once, so it takes few calls */
+        assert(syscalls * 4 <= datagrams);
+    }
+#endif
+
+    close(fd);
+    vlc_stream_Delete(access);
+}
+
+int main(void)
+{
+    static const char *const args[] = { "-v" };
+
+    alarm(10);
+    setenv("VLC_PLUGIN_PATH", "../modules", 1);
+
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(args), args);
+    assert(vlc != NULL);
+
+    vlc_object_t *obj = VLC_OBJECT(vlc->p_libvlc_int);
+
+    test_udp(obj, 32);
+    test_udp(obj, 1);
+
+    libvlc_release(vlc);
+    return 0;
+}
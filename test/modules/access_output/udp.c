@@ -0,0 +1,283 @@
+/*****************************************************************************
+ * udp.c: UDP stream output loopback test and benchmark
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_sout.h>
+#include "../../../lib/libvlc_internal.h"
+
+#include <vlc/vlc.h>
+
+#define PACKET_SIZE (7 * 188)
+#define PACKET_COUNT 20000
+#define PACED_RATE 9000 /* packets per second */
+
+#define BURST 32   /* packets due at once */
+#define BURSTS 100
+
+/* Mostly full packets, with shorter ones ending or breaking the runs of
+ * packets of the same size. Two of them never fit in one datagram. */
+static size_t packet_size(unsigned seq)
+{
+    if (seq % 7 == 6)
+        return 1000;
+    if (seq % 11 == 10)
+        return 1200;
+    return PACKET_SIZE;
+}
+
+static uint8_t pattern(unsigned seq, size_t i)
+{
+    return (seq * 31 + i) % 251;
+}
+
+/* Checks that every packet makes one datagram, in order */
+static void test_order(vlc_object_t *obj, const char *access, bool gso)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    socklen_t addrlen = sizeof (addr);
+    struct pollfd ufd = { .events = POLLIN };
+    uint8_t buf[2048];
+    char dst[32];
+
+    ufd.fd = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(ufd.fd != -1);
+    assert(bind(ufd.fd, (struct sockaddr *)&addr, sizeof (addr)) == 0);
+    assert(getsockname(ufd.fd, (struct sockaddr *)&addr, &addrlen) == 0);
+
+    snprintf(dst, sizeof (dst), "127.0.0.1:%u", ntohs(addr.sin_port));
+    sout_access_out_t *out = sout_AccessOutNew(obj, access, dst);
+    assert(out != NULL);
+
+    mtime_t start = mdate() + 50000;
+    unsigned seq = 0, count = 0;
+
+    for (unsigned burst = 0; burst < BURSTS; burst++)
+    {
+        /* Each burst is sent as a batch, while the receiver waits */
+        for (unsigned i = 0; i < BURST; i++, seq++)
+        {
+            size_t size = packet_size(seq);
+            block_t *block = block_Alloc(size);
+
+            assert(block != NULL);
+            for (size_t j = 0; j < size; j++)
+                block->p_buffer[j] = pattern(seq, j);
+            block->i_dts = start + burst * 2000;
+            sout_AccessOutWrite(out, block);
+        }
+
+        /* The last packet stays buffered in the access output until the
+         * next one is written */
+        while (count < seq - 1)
+        {
+            assert(poll(&ufd, 1, 1000) == 1);
+
+            ssize_t val = recv(ufd.fd, buf, sizeof (buf), 0);
+            assert(val == (ssize_t)packet_size(count));
+            for (ssize_t j = 0; j < val; j++)
+                assert(buf[j] == pattern(count, j));
+            count++;
+        }
+    }
+
+    /* The statistics are updated after the datagrams are sent */
+    int64_t datagrams;
+    while ((datagrams = var_GetInteger(out, "udp-datagrams")) < count)
+        poll(NULL, 0, 10);
+    int64_t segmented = var_GetInteger(out, "udp-gso-datagrams");
+
+    printf("%-32s %6u datagrams, %6"PRId64" segmented by the kernel\n",
+           access, count, segmented);
+    assert(datagrams == count);
+    if (!gso)
+        assert(segmented == 0);
+    else if (segmented == 0)
+        printf("segmentation offload not available, skipped\n");
+    else /* all but the packets alone between two different sizes */
+        assert(segmented * 4 >= datagrams * 3);
+
+    sout_AccessOutDelete(out);
+    assert(poll(&ufd, 1, 100) == 0);
+    close(ufd.fd);
+}
+
+struct receiver
+{
+    int fd;
+    unsigned count;
+    mtime_t *dates;
+};
+
+static void *Receive(void *data)
+{
+    struct receiver *rx = data;
+    struct pollfd ufd = { .fd = rx->fd, .events = POLLIN };
+    char buf[2048];
+
+    while (rx->count < PACKET_COUNT && poll(&ufd, 1, 1000) > 0)
+    {
+        if (recv(rx->fd, buf, sizeof (buf), 0) != PACKET_SIZE)
+            continue;
+        rx->dates[rx->count++] = mdate();
+    }
+    return NULL;
+}
+
+static void bench(vlc_object_t *obj, const char *access, mtime_t period)
+{
+    struct receiver rx;
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    socklen_t addrlen = sizeof (addr);
+    int bufsize = 32 << 20;
+    char dst[32];
+    vlc_thread_t th;
+
+    rx.fd = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(rx.fd != -1);
+    setsockopt(rx.fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof (bufsize));
+    assert(bind(rx.fd, (struct sockaddr *)&addr, sizeof (addr)) == 0);
+    assert(getsockname(rx.fd, (struct sockaddr *)&addr, &addrlen) == 0);
+    rx.count = 0;
+    rx.dates = malloc(PACKET_COUNT * sizeof (*rx.dates));
+    assert(rx.dates != NULL);
+
+    snprintf(dst, sizeof (dst), "127.0.0.1:%u", ntohs(addr.sin_port));
+    sout_access_out_t *out = sout_AccessOutNew(obj, access, dst);
+    assert(out != NULL);
+    assert(vlc_clone(&th, Receive, &rx, VLC_THREAD_PRIORITY_LOW) == 0);
+
+    mtime_t start = mdate() + 100000;
+
+    for (unsigned i = 0; i < PACKET_COUNT; i++)
+    {
+        block_t *block = block_Alloc(PACKET_SIZE);
+        assert(block != NULL);
+        memset(block->p_buffer, i, PACKET_SIZE);
+        block->i_dts = start + i * period;
+        sout_AccessOutWrite(out, block);
+    }
+
+    vlc_join(th, NULL);
+    sout_AccessOutDelete(out);
+    close(rx.fd);
+
+    /* The last packet stays buffered in the access output until closed */
+    assert(rx.count > 0);
+
+    double duration = (rx.dates[rx.count - 1] - rx.dates[0]) / 1e6;
+    double jitter = 0.;
+    mtime_t jitter_max = 0;
+
+    for (unsigned i = 1; i < rx.count; i++)
+    {
+        mtime_t delta = rx.dates[i] - rx.dates[i - 1] - period;
+
+        if (delta < 0)
+            delta = -delta;
+        jitter += delta;
+        if (delta > jitter_max)
+            jitter_max = delta;
+    }
+    if (rx.count > 1)
+        jitter /= rx.count - 1;
+
+    printf("%-46s %6u pkts %10.0f pkts/s jitter avg %7.1f us max %6"PRId64
+           " us\n", access, rx.count,
+           duration > 0. ? (rx.count - 1) / duration : 0., jitter,
+           jitter_max);
+    free(rx.dates);
+}
+
+static const struct
+{
+    const char *access;
+    bool gso;
+} tests[] = {
+    { "udp{caching=0,batch=1}", false },
+    { "udp{caching=0,batch=32,no-gso}", false },
+    { "udp{caching=0,batch=32}", true },
+    { "udp{caching=0,batch=64}", true },
+};
+
+static const char *const accesses[] = {
+    "udp{caching=0,batch=1}",
+    "udp{caching=0,batch=32,no-gso}",
+    "udp{caching=0,batch=32}",
+    "udp{caching=0,batch=32,batch-window=1,no-gso}",
+};
+
+int main(int argc, char **argv)
+{
+    libvlc_instance_t *vlc;
+    vlc_object_t *obj;
+
+    alarm(30);
+    setenv("VLC_PLUGIN_PATH", "../modules", 1);
+
+    vlc = libvlc_new(0, NULL);
+    assert(vlc != NULL);
+    obj = VLC_OBJECT(vlc->p_libvlc_int);
+
+    for (size_t i = 0; i < ARRAY_SIZE(tests); i++)
+        test_order(obj, tests[i].access, tests[i].gso);
+
+    /* The benchmark takes a while */
+    if (argc < 2 || strcmp(argv[1], "bench"))
+    {
+        libvlc_release(vlc);
+        return 0;
+    }
+    alarm(0);
+
+    puts("Unpaced:");
+    for (size_t i = 0; i < ARRAY_SIZE(accesses); i++)
+        bench(obj, accesses[i], 0);
+
+    printf("Paced at %u packets/s:\n", PACED_RATE);
+    for (size_t i = 0; i < ARRAY_SIZE(accesses); i++)
+        bench(obj, accesses[i], CLOCK_FREQ / PACED_RATE);
+
+    libvlc_release(vlc);
+    return 0;
+}
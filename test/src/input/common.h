@@ -37,6 +37,12 @@ struct vlc_run_args
 
     /* true to test demux controls */
     bool test_demux_controls;
+
+    /* true to only run the packetizers (if built with decoders) */
+    bool packetize_only;
+
+    /* filled with the statistics of the run if not NULL */
+    struct vlc_demux_stats *stats;
 };
 
 void vlc_run_args_init(struct vlc_run_args *args);
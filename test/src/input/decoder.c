@@ -34,7 +34,7 @@
 #include <vlc_url.h>
 
 #include <vlc/libvlc.h>
-#include "../../lib/libvlc_internal.h"
+#include "../lib/libvlc_internal.h"
 
 #include "common.h"
 #include "decoder.h"
@@ -143,7 +143,8 @@ void test_decoder_destroy(decoder_t *decoder)
     vlc_object_release(decoder);
 }
 
-decoder_t *test_decoder_create(vlc_object_t *parent, const es_format_t *fmt)
+decoder_t *test_decoder_create(vlc_object_t *parent, const es_format_t *fmt,
+                               bool packetize_only)
 {
     assert(parent && fmt);
     decoder_t *packetizer = NULL;
@@ -171,7 +172,10 @@ decoder_t *test_decoder_create(vlc_object_t *parent, const es_format_t *fmt)
     if (decoder_load(packetizer, true, fmt) != VLC_SUCCESS)
         goto end;
 
-    if (decoder_load(decoder, false, &packetizer->fmt_out) != VLC_SUCCESS)
+    /* The decoder is left unloaded to only run the packetizer */
+    decoder->p_module = NULL;
+    if (!packetize_only
+     && decoder_load(decoder, false, &packetizer->fmt_out) != VLC_SUCCESS)
         goto end;
 
     return decoder;
@@ -186,7 +190,7 @@ int test_decoder_process(decoder_t *decoder, block_t *p_block)
     decoder_t *packetizer = (void *) decoder->p_owner;
 
     /* This case can happen if a decoder reload failed */
-    if (decoder->p_module == NULL)
+    if (packetizer->p_module == NULL)
     {
         if (p_block != NULL)
             block_Release(p_block);
@@ -198,6 +202,11 @@ int test_decoder_process(decoder_t *decoder, block_t *p_block)
     while ((p_packetized_block =
                 packetizer->pf_packetize(packetizer, pp_block)))
     {
+        if (decoder->p_module == NULL)
+        {
+            block_ChainRelease(p_packetized_block);
+            continue;
+        }
 
         if (!es_format_IsSimilar(&decoder->fmt_in, &packetizer->fmt_out))
         {
@@ -240,7 +249,7 @@ int test_decoder_process(decoder_t *decoder, block_t *p_block)
             p_packetized_block = p_next;
         }
     }
-    if (p_block == NULL) /* Drain */
+    if (p_block == NULL && decoder->p_module != NULL) /* Drain */
         decoder->pf_decode(decoder, NULL);
     return VLC_SUCCESS;
 }
@@ -41,6 +41,7 @@
 #include <vlc_input.h>
 #include <vlc_meta.h>
 #include <vlc_es_out.h>
+#include <vlc_modules.h>
 #include <vlc_url.h>
 #include "../lib/libvlc_internal.h"
 
@@ -53,6 +54,9 @@ struct test_es_out_t
 {
     struct es_out_t out;
     struct es_out_id_t *ids;
+    bool packetize_only;
+    uint64_t blocks;
+    uint64_t bytes;
 };
 
 struct es_out_id_t
@@ -77,7 +81,8 @@ static es_out_id_t *EsOutAdd(es_out_t *out, const es_format_t *fmt)
     id->next = ctx->ids;
     ctx->ids = id;
 #ifdef HAVE_DECODERS
-    id->decoder = test_decoder_create((void *)out->p_sys, fmt);
+    id->decoder = test_decoder_create((void *)out->p_sys, fmt,
+                                      ctx->packetize_only);
 #endif
 
     debug("[%p] Added   ES\n", (void *)id);
@@ -97,8 +102,12 @@ static void EsOutCheckId(es_out_t *out, es_out_id_t *id)
 
 static int EsOutSend(es_out_t *out, es_out_id_t *id, block_t *block)
 {
+    struct test_es_out_t *ctx = (struct test_es_out_t *) out;
+
     //debug("[%p] Sent    ES: %zu\n", (void *)idd, block->i_buffer);
     EsOutCheckId(out, id);
+    ctx->blocks++;
+    ctx->bytes += block->i_buffer;
 #ifdef HAVE_DECODERS
     if (id->decoder)
         test_decoder_process(id->decoder, block);
@@ -194,7 +203,8 @@ static void EsOutDestroy(es_out_t *out)
     free(ctx);
 }
 
-static es_out_t *test_es_out_create(vlc_object_t *parent)
+static es_out_t *test_es_out_create(vlc_object_t *parent,
+                                    const struct vlc_run_args *args)
 {
     struct test_es_out_t *ctx = malloc(sizeof (*ctx));
     if (ctx == NULL)
@@ -204,6 +214,9 @@ static es_out_t *test_es_out_create(vlc_object_t *parent)
     }
 
     ctx->ids = NULL;
+    ctx->packetize_only = args->packetize_only;
+    ctx->blocks = 0;
+    ctx->bytes = 0;
 
     es_out_t *out = &ctx->out;
     out->pf_add = EsOutAdd;
@@ -265,10 +278,11 @@ static int demux_process_stream(const struct vlc_run_args *args, stream_t *s)
     if (s == NULL)
         return -1;
 
-    es_out_t *out = test_es_out_create(VLC_OBJECT(s));
+    es_out_t *out = test_es_out_create(VLC_OBJECT(s), args);
     if (out == NULL)
         return -1;
 
+    mtime_t start = mdate();
     demux_t *demux = demux_New(VLC_OBJECT(s), name, "", s, out);
     if (demux == NULL)
     {
@@ -305,7 +319,22 @@ static int demux_process_stream(const struct vlc_run_args *args, stream_t *s)
         i++;
     }
 
+    struct vlc_demux_stats *stats = args->stats;
+    if (stats != NULL)
+    {
+        struct test_es_out_t *ctx = (struct test_es_out_t *) out;
+        int64_t size = stream_Size(s);
+
+        strlcpy(stats->module, module_get_object(demux->p_module),
+                sizeof (stats->module));
+        stats->size = size > 0 ? size : 0;
+        stats->es_blocks = ctx->blocks;
+        stats->es_bytes = ctx->bytes;
+    }
+
     demux_Delete(demux);
+    if (stats != NULL)
+        stats->duration = mdate() - start;
     es_out_Delete(out);
 
     debug("Completed with %ju iteration(s).\n", i);
@@ -26,6 +26,15 @@
 
 #include "common.h"
 
+struct vlc_demux_stats
+{
+    char module[32]; /* demux module that was probed */
+    uint64_t size; /* size of the input stream, in bytes */
+    uint64_t es_blocks; /* blocks sent by the demux */
+    uint64_t es_bytes;
+    int64_t duration; /* from the demux creation to its deletion, in us */
+};
+
 int vlc_demux_process_url(const struct vlc_run_args *, const char *url);
 int vlc_demux_process_path(const struct vlc_run_args *, const char *path);
 int vlc_demux_process_memory(const struct vlc_run_args *,
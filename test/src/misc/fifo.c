@@ -0,0 +1,162 @@
+/*****************************************************************************
+ * fifo.c test block FIFOs
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "../../libvlc/test.h"
+#include <vlc_common.h>
+#include <vlc_block.h>
+
+/* Kept small for make check, set FIFO_BENCH_COUNT to actually benchmark */
+static unsigned bench_count = 10000;
+
+static void test_basic(block_fifo_t *fifo)
+{
+    block_t *chain = NULL, **pp = &chain;
+
+    assert(vlc_fifo_IsEmpty(fifo));
+
+    /* Enough blocks to span several internal segments */
+    for (unsigned i = 0; i < 1000; i++)
+    {
+        block_t *block = block_Alloc(i);
+        assert(block != NULL);
+        block->i_dts = i;
+        block_FifoPut(fifo, block);
+
+        block = block_Alloc(1);
+        assert(block != NULL);
+        *pp = block;
+        pp = &block->p_next;
+    }
+    assert(vlc_fifo_GetCount(fifo) == 1000);
+    assert(vlc_fifo_GetBytes(fifo) == 999 * 1000 / 2);
+    assert(block_FifoShow(fifo)->i_dts == 0);
+
+    for (unsigned i = 0; i < 500; i++)
+    {
+        block_t *block = block_FifoGet(fifo);
+        assert(block->i_dts == i && block->i_buffer == i);
+        assert(block->p_next == NULL);
+        block_Release(block);
+    }
+
+    vlc_fifo_Lock(fifo);
+    vlc_fifo_QueueUnlocked(fifo, chain);
+    assert(vlc_fifo_GetCount(fifo) == 1500);
+    assert(vlc_fifo_GetBytes(fifo) == 1000 + (500 + 999) * 500 / 2);
+    block_t *block = vlc_fifo_DequeueUnlocked(fifo);
+    assert(block->i_dts == 500);
+    block_Release(block);
+    chain = vlc_fifo_DequeueAllUnlocked(fifo);
+    assert(vlc_fifo_IsEmpty(fifo));
+    assert(vlc_fifo_GetBytes(fifo) == 0);
+    assert(vlc_fifo_DequeueUnlocked(fifo) == NULL);
+    vlc_fifo_Unlock(fifo);
+
+    unsigned count = 0;
+    for (block = chain; block != NULL; block = block->p_next)
+        count++;
+    assert(count == 1499);
+    block_ChainRelease(chain);
+
+    /* Leftover blocks are released with the FIFO */
+    block_FifoPut(fifo, block_Alloc(16));
+}
+
+/* Blocks are recycled through a second FIFO, as few as a real pipeline
+ * has in flight, so that the benchmark does not measure the allocator */
+#define BENCH_POOL 64
+
+struct bench
+{
+    block_fifo_t *fifo;
+    block_fifo_t *pool;
+};
+
+static void *Consumer(void *data)
+{
+    struct bench *b = data;
+
+    for (unsigned i = 0; i < bench_count; i++)
+    {
+        block_t *block = block_FifoGet(b->fifo);
+        assert(block->i_dts == i);
+        block_FifoPut(b->pool, block);
+    }
+    return NULL;
+}
+
+static void bench(const char *name, block_fifo_t *(*create)(void))
+{
+    struct bench b = { create(), create() };
+    vlc_thread_t th;
+
+    assert(b.fifo != NULL && b.pool != NULL);
+    for (unsigned i = 0; i < BENCH_POOL; i++)
+    {
+        block_t *block = block_Alloc(188);
+        assert(block != NULL);
+        block_FifoPut(b.pool, block);
+    }
+
+    mtime_t start = mdate();
+
+    assert(vlc_clone(&th, Consumer, &b, VLC_THREAD_PRIORITY_LOW) == 0);
+    for (unsigned i = 0; i < bench_count; i++)
+    {
+        block_t *block = block_FifoGet(b.pool);
+        block->i_dts = i;
+        block_FifoPut(b.fifo, block);
+    }
+    vlc_join(th, NULL);
+
+    mtime_t duration = mdate() - start;
+
+    printf("%-6s %6.1f ns/block\n", name, duration * 1000. / bench_count);
+    assert(vlc_fifo_IsEmpty(b.fifo));
+    assert(vlc_fifo_GetCount(b.pool) == BENCH_POOL);
+    block_FifoRelease(b.fifo);
+    block_FifoRelease(b.pool);
+}
+
+int main(void)
+{
+    block_fifo_t *fifo;
+    const char *count = getenv("FIFO_BENCH_COUNT");
+
+    test_init();
+
+    if (count != NULL && atoi(count) > 0)
+        bench_count = atoi(count);
+
+    fifo = block_FifoNew();
+    assert(fifo != NULL);
+    test_basic(fifo);
+    block_FifoRelease(fifo);
+
+    fifo = block_FifoNewSPSC();
+    assert(fifo != NULL);
+    test_basic(fifo);
+    block_FifoRelease(fifo);
+
+    bench("mutex", block_FifoNew);
+    bench("SPSC", block_FifoNewSPSC);
+
+    return 0;
+}
@@ -0,0 +1,156 @@
+/*****************************************************************************
+ * messages.c: test log messages delivery
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "../../libvlc/test.h"
+#include "../../../lib/libvlc_internal.h"
+
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include <vlc_common.h>
+#include <vlc_atomic.h>
+
+#define THREADS 4
+#define MESSAGES 50000
+#define TARGET_NS 200 /* asynchronous cost per message */
+
+const char vlc_module_name[] = "test";
+
+static atomic_uint received;
+static atomic_uint dropped;
+
+static void Log(void *data, int level, const libvlc_log_t *ctx,
+                const char *fmt, va_list ap)
+{
+    const char *type;
+    char *str;
+
+    libvlc_log_get_object(ctx, &type, NULL, NULL);
+    if (vasprintf(&str, fmt, ap) == -1)
+        abort();
+
+    if (strncmp(str, "test message ", 13) == 0)
+    {
+        const char *module;
+        unsigned line;
+
+        libvlc_log_get_context(ctx, &module, NULL, &line);
+        assert(level == LIBVLC_DEBUG);
+        assert(module != NULL && !strcmp(module, "test"));
+        assert(line > 0);
+        atomic_fetch_add(&received, 1);
+    }
+    else
+    {
+        unsigned count;
+
+        if (!strcmp(type, "logger")
+         && sscanf(str, "%u log message(s) dropped", &count) == 1)
+            atomic_fetch_add(&dropped, count);
+    }
+    free(str);
+    (void) data;
+}
+
+/* Time spent by the calling thread, not preempted by the others */
+static mtime_t ThreadTime(void)
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        return ts.tv_sec * CLOCK_FREQ + ts.tv_nsec / (1000000000 / CLOCK_FREQ);
+#endif
+    return mdate();
+}
+
+static void *Emit(void *data)
+{
+    vlc_object_t *obj = data;
+    mtime_t start = ThreadTime();
+
+    for (unsigned i = 0; i < MESSAGES; i++)
+        msg_Dbg(obj, "test message %u from %p", i, (void *)&i);
+
+    return (void *)(uintptr_t)(ThreadTime() - start);
+}
+
+static double test(const char *name, bool async)
+{
+    const char *args[] = {
+        "-vvv", "--ignore-config", "--no-media-library",
+        async ? "--log-async" : "--no-log-async",
+    };
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(args), args);
+    vlc_object_t *obj;
+    vlc_thread_t th[THREADS];
+    mtime_t total = 0;
+
+    assert(vlc != NULL);
+    obj = VLC_OBJECT(vlc->p_libvlc_int);
+    atomic_init(&received, 0);
+    atomic_init(&dropped, 0);
+    libvlc_log_set(vlc, Log, NULL);
+
+    for (unsigned i = 0; i < THREADS; i++)
+        assert(vlc_clone(&th[i], Emit, obj, VLC_THREAD_PRIORITY_LOW) == 0);
+    for (unsigned i = 0; i < THREADS; i++)
+    {
+        void *duration;
+
+        vlc_join(th[i], &duration);
+        total += (uintptr_t)duration;
+    }
+
+    /* Unsetting the callback flushes the pending messages */
+    libvlc_log_unset(vlc);
+
+    unsigned count = atomic_load(&received);
+    unsigned lost = atomic_load(&dropped);
+    double ns = total * 1000. / (THREADS * MESSAGES);
+
+    printf("%-5s %6.1f ns/message, %u received, %u dropped\n", name, ns,
+           count, lost);
+    assert(count <= THREADS * MESSAGES);
+    if (async)
+        assert(count + lost >= THREADS * MESSAGES);
+    else
+        assert(count == THREADS * MESSAGES);
+
+    libvlc_release(vlc);
+    return ns;
+}
+
+int main(void)
+{
+    test_init();
+
+    test("sync", false);
+
+    double ns = test("async", true);
+    if (ns > TARGET_NS)
+    {   /* Slow or instrumented builds cannot tell about the logger */
+        fprintf(stderr, "SKIP: asynchronous logging takes %.1f ns/message, "
+                "above the %u ns target\n", ns, TARGET_NS);
+        return 77;
+    }
+    return 0;
+}
@@ -443,6 +443,140 @@ static void test_creation_and_type( libvlc_int_t *p_libvlc )
     assert( var_Get( p_libvlc, "bla", &val ) == VLC_ENOVAR );
 }
 
+static void test_many( libvlc_int_t *p_libvlc )
+{
+    char name[16];
+
+    for( unsigned i = 0; i < 1000; i++ )
+    {
+        sprintf( name, "var%u", i );
+        var_Create( p_libvlc, name, VLC_VAR_INTEGER );
+        var_SetInteger( p_libvlc, name, i );
+    }
+
+    /* Destroy every third variable, in both directions */
+    for( unsigned i = 0; i < 1000; i += 6 )
+    {
+        sprintf( name, "var%u", i );
+        var_Destroy( p_libvlc, name );
+        sprintf( name, "var%u", 999 - i );
+        var_Destroy( p_libvlc, name );
+    }
+
+    for( unsigned i = 0; i < 1000; i++ )
+    {
+        bool destroyed = (i % 6) == 0 || ((999 - i) % 6) == 0;
+
+        sprintf( name, "var%u", i );
+        if( destroyed )
+            assert( var_Type( p_libvlc, name ) == 0 );
+        else
+        {
+            assert( var_GetInteger( p_libvlc, name ) == i );
+            var_Destroy( p_libvlc, name );
+        }
+    }
+
+    for( unsigned i = 0; i < 1000; i++ )
+    {
+        sprintf( name, "var%u", i );
+        assert( var_Type( p_libvlc, name ) == 0 );
+    }
+}
+
+#define CHAIN_DEPTH 8
+
+static void test_inherit( libvlc_int_t *p_libvlc )
+{
+    vlc_object_t *chain[CHAIN_DEPTH];
+    vlc_object_t *parent = VLC_OBJECT(p_libvlc);
+
+    for( unsigned i = 0; i < CHAIN_DEPTH; i++ )
+    {
+        chain[i] = vlc_object_create( parent, sizeof( *chain[i] ) );
+        assert( chain[i] != NULL );
+        parent = chain[i];
+    }
+
+    vlc_object_t *leaf = chain[CHAIN_DEPTH - 1];
+
+    /* From the configuration */
+    int64_t mtu = var_InheritInteger( leaf, "mtu" );
+    assert( var_InheritInteger( leaf, "mtu" ) == mtu );
+    config_PutInt( p_libvlc, "mtu", mtu + 1 );
+    assert( var_InheritInteger( leaf, "mtu" ) == mtu + 1 );
+
+    /* From a variable, created afterwards, then changed */
+    var_Create( p_libvlc, "mtu", VLC_VAR_INTEGER );
+    var_SetInteger( p_libvlc, "mtu", 1 );
+    assert( var_InheritInteger( leaf, "mtu" ) == 1 );
+    var_SetInteger( p_libvlc, "mtu", 2 );
+    assert( var_InheritInteger( leaf, "mtu" ) == 2 );
+
+    /* From a closer variable */
+    var_Create( chain[2], "mtu", VLC_VAR_INTEGER );
+    var_SetInteger( chain[2], "mtu", 3 );
+    assert( var_InheritInteger( leaf, "mtu" ) == 3 );
+    var_Destroy( chain[2], "mtu" );
+    assert( var_InheritInteger( leaf, "mtu" ) == 2 );
+    var_Destroy( p_libvlc, "mtu" );
+    assert( var_InheritInteger( leaf, "mtu" ) == mtu + 1 );
+    config_PutInt( p_libvlc, "mtu", mtu );
+    assert( var_InheritInteger( leaf, "mtu" ) == mtu );
+
+    /* Strings are duplicated */
+    var_Create( chain[0], "bla", VLC_VAR_STRING );
+    var_SetString( chain[0], "bla", "foo" );
+    for( unsigned i = 0; i < 2; i++ )
+    {
+        char *str = var_InheritString( leaf, "bla" );
+        assert( str != NULL && !strcmp( str, "foo" ) );
+        free( str );
+    }
+    var_Destroy( chain[0], "bla" );
+
+    /* Microbenchmarks */
+    enum { N = 1000000 };
+    char name[16];
+    int64_t sum = 0;
+
+    for( unsigned i = 0; i < 64; i++ )
+    {
+        sprintf( name, "bench%u", i );
+        var_Create( p_libvlc, name, VLC_VAR_INTEGER );
+    }
+
+    mtime_t start = mdate();
+    for( unsigned i = 0; i < N; i++ )
+        sum += var_GetInteger( p_libvlc, "bench42" );
+    mtime_t get = mdate() - start;
+
+    start = mdate();
+    for( unsigned i = 0; i < N; i++ )
+        sum += var_InheritInteger( leaf, "bench42" );
+    mtime_t inherit = mdate() - start;
+
+    start = mdate();
+    for( unsigned i = 0; i < N; i++ )
+        sum += var_InheritInteger( leaf, "mtu" );
+    mtime_t config = mdate() - start;
+    assert( sum == (int64_t)N * mtu );
+
+    printf( "var_GetInteger:                %5.1f ns/call\n"
+            "var_InheritInteger (variable): %5.1f ns/call\n"
+            "var_InheritInteger (config):   %5.1f ns/call\n",
+            get * 1000. / N, inherit * 1000. / N, config * 1000. / N );
+
+    for( unsigned i = 0; i < 64; i++ )
+    {
+        sprintf( name, "bench%u", i );
+        var_Destroy( p_libvlc, name );
+    }
+
+    for( unsigned i = CHAIN_DEPTH; i > 0; i-- )
+        vlc_object_release( chain[i - 1] );
+}
+
 static void test_variables( libvlc_instance_t *p_vlc )
 {
     libvlc_int_t *p_libvlc = p_vlc->p_libvlc_int;
@@ -480,6 +614,12 @@ static void test_variables( libvlc_instance_t *p_vlc )
 
     log( "Testing type at creation\n" );
     test_creation_and_type( p_libvlc );
+
+    log( "Testing many variables\n" );
+    test_many( p_libvlc );
+
+    log( "Testing inheritance\n" );
+    test_inherit( p_libvlc );
 }
 
 
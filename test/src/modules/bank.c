@@ -0,0 +1,160 @@
+/*****************************************************************************
+ * bank.c: module bank capability lookup test and start-up benchmark
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_modules.h>
+#include "../../../lib/libvlc_internal.h"
+
+#include <vlc/vlc.h>
+
+#define RUNS 20
+
+static ssize_t candidates;
+
+static void log_cb(void *data, int level, const libvlc_log_t *ctx,
+                   const char *fmt, va_list ap)
+{
+    static const char match[] = "module matching \"none\": ";
+    char msg[256];
+    const char *p;
+
+    vsnprintf(msg, sizeof (msg), fmt, ap);
+    p = strstr(msg, match);
+    if (p != NULL)
+        candidates = strtol(p + strlen(match), NULL, 10);
+    (void) data; (void) level; (void) ctx;
+}
+
+/* Returns how many modules the bank lists for a capability. Nothing gets
+ * loaded as the "none" module is requested. */
+static ssize_t lookup(vlc_object_t *obj, const char *capability)
+{
+    candidates = -1;
+    assert(module_need(obj, capability, "none", false) == NULL);
+    assert(candidates >= 0);
+    return candidates;
+}
+
+static void test_lookup(void)
+{
+    static const char *const args[] = { "--ignore-config" };
+    static const char *const unknown[] = {
+        "", "x", "no-such-capability", "decoders", "DECODER", "decoder ",
+        "access_demux2", "video output", "capability-with-a-rather-long-name",
+    };
+
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(args), args);
+    assert(vlc != NULL);
+    libvlc_log_set(vlc, log_cb, NULL);
+
+    vlc_object_t *obj = VLC_OBJECT(vlc->p_libvlc_int);
+    size_t count;
+    module_t **list = module_list_get(&count);
+    assert(list != NULL && count > 0);
+
+    /* Every capability finds all of its modules */
+    for (size_t i = 0; i < count; i++)
+    {
+        const char *cap = module_get_capability(list[i]);
+        ssize_t n = 0;
+
+        for (size_t j = 0; j < count; j++)
+            if (!strcmp(module_get_capability(list[j]), cap))
+                n++;
+        assert(lookup(obj, cap) == n);
+    }
+    module_list_free(list);
+
+    /* Unknown capabilities find nothing, whichever bucket they hash to */
+    for (size_t i = 0; i < ARRAY_SIZE(unknown); i++)
+        assert(lookup(obj, unknown[i]) == 0);
+    for (unsigned i = 0; i < 1000; i++)
+    {
+        char name[24];
+
+        snprintf(name, sizeof (name), "unknown-%u", i);
+        assert(lookup(obj, name) == 0);
+    }
+
+    libvlc_log_unset(vlc);
+    libvlc_release(vlc);
+}
+
+/* Creates and destroys RUNS instances, returns the average time. */
+static mtime_t bench(int argc, const char *const *argv)
+{
+    mtime_t start = mdate();
+
+    for (unsigned i = 0; i < RUNS; i++)
+    {
+        libvlc_instance_t *vlc = libvlc_new(argc, argv);
+        assert(vlc != NULL);
+        libvlc_release(vlc);
+    }
+    return (mdate() - start) / RUNS;
+}
+
+static void run(const char *name, int argc, const char *const *argv)
+{
+    /* Cold: the module bank is built from the plugins cache every time */
+    mtime_t cold = bench(argc, argv);
+
+    /* Warm: the module bank is kept alive by another instance */
+    libvlc_instance_t *vlc = libvlc_new(argc, argv);
+    assert(vlc != NULL);
+
+    mtime_t warm = bench(argc, argv);
+    size_t count;
+
+    module_list_free(module_list_get(&count));
+    libvlc_release(vlc);
+
+    printf("%-10s %4zu modules: cold %6"PRId64" us, warm %6"PRId64" us\n",
+           name, count, cold, warm);
+}
+
+int main(void)
+{
+    static const char *const scan[] = { "--ignore-config" };
+    static const char *const noscan[] = {
+        "--ignore-config", "--no-plugins-scan"
+    };
+
+    setenv("VLC_PLUGIN_PATH", "../modules", 1);
+
+    /* Discard the first run, which pays for faulting the files in */
+    libvlc_release(libvlc_new(ARRAY_SIZE(scan), scan));
+
+    test_lookup();
+
+    run("scan", ARRAY_SIZE(scan), scan);
+    run("cache-only", ARRAY_SIZE(noscan), noscan);
+    return 0;
+}
@@ -0,0 +1,313 @@
+/*****************************************************************************
+ * httpd.c: HTTP stream server loopback load test
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "../../libvlc/test.h"
+#include <errno.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_httpd.h>
+#include "../../../lib/libvlc_internal.h"
+
+#define BLOCK_SIZE 1316
+#define BLOCK_COUNT 500
+#define BLOCK_PERIOD 1000 /* microseconds */
+
+static const char header[] = "STREAM-HEADER";
+
+/* Block payload is a pure function of its sequence number */
+static uint8_t pattern(uint32_t seq, size_t i)
+{
+    return (seq * 31 + i) % 251;
+}
+
+struct client
+{
+    int fd;
+    size_t got;             /* bytes received so far, including headers */
+    size_t body;            /* offset of the body, or 0 if not seen yet */
+    uint8_t block[BLOCK_SIZE];
+    size_t fill;
+    int64_t last_seq;
+    unsigned blocks;
+    char head[512];
+};
+
+static void client_Parse(struct client *c, const uint8_t *buf, size_t len)
+{
+    while (len > 0)
+    {
+        if (c->body == 0)
+        {   /* HTTP headers, then the stream header */
+            size_t n = __MIN(len, sizeof (c->head) - 1 - c->got);
+
+            assert(n > 0);
+            memcpy(c->head + c->got, buf, n);
+            c->got += n;
+            c->head[c->got] = '\0';
+
+            const char *end = strstr(c->head, "\r\n\r\n");
+            if (end == NULL
+             || c->got < (size_t)(end + 4 - c->head) + strlen(header))
+            {
+                len -= n;
+                buf += n;
+                continue;
+            }
+            assert(!strncmp(c->head, "HTTP/1.0 200 ", 13));
+            end += 4;
+            assert(!memcmp(end, header, strlen(header)));
+            c->body = end + strlen(header) - c->head;
+
+            /* Rewind the input to the start of the body */
+            size_t extra = c->got - c->body;
+            buf += n - extra;
+            len -= n - extra;
+            c->got = c->body;
+            continue;
+        }
+
+        size_t n = __MIN(len, BLOCK_SIZE - c->fill);
+
+        memcpy(c->block + c->fill, buf, n);
+        c->fill += n;
+        c->got += n;
+        buf += n;
+        len -= n;
+
+        if (c->fill < BLOCK_SIZE)
+            continue;
+
+        /* Check that a whole block was received unaltered */
+        uint32_t seq;
+
+        memcpy(&seq, c->block, sizeof (seq));
+        for (size_t i = sizeof (seq); i < BLOCK_SIZE; i++)
+            assert(c->block[i] == pattern(seq, i));
+        /* Clients connected before the stream started get everything */
+        assert(seq == c->last_seq + 1);
+        c->last_seq = seq;
+        c->blocks++;
+        c->fill = 0;
+    }
+}
+
+struct feeder
+{
+    httpd_stream_t *stream;
+    unsigned count;
+};
+
+static void *Feed(void *data)
+{
+    struct feeder *f = data;
+    mtime_t deadline = mdate();
+
+    for (uint32_t seq = 0; seq < f->count; seq++)
+    {
+        block_t *block = block_Alloc(BLOCK_SIZE);
+
+        assert(block != NULL);
+        memcpy(block->p_buffer, &seq, sizeof (seq));
+        for (size_t i = sizeof (seq); i < BLOCK_SIZE; i++)
+            block->p_buffer[i] = pattern(seq, i);
+
+        httpd_StreamSend(f->stream, block);
+        block_Release(block);
+
+        deadline += BLOCK_PERIOD;
+        mwait(deadline);
+    }
+    return NULL;
+}
+
+/* Finds a free port for the HTTP host to listen on */
+static unsigned GetFreePort(void)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    socklen_t len = sizeof (addr);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    assert(fd != -1);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof (addr))
+     || getsockname(fd, (struct sockaddr *)&addr, &len))
+    {
+        perror("bind");
+        abort();
+    }
+    close(fd);
+    return ntohs(addr.sin_port);
+}
+
+static int client_Connect(unsigned port)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    static const char req[] = "GET /stream HTTP/1.0\r\n\r\n";
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    assert(fd != -1);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof (addr)))
+    {
+        perror("connect");
+        abort();
+    }
+    assert(send(fd, req, strlen(req), 0) == (ssize_t)strlen(req));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+/* Usage: test_src_network_httpd [clients] */
+int main(int argc, char *argv[])
+{
+    unsigned n = (argc > 1) ? strtoul(argv[1], NULL, 0) : 100;
+    struct rlimit lim;
+
+    /* Raise the file descriptors limit for thousands of connections */
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0)
+    {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+        if (lim.rlim_cur < 2 * n + 64)
+            n = (lim.rlim_cur - 64) / 2;
+    }
+
+    test_init();
+    if (argc > 1)
+        alarm(0); /* load test, may take longer */
+
+    /* Listen on a free port, and use several threads, even on single CPU
+     * systems */
+    unsigned port = GetFreePort();
+    char portarg[sizeof ("--http-port=65535")];
+    snprintf(portarg, sizeof (portarg), "--http-port=%u", port);
+
+    const char *args[] = {
+        "--http-host=127.0.0.1", portarg, "--http-threads=4",
+    };
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(args), args);
+    assert(vlc != NULL);
+
+    vlc_object_t *obj = VLC_OBJECT(vlc->p_libvlc_int);
+    httpd_host_t *host = vlc_http_HostNew(obj);
+    assert(host != NULL);
+
+    httpd_stream_t *stream = httpd_StreamNew(host, "/stream",
+                                             "application/octet-stream",
+                                             NULL, NULL);
+    assert(stream != NULL);
+    httpd_StreamHeader(stream, (uint8_t *)header, strlen(header));
+
+    struct client *clients = calloc(n, sizeof (*clients));
+    struct pollfd *ufd = calloc(n, sizeof (*ufd));
+    assert(clients != NULL && ufd != NULL);
+
+    for (unsigned i = 0; i < n; i++)
+    {
+        clients[i].fd = client_Connect(port);
+        clients[i].last_seq = -1;
+        ufd[i].fd = clients[i].fd;
+        ufd[i].events = POLLIN;
+    }
+
+    struct feeder feeder = { stream, BLOCK_COUNT };
+    vlc_thread_t th;
+    mtime_t start = 0;
+    uint64_t total = 0;
+    unsigned open = n, ready = 0, complete = 0;
+
+    /* Receive until all clients got the whole stream */
+    while (complete < n && open > 0 && poll(ufd, n, 1000) > 0)
+    {
+
+        for (unsigned i = 0; i < n; i++)
+        {
+            uint8_t buf[65536];
+
+            if (!(ufd[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+
+            ssize_t len = recv(ufd[i].fd, buf, sizeof (buf), 0);
+            if (len > 0)
+            {
+                bool was_ready = clients[i].body != 0;
+
+                client_Parse(&clients[i], buf, len);
+                if (!was_ready && clients[i].body != 0)
+                    ready++;
+                if (clients[i].blocks == BLOCK_COUNT)
+                {
+                    complete++;
+                    ufd[i].fd = -1;
+                }
+                total += len;
+            }
+            else if (len == 0 || errno != EAGAIN)
+            {
+                ufd[i].fd = -1;
+                open--;
+            }
+        }
+
+        if (start == 0 && ready == n)
+        {   /* Start streaming once all clients got the stream header */
+            start = mdate();
+            assert(vlc_clone(&th, Feed, &feeder,
+                             VLC_THREAD_PRIORITY_LOW) == 0);
+        }
+    }
+
+    assert(start != 0);
+    vlc_join(th, NULL);
+
+    mtime_t duration = mdate() - start;
+
+    for (unsigned i = 0; i < n; i++)
+    {
+        assert(clients[i].blocks == BLOCK_COUNT);
+        close(clients[i].fd);
+    }
+
+    printf("%u clients: %.1f MiB/s\n", n,
+           total * (double)CLOCK_FREQ / duration / (1 << 20));
+
+    httpd_StreamDelete(stream);
+    httpd_HostDelete(host);
+    free(ufd);
+    free(clients);
+    libvlc_release(vlc);
+    return 0;
+}
@@ -0,0 +1,442 @@
+/**
+ * @file vlc-demux-bench.c
+ */
+/*****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <vlc_common.h>
+#include "src/input/demux-run.h"
+
+/* Each file is demuxed by its own process, so that the runs can use all the
+ * cores, that a crash only loses one result, and that the peak memory usage
+ * reported by the kernel is the one of that file. */
+struct bench_file
+{
+    char *path;
+    pid_t pid;
+    int fd; /* pipe receiving the statistics */
+    int status;
+    bool has_stats;
+    struct vlc_demux_stats stats;
+    struct rusage usage;
+};
+
+struct bench_module
+{
+    const char *name;
+    unsigned files;
+    unsigned errors;
+    uint64_t size;
+    uint64_t es_blocks;
+    mtime_t duration;
+    long max_rss;
+    long minor_faults;
+};
+
+static struct bench_file *files;
+static size_t files_count;
+
+static int bench_add_path(const char *path)
+{
+    struct stat st;
+
+    if (stat(path, &st))
+    {
+        fprintf(stderr, "Error: cannot stat %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    if (S_ISDIR(st.st_mode))
+    {
+        DIR *dir = opendir(path);
+        if (dir == NULL)
+        {
+            fprintf(stderr, "Error: cannot open %s: %s\n", path,
+                    strerror(errno));
+            return -1;
+        }
+
+        struct dirent *ent;
+        int ret = 0;
+        while (ret == 0 && (ent = readdir(dir)) != NULL)
+        {
+            char *sub;
+
+            if (ent->d_name[0] == '.')
+                continue;
+            if (asprintf(&sub, "%s/%s", path, ent->d_name) == -1)
+                ret = -1;
+            else
+            {
+                ret = bench_add_path(sub);
+                free(sub);
+            }
+        }
+        closedir(dir);
+        return ret;
+    }
+
+    if (!S_ISREG(st.st_mode))
+        return 0;
+
+    struct bench_file *tab = realloc(files, (files_count + 1) * sizeof (*tab));
+    if (tab == NULL)
+        return -1;
+    files = tab;
+
+    struct bench_file *file = &files[files_count];
+    memset(file, 0, sizeof (*file));
+    file->path = strdup(path);
+    file->pid = -1;
+    file->fd = -1;
+    if (file->path == NULL)
+        return -1;
+    files_count++;
+    return 0;
+}
+
+static int bench_file_cmp(const void *a, const void *b)
+{
+    return strcmp(((const struct bench_file *)a)->path,
+                  ((const struct bench_file *)b)->path);
+}
+
+static int bench_spawn(const struct vlc_run_args *args, struct bench_file *file)
+{
+    int fds[2];
+
+    if (pipe(fds))
+        return -1;
+
+    fflush(NULL);
+    file->pid = fork();
+    if (file->pid == 0)
+    {
+        struct vlc_run_args child_args = *args;
+        struct vlc_demux_stats stats;
+
+        close(fds[0]);
+        memset(&stats, 0, sizeof (stats));
+        child_args.stats = &stats;
+
+        int ret = vlc_demux_process_path(&child_args, file->path);
+        if (write(fds[1], &stats, sizeof (stats)) != sizeof (stats))
+            ret = -1;
+        _exit(ret == 0 ? 0 : 1);
+    }
+
+    close(fds[1]);
+    if (file->pid == -1)
+    {
+        close(fds[0]);
+        return -1;
+    }
+    file->fd = fds[0];
+    return 0;
+}
+
+static void bench_collect(struct bench_file *file, int status,
+                          const struct rusage *usage)
+{
+    file->status = status;
+    file->usage = *usage;
+    file->has_stats = read(file->fd, &file->stats, sizeof (file->stats))
+                      == sizeof (file->stats);
+    close(file->fd);
+    file->fd = -1;
+    file->pid = -1;
+}
+
+static int bench_run(const struct vlc_run_args *args, unsigned jobs)
+{
+    size_t next = 0;
+    unsigned running = 0;
+
+    while (next < files_count || running > 0)
+    {
+        while (running < jobs && next < files_count)
+        {
+            if (bench_spawn(args, &files[next]))
+            {
+                fprintf(stderr, "Error: cannot start %s: %s\n",
+                        files[next].path, strerror(errno));
+                return -1;
+            }
+            next++;
+            running++;
+        }
+
+        struct rusage usage;
+        int status;
+        pid_t pid = wait4(-1, &status, 0, &usage);
+        if (pid == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        for (size_t i = 0; i < next; i++)
+            if (files[i].pid == pid)
+            {
+                bench_collect(&files[i], status, &usage);
+                running--;
+                fprintf(stderr, "[%zu/%zu] %s\n", i + 1, files_count,
+                        files[i].path);
+                break;
+            }
+    }
+    return 0;
+}
+
+static const char *bench_file_status(const struct bench_file *file)
+{
+    if (WIFSIGNALED(file->status))
+        return "crash";
+    if (!WIFEXITED(file->status) || WEXITSTATUS(file->status) != 0)
+        return "error";
+    return "ok";
+}
+
+static double bench_rate(uint64_t count, mtime_t duration)
+{
+    return duration > 0 ? (double)count * CLOCK_FREQ / duration : 0.;
+}
+
+static void json_string(FILE *out, const char *str)
+{
+    fputc('"', out);
+    for (const unsigned char *p = (const unsigned char *)str; *p; p++)
+    {
+        if (*p == '"' || *p == '\\')
+            fprintf(out, "\\%c", *p);
+        else if (*p < 0x20)
+            fprintf(out, "\\u%04x", *p);
+        else
+            fputc(*p, out);
+    }
+    fputc('"', out);
+}
+
+static void bench_print_file(FILE *out, const struct bench_file *file)
+{
+    const struct vlc_demux_stats *stats = &file->stats;
+    mtime_t cpu = file->usage.ru_utime.tv_sec * CLOCK_FREQ
+                + file->usage.ru_utime.tv_usec
+                + file->usage.ru_stime.tv_sec * CLOCK_FREQ
+                + file->usage.ru_stime.tv_usec;
+
+    fputs("    { \"path\": ", out);
+    json_string(out, file->path);
+    fputs(", \"module\": ", out);
+    json_string(out, file->has_stats && stats->module[0] ? stats->module
+                                                         : "none");
+    fprintf(out, ", \"status\": \"%s\"", bench_file_status(file));
+    fprintf(out, ", \"size\": %"PRIu64", \"time_us\": %"PRId64
+                 ", \"mb_per_s\": %.3f",
+            stats->size, stats->duration,
+            bench_rate(stats->size, stats->duration) / 1000000.);
+    fprintf(out, ", \"es_blocks\": %"PRIu64", \"es_bytes\": %"PRIu64
+                 ", \"blocks_per_s\": %.1f",
+            stats->es_blocks, stats->es_bytes,
+            bench_rate(stats->es_blocks, stats->duration));
+    fprintf(out, ", \"cpu_us\": %"PRId64", \"max_rss_kb\": %ld"
+                 ", \"minor_faults\": %ld }",
+            cpu, file->usage.ru_maxrss, file->usage.ru_minflt);
+}
+
+static void bench_print(FILE *out, const struct vlc_run_args *args,
+                        unsigned jobs)
+{
+    struct bench_module *modules = NULL;
+    size_t modules_count = 0;
+
+    fprintf(out, "{\n  \"version\": 1,\n  \"jobs\": %u,\n", jobs);
+#ifdef HAVE_DECODERS
+    fprintf(out, "  \"decoders\": %s,\n",
+            args->packetize_only ? "false" : "true");
+    fputs("  \"packetizers\": true,\n", out);
+#else
+    fputs("  \"decoders\": false,\n  \"packetizers\": false,\n", out);
+    (void) args;
+#endif
+    fputs("  \"files\": [\n", out);
+
+    for (size_t i = 0; i < files_count; i++)
+    {
+        const struct bench_file *file = &files[i];
+        const char *name = file->has_stats && file->stats.module[0]
+                         ? file->stats.module : "none";
+
+        bench_print_file(out, file);
+        fputs(i + 1 < files_count ? ",\n" : "\n", out);
+
+        struct bench_module *module = NULL;
+        for (size_t j = 0; j < modules_count; j++)
+            if (!strcmp(modules[j].name, name))
+                module = &modules[j];
+        if (module == NULL)
+        {
+            struct bench_module *tab = realloc(modules,
+                                   (modules_count + 1) * sizeof (*tab));
+            if (tab == NULL)
+                continue;
+            modules = tab;
+            module = &modules[modules_count++];
+            memset(module, 0, sizeof (*module));
+            module->name = name;
+        }
+
+        module->files++;
+        if (strcmp(bench_file_status(file), "ok"))
+            module->errors++;
+        module->size += file->stats.size;
+        module->es_blocks += file->stats.es_blocks;
+        module->duration += file->stats.duration;
+        if (file->usage.ru_maxrss > module->max_rss)
+            module->max_rss = file->usage.ru_maxrss;
+        module->minor_faults += file->usage.ru_minflt;
+    }
+
+    fputs("  ],\n  \"modules\": [\n", out);
+    for (size_t i = 0; i < modules_count; i++)
+    {
+        const struct bench_module *module = &modules[i];
+
+        fputs("    { \"module\": ", out);
+        json_string(out, module->name);
+        fprintf(out, ", \"files\": %u, \"errors\": %u", module->files,
+                module->errors);
+        fprintf(out, ", \"size\": %"PRIu64", \"time_us\": %"PRId64
+                     ", \"mb_per_s\": %.3f",
+                module->size, module->duration,
+                bench_rate(module->size, module->duration) / 1000000.);
+        fprintf(out, ", \"es_blocks\": %"PRIu64", \"blocks_per_s\": %.1f",
+                module->es_blocks,
+                bench_rate(module->es_blocks, module->duration));
+        fprintf(out, ", \"max_rss_kb\": %ld, \"minor_faults\": %ld }%s\n",
+                module->max_rss, module->minor_faults,
+                i + 1 < modules_count ? "," : "");
+    }
+    fputs("  ]\n}\n", out);
+    free(modules);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [-j jobs] [-m module] [-o output.json]"
+#ifdef HAVE_DECODERS
+            " [-p]"
+#endif
+            " <file or directory>...\n"
+            " -j: number of files demuxed in parallel (default: CPU count)\n"
+            " -m: demux module to use (default: probe)\n"
+            " -o: JSON output file (default: standard output)\n"
+#ifdef HAVE_DECODERS
+            " -p: only run the packetizers, not the decoders\n"
+#endif
+            , name);
+}
+
+int main(int argc, char *argv[])
+{
+    struct vlc_run_args args;
+    const char *output = NULL;
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int c;
+
+    vlc_run_args_init(&args);
+
+    while ((c = getopt(argc, argv, "hj:m:o:p")) != -1)
+    {
+        switch (c)
+        {
+            case 'j':
+                jobs = atol(optarg);
+                break;
+            case 'm':
+                args.name = optarg;
+                break;
+            case 'o':
+                output = optarg;
+                break;
+#ifdef HAVE_DECODERS
+            case 'p':
+                args.packetize_only = true;
+                break;
+#endif
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind >= argc)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    if (jobs < 1)
+        jobs = 1;
+
+    for (int i = optind; i < argc; i++)
+        if (bench_add_path(argv[i]))
+            return 1;
+    qsort(files, files_count, sizeof (*files), bench_file_cmp);
+
+    if (bench_run(&args, jobs))
+        return 1;
+
+    FILE *out = stdout;
+    if (output != NULL)
+    {
+        out = fopen(output, "w");
+        if (out == NULL)
+        {
+            fprintf(stderr, "Error: cannot open %s: %s\n", output,
+                    strerror(errno));
+            return 1;
+        }
+    }
+
+    bench_print(out, &args, jobs);
+
+    if (out != stdout)
+        fclose(out);
+    for (size_t i = 0; i < files_count; i++)
+        free(files[i].path);
+    free(files);
+    return 0;
+}